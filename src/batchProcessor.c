@@ -0,0 +1,609 @@
+/*
+	Parallel batch reprocessor for archived sweeps
+
+	All frames of all given sweeps are collected into one job list.
+	Every worker initially owns a contiguous range of that list and
+	processes it front to back. A worker that runs out of work steals
+	the back half of the largest remaining range of another worker, so
+	slow frames (large clusters) do not leave cores idle.
+
+	Each worker owns it's own image, frame buffer and detector scratch
+	memory - after warmup no allocations happen on the hot path.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <time.h>
+
+#include <sys/stat.h>
+
+#include <linux/videodev2.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./jpegFile.h"
+#include "./rawRecorder.h"
+#include "./mjpegAvi.h"
+#include "./captureDevice.h"
+#include "./batchProcessor.h"
+#include "./frameTrace.h"
+#include "./realtime.h"
+
+struct batchSweep {
+	char*						lpInput;
+	char*						lpOutputFile;
+	struct rawRecording*		lpRecording;	/* NULL for JPEG directories */
+	struct mjpegAviFile*		lpVideo;		/* Sweep video */
+	struct mjpegAviStreamInfo	videoStream;	/* Stream of the raw frames */
+
+	unsigned long int			dwFirstJob;
+	unsigned long int			dwJobCount;
+};
+
+struct batchJob {
+	unsigned long int			dwSweep;
+	unsigned long int			dwFrame;		/* Index inside raw recording or video */
+	char*						lpFilename;		/* JPEG file */
+	unsigned long int			frq;
+
+	int							iStatus;
+	struct blobResult			result;
+};
+
+struct batchContext;
+
+struct batchWorker {
+	struct batchContext*		lpContext;
+	unsigned long int			dwWorkerIndex;
+	pthread_t					thrWorker;
+
+	pthread_mutex_t				mtxRange;
+	unsigned long int			dwNext;
+	unsigned long int			dwEnd;
+
+	struct imgRawImage			img;
+	size_t						sImgCapacity;
+	size_t						sLumaCapacity;
+	unsigned char*				lpFrameBuffer;
+	size_t						sFrameCapacity;
+	struct blobDetectorScratch	scratch;
+
+	unsigned long int			dwProcessed;
+	unsigned long int			dwStolen;
+};
+
+struct batchContext {
+	const struct blobDetectorParams*	lpParams;
+
+	struct batchSweep*			lpSweeps;
+	unsigned long int			dwSweepCount;
+
+	struct batchJob*			lpJobs;
+	unsigned long int			dwJobCount;
+	unsigned long int			dwJobCapacity;
+
+	struct batchWorker*			lpWorkers;
+	unsigned long int			dwWorkerCount;
+};
+
+static struct batchJob* batchAddJob(struct batchContext* lpContext) {
+	if(lpContext->dwJobCount == lpContext->dwJobCapacity) {
+		unsigned long int dwNewCapacity = (lpContext->dwJobCapacity == 0) ? 1024 : lpContext->dwJobCapacity * 2;
+		struct batchJob* lpNew = realloc(lpContext->lpJobs, sizeof(struct batchJob) * dwNewCapacity);
+		if(lpNew == NULL) { return NULL; }
+		lpContext->lpJobs = lpNew;
+		lpContext->dwJobCapacity = dwNewCapacity;
+	}
+	memset(&(lpContext->lpJobs[lpContext->dwJobCount]), 0, sizeof(struct batchJob));
+	lpContext->dwJobCount = lpContext->dwJobCount + 1;
+	return &(lpContext->lpJobs[lpContext->dwJobCount - 1]);
+}
+
+static int batchCompareJobFrequency(const void* lpA, const void* lpB) {
+	const struct batchJob* lpJobA = (const struct batchJob*)lpA;
+	const struct batchJob* lpJobB = (const struct batchJob*)lpB;
+
+	if(lpJobA->frq < lpJobB->frq) { return -1; }
+	if(lpJobA->frq > lpJobB->frq) { return 1; }
+	return 0;
+}
+
+/*
+	Extract the frequency from <prefix><frq>-raw.jpg. Files without
+	frequency (current-raw.jpg, single shot captures) are skipped
+*/
+static int batchParseSweepFilename(const char* lpName, unsigned long int* lpFrqOut) {
+	static const char* lpSuffix = "-raw.jpg";
+	size_t sLen = strlen(lpName);
+	size_t sSuffixLen = strlen(lpSuffix);
+	size_t sDigitsStart;
+	unsigned long int frq = 0;
+	size_t i;
+
+	if(sLen <= sSuffixLen) { return 1; }
+	if(strcmp(&(lpName[sLen - sSuffixLen]), lpSuffix) != 0) { return 1; }
+
+	sDigitsStart = sLen - sSuffixLen;
+	while((sDigitsStart > 0) && isdigit((unsigned char)lpName[sDigitsStart-1])) { sDigitsStart = sDigitsStart - 1; }
+	if(sDigitsStart == sLen - sSuffixLen) { return 1; }
+
+	for(i = sDigitsStart; i < sLen - sSuffixLen; i=i+1) {
+		frq = frq * 10 + (lpName[i] - '0');
+	}
+	(*lpFrqOut) = frq;
+	return 0;
+}
+
+static int batchAddDirectory(struct batchContext* lpContext, struct batchSweep* lpSweep, unsigned long int dwSweep) {
+	DIR* lpDir;
+	struct dirent* lpEntry;
+
+	lpDir = opendir(lpSweep->lpInput);
+	if(lpDir == NULL) {
+		printf("%s:%u Failed to open sweep directory %s\n", __FILE__, __LINE__, lpSweep->lpInput);
+		return 1;
+	}
+
+	while((lpEntry = readdir(lpDir)) != NULL) {
+		unsigned long int frq;
+		struct batchJob* lpJob;
+
+		if(batchParseSweepFilename(lpEntry->d_name, &frq) != 0) { continue; }
+
+		lpJob = batchAddJob(lpContext);
+		if(lpJob == NULL) {
+			closedir(lpDir);
+			return 1;
+		}
+		lpJob->dwSweep = dwSweep;
+		lpJob->frq = frq;
+		if(asprintf(&(lpJob->lpFilename), "%s/%s", lpSweep->lpInput, lpEntry->d_name) < 0) {
+			lpJob->lpFilename = NULL;
+			closedir(lpDir);
+			return 1;
+		}
+		lpSweep->dwJobCount = lpSweep->dwJobCount + 1;
+	}
+	closedir(lpDir);
+
+	/* Directory order is arbitrary, peaks.dat is ordered by frequency */
+	qsort(&(lpContext->lpJobs[lpSweep->dwFirstJob]), lpSweep->dwJobCount, sizeof(struct batchJob), &batchCompareJobFrequency);
+
+	if(asprintf(&(lpSweep->lpOutputFile), "%s/peaks-reprocessed.dat", lpSweep->lpInput) < 0) {
+		lpSweep->lpOutputFile = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+static int batchAddRecording(struct batchContext* lpContext, struct batchSweep* lpSweep, unsigned long int dwSweep) {
+	unsigned long int i;
+	struct rawRecorderFileHeader* lpHeader;
+
+	if(rawRecordingOpen(&(lpSweep->lpRecording), lpSweep->lpInput) != 0) {
+		printf("%s:%u Failed to open raw recording %s\n", __FILE__, __LINE__, lpSweep->lpInput);
+		return 1;
+	}
+
+	lpHeader = rawRecordingHeader(lpSweep->lpRecording);
+	if((lpHeader->pixelFormat != V4L2_PIX_FMT_YUYV) && (lpHeader->pixelFormat != V4L2_PIX_FMT_GREY) && (lpHeader->pixelFormat != V4L2_PIX_FMT_MJPEG)) {
+		printf("%s:%u Unsupported pixel format %08x in %s\n", __FILE__, __LINE__, lpHeader->pixelFormat, lpSweep->lpInput);
+		return 1;
+	}
+
+	/* Recordings are already stored in sweep order */
+	for(i = 0; i < rawRecordingFrameCount(lpSweep->lpRecording); i=i+1) {
+		struct rawRecorderIndexEntry entry;
+		struct batchJob* lpJob = batchAddJob(lpContext);
+		if(lpJob == NULL) { return 1; }
+
+		if(rawRecordingFrameInfo(lpSweep->lpRecording, i, &entry) != 0) { return 1; }
+		lpJob->dwSweep = dwSweep;
+		lpJob->dwFrame = i;
+		lpJob->frq = entry.frequency;
+		lpSweep->dwJobCount = lpSweep->dwJobCount + 1;
+	}
+
+	if(asprintf(&(lpSweep->lpOutputFile), "%s-peaks.dat", lpSweep->lpInput) < 0) {
+		lpSweep->lpOutputFile = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+	Sweep videos (-V) are processed from their raw stream (the stream
+	named "raw", else the first one)
+*/
+static int batchIsVideo(const char* lpFilename) {
+	unsigned char magic[12];
+	FILE* fHandle = fopen(lpFilename, "rb");
+	int bVideo = 0;
+
+	if(fHandle == NULL) { return 0; }
+	if((fread(magic, sizeof(magic), 1, fHandle) == 1) && (memcmp(magic, "RIFF", 4) == 0) && (memcmp(&(magic[8]), "AVI ", 4) == 0)) {
+		bVideo = 1;
+	}
+	fclose(fHandle);
+	return bVideo;
+}
+
+static int batchAddVideo(struct batchContext* lpContext, struct batchSweep* lpSweep, unsigned long int dwSweep) {
+	unsigned long int dwStream = 0;
+	unsigned long int i;
+
+	if(mjpegAviFileOpen(&(lpSweep->lpVideo), lpSweep->lpInput) != 0) {
+		printf("%s:%u Failed to open sweep video %s\n", __FILE__, __LINE__, lpSweep->lpInput);
+		return 1;
+	}
+
+	for(i = 0; i < mjpegAviFileStreamCount(lpSweep->lpVideo); i=i+1) {
+		struct mjpegAviStreamInfo info;
+		if((mjpegAviFileStreamInfo(lpSweep->lpVideo, i, &info) == 0) && (strcmp(info.strName, "raw") == 0)) {
+			dwStream = i;
+			break;
+		}
+	}
+	if(mjpegAviFileStreamInfo(lpSweep->lpVideo, dwStream, &(lpSweep->videoStream)) != 0) {
+		return 1;
+	}
+
+	/* Videos are already stored in sweep order */
+	for(i = 0; i < mjpegAviFileFrameCount(lpSweep->lpVideo); i=i+1) {
+		struct mjpegAviFrameInfo info;
+		struct batchJob* lpJob;
+
+		if(mjpegAviFileFrameInfo(lpSweep->lpVideo, i, &info) != 0) { return 1; }
+		if((info.dwStream != dwStream) || (info.length == 0)) { continue; }
+
+		lpJob = batchAddJob(lpContext);
+		if(lpJob == NULL) { return 1; }
+		lpJob->dwSweep = dwSweep;
+		lpJob->dwFrame = i;
+		lpJob->frq = (unsigned long int)info.frequency;
+		lpSweep->dwJobCount = lpSweep->dwJobCount + 1;
+	}
+
+	if(asprintf(&(lpSweep->lpOutputFile), "%s-peaks.dat", lpSweep->lpInput) < 0) {
+		lpSweep->lpOutputFile = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+static int batchReserveLuma(struct batchWorker* lpWorker, unsigned long int width, unsigned long int height) {
+	if(lpWorker->sLumaCapacity < width * height) {
+		unsigned char* lpNew = realloc(lpWorker->img.lpLuma, sizeof(unsigned char) * width * height);
+		if(lpNew == NULL) { return 1; }
+		lpWorker->img.lpLuma = lpNew;
+		lpWorker->sLumaCapacity = width * height;
+	}
+	return 0;
+}
+
+static int batchProcessJob(struct batchWorker* lpWorker, struct batchJob* lpJob) {
+	struct batchContext* lpContext = lpWorker->lpContext;
+	struct batchSweep* lpSweep = &(lpContext->lpSweeps[lpJob->dwSweep]);
+
+	frameTraceSetSequence(lpJob->dwFrame);
+	frameTraceSetFrequency(lpJob->frq);
+
+	if(lpSweep->lpRecording != NULL) {
+		struct rawRecorderFileHeader* lpHeader = rawRecordingHeader(lpSweep->lpRecording);
+		size_t sRead = 0;
+
+		if(rawRecordingReadFrame(lpSweep->lpRecording, lpJob->dwFrame, NULL, lpWorker->lpFrameBuffer, lpWorker->sFrameCapacity, &sRead) != 0) {
+			unsigned char* lpNew;
+			if(sRead <= lpWorker->sFrameCapacity) { return 1; }
+
+			lpNew = realloc(lpWorker->lpFrameBuffer, sRead);
+			if(lpNew == NULL) { return 1; }
+			lpWorker->lpFrameBuffer = lpNew;
+			lpWorker->sFrameCapacity = sRead;
+			if(rawRecordingReadFrame(lpSweep->lpRecording, lpJob->dwFrame, NULL, lpWorker->lpFrameBuffer, lpWorker->sFrameCapacity, &sRead) != 0) {
+				return 1;
+			}
+		}
+		if(batchReserveLuma(lpWorker, lpHeader->width, lpHeader->height) != 0) { return 1; }
+		if(captureFrameToLuma(&(lpWorker->img), lpHeader->pixelFormat, lpWorker->lpFrameBuffer, sRead, lpHeader->width, lpHeader->height, lpHeader->bytesPerLine) != 0) {
+			return 1;
+		}
+	} else if(lpSweep->lpVideo != NULL) {
+		size_t sRead = 0;
+
+		if(mjpegAviFileReadFrame(lpSweep->lpVideo, lpJob->dwFrame, lpWorker->lpFrameBuffer, lpWorker->sFrameCapacity, &sRead) != 0) {
+			unsigned char* lpNew;
+			if(sRead <= lpWorker->sFrameCapacity) { return 1; }
+
+			lpNew = realloc(lpWorker->lpFrameBuffer, sRead);
+			if(lpNew == NULL) { return 1; }
+			lpWorker->lpFrameBuffer = lpNew;
+			lpWorker->sFrameCapacity = sRead;
+			if(mjpegAviFileReadFrame(lpSweep->lpVideo, lpJob->dwFrame, lpWorker->lpFrameBuffer, lpWorker->sFrameCapacity, &sRead) != 0) {
+				return 1;
+			}
+		}
+		if(batchReserveLuma(lpWorker, lpSweep->videoStream.width, lpSweep->videoStream.height) != 0) { return 1; }
+		if(decodeJpegLuma(&(lpWorker->img), lpWorker->lpFrameBuffer, sRead, lpSweep->videoStream.width, lpSweep->videoStream.height) != 0) {
+			return 1;
+		}
+	} else {
+		if(loadJpegImageFile(&(lpWorker->img), &(lpWorker->sImgCapacity), lpJob->lpFilename) != 0) {
+			return 1;
+		}
+		if(batchReserveLuma(lpWorker, lpWorker->img.width, lpWorker->img.height) != 0) { return 1; }
+		greyscale(&(lpWorker->img));
+	}
+
+	return blobDetect(&(lpWorker->img), lpContext->lpParams, &(lpWorker->scratch), &(lpJob->result));
+}
+
+/*
+	Take the next job from the own range or steal the back half of
+	the largest range of another worker
+*/
+static int batchNextJob(struct batchWorker* lpWorker, unsigned long int* lpJobOut) {
+	struct batchContext* lpContext = lpWorker->lpContext;
+	unsigned long int i;
+
+	pthread_mutex_lock(&(lpWorker->mtxRange));
+	if(lpWorker->dwNext < lpWorker->dwEnd) {
+		(*lpJobOut) = lpWorker->dwNext;
+		lpWorker->dwNext = lpWorker->dwNext + 1;
+		pthread_mutex_unlock(&(lpWorker->mtxRange));
+		return 0;
+	}
+	pthread_mutex_unlock(&(lpWorker->mtxRange));
+
+	for(;;) {
+		struct batchWorker* lpVictim = NULL;
+		unsigned long int dwVictimRemaining = 0;
+		unsigned long int dwStealBegin, dwStealEnd;
+
+		/* Select the victim with the most remaining work */
+		for(i = 1; i < lpContext->dwWorkerCount; i=i+1) {
+			struct batchWorker* lpCandidate = &(lpContext->lpWorkers[(lpWorker->dwWorkerIndex + i) % lpContext->dwWorkerCount]);
+			unsigned long int dwRemaining;
+
+			pthread_mutex_lock(&(lpCandidate->mtxRange));
+			dwRemaining = lpCandidate->dwEnd - lpCandidate->dwNext;
+			pthread_mutex_unlock(&(lpCandidate->mtxRange));
+
+			if(dwRemaining > dwVictimRemaining) {
+				dwVictimRemaining = dwRemaining;
+				lpVictim = lpCandidate;
+			}
+		}
+		if(lpVictim == NULL) {
+			return 1; /* All ranges are empty, no new jobs will appear */
+		}
+
+		pthread_mutex_lock(&(lpVictim->mtxRange));
+		if(lpVictim->dwEnd <= lpVictim->dwNext) {
+			pthread_mutex_unlock(&(lpVictim->mtxRange));
+			continue; /* Someone else was faster */
+		}
+		dwStealEnd = lpVictim->dwEnd;
+		dwStealBegin = lpVictim->dwEnd - (lpVictim->dwEnd - lpVictim->dwNext + 1) / 2;
+		lpVictim->dwEnd = dwStealBegin;
+		pthread_mutex_unlock(&(lpVictim->mtxRange));
+
+		pthread_mutex_lock(&(lpWorker->mtxRange));
+		lpWorker->dwNext = dwStealBegin + 1;
+		lpWorker->dwEnd = dwStealEnd;
+		lpWorker->dwStolen = lpWorker->dwStolen + (dwStealEnd - dwStealBegin);
+		pthread_mutex_unlock(&(lpWorker->mtxRange));
+
+		(*lpJobOut) = dwStealBegin;
+		return 0;
+	}
+}
+
+static void* batchWorkerThread(void* lpArg) {
+	struct batchWorker* lpWorker = (struct batchWorker*)lpArg;
+	unsigned long int dwJob;
+
+	realtimeEnterThread(realtimeRole_Analysis, lpWorker->dwWorkerIndex);
+
+	while(batchNextJob(lpWorker, &dwJob) == 0) {
+		struct batchJob* lpJob = &(lpWorker->lpContext->lpJobs[dwJob]);
+		lpJob->iStatus = batchProcessJob(lpWorker, lpJob);
+		lpWorker->dwProcessed = lpWorker->dwProcessed + 1;
+	}
+
+	return NULL;
+}
+
+static int batchWriteResults(struct batchContext* lpContext, struct batchSweep* lpSweep) {
+	unsigned long int i;
+	unsigned long int dwFailed = 0;
+	FILE* fHandle;
+
+	frameTraceBegin("peaksWrite");
+	fHandle = fopen(lpSweep->lpOutputFile, "w");
+	if(fHandle == NULL) {
+		frameTraceEnd("peaksWrite");
+		printf("%s:%u Failed to write %s\n", __FILE__, __LINE__, lpSweep->lpOutputFile);
+		return 1;
+	}
+
+	for(i = lpSweep->dwFirstJob; i < lpSweep->dwFirstJob + lpSweep->dwJobCount; i=i+1) {
+		struct batchJob* lpJob = &(lpContext->lpJobs[i]);
+		struct rectBound* lpB = &(lpJob->result.bounds);
+
+		if(lpJob->iStatus != 0) {
+			dwFailed = dwFailed + 1;
+			continue;
+		}
+		fprintf(fHandle, "%lu %lu %lu %lu %lu %lu %lu %lf %lu", lpJob->frq, lpB->xMin, lpB->xMax, lpB->yMin, lpB->yMax, lpB->xMax-lpB->xMin, lpB->yMax-lpB->yMin, lpJob->result.dAreaSum, lpJob->result.clusterPixelArea);
+		profileFitPrint(fHandle, &(lpJob->result.fitX));
+		profileFitPrint(fHandle, &(lpJob->result.fitY));
+		fprintf(fHandle, "\n");
+	}
+	fclose(fHandle);
+	frameTraceEnd("peaksWrite");
+
+	printf("%s: %lu frames -> %s", lpSweep->lpInput, lpSweep->dwJobCount - dwFailed, lpSweep->lpOutputFile);
+	if(dwFailed > 0) {
+		printf(" (%lu frames failed)", dwFailed);
+	}
+	printf("\n");
+	return 0;
+}
+
+static void batchRelease(struct batchContext* lpContext) {
+	unsigned long int i;
+
+	if(lpContext->lpWorkers != NULL) {
+		for(i = 0; i < lpContext->dwWorkerCount; i=i+1) {
+			if(lpContext->lpWorkers[i].img.lpData != NULL) { free(lpContext->lpWorkers[i].img.lpData); }
+			if(lpContext->lpWorkers[i].img.lpLuma != NULL) { free(lpContext->lpWorkers[i].img.lpLuma); }
+			if(lpContext->lpWorkers[i].lpFrameBuffer != NULL) { free(lpContext->lpWorkers[i].lpFrameBuffer); }
+			blobDetectorScratchRelease(&(lpContext->lpWorkers[i].scratch));
+		}
+		free(lpContext->lpWorkers);
+	}
+	if(lpContext->lpJobs != NULL) {
+		for(i = 0; i < lpContext->dwJobCount; i=i+1) {
+			if(lpContext->lpJobs[i].lpFilename != NULL) { free(lpContext->lpJobs[i].lpFilename); }
+		}
+		free(lpContext->lpJobs);
+	}
+	if(lpContext->lpSweeps != NULL) {
+		for(i = 0; i < lpContext->dwSweepCount; i=i+1) {
+			if(lpContext->lpSweeps[i].lpRecording != NULL) { rawRecordingClose(lpContext->lpSweeps[i].lpRecording); }
+			if(lpContext->lpSweeps[i].lpVideo != NULL) { mjpegAviFileClose(lpContext->lpSweeps[i].lpVideo); }
+			if(lpContext->lpSweeps[i].lpOutputFile != NULL) { free(lpContext->lpSweeps[i].lpOutputFile); }
+		}
+		free(lpContext->lpSweeps);
+	}
+}
+
+int batchProcess(
+	char** lpInputs,
+	unsigned long int dwInputCount,
+	unsigned long int dwThreads,
+	const struct blobDetectorParams* lpParams
+) {
+	struct batchContext ctx;
+	struct timespec tsStart, tsEnd;
+	unsigned long int i;
+	unsigned long int dwStarted;
+	int rc = 0;
+
+	if((lpInputs == NULL) || (dwInputCount == 0)) {
+		return 1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.lpParams = lpParams;
+
+	ctx.lpSweeps = calloc(dwInputCount, sizeof(struct batchSweep));
+	if(ctx.lpSweeps == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		return 1;
+	}
+	ctx.dwSweepCount = dwInputCount;
+
+	for(i = 0; i < dwInputCount; i=i+1) {
+		struct stat st;
+		struct batchSweep* lpSweep = &(ctx.lpSweeps[i]);
+
+		lpSweep->lpInput = lpInputs[i];
+		lpSweep->dwFirstJob = ctx.dwJobCount;
+
+		if(stat(lpInputs[i], &st) == -1) {
+			printf("%s:%u Input %s not found\n", __FILE__, __LINE__, lpInputs[i]);
+			batchRelease(&ctx);
+			return 1;
+		}
+		if(S_ISDIR(st.st_mode)) {
+			rc = batchAddDirectory(&ctx, lpSweep, i);
+		} else if(batchIsVideo(lpInputs[i]) != 0) {
+			rc = batchAddVideo(&ctx, lpSweep, i);
+		} else {
+			rc = batchAddRecording(&ctx, lpSweep, i);
+		}
+		if(rc != 0) {
+			batchRelease(&ctx);
+			return 1;
+		}
+	}
+
+	if(dwThreads == 0) {
+		long lCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+		dwThreads = (lCPUs > 0) ? (unsigned long int)lCPUs : 1;
+	}
+	if(dwThreads > ctx.dwJobCount) {
+		dwThreads = (ctx.dwJobCount > 0) ? ctx.dwJobCount : 1;
+	}
+
+	ctx.lpWorkers = calloc(dwThreads, sizeof(struct batchWorker));
+	if(ctx.lpWorkers == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		batchRelease(&ctx);
+		return 1;
+	}
+	ctx.dwWorkerCount = dwThreads;
+
+	/* Initial distribution: contiguous equally sized ranges */
+	for(i = 0; i < dwThreads; i=i+1) {
+		struct batchWorker* lpWorker = &(ctx.lpWorkers[i]);
+
+		lpWorker->lpContext = &ctx;
+		lpWorker->dwWorkerIndex = i;
+		lpWorker->dwNext = (ctx.dwJobCount * i) / dwThreads;
+		lpWorker->dwEnd = (ctx.dwJobCount * (i + 1)) / dwThreads;
+		blobDetectorScratchInit(&(lpWorker->scratch));
+		pthread_mutex_init(&(lpWorker->mtxRange), NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tsStart);
+
+	for(dwStarted = 0; dwStarted < dwThreads; dwStarted=dwStarted+1) {
+		if(pthread_create(&(ctx.lpWorkers[dwStarted].thrWorker), NULL, &batchWorkerThread, &(ctx.lpWorkers[dwStarted])) != 0) {
+			printf("%s:%u Failed to start worker %lu\n", __FILE__, __LINE__, dwStarted);
+			break;
+		}
+	}
+	if(dwStarted == 0) {
+		/* No threads at all - process everything on the calling thread */
+		ctx.dwWorkerCount = 1;
+		ctx.lpWorkers[0].dwNext = 0;
+		ctx.lpWorkers[0].dwEnd = ctx.dwJobCount;
+		batchWorkerThread(&(ctx.lpWorkers[0]));
+	} else {
+		/* Threads that failed to start leave their range to be stolen */
+		for(i = 0; i < dwStarted; i=i+1) {
+			pthread_join(ctx.lpWorkers[i].thrWorker, NULL);
+		}
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tsEnd);
+
+	for(i = 0; i < dwThreads; i=i+1) {
+		pthread_mutex_destroy(&(ctx.lpWorkers[i].mtxRange));
+		#ifdef DEBUG
+			printf("%s:%u Worker %lu processed %lu frames (%lu stolen)\n", __FILE__, __LINE__, i, ctx.lpWorkers[i].dwProcessed, ctx.lpWorkers[i].dwStolen);
+		#endif
+	}
+
+	for(i = 0; i < ctx.dwSweepCount; i=i+1) {
+		if(batchWriteResults(&ctx, &(ctx.lpSweeps[i])) != 0) {
+			rc = 1;
+		}
+	}
+
+	{
+		double dSeconds = (double)(tsEnd.tv_sec - tsStart.tv_sec) + ((double)(tsEnd.tv_nsec - tsStart.tv_nsec)) / 1e9;
+		printf("Processed %lu frames on %lu threads in %lf s (%lf frames/s)\n", ctx.dwJobCount, dwStarted, dSeconds, (dSeconds > 0) ? ((double)ctx.dwJobCount) / dSeconds : 0.0);
+	}
+
+	batchRelease(&ctx);
+	return rc;
+}
@@ -0,0 +1,36 @@
+#ifndef __BATCHPROCESSOR_H__
+#define __BATCHPROCESSOR_H__
+
+#include "./blobDetector.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Offline reprocessing of archived sweeps
+
+	Every input is either a raw recording (see rawRecorder.h), a sweep
+	video (the raw stream, see mjpegAvi.h) or a sweep directory
+	containing <prefix><frq>-raw.jpg files. All frames of all inputs
+	are distributed over a work stealing thread pool; results are
+	written per sweep in frequency (peaks.dat) order:
+
+		Raw recording		<recording>-peaks.dat
+		Sweep video			<video>-peaks.dat
+		Sweep directory		<directory>/peaks-reprocessed.dat
+
+	dwThreads == 0 uses one thread per online CPU
+*/
+int batchProcess(
+	char** lpInputs,
+	unsigned long int dwInputCount,
+	unsigned long int dwThreads,
+	const struct blobDetectorParams* lpParams
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __BATCHPROCESSOR_H__ */
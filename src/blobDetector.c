@@ -0,0 +1,787 @@
+/*
+	Single blob detector
+
+	Locates the candidate region using the X and Y projections of
+	the greyscale image, seeds the cluster at the brightest pixel
+	inside the candidate box and then traces all pixels above
+	threshold that are within the gap radius (10 pixels by default)
+	of a cluster pixel.
+
+	The detector only reads the planar luma of the image. Cluster
+	membership is kept in a separate bit packed visited mask, the
+	tracing thresholds the luma into bit packed masks and grows the
+	cluster with morphological dilations (see morphology.h) so it's
+	cost does not depend on the gap radius.
+	The pass building the projections also builds integral images of
+	the luma and it's square so rectangle statistics (like the
+	background around the beam) cost four lookups each. Optionally the
+	seed is searched in a smoothed copy of the candidate box so single
+	hot pixels do not move the seed or raise the association threshold.
+	All working memory is passed in by the caller (blobDetectorScratch)
+	so the detector can run concurrently on different images.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <math.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./frameTrace.h"
+#include "./realtime.h"
+#include "./kernels.h"
+
+void blobDetectorParamsDefault(struct blobDetectorParams* lpParams) {
+	if(lpParams == NULL) { return; }
+
+	lpParams->dProjectionThreshold = BLOBDETECTOR_DEFAULT_PROJECTIONTHRESHOLD;
+	lpParams->dAssociationThreshold = BLOBDETECTOR_DEFAULT_ASSOCIATIONTHRESHOLD;
+	lpParams->dwSmoothRadius = 0;
+	lpParams->dwSmoothPasses = BLOBDETECTOR_DEFAULT_SMOOTHPASSES;
+	lpParams->dwGapRadius = BLOBDETECTOR_DEFAULT_GAPRADIUS;
+}
+
+int blobDetectorScratchInit(struct blobDetectorScratch* lpScratch) {
+	if(lpScratch == NULL) { return 1; }
+	memset(lpScratch, 0, sizeof(struct blobDetectorScratch));
+	return 0;
+}
+
+void blobDetectorScratchRelease(struct blobDetectorScratch* lpScratch) {
+	if(lpScratch == NULL) { return; }
+
+	if(lpScratch->lpHistX != NULL) { free(lpScratch->lpHistX); }
+	if(lpScratch->lpHistY != NULL) { free(lpScratch->lpHistY); }
+	if(lpScratch->lpVisited != NULL) { free(lpScratch->lpVisited); }
+	if(lpScratch->lpMask != NULL) { free(lpScratch->lpMask); }
+	if(lpScratch->lpMaskBox != NULL) { free(lpScratch->lpMaskBox); }
+	morphologyScratchRelease(&(lpScratch->morph));
+	if(lpScratch->lpColumnSums != NULL) { free(lpScratch->lpColumnSums); }
+	if(lpScratch->lpIntegral != NULL) { free(lpScratch->lpIntegral); }
+	if(lpScratch->lpIntegralSq != NULL) { free(lpScratch->lpIntegralSq); }
+	if(lpScratch->lpSmooth != NULL) { free(lpScratch->lpSmooth); }
+	if(lpScratch->lpSmoothTmp != NULL) { free(lpScratch->lpSmoothTmp); }
+	memset(lpScratch, 0, sizeof(struct blobDetectorScratch));
+}
+
+static int blobDetectorScratchReserve(
+	struct blobDetectorScratch* lpScratch,
+	unsigned long int width,
+	unsigned long int height
+) {
+	if(lpScratch->sHistXCapacity < width) {
+		uint32_t* lpNewSums;
+		struct histogramBuffer* lpNew = realloc(lpScratch->lpHistX, sizeof(struct histogramBuffer) + sizeof(double)*width);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpHistX = lpNew;
+		lpNewSums = realloc(lpScratch->lpColumnSums, sizeof(uint32_t)*width);
+		if(lpNewSums == NULL) { return 1; }
+		lpScratch->lpColumnSums = lpNewSums;
+		lpScratch->sHistXCapacity = width;
+	}
+	if(lpScratch->sHistYCapacity < height) {
+		struct histogramBuffer* lpNew = realloc(lpScratch->lpHistY, sizeof(struct histogramBuffer) + sizeof(double)*height);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpHistY = lpNew;
+		lpScratch->sHistYCapacity = height;
+	}
+
+	lpScratch->dwVisitedStride = (width + 63) / 64;
+	if(lpScratch->sVisitedCapacity < lpScratch->dwVisitedStride * height) {
+		uint64_t* lpNew = realloc(lpScratch->lpVisited, sizeof(uint64_t) * lpScratch->dwVisitedStride * height);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpVisited = lpNew;
+		lpScratch->sVisitedCapacity = lpScratch->dwVisitedStride * height;
+	}
+	if(lpScratch->sMaskCapacity < lpScratch->dwVisitedStride * height) {
+		uint64_t* lpNew = realloc(lpScratch->lpMask, sizeof(uint64_t) * lpScratch->dwVisitedStride * height);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpMask = lpNew;
+		lpNew = realloc(lpScratch->lpMaskBox, sizeof(uint64_t) * lpScratch->dwVisitedStride * height);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpMaskBox = lpNew;
+		lpScratch->sMaskCapacity = lpScratch->dwVisitedStride * height;
+	}
+
+	lpScratch->dwIntegralStride = width + 1;
+	if(lpScratch->sIntegralCapacity < (width + 1) * (height + 1)) {
+		uint32_t* lpNew = realloc(lpScratch->lpIntegral, sizeof(uint32_t) * (width + 1) * (height + 1));
+		uint64_t* lpNewSq;
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpIntegral = lpNew;
+		lpNewSq = realloc(lpScratch->lpIntegralSq, sizeof(uint64_t) * (width + 1) * (height + 1));
+		if(lpNewSq == NULL) { return 1; }
+		lpScratch->lpIntegralSq = lpNewSq;
+		lpScratch->sIntegralCapacity = (width + 1) * (height + 1);
+	}
+	return 0;
+}
+
+/*
+	lpSmoothTmp additionally holds one row of column sums and the
+	reciprocal window sizes along a row (they only differ at the border)
+*/
+static int blobDetectorSmoothReserve(
+	struct blobDetectorScratch* lpScratch,
+	unsigned long int dwW,
+	unsigned long int dwH
+) {
+	if(lpScratch->sSmoothCapacity < dwW * dwH + 2 * dwW) {
+		float* lpNew = realloc(lpScratch->lpSmooth, sizeof(float) * (dwW * dwH + 2 * dwW));
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpSmooth = lpNew;
+		lpNew = realloc(lpScratch->lpSmoothTmp, sizeof(float) * (dwW * dwH + 2 * dwW));
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpSmoothTmp = lpNew;
+		lpScratch->sSmoothCapacity = dwW * dwH + 2 * dwW;
+	}
+	return 0;
+}
+
+int blobDetectorScratchPrepare(
+	struct blobDetectorScratch* lpScratch,
+	const struct blobDetectorParams* lpParams,
+	unsigned long int width,
+	unsigned long int height
+) {
+	if((lpScratch == NULL) || (lpParams == NULL) || (width == 0) || (height == 0)) { return 1; }
+
+	if(blobDetectorScratchReserve(lpScratch, width, height) != 0) { return 1; }
+	if(morphologyScratchReserve(&(lpScratch->morph), lpScratch->dwVisitedStride, height, lpParams->dwGapRadius) != 0) { return 1; }
+	if((lpParams->dwSmoothRadius > 0) && (lpParams->dwSmoothPasses > 0)) {
+		if(blobDetectorSmoothReserve(lpScratch, width, height) != 0) { return 1; }
+		realtimePrefault(lpScratch->lpSmooth, sizeof(float) * lpScratch->sSmoothCapacity);
+		realtimePrefault(lpScratch->lpSmoothTmp, sizeof(float) * lpScratch->sSmoothCapacity);
+	}
+
+	realtimePrefault(lpScratch->lpHistX, sizeof(struct histogramBuffer) + sizeof(double) * lpScratch->sHistXCapacity);
+	realtimePrefault(lpScratch->lpColumnSums, sizeof(uint32_t) * lpScratch->sHistXCapacity);
+	realtimePrefault(lpScratch->lpHistY, sizeof(struct histogramBuffer) + sizeof(double) * lpScratch->sHistYCapacity);
+	realtimePrefault(lpScratch->lpVisited, sizeof(uint64_t) * lpScratch->sVisitedCapacity);
+	realtimePrefault(lpScratch->lpMask, sizeof(uint64_t) * lpScratch->sMaskCapacity);
+	realtimePrefault(lpScratch->lpMaskBox, sizeof(uint64_t) * lpScratch->sMaskCapacity);
+	realtimePrefault(lpScratch->lpIntegral, sizeof(uint32_t) * lpScratch->sIntegralCapacity);
+	realtimePrefault(lpScratch->lpIntegralSq, sizeof(uint64_t) * lpScratch->sIntegralCapacity);
+	realtimePrefault(lpScratch->morph.lpPrefix, sizeof(uint64_t) * lpScratch->morph.sLineCapacity);
+	realtimePrefault(lpScratch->morph.lpSuffix, sizeof(uint64_t) * lpScratch->morph.sLineCapacity);
+	realtimePrefault(lpScratch->morph.lpTemp, sizeof(uint64_t) * lpScratch->morph.sTempCapacity);
+	return 0;
+}
+
+/*
+	Separable running sum filter of the region xMin..xMax, yMin..yMax of
+	the luma. Every pass replaces each value by the mean over the values
+	within dwRadius along the row and then along the column (the window
+	is cut at the region border), so the cost per pixel does not depend
+	on the radius. The result is left in lpSmooth with xMax - xMin + 1
+	values per row.
+
+	The column pass updates whole rows of running sums which the
+	compiler vectorizes, the row pass is inherently sequential
+*/
+static int blobDetectorSmooth(
+	struct blobDetectorScratch* lpScratch,
+	const struct imgRawImage* lpImage,
+	unsigned long int xMin,
+	unsigned long int xMax,
+	unsigned long int yMin,
+	unsigned long int yMax,
+	unsigned long int dwRadius,
+	unsigned long int dwPasses
+) {
+	unsigned long int dwW = xMax - xMin + 1;
+	unsigned long int dwH = yMax - yMin + 1;
+	unsigned long int x, y, dwPass;
+
+	if(blobDetectorSmoothReserve(lpScratch, dwW, dwH) != 0) { return 1; }
+	float* lpColSum = &(lpScratch->lpSmoothTmp[dwW * dwH]);
+	float* lpRowScale = &(lpScratch->lpSmoothTmp[dwW * dwH + dwW]);
+
+	for(x = 0; x < dwW; x=x+1) {
+		unsigned long int dwLo = (x > dwRadius) ? x - dwRadius : 0;
+		unsigned long int dwHi = (x + dwRadius < dwW) ? x + dwRadius : dwW - 1;
+		lpRowScale[x] = 1.0f / (float)(dwHi - dwLo + 1);
+	}
+
+	for(y = 0; y < dwH; y=y+1) {
+		const unsigned char* lpRow = &(lpImage->lpLuma[(y + yMin) * lpImage->width + xMin]);
+		float* lpDst = &(lpScratch->lpSmooth[y * dwW]);
+		for(x = 0; x < dwW; x=x+1) { lpDst[x] = (float)lpRow[x]; }
+	}
+
+	for(dwPass = 0; dwPass < dwPasses; dwPass=dwPass+1) {
+		unsigned long int dwLo, dwHi;
+
+		/* Rows: lpSmooth -> lpSmoothTmp */
+		for(y = 0; y < dwH; y=y+1) {
+			const float* lpSrc = &(lpScratch->lpSmooth[y * dwW]);
+			float* lpDst = &(lpScratch->lpSmoothTmp[y * dwW]);
+			float fSum = 0;
+
+			dwHi = (dwRadius < dwW - 1) ? dwRadius : dwW - 1;
+			for(x = 0; x <= dwHi; x=x+1) { fSum = fSum + lpSrc[x]; }
+			for(x = 0; x < dwW; x=x+1) {
+				lpDst[x] = fSum * lpRowScale[x];
+				if(x + dwRadius + 1 < dwW) { fSum = fSum + lpSrc[x + dwRadius + 1]; }
+				if(x >= dwRadius) { fSum = fSum - lpSrc[x - dwRadius]; }
+			}
+		}
+
+		/* Columns: lpSmoothTmp -> lpSmooth, one row of running sums */
+		dwLo = 0;
+		dwHi = (dwRadius < dwH - 1) ? dwRadius : dwH - 1;
+		for(x = 0; x < dwW; x=x+1) { lpColSum[x] = 0; }
+		for(y = 0; y <= dwHi; y=y+1) {
+			const float* lpSrc = &(lpScratch->lpSmoothTmp[y * dwW]);
+			for(x = 0; x < dwW; x=x+1) { lpColSum[x] = lpColSum[x] + lpSrc[x]; }
+		}
+		for(y = 0; y < dwH; y=y+1) {
+			float* lpDst = &(lpScratch->lpSmooth[y * dwW]);
+			float fScale = 1.0f / (float)(dwHi - dwLo + 1);
+
+			for(x = 0; x < dwW; x=x+1) { lpDst[x] = lpColSum[x] * fScale; }
+			if(y + dwRadius + 1 < dwH) {
+				const float* lpAdd = &(lpScratch->lpSmoothTmp[(y + dwRadius + 1) * dwW]);
+				for(x = 0; x < dwW; x=x+1) { lpColSum[x] = lpColSum[x] + lpAdd[x]; }
+				dwHi = dwHi + 1;
+			}
+			if(y >= dwRadius) {
+				const float* lpSub = &(lpScratch->lpSmoothTmp[(y - dwRadius) * dwW]);
+				for(x = 0; x < dwW; x=x+1) { lpColSum[x] = lpColSum[x] - lpSub[x]; }
+				dwLo = dwLo + 1;
+			}
+		}
+	}
+	return 0;
+}
+
+void convertYUYVToLuma(
+	struct imgRawImage* lpImage,
+	const unsigned char* lpSrc,
+	unsigned long int width,
+	unsigned long int height
+) {
+	/*
+		Convert the previously requested YUYV (YUV422) image into RGB (RGB888)
+		and from there into luma without storing the RGB image
+
+		YUV422:
+			4 Byte -> 2 Pixel
+
+		The conversion itself is done by the dispatched kernel (see kernels.h)
+	*/
+	lpImage->width = width;
+	lpImage->height = height;
+
+	kernelTableGet()->yuyvToLuma(lpImage->lpLuma, lpSrc, width * height);
+}
+
+void drawRect(
+	struct imgRawImage* lpImage,
+	unsigned long int xStart,
+	unsigned long int xEnd,
+	unsigned long int yStart,
+	unsigned long int yEnd,
+	unsigned long int lineWidth
+) {
+	unsigned long int x,y;
+	for(x = xStart; x <= xEnd; x=x+1) {
+		for(y = yStart; (y < yStart + lineWidth) && (y < lpImage->height); y=y+1) {
+			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
+		}
+	}
+
+	for(x = xStart; x <= xEnd; x=x+1) {
+		for(y = yEnd; (y < yEnd + lineWidth) && (y < lpImage->height); y=y+1) {
+			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
+		}
+	}
+
+	for(y = yStart; y <= yEnd; y=y+1) {
+		for(x = xStart; (x < xStart + lineWidth) && (x < lpImage->width); x=x+1) {
+			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
+		}
+	}
+
+	for(y = yStart; y <= yEnd; y=y+1) {
+		for(x = xEnd; (x < xEnd + lineWidth) && (x < lpImage->width); x=x+1) {
+			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
+		}
+	}
+
+}
+
+void greyscale(
+	struct imgRawImage* lpImage
+) {
+	unsigned long int i;
+
+	frameTraceBegin("greyscale");
+	if(lpImage->numComponents < 3) {
+		for(i = 0; i < (lpImage->width * lpImage->height); i=i+1) {
+			lpImage->lpLuma[i] = lpImage->lpData[i * lpImage->numComponents];
+		}
+		frameTraceEnd("greyscale");
+		return;
+	}
+
+	kernelTableGet()->rgbToLuma(lpImage->lpLuma, lpImage->lpData, lpImage->width * lpImage->height, lpImage->numComponents);
+	frameTraceEnd("greyscale");
+}
+
+int blobDetect(
+	struct imgRawImage* lpImage,
+	const struct blobDetectorParams* lpParams,
+	struct blobDetectorScratch* lpScratch,
+	struct blobResult* lpResult
+) {
+	struct histogramBuffer* lpNewHistX;
+	struct histogramBuffer* lpNewHistY;
+	struct blobDetectorParams defaultParams;
+	const unsigned char* lpLuma;
+	kernelProjectRowFn lpProjectRow;
+	unsigned long int i;
+	unsigned long int y;
+
+	if((lpImage == NULL) || (lpImage->lpLuma == NULL) || (lpScratch == NULL) || (lpResult == NULL)) {
+		return 1;
+	}
+	if((lpImage->width == 0) || (lpImage->height == 0)) {
+		return 1;
+	}
+	if(lpParams == NULL) {
+		blobDetectorParamsDefault(&defaultParams);
+		lpParams = &defaultParams;
+	}
+	lpLuma = lpImage->lpLuma;
+
+	/*
+		Create histogram X and histogram Y
+	*/
+	if(blobDetectorScratchReserve(lpScratch, lpImage->width, lpImage->height) != 0) {
+		return 1;
+	}
+	lpNewHistX = lpScratch->lpHistX;
+	lpNewHistY = lpScratch->lpHistY;
+
+	lpNewHistX->sLen = lpImage->width;
+	lpNewHistY->sLen = lpImage->height;
+
+	/*
+		Sums are accumulated as integers (the column sums in 32 bit,
+		exact up to 16843009 rows) and scaled once. The projections keep
+		their historic scale of two colour channels per pixel normalized
+		to 255.
+
+		The integral images are filled in the same pass by the dispatched
+		row kernel (see kernels.h): every entry is the one above plus the
+		running sum of the current row
+	*/
+	frameTraceBegin("projection");
+	lpProjectRow = kernelTableGet()->projectRow;
+	memset(lpScratch->lpColumnSums, 0, sizeof(uint32_t) * lpImage->width);
+	memset(lpScratch->lpIntegral, 0, sizeof(uint32_t) * lpScratch->dwIntegralStride);
+	memset(lpScratch->lpIntegralSq, 0, sizeof(uint64_t) * lpScratch->dwIntegralStride);
+	for(y = 0; y < lpImage->height; y=y+1) {
+		uint32_t* lpIntRow = &(lpScratch->lpIntegral[(y + 1) * lpScratch->dwIntegralStride + 1]);
+		uint64_t* lpIntSqRow = &(lpScratch->lpIntegralSq[(y + 1) * lpScratch->dwIntegralStride + 1]);
+
+		lpIntRow[-1] = 0;
+		lpIntSqRow[-1] = 0;
+		lpNewHistY->dValues[y] = (double)lpProjectRow(
+			&(lpLuma[y * lpImage->width]),
+			lpImage->width,
+			lpScratch->lpColumnSums,
+			&(lpScratch->lpIntegral[y * lpScratch->dwIntegralStride + 1]),
+			lpIntRow,
+			&(lpScratch->lpIntegralSq[y * lpScratch->dwIntegralStride + 1]),
+			lpIntSqRow
+		);
+	}
+	for(i = 0; i < lpImage->width; i=i+1)  { lpNewHistX->dValues[i] = (2.0 * (double)lpScratch->lpColumnSums[i]) / 255.0; }
+	for(i = 0; i < lpImage->height; i=i+1) { lpNewHistY->dValues[i] = (2.0 * lpNewHistY->dValues[i]) / 255.0; }
+	frameTraceEnd("projection");
+
+	/*
+		Normalize histograms (for peak search)
+		and perform absolute peak search in parallel
+	*/
+	unsigned long int absPeakX = 0;
+	unsigned long int absPeakY = 0;
+	double dHistAbsX = 0;
+	double dHistAbsY = 0;
+	{
+		double dMax = lpNewHistX->dValues[0];
+		for(i = 0; i < lpNewHistX->sLen; i=i+1) {
+			if(lpNewHistX->dValues[i] > dMax) { dMax = lpNewHistX->dValues[i]; absPeakX = i; }
+		}
+		dHistAbsX = dMax;
+	}
+	{
+		double dMax = lpNewHistY->dValues[0];
+		for(i = 0; i < lpNewHistY->sLen; i=i+1) {
+			if(lpNewHistY->dValues[i] > dMax) { dMax = lpNewHistY->dValues[i]; absPeakY = i; }
+		}
+		dHistAbsY = dMax;
+	}
+
+	/*
+		Calculate width of peaks
+
+		The seed is given by the local max.
+
+		The width is determined by associating every pixel with the peak that's above
+		average (?), expanding from the seed ...
+
+		this yields a candidate cluster
+
+		Then we will determine the maximum pixel value (or one of the max) in
+		the candidate cluster and trace all pixels from there on in an iterative
+		fashion
+	*/
+	double dThreasholdX = dHistAbsX * lpParams->dProjectionThreshold;
+	double dThreasholdY = dHistAbsY * lpParams->dProjectionThreshold;
+	{
+		unsigned long int peakXMin = absPeakX;
+		unsigned long int peakXMax = absPeakX;
+		unsigned long int peakYMin = absPeakY;
+		unsigned long int peakYMax = absPeakY;
+		unsigned long int x,y;
+
+		double dAreaSum = 0;
+
+		while((peakXMin > 0) && ((double)lpNewHistX->dValues[peakXMin-1] > (dThreasholdX))) { peakXMin = peakXMin - 1; }
+		while((peakXMax < (lpNewHistX->sLen-1)) && ((double)lpNewHistX->dValues[peakXMax+1] > (dThreasholdX))) { peakXMax = peakXMax + 1; }
+
+		while((peakYMin > 0) && ((double)lpNewHistY->dValues[peakYMin-1] > (dThreasholdY))) { peakYMin = peakYMin - 1; }
+		while((peakYMax < (lpNewHistY->sLen-1)) && ((double)lpNewHistY->dValues[peakYMax+1] > (dThreasholdY))) { peakYMax = peakYMax + 1; }
+
+		/*
+			located candidate ... now locate absolute maximum. In case of ties
+			the pixel with the smallest x (then smallest y) is used as seed
+		*/
+		unsigned int dMaxPixelValueInCluster = 0;
+		unsigned long int seedX = absPeakX;
+		unsigned long int seedY = absPeakY;
+		for(y = peakYMin; y <= peakYMax; y=y+1) {
+			const unsigned char* lpRow = &(lpLuma[y * lpImage->width]);
+			for(x = peakXMin; x <= peakXMax; x=x+1) {
+				if((lpRow[x] > dMaxPixelValueInCluster) || ((lpRow[x] == dMaxPixelValueInCluster) && (dMaxPixelValueInCluster > 0) && (x < seedX))) {
+					dMaxPixelValueInCluster = lpRow[x];
+					seedX = x;
+					seedY = y;
+				}
+			}
+		}
+
+		/*
+			With smoothing enabled seed and association threshold come from
+			the smoothed candidate box. The filter is run over the box plus
+			it's support so the box border sees the same kernel as the inside
+		*/
+		unsigned int dwSeedValue = dMaxPixelValueInCluster;
+		if((lpParams->dwSmoothRadius > 0) && (lpParams->dwSmoothPasses > 0)) {
+			unsigned long int dwSupport = lpParams->dwSmoothRadius * lpParams->dwSmoothPasses;
+			unsigned long int smXMin = (peakXMin > dwSupport) ? peakXMin - dwSupport : 0;
+			unsigned long int smXMax = (peakXMax + dwSupport < lpImage->width) ? peakXMax + dwSupport : lpImage->width - 1;
+			unsigned long int smYMin = (peakYMin > dwSupport) ? peakYMin - dwSupport : 0;
+			unsigned long int smYMax = (peakYMax + dwSupport < lpImage->height) ? peakYMax + dwSupport : lpImage->height - 1;
+			unsigned long int dwSmoothStride = smXMax - smXMin + 1;
+			float fMax = -1;
+
+			frameTraceBegin("smooth");
+			if(blobDetectorSmooth(lpScratch, lpImage, smXMin, smXMax, smYMin, smYMax, lpParams->dwSmoothRadius, lpParams->dwSmoothPasses) != 0) {
+				frameTraceEnd("smooth");
+				return 1;
+			}
+			frameTraceEnd("smooth");
+			for(y = peakYMin; y <= peakYMax; y=y+1) {
+				const float* lpRow = &(lpScratch->lpSmooth[(y - smYMin) * dwSmoothStride]);
+				for(x = peakXMin; x <= peakXMax; x=x+1) {
+					if((lpRow[x - smXMin] > fMax) || ((lpRow[x - smXMin] == fMax) && (x < seedX))) {
+						fMax = lpRow[x - smXMin];
+						seedX = x;
+						seedY = y;
+					}
+				}
+			}
+			dwSeedValue = (unsigned int)(fMax + 0.5f);
+		}
+
+		/*
+			Now trace the cluster from seeds on ...
+
+			Every cluster pixel inside the candidate box joins all pixels
+			over threashold within dwGapRadius (along x and y) to the
+			cluster. On the threshold mask this is a geodesic
+			reconstruction: starting at the seed the cluster is dilated by
+			the gap radius and cut to the pixels over threshold inside the
+			candidate box until it stops growing. One final dilation adds
+			the pixels over threshold outside of the box that are in reach
+			of the cluster. All masks are only touched in the box extended
+			by the gap radius.
+		*/
+		unsigned long int dwAssocThreshold = (unsigned long int)floor(lpParams->dAssociationThreshold * (double)dwSeedValue);
+		unsigned long int dwGap = lpParams->dwGapRadius;
+		unsigned long int dwStride = lpScratch->dwVisitedStride;
+		struct morphologyRegion regionBox;
+		struct morphologyRegion regionReach;
+		uint64_t qwSeedBit = ((uint64_t)1) << (seedX & 63);
+		long int dwTraceSteps;
+
+		unsigned long int peakXMinReal = absPeakX;
+		unsigned long int peakYMinReal = absPeakY;
+		unsigned long int peakXMaxReal = absPeakX;
+		unsigned long int peakYMaxReal = absPeakY;
+		unsigned long int clusterPixelArea = 0;
+
+		regionBox.xMin = peakXMin;
+		regionBox.xMax = peakXMax;
+		regionBox.yMin = peakYMin;
+		regionBox.yMax = peakYMax;
+		regionReach.xMin = (peakXMin > dwGap) ? peakXMin - dwGap : 0;
+		regionReach.xMax = (peakXMax + dwGap < lpImage->width) ? peakXMax + dwGap : lpImage->width - 1;
+		regionReach.yMin = (peakYMin > dwGap) ? peakYMin - dwGap : 0;
+		regionReach.yMax = (peakYMax + dwGap < lpImage->height) ? peakYMax + dwGap : lpImage->height - 1;
+
+		frameTraceBegin("trace");
+
+		/* Pixels over threshold in reach and inside the box (the seed always belongs to the cluster) */
+		morphologyThreshold(lpScratch->lpMask, dwStride, lpLuma, lpImage->width, &regionReach, (dwAssocThreshold > 255) ? 255 : (unsigned int)dwAssocThreshold);
+		morphologyThreshold(lpScratch->lpMaskBox, dwStride, lpLuma, lpImage->width, &regionBox, (dwAssocThreshold > 255) ? 255 : (unsigned int)dwAssocThreshold);
+		lpScratch->lpMaskBox[seedY * dwStride + (seedX >> 6)] |= qwSeedBit;
+
+		/* The visited mask has to be clean in all rows the cluster can reach */
+		memset(&(lpScratch->lpVisited[regionReach.yMin * dwStride]), 0, sizeof(uint64_t) * dwStride * (regionReach.yMax - regionReach.yMin + 1));
+		lpScratch->lpVisited[seedY * dwStride + (seedX >> 6)] |= qwSeedBit;
+
+		dwTraceSteps = morphologyReconstruct(&(lpScratch->morph), lpScratch->lpVisited, lpScratch->lpMaskBox, dwStride, &regionBox, dwGap);
+		if((dwTraceSteps < 0) || (morphologyDilate(&(lpScratch->morph), lpScratch->lpVisited, lpScratch->lpVisited, dwStride, &regionReach, dwGap) != 0)) {
+			frameTraceEnd("trace");
+			return 1;
+		}
+		for(y = regionReach.yMin; y <= regionReach.yMax; y=y+1) {
+			unsigned long int w;
+			for(w = (regionReach.xMin >> 6); w <= (regionReach.xMax >> 6); w=w+1) {
+				lpScratch->lpVisited[y * dwStride + w] &= lpScratch->lpMask[y * dwStride + w];
+			}
+		}
+		lpScratch->lpVisited[seedY * dwStride + (seedX >> 6)] |= qwSeedBit;
+
+		/*
+			Area and bounds of the cluster. The bounds start at the
+			projection peak and cover all cluster pixels except the seed
+		*/
+		for(y = regionReach.yMin; y <= regionReach.yMax; y=y+1) {
+			const uint64_t* lpRow = &(lpScratch->lpVisited[y * dwStride]);
+			unsigned long int w;
+
+			for(w = (regionReach.xMin >> 6); w <= (regionReach.xMax >> 6); w=w+1) {
+				uint64_t qwBits = lpRow[w];
+
+				clusterPixelArea = clusterPixelArea + (unsigned long int)__builtin_popcountll(qwBits);
+				if((y == seedY) && (w == (seedX >> 6))) { qwBits = qwBits & ~qwSeedBit; }
+				if(qwBits == 0) { continue; }
+
+				if(peakXMinReal > w * 64 + (unsigned long int)__builtin_ctzll(qwBits)) { peakXMinReal = w * 64 + (unsigned long int)__builtin_ctzll(qwBits); }
+				if(peakXMaxReal < w * 64 + 63 - (unsigned long int)__builtin_clzll(qwBits)) { peakXMaxReal = w * 64 + 63 - (unsigned long int)__builtin_clzll(qwBits); }
+				if(peakYMinReal > y) { peakYMinReal = y; }
+				if(peakYMaxReal < y) { peakYMaxReal = y; }
+			}
+		}
+
+		frameTraceEndCount("trace", (unsigned long int)dwTraceSteps);
+
+		/* Calculate new boundaries ... */
+		peakXMin = peakXMinReal;
+		peakXMax = peakXMaxReal;
+		peakYMin = peakYMinReal;
+		peakYMax = peakYMaxReal;
+
+		unsigned long int dwSaturatedPixels = 0;
+		for(y = peakYMin; y <= peakYMax; y=y+1) {
+			const unsigned char* lpRow = &(lpLuma[y * lpImage->width]);
+			for(x = peakXMin; x <= peakXMax; x=x+1) {
+				if(BLOBDETECTOR_VISITED(lpScratch, x, y) != 0) {
+					dAreaSum = dAreaSum + ((double)(lpRow[x]));
+					if(lpRow[x] == 255) { dwSaturatedPixels = dwSaturatedPixels + 1; }
+				}
+			}
+		}
+
+		lpResult->bounds.xMin = peakXMin;
+		lpResult->bounds.xMax = peakXMax;
+		lpResult->bounds.yMin = peakYMin;
+		lpResult->bounds.yMax = peakYMax;
+		lpResult->dAreaSum = dAreaSum;
+		lpResult->clusterPixelArea = clusterPixelArea;
+		lpResult->dwPeakValue = dMaxPixelValueInCluster;
+		lpResult->dwSaturatedPixels = dwSaturatedPixels;
+
+		/* Profile fits over the cluster and one cluster size of background on each side */
+		frameTraceBegin("fit");
+		{
+			unsigned long int dwW = peakXMax - peakXMin + 1;
+			unsigned long int dwH = peakYMax - peakYMin + 1;
+
+			profileFitGaussian(lpNewHistX->dValues, (peakXMin > dwW) ? peakXMin - dwW : 0, (peakXMax + dwW < lpNewHistX->sLen) ? peakXMax + dwW : lpNewHistX->sLen - 1, &(lpResult->fitX));
+			profileFitGaussian(lpNewHistY->dValues, (peakYMin > dwH) ? peakYMin - dwH : 0, (peakYMax + dwH < lpNewHistY->sLen) ? peakYMax + dwH : lpNewHistY->sLen - 1, &(lpResult->fitY));
+
+			/* Background in the same window, outside of the bounding box */
+			unsigned long int bgXMin = (peakXMin > dwW) ? peakXMin - dwW : 0;
+			unsigned long int bgXMax = (peakXMax + dwW < lpImage->width) ? peakXMax + dwW : lpImage->width - 1;
+			unsigned long int bgYMin = (peakYMin > dwH) ? peakYMin - dwH : 0;
+			unsigned long int bgYMax = (peakYMax + dwH < lpImage->height) ? peakYMax + dwH : lpImage->height - 1;
+			unsigned long int dwBgPixels = (bgXMax - bgXMin + 1) * (bgYMax - bgYMin + 1) - dwW * dwH;
+
+			if(dwBgPixels > 0) {
+				double dSum = (double)(blobDetectorRectSum(lpScratch, bgXMin, bgXMax, bgYMin, bgYMax) - blobDetectorRectSum(lpScratch, peakXMin, peakXMax, peakYMin, peakYMax));
+				double dSumSq = (double)(blobDetectorRectSumSq(lpScratch, bgXMin, bgXMax, bgYMin, bgYMax) - blobDetectorRectSumSq(lpScratch, peakXMin, peakXMax, peakYMin, peakYMax));
+				double dVariance;
+
+				lpResult->dBackground = dSum / (double)dwBgPixels;
+				dVariance = dSumSq / (double)dwBgPixels - lpResult->dBackground * lpResult->dBackground;
+				lpResult->dBackgroundStdDev = (dVariance > 0) ? sqrt(dVariance) : 0;
+			} else {
+				lpResult->dBackground = NAN;
+				lpResult->dBackgroundStdDev = NAN;
+			}
+		}
+		frameTraceEnd("fit");
+	}
+
+	return 0;
+}
+
+uint32_t blobDetectorRectSum(
+	const struct blobDetectorScratch* lpScratch,
+	unsigned long int xMin,
+	unsigned long int xMax,
+	unsigned long int yMin,
+	unsigned long int yMax
+) {
+	const uint32_t* lpTop = &(lpScratch->lpIntegral[yMin * lpScratch->dwIntegralStride]);
+	const uint32_t* lpBottom = &(lpScratch->lpIntegral[(yMax + 1) * lpScratch->dwIntegralStride]);
+
+	/* Wraps around modulo 2^32 like the table itself */
+	return lpBottom[xMax + 1] - lpBottom[xMin] - lpTop[xMax + 1] + lpTop[xMin];
+}
+
+uint64_t blobDetectorRectSumSq(
+	const struct blobDetectorScratch* lpScratch,
+	unsigned long int xMin,
+	unsigned long int xMax,
+	unsigned long int yMin,
+	unsigned long int yMax
+) {
+	const uint64_t* lpTop = &(lpScratch->lpIntegralSq[yMin * lpScratch->dwIntegralStride]);
+	const uint64_t* lpBottom = &(lpScratch->lpIntegralSq[(yMax + 1) * lpScratch->dwIntegralStride]);
+
+	return lpBottom[xMax + 1] - lpBottom[xMin] - lpTop[xMax + 1] + lpTop[xMin];
+}
+
+int blobRenderAnnotation(
+	const struct imgRawImage* lpImage,
+	const struct blobDetectorScratch* lpScratch,
+	const struct blobResult* lpResult,
+	struct imgRawImage* lpOut
+) {
+	unsigned long int i;
+	unsigned long int x,y;
+
+	if((lpImage == NULL) || (lpImage->lpLuma == NULL) || (lpScratch == NULL) || (lpResult == NULL) || (lpOut == NULL) || (lpOut->lpData == NULL)) {
+		return 1;
+	}
+
+	lpOut->numComponents = 3;
+	lpOut->width = lpImage->width;
+	lpOut->height = lpImage->height;
+
+	for(i = 0; i < (lpImage->width * lpImage->height); i=i+1) {
+		lpOut->lpData[i*3 + 0] = lpImage->lpLuma[i];
+		lpOut->lpData[i*3 + 1] = lpImage->lpLuma[i];
+		lpOut->lpData[i*3 + 2] = lpImage->lpLuma[i];
+	}
+
+	/* Mark cluster fully blue */
+	for(y = lpResult->bounds.yMin; y <= lpResult->bounds.yMax; y=y+1) {
+		for(x = lpResult->bounds.xMin; x <= lpResult->bounds.xMax; x=x+1) {
+			if(BLOBDETECTOR_VISITED(lpScratch, x, y) != 0) {
+				lpOut->lpData[(x + y * lpOut->width)*3 + 0] = 0;
+				lpOut->lpData[(x + y * lpOut->width)*3 + 1] = 0;
+				lpOut->lpData[(x + y * lpOut->width)*3 + 2] = 255;
+			}
+		}
+	}
+
+	/*
+		Plot estimated peak location into image (2 pixel wide red if possible)...
+	*/
+	drawRect(lpOut, lpResult->bounds.xMin, lpResult->bounds.xMax, lpResult->bounds.yMin, lpResult->bounds.yMax, 2);
+	return 0;
+}
+
+static double blobRelChange(double dA, double dB) {
+	double dNorm = fabs(dA);
+	if(fabs(dB) > dNorm) { dNorm = fabs(dB); }
+	if(dNorm < 1) { dNorm = 1; }
+	return fabs(dA - dB) / dNorm;
+}
+
+double blobResultRelativeChange(
+	const struct blobResult* lpA,
+	const struct blobResult* lpB
+) {
+	double dChange = 0;
+	double d;
+
+	d = blobRelChange((double)(lpA->bounds.xMax - lpA->bounds.xMin), (double)(lpB->bounds.xMax - lpB->bounds.xMin));
+	if(d > dChange) { dChange = d; }
+	d = blobRelChange((double)(lpA->bounds.yMax - lpA->bounds.yMin), (double)(lpB->bounds.yMax - lpB->bounds.yMin));
+	if(d > dChange) { dChange = d; }
+	d = blobRelChange(lpA->dAreaSum, lpB->dAreaSum);
+	if(d > dChange) { dChange = d; }
+	d = blobRelChange((double)lpA->clusterPixelArea, (double)lpB->clusterPixelArea);
+	if(d > dChange) { dChange = d; }
+	d = blobRelChange((double)lpA->dwPeakValue, (double)lpB->dwPeakValue);
+	if(d > dChange) { dChange = d; }
+
+	return dChange;
+}
+
+int blobResultSignificant(
+	const struct blobResult* lpResult
+) {
+	double dMargin;
+
+	if((lpResult == NULL) || (lpResult->clusterPixelArea == 0)) {
+		return 0;
+	}
+	if(isnan(lpResult->dBackground) || isnan(lpResult->dBackgroundStdDev)) {
+		return 0;
+	}
+
+	dMargin = BLOBDETECTOR_MIN_SNR * lpResult->dBackgroundStdDev;
+	if(dMargin < BLOBDETECTOR_MIN_CONTRAST) { dMargin = BLOBDETECTOR_MIN_CONTRAST; }
+	return ((double)lpResult->dwPeakValue > lpResult->dBackground + dMargin) ? 1 : 0;
+}
+
+void blobResultOffset(
+	struct blobResult* lpResult,
+	long int dx,
+	long int dy
+) {
+	if(lpResult == NULL) {
+		return;
+	}
+
+	lpResult->bounds.xMin = (unsigned long int)((long int)lpResult->bounds.xMin + dx);
+	lpResult->bounds.xMax = (unsigned long int)((long int)lpResult->bounds.xMax + dx);
+	lpResult->bounds.yMin = (unsigned long int)((long int)lpResult->bounds.yMin + dy);
+	lpResult->bounds.yMax = (unsigned long int)((long int)lpResult->bounds.yMax + dy);
+
+	/* Invalid fits carry NaN which stays NaN */
+	lpResult->fitX.dCenter = lpResult->fitX.dCenter + (double)dx;
+	lpResult->fitY.dCenter = lpResult->fitY.dCenter + (double)dy;
+}
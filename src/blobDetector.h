@@ -0,0 +1,242 @@
+#ifndef __BLOBDETECTOR_H__
+#define __BLOBDETECTOR_H__
+
+#include <stdint.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./profileFit.h"
+#include "./morphology.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Tunable thresholds of the detector:
+
+		dProjectionThreshold	Fraction of the projection peak used to
+								locate the candidate box (default 0.2)
+		dAssociationThreshold	Fraction of the brightest pixel in the
+								candidate box a pixel has to exceed to
+								be associated with the cluster (default 0.5)
+		dwSmoothRadius			If not 0 the seed and the brightest pixel
+								for the association threshold are taken
+								from the candidate box smoothed by
+								dwSmoothPasses box filters of this radius
+								(default 0, no smoothing)
+		dwSmoothPasses			Number of box filter passes, 1 is a box,
+								3 approximates a gaussian (default 3)
+		dwGapRadius				Largest distance (in pixels along x and y)
+								over which pixels above the association
+								threshold are joined to the cluster
+								(default 10)
+*/
+struct blobDetectorParams {
+	double					dProjectionThreshold;
+	double					dAssociationThreshold;
+	unsigned long int		dwSmoothRadius;
+	unsigned long int		dwSmoothPasses;
+	unsigned long int		dwGapRadius;
+};
+
+#define BLOBDETECTOR_DEFAULT_PROJECTIONTHRESHOLD	0.2
+#define BLOBDETECTOR_DEFAULT_ASSOCIATIONTHRESHOLD	0.5
+#define BLOBDETECTOR_DEFAULT_SMOOTHPASSES			3
+#define BLOBDETECTOR_DEFAULT_GAPRADIUS				10
+
+/*
+	Result of one detection. dwPeakValue is the brightest pixel of the
+	candidate box (unsmoothed), dwSaturatedPixels the number of cluster pixels at
+	full scale (both used for exposure control). fitX and fitY are
+	gaussian fits of the projections in a window of three times the
+	cluster size around the cluster. dBackground and dBackgroundStdDev
+	are mean and standard deviation of the pixels in the same window
+	outside of the bounding box (NaN if the box covers the window)
+*/
+struct blobResult {
+	struct rectBound		bounds;
+
+	double					dAreaSum;
+	unsigned long int		clusterPixelArea;
+
+	unsigned int			dwPeakValue;
+	unsigned long int		dwSaturatedPixels;
+
+	struct profileFitResult	fitX;
+	struct profileFitResult	fitY;
+
+	double					dBackground;
+	double					dBackgroundStdDev;
+};
+
+/*
+	Scratch memory used by the detector. One instance per thread,
+	reused for every frame (only grows when the image size changes).
+	After blobDetect the visited mask holds the cluster pixels (one bit
+	per pixel, dwVisitedStride 64 bit words per row; the threshold masks
+	use the same layout) and the integral images of the luma and it's
+	square are valid until the next call.
+	The integral images have (width + 1) * (height + 1) entries with a
+	leading row and column of zeros; entry (x, y) is the sum over all
+	pixels left of and above (x, y). The luma sums are kept modulo 2^32
+	which keeps every rectangle of up to 16843009 pixels exact
+*/
+struct blobDetectorScratch {
+	struct histogramBuffer*	lpHistX;
+	struct histogramBuffer*	lpHistY;
+	size_t					sHistXCapacity;
+	size_t					sHistYCapacity;
+	uint32_t*				lpColumnSums;		/* sHistXCapacity entries */
+
+	uint64_t*				lpVisited;
+	size_t					sVisitedCapacity;
+	unsigned long int		dwVisitedStride;
+
+	uint64_t*				lpMask;
+	uint64_t*				lpMaskBox;
+	size_t					sMaskCapacity;
+	struct morphologyScratch	morph;
+
+	uint32_t*				lpIntegral;
+	uint64_t*				lpIntegralSq;
+	size_t					sIntegralCapacity;
+	unsigned long int		dwIntegralStride;
+
+	float*					lpSmooth;
+	float*					lpSmoothTmp;
+	size_t					sSmoothCapacity;
+};
+
+#define BLOBDETECTOR_VISITED(lpScratch, x, y) \
+	(((lpScratch)->lpVisited[(y) * (lpScratch)->dwVisitedStride + ((x) >> 6)] >> ((x) & 63)) & 1)
+
+void blobDetectorParamsDefault(struct blobDetectorParams* lpParams);
+
+int blobDetectorScratchInit(struct blobDetectorScratch* lpScratch);
+void blobDetectorScratchRelease(struct blobDetectorScratch* lpScratch);
+
+/*
+	Allocates all scratch memory for images of up to width x height up
+	front instead of during the first frames and prefaults it if memory
+	locking is enabled (see realtime.h). Optional, returns 0 on success
+*/
+int blobDetectorScratchPrepare(
+	struct blobDetectorScratch* lpScratch,
+	const struct blobDetectorParams* lpParams,
+	unsigned long int width,
+	unsigned long int height
+);
+
+/*
+	Converts a YUYV (YUV422) buffer directly into the planar luma of
+	the image (lpLuma has to hold width * height bytes). The result is
+	identical to converting into RGB888 and applying greyscale
+*/
+void convertYUYVToLuma(
+	struct imgRawImage* lpImage,
+	const unsigned char* lpSrc,
+	unsigned long int width,
+	unsigned long int height
+);
+
+/*
+	Calculates the planar luma (lpLuma) from the interleaved RGB888
+	or single component data of the image
+*/
+void greyscale(
+	struct imgRawImage* lpImage
+);
+
+void drawRect(
+	struct imgRawImage* lpImage,
+	unsigned long int xStart,
+	unsigned long int xEnd,
+	unsigned long int yStart,
+	unsigned long int yEnd,
+	unsigned long int lineWidth
+);
+
+/*
+	Runs the blob detection on the planar luma of the image. The image
+	itself is not modified, the projections and the cluster mask are
+	left in the scratch buffers for the caller
+*/
+int blobDetect(
+	struct imgRawImage* lpImage,
+	const struct blobDetectorParams* lpParams,
+	struct blobDetectorScratch* lpScratch,
+	struct blobResult* lpResult
+);
+
+/*
+	Sum and sum of squares of the luma in the rectangle xMin..xMax,
+	yMin..yMax (inclusive) of the image of the last blobDetect. Both are
+	answered from the integral images in constant time
+*/
+uint32_t blobDetectorRectSum(
+	const struct blobDetectorScratch* lpScratch,
+	unsigned long int xMin,
+	unsigned long int xMax,
+	unsigned long int yMin,
+	unsigned long int yMax
+);
+uint64_t blobDetectorRectSumSq(
+	const struct blobDetectorScratch* lpScratch,
+	unsigned long int xMin,
+	unsigned long int xMax,
+	unsigned long int yMin,
+	unsigned long int yMax
+);
+
+/*
+	Renders the annotated image (greyscale, cluster pixels blue and the
+	bounding box red) into lpOut which has to provide width * height * 3
+	bytes of RGB888 data. Uses the cluster mask of the last blobDetect
+*/
+int blobRenderAnnotation(
+	const struct imgRawImage* lpImage,
+	const struct blobDetectorScratch* lpScratch,
+	const struct blobResult* lpResult,
+	struct imgRawImage* lpOut
+);
+
+/*
+	Largest relative change of the cluster widths, area sum, pixel area
+	and peak value between two results (0 for identical results)
+*/
+double blobResultRelativeChange(
+	const struct blobResult* lpA,
+	const struct blobResult* lpB
+);
+
+/*
+	blobDetect always traces a cluster (at least the seed pixel), also
+	on frames without beam. A result counts as beam if the cluster is
+	not empty and it's peak exceeds the background around it by at
+	least BLOBDETECTOR_MIN_CONTRAST grey levels and
+	BLOBDETECTOR_MIN_SNR background standard deviations. Results
+	without background (the bounding box covers the whole window) never
+	count. Returns 1 for a beam, 0 otherwise
+*/
+#define BLOBDETECTOR_MIN_CONTRAST					10
+#define BLOBDETECTOR_MIN_SNR						3
+
+int blobResultSignificant(
+	const struct blobResult* lpResult
+);
+
+/*
+	Moves bounds and fit centers of a result by dx, dy pixels, for
+	example from the coordinates of a cropped frame into the full frame
+*/
+void blobResultOffset(
+	struct blobResult* lpResult,
+	long int dx,
+	long int dy
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __BLOBDETECTOR_H__ */
@@ -0,0 +1,488 @@
+/*
+	Reusable capture and detection context (see blobEstimator.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include <linux/videodev2.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./captureDevice.h"
+#include "./exposureController.h"
+#include "./blobEstimator.h"
+#include "./frameTrace.h"
+#include "./realtime.h"
+
+struct blobEstimator {
+	struct captureDevice			device;
+	struct blobEstimatorSettings	settings;
+
+	struct imgRawImage				img;
+	struct blobDetectorScratch		scratch;
+
+	int								bExposureControl;
+	struct exposureController		exposure;
+
+	struct v4l2_buffer				buf;			/* Last accepted frame */
+	int								bHaveBuffer;
+
+	int								bRoiPending;	/* Region for the next grab */
+	int								bRoiPendingFull;
+	struct rectBound				roiPending;
+};
+
+void blobEstimatorSettingsDefault(struct blobEstimatorSettings* lpSettings) {
+	if(lpSettings == NULL) {
+		return;
+	}
+	memset(lpSettings, 0, sizeof(struct blobEstimatorSettings));
+	blobDetectorParamsDefault(&(lpSettings->detector));
+	lpSettings->dExposureTarget = 0;
+	lpSettings->dStabilityTolerance = 0;
+	lpSettings->dwMaxAttempts = BLOBESTIMATOR_DEFAULT_MAXATTEMPTS;
+	lpSettings->dwTimeoutMs = 0;
+	lpSettings->dwRoiMargin = 0;
+}
+
+enum cameraError blobEstimatorOpen(
+	struct blobEstimator** lpEstimatorOut,
+	char* lpDeviceName,
+	const struct captureDeviceFormatRequest* lpRequest
+) {
+	struct blobEstimator* lpNew;
+	enum cameraError e;
+
+	if(lpEstimatorOut == NULL) {
+		return cameraE_InvalidParam;
+	}
+	(*lpEstimatorOut) = NULL;
+
+	if(lpDeviceName == NULL) {
+		return cameraE_InvalidParam;
+	}
+
+	lpNew = (struct blobEstimator*)malloc(sizeof(struct blobEstimator));
+	if(lpNew == NULL) {
+		return cameraE_Failed;
+	}
+	memset(lpNew, 0, sizeof(struct blobEstimator));
+	blobEstimatorSettingsDefault(&(lpNew->settings));
+
+	/* A single buffer: every frame we get has been exposed after the previous grab returned it */
+	e = captureDeviceOpen(&(lpNew->device), lpDeviceName, lpRequest, 1);
+	if(e != cameraE_Ok) {
+		free(lpNew);
+		return e;
+	}
+
+	if(blobDetectorScratchInit(&(lpNew->scratch)) != 0) {
+		captureDeviceClose(&(lpNew->device));
+		free(lpNew);
+		return cameraE_Failed;
+	}
+
+	lpNew->img.width = lpNew->device.width;
+	lpNew->img.height = lpNew->device.height;
+	lpNew->img.numComponents = 1;
+	lpNew->img.lpLuma = malloc(sizeof(unsigned char) * lpNew->device.width * lpNew->device.height);
+	if(lpNew->img.lpLuma == NULL) {
+		blobDetectorScratchRelease(&(lpNew->scratch));
+		captureDeviceClose(&(lpNew->device));
+		free(lpNew);
+		return cameraE_Failed;
+	}
+	lpNew->img.lpData = lpNew->img.lpLuma; /* Single component view for the JPEG writer */
+	realtimePrefault(lpNew->img.lpLuma, lpNew->device.width * lpNew->device.height);
+
+	(*lpEstimatorOut) = lpNew;
+	return cameraE_Ok;
+}
+
+static int blobEstimatorRoiActive(const struct blobEstimator* lpEstimator) {
+	const struct captureDevice* lpDevice = &(lpEstimator->device);
+
+	if((lpDevice->roi.xMin != 0) || (lpDevice->roi.yMin != 0)) { return 1; }
+	if((lpDevice->roi.xMax + 1 != lpDevice->dwFullWidth) || (lpDevice->roi.yMax + 1 != lpDevice->dwFullHeight)) { return 1; }
+	return 0;
+}
+
+/*
+	Reprograms the sensor region (NULL for the full frame). Held buffers
+	have to be released before. A driver that does not read out the
+	region leaves the full frame which is not an error for the grab
+*/
+static enum cameraError blobEstimatorSetRoi(
+	struct blobEstimator* lpEstimator,
+	const struct rectBound* lpRoi
+) {
+	frameTraceBegin("roi");
+	captureDeviceSetRoi(&(lpEstimator->device), lpRoi);
+	frameTraceEnd("roi");
+
+	if(lpEstimator->device.bStreaming == 0) {
+		return cameraE_Failed;
+	}
+	lpEstimator->img.width = lpEstimator->device.width;
+	lpEstimator->img.height = lpEstimator->device.height;
+	return cameraE_Ok;
+}
+
+/*
+	A cluster that touches an edge of the region which is not an edge
+	of the full frame may extend beyond the region
+*/
+static int blobEstimatorRoiClipped(
+	const struct blobEstimator* lpEstimator,
+	const struct blobResult* lpBlob
+) {
+	const struct captureDevice* lpDevice = &(lpEstimator->device);
+
+	if((lpBlob->bounds.xMin == 0) && (lpDevice->roi.xMin > 0)) { return 1; }
+	if((lpBlob->bounds.yMin == 0) && (lpDevice->roi.yMin > 0)) { return 1; }
+	if((lpBlob->bounds.xMax + 1 >= lpDevice->width) && (lpDevice->roi.xMax + 1 < lpDevice->dwFullWidth)) { return 1; }
+	if((lpBlob->bounds.yMax + 1 >= lpDevice->height) && (lpDevice->roi.yMax + 1 < lpDevice->dwFullHeight)) { return 1; }
+	return 0;
+}
+
+/*
+	Chooses the region for the next grab from the bounds of the accepted
+	cluster (full frame coordinates). The stream is only restarted if the
+	cluster came closer than half the margin to an edge of the current
+	region or the current region is more than four times larger than
+	needed (after a full frame acquisition)
+*/
+static void blobEstimatorRoiFollow(
+	struct blobEstimator* lpEstimator,
+	const struct blobResult* lpBlob
+) {
+	const struct captureDevice* lpDevice = &(lpEstimator->device);
+	unsigned long int dwMargin = lpEstimator->settings.dwRoiMargin;
+	unsigned long int dwHalf = dwMargin / 2;
+	struct rectBound roiWanted;
+	unsigned long long int qwAreaWanted, qwAreaCurrent;
+	int bFollow = 0;
+
+	roiWanted.xMin = (lpBlob->bounds.xMin > dwMargin) ? lpBlob->bounds.xMin - dwMargin : 0;
+	roiWanted.yMin = (lpBlob->bounds.yMin > dwMargin) ? lpBlob->bounds.yMin - dwMargin : 0;
+	roiWanted.xMax = (lpBlob->bounds.xMax + dwMargin < lpDevice->dwFullWidth) ? lpBlob->bounds.xMax + dwMargin : lpDevice->dwFullWidth - 1;
+	roiWanted.yMax = (lpBlob->bounds.yMax + dwMargin < lpDevice->dwFullHeight) ? lpBlob->bounds.yMax + dwMargin : lpDevice->dwFullHeight - 1;
+
+	if((lpBlob->bounds.xMin < lpDevice->roi.xMin + dwHalf) && (lpDevice->roi.xMin > 0)) { bFollow = 1; }
+	if((lpBlob->bounds.yMin < lpDevice->roi.yMin + dwHalf) && (lpDevice->roi.yMin > 0)) { bFollow = 1; }
+	if((lpBlob->bounds.xMax + dwHalf > lpDevice->roi.xMax) && (lpDevice->roi.xMax + 1 < lpDevice->dwFullWidth)) { bFollow = 1; }
+	if((lpBlob->bounds.yMax + dwHalf > lpDevice->roi.yMax) && (lpDevice->roi.yMax + 1 < lpDevice->dwFullHeight)) { bFollow = 1; }
+
+	qwAreaWanted = (unsigned long long int)(roiWanted.xMax - roiWanted.xMin + 1) * (unsigned long long int)(roiWanted.yMax - roiWanted.yMin + 1);
+	qwAreaCurrent = (unsigned long long int)lpDevice->width * (unsigned long long int)lpDevice->height;
+	if(qwAreaCurrent > 4 * qwAreaWanted) { bFollow = 1; }
+
+	if(bFollow != 0) {
+		lpEstimator->bRoiPending = 1;
+		lpEstimator->bRoiPendingFull = 0;
+		lpEstimator->roiPending = roiWanted;
+	}
+}
+
+enum cameraError blobEstimatorConfigure(
+	struct blobEstimator* lpEstimator,
+	const struct blobEstimatorSettings* lpSettings
+) {
+	if((lpEstimator == NULL) || (lpSettings == NULL)) {
+		return cameraE_InvalidParam;
+	}
+	if((lpSettings->dExposureTarget < 0) || (lpSettings->dExposureTarget >= 255) || (lpSettings->dStabilityTolerance < 0)) {
+		return cameraE_InvalidParam;
+	}
+	if(blobDetectorScratchPrepare(&(lpEstimator->scratch), &(lpSettings->detector), lpEstimator->device.width, lpEstimator->device.height) != 0) {
+		return cameraE_Failed;
+	}
+
+	if(lpEstimator->bExposureControl != 0) {
+		if(lpSettings->dExposureTarget == lpEstimator->settings.dExposureTarget) {
+			/* Keep the converged exposure */
+		} else {
+			exposureControllerRelease(&(lpEstimator->exposure));
+			lpEstimator->bExposureControl = 0;
+		}
+	}
+	if((lpSettings->dExposureTarget > 0) && (lpEstimator->bExposureControl == 0)) {
+		if(exposureControllerInit(&(lpEstimator->exposure), lpEstimator->device.hHandle, lpSettings->dExposureTarget) != 0) {
+			lpEstimator->settings.dExposureTarget = 0;
+			return cameraE_Failed;
+		}
+		lpEstimator->bExposureControl = 1;
+	}
+
+	if((lpSettings->dwRoiMargin > 0) && (lpEstimator->device.bCropSupported == 0)) {
+		printf("%s does not support cropping, reading out the full frame\n", lpEstimator->device.lpDeviceName);
+	}
+	if((lpSettings->dwRoiMargin == 0) && (blobEstimatorRoiActive(lpEstimator) != 0)) {
+		/* Back to the full frame with the next grab, the caller may still use the current frame */
+		lpEstimator->bRoiPending = 1;
+		lpEstimator->bRoiPendingFull = 1;
+	}
+
+	memcpy(&(lpEstimator->settings), lpSettings, sizeof(struct blobEstimatorSettings));
+	if(lpEstimator->settings.dwMaxAttempts == 0) {
+		lpEstimator->settings.dwMaxAttempts = 1;
+	}
+	return cameraE_Ok;
+}
+
+static void blobEstimatorSleepUntil(const struct timespec* lpDeadline) {
+	while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, lpDeadline, NULL) == EINTR) {
+	}
+}
+
+static enum cameraError blobEstimatorRelease(struct blobEstimator* lpEstimator) {
+	if(lpEstimator->bHaveBuffer == 0) {
+		return cameraE_Ok;
+	}
+	lpEstimator->bHaveBuffer = 0;
+	return captureDeviceRequeue(&(lpEstimator->device), &(lpEstimator->buf));
+}
+
+enum cameraError blobEstimatorGrab(
+	struct blobEstimator* lpEstimator,
+	const struct timespec* lpNotBefore,
+	struct blobEstimatorResult* lpResultOut
+) {
+	const struct blobEstimatorSettings* lpSettings;
+	struct blobResult resPrevious;
+	int bHavePrevious = 0;
+	int iDetectResult = 1;
+	int bBeam = 0;
+	int dwFrameExposure = -1;
+	enum cameraError e;
+
+	if((lpEstimator == NULL) || (lpResultOut == NULL)) {
+		return cameraE_InvalidParam;
+	}
+	lpSettings = &(lpEstimator->settings);
+	memset(lpResultOut, 0, sizeof(struct blobEstimatorResult));
+	lpResultOut->dwExposure = -1;
+
+	/* The previous frame is no longer needed by the caller */
+	e = blobEstimatorRelease(lpEstimator);
+	if(e != cameraE_Ok) {
+		return e;
+	}
+
+	/* Region chosen after the previous grab, the stream restarts with new buffers */
+	if(lpEstimator->bRoiPending != 0) {
+		lpEstimator->bRoiPending = 0;
+		e = blobEstimatorSetRoi(lpEstimator, (lpEstimator->bRoiPendingFull != 0) ? NULL : &(lpEstimator->roiPending));
+		if(e != cameraE_Ok) {
+			return e;
+		}
+	}
+
+	/* Waiting for (and discarding) frames exposed before the deadline */
+	if(lpNotBefore != NULL) {
+		frameTraceBegin("settle");
+	}
+
+	for(;;) {
+		int bAccept = 1;
+
+		e = captureDeviceDequeue(&(lpEstimator->device), &(lpEstimator->buf), lpSettings->dwTimeoutMs);
+		if(e != cameraE_Ok) {
+			if(lpNotBefore != NULL) { frameTraceEnd("settle"); }
+			return e;
+		}
+		lpEstimator->bHaveBuffer = 1;
+
+		if(lpNotBefore != NULL) {
+			int iGate = captureDeviceFrameStartedAfter(&(lpEstimator->device), &(lpEstimator->buf), lpNotBefore);
+
+			if((iGate < 0) || (lpResultOut->dwDiscarded >= BLOBESTIMATOR_MAX_DISCARDED)) {
+				/*
+					Timestamps not usable: wait for the deadline and drop
+					the frame we hold, the next one is exposed afterwards
+				*/
+				blobEstimatorSleepUntil(lpNotBefore);
+				lpNotBefore = NULL;
+				lpResultOut->dwDiscarded = lpResultOut->dwDiscarded + 1;
+				frameTraceEnd("settle");
+				e = blobEstimatorRelease(lpEstimator);
+				if(e != cameraE_Ok) {
+					return e;
+				}
+				continue;
+			}
+			if(iGate == 0) {
+				lpResultOut->dwDiscarded = lpResultOut->dwDiscarded + 1;
+				e = blobEstimatorRelease(lpEstimator);
+				if(e != cameraE_Ok) {
+					frameTraceEnd("settle");
+					return e;
+				}
+				continue;
+			}
+			frameTraceEnd("settle");
+			lpNotBefore = NULL;
+		}
+
+		lpResultOut->dwAttempts = lpResultOut->dwAttempts + 1;
+		dwFrameExposure = (lpEstimator->bExposureControl != 0) ? lpEstimator->exposure.dwExposure : -1;
+
+		if(captureFrameToLuma(&(lpEstimator->img), lpEstimator->device.pixelFormat, (unsigned char*)(captureDeviceBufferData(&(lpEstimator->device), &(lpEstimator->buf))), lpEstimator->buf.bytesused, lpEstimator->device.width, lpEstimator->device.height, lpEstimator->device.bytesPerLine) != 0) {
+			/*
+				Truncated or corrupt frame: the luma image still holds the
+				previous frame, so this attempt is dropped
+			*/
+			#ifdef DEBUG
+				printf("%s:%u Failed to convert frame\n", __FILE__, __LINE__);
+			#endif
+			bHavePrevious = 0;
+			e = blobEstimatorRelease(lpEstimator);
+			if(e != cameraE_Ok) {
+				return e;
+			}
+			if(lpResultOut->dwAttempts >= lpSettings->dwMaxAttempts) {
+				return cameraE_Failed;
+			}
+			continue;
+		}
+		iDetectResult = blobDetect(&(lpEstimator->img), &(lpSettings->detector), &(lpEstimator->scratch), &(lpResultOut->blob));
+		/* Only the region tracking requires a beam above the background */
+		bBeam = ((iDetectResult == 0) && (blobResultSignificant(&(lpResultOut->blob)) != 0)) ? 1 : 0;
+
+		if(blobEstimatorRoiActive(lpEstimator) != 0) {
+			if((bBeam == 0) || (blobEstimatorRoiClipped(lpEstimator, &(lpResultOut->blob)) != 0)) {
+				/* Lost or cut by the region: acquire again on the full frame */
+				e = blobEstimatorRelease(lpEstimator);
+				if(e != cameraE_Ok) {
+					return e;
+				}
+				e = blobEstimatorSetRoi(lpEstimator, NULL);
+				if(e != cameraE_Ok) {
+					return e;
+				}
+				bHavePrevious = 0;
+				continue;
+			}
+		}
+
+		if((iDetectResult != 0) || (lpResultOut->dwAttempts >= lpSettings->dwMaxAttempts)) {
+			/* Still feed the last frame into the controller so the next grab starts better */
+			if((iDetectResult == 0) && (lpEstimator->bExposureControl != 0)) {
+				exposureControllerUpdate(&(lpEstimator->exposure), &(lpResultOut->blob));
+			}
+			break;
+		}
+
+		if(lpEstimator->bExposureControl != 0) {
+			if(exposureControllerUpdate(&(lpEstimator->exposure), &(lpResultOut->blob)) > 0) {
+				/* Badly exposed, discard and capture again */
+				#ifdef DEBUG
+					printf("%s:%u Discarding frame with peak %u (%lu saturated) at exposure %d, retrying with %d\n", __FILE__, __LINE__, lpResultOut->blob.dwPeakValue, lpResultOut->blob.dwSaturatedPixels, dwFrameExposure, lpEstimator->exposure.dwExposure);
+				#endif
+				bAccept = 0;
+				bHavePrevious = 0;
+			}
+		}
+
+		if((bAccept != 0) && (lpSettings->dStabilityTolerance > 0)) {
+			if((bHavePrevious == 0) || (blobResultRelativeChange(&resPrevious, &(lpResultOut->blob)) > lpSettings->dStabilityTolerance)) {
+				bAccept = 0;
+			}
+			memcpy(&resPrevious, &(lpResultOut->blob), sizeof(struct blobResult));
+			bHavePrevious = 1;
+		}
+
+		if(bAccept != 0) {
+			break;
+		}
+
+		e = blobEstimatorRelease(lpEstimator);
+		if(e != cameraE_Ok) {
+			return e;
+		}
+	}
+
+	lpResultOut->bDetected = (iDetectResult == 0) ? 1 : 0;
+	lpResultOut->roi = lpEstimator->device.roi;
+	if(lpResultOut->bDetected != 0) {
+		blobResultOffset(&(lpResultOut->blob), (long int)lpResultOut->roi.xMin, (long int)lpResultOut->roi.yMin);
+		if((bBeam != 0) && (lpSettings->dwRoiMargin > 0) && (lpEstimator->device.bCropSupported != 0)) {
+			blobEstimatorRoiFollow(lpEstimator, &(lpResultOut->blob));
+		}
+	}
+	lpResultOut->dwExposure = dwFrameExposure;
+	lpResultOut->dwSequence = lpEstimator->buf.sequence;
+	lpResultOut->tvTimestamp = lpEstimator->buf.timestamp;
+	return cameraE_Ok;
+}
+
+const struct imgRawImage* blobEstimatorImage(
+	struct blobEstimator* lpEstimator
+) {
+	if(lpEstimator == NULL) {
+		return NULL;
+	}
+	return &(lpEstimator->img);
+}
+
+const struct blobDetectorScratch* blobEstimatorScratch(
+	struct blobEstimator* lpEstimator
+) {
+	if(lpEstimator == NULL) {
+		return NULL;
+	}
+	return &(lpEstimator->scratch);
+}
+
+int blobEstimatorRawFrame(
+	struct blobEstimator* lpEstimator,
+	void** lpDataOut,
+	size_t* lpLenOut
+) {
+	if((lpEstimator == NULL) || (lpDataOut == NULL) || (lpLenOut == NULL)) {
+		return 1;
+	}
+	if(lpEstimator->bHaveBuffer == 0) {
+		return 1;
+	}
+	(*lpDataOut) = captureDeviceBufferData(&(lpEstimator->device), &(lpEstimator->buf));
+	(*lpLenOut) = lpEstimator->buf.bytesused;
+	return 0;
+}
+
+const struct captureDevice* blobEstimatorDevice(
+	struct blobEstimator* lpEstimator
+) {
+	if(lpEstimator == NULL) {
+		return NULL;
+	}
+	return &(lpEstimator->device);
+}
+
+enum cameraError blobEstimatorClose(
+	struct blobEstimator* lpEstimator
+) {
+	enum cameraError e;
+
+	if(lpEstimator == NULL) {
+		return cameraE_InvalidParam;
+	}
+
+	if(lpEstimator->bExposureControl != 0) {
+		exposureControllerRelease(&(lpEstimator->exposure));
+		lpEstimator->bExposureControl = 0;
+	}
+
+	/* Streaming is stopped by the close, held buffers need no requeue */
+	e = captureDeviceClose(&(lpEstimator->device));
+
+	blobDetectorScratchRelease(&(lpEstimator->scratch));
+	free(lpEstimator->img.lpLuma);
+	free(lpEstimator);
+
+	return e;
+}
@@ -0,0 +1,171 @@
+#ifndef __BLOBESTIMATOR_H__
+#define __BLOBESTIMATOR_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./captureDevice.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Reusable capture and detection context (libwebcamBlobEstimator)
+
+	The context owns the capture device, it's buffers, the luma image,
+	the detector scratch memory and the optional exposure controller.
+	Everything is set up by blobEstimatorOpen and reused by every call
+	to blobEstimatorGrab, so an embedding application pays the setup
+	cost once; after the first frame grabbing does not allocate.
+
+	Typical use:
+
+		struct blobEstimator* lpEstimator;
+		struct blobEstimatorResult result;
+
+		blobEstimatorOpen(&lpEstimator, "/dev/video0", NULL);
+		blobEstimatorConfigure(lpEstimator, &settings);
+		for(...) {
+			blobEstimatorGrab(lpEstimator, NULL, &result);
+		}
+		blobEstimatorClose(lpEstimator);
+
+	A context must not be used by several threads at the same time.
+*/
+struct blobEstimator;
+
+/*
+	Runtime settings, may be changed between grabs:
+
+		detector				Detector thresholds
+		dExposureTarget			Closed loop exposure control target peak
+								(of 255), 0 keeps the camera exposure
+		dStabilityTolerance		Only accept a frame once the relative
+								change of the blob metrics to the previous
+								frame is below this limit (0 disables)
+		dwMaxAttempts			Maximum number of frames analyzed per grab
+								while exposure or stability converge
+		dwTimeoutMs				Maximum time to wait for a single frame
+								(0 waits forever)
+		dwRoiMargin				If not 0 the sensor only reads out the
+								cluster bounds of the last grab plus this
+								margin (pixels on every side). The region
+								follows the blob; if the blob is lost (no
+								significant cluster, see
+								blobResultSignificant) or cut by the region
+								edge the frame is captured again at full
+								size. Requires a driver that supports
+								cropping
+*/
+struct blobEstimatorSettings {
+	struct blobDetectorParams	detector;
+	double						dExposureTarget;
+	double						dStabilityTolerance;
+	unsigned long int			dwMaxAttempts;
+	unsigned long int			dwTimeoutMs;
+	unsigned long int			dwRoiMargin;
+};
+
+#define BLOBESTIMATOR_DEFAULT_MAXATTEMPTS		6
+#define BLOBESTIMATOR_MAX_DISCARDED				100
+
+/*
+	Result of one grab. bDetected is 0 if no cluster has been found in
+	the accepted frame (blob is undefined then). dwExposure is the
+	absolute exposure of the frame (-1 without exposure control),
+	dwAttempts the number of analyzed frames and dwDiscarded the
+	number of frames dropped because they started before lpNotBefore.
+	blob is given in full frame coordinates, roi is the position of the
+	accepted frame (the image, raw data and detector scratch of the
+	context) within the full frame
+*/
+struct blobEstimatorResult {
+	int							bDetected;
+	struct blobResult			blob;
+	struct rectBound			roi;
+
+	int							dwExposure;
+	unsigned long int			dwAttempts;
+	unsigned long int			dwDiscarded;
+
+	uint32_t					dwSequence;
+	struct timeval				tvTimestamp;
+};
+
+void blobEstimatorSettingsDefault(struct blobEstimatorSettings* lpSettings);
+
+/*
+	Opens and starts the capture device in the mode negotiated for
+	lpRequest (NULL uses the defaults) with default settings
+*/
+enum cameraError blobEstimatorOpen(
+	struct blobEstimator** lpEstimatorOut,
+	char* lpDeviceName,
+	const struct captureDeviceFormatRequest* lpRequest
+);
+
+/*
+	Applies new settings. Enabling exposure control switches the
+	camera into manual exposure, disabling it restores the previous
+	mode
+*/
+enum cameraError blobEstimatorConfigure(
+	struct blobEstimator* lpEstimator,
+	const struct blobEstimatorSettings* lpSettings
+);
+
+/*
+	Captures frames until one is usable and runs the detection on it.
+	With region of interest tracking the region for the next grab is
+	chosen from the result and programmed at the start of that grab.
+	If lpNotBefore (CLOCK_MONOTONIC) is given frames whose exposure
+	started earlier are discarded - for cameras without monotonic
+	timestamps the call sleeps until lpNotBefore and discards a single
+	frame instead. The accepted frame (raw data, luma image and the
+	detector projections) stays available until the next grab. Frames
+	that cannot be converted (truncated or corrupt) are dropped and
+	count as attempts; cameraE_Failed is returned if the attempts run
+	out on such a frame
+*/
+enum cameraError blobEstimatorGrab(
+	struct blobEstimator* lpEstimator,
+	const struct timespec* lpNotBefore,
+	struct blobEstimatorResult* lpResultOut
+);
+
+/*
+	Access to the last accepted frame
+*/
+const struct imgRawImage* blobEstimatorImage(
+	struct blobEstimator* lpEstimator
+);
+const struct blobDetectorScratch* blobEstimatorScratch(
+	struct blobEstimator* lpEstimator
+);
+int blobEstimatorRawFrame(
+	struct blobEstimator* lpEstimator,
+	void** lpDataOut,
+	size_t* lpLenOut
+);
+
+/*
+	Capture device of the context (negotiated mode and statistics)
+*/
+const struct captureDevice* blobEstimatorDevice(
+	struct blobEstimator* lpEstimator
+);
+
+enum cameraError blobEstimatorClose(
+	struct blobEstimator* lpEstimator
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __BLOBESTIMATOR_H__ */
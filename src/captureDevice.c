@@ -0,0 +1,1452 @@
+/*
+	V4L2 capture device handling
+
+	Opening, format negotiation, buffer mapping and streaming of a
+	single capture device. Every device owns it's own buffer ring and
+	kqueue so several devices can be captured from independent threads.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <math.h>
+
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/event.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+
+#include <linux/videodev2.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./jpegFile.h"
+#include "./captureDevice.h"
+#include "./frameTrace.h"
+#include "./realtime.h"
+
+/*
+  Wrapper around ioctl that repeats the calls in case
+  they are interrupted by a signal (i.e. restarts) until
+  they succeed or fail.
+*/
+static int xioctl(int fh, int request, void* arg) {
+	int r;
+	do {
+		r = ioctl(fh, request, arg);
+	} while((r == -1) && (errno == EINTR));
+	return r;
+}
+
+/*
+	Exposure control:
+		V4L2 knows 4 exposure modes:
+
+		| Mode							  | Exposure | Aperture |
+		| ------------------------------- | -------- | -------- |
+		| V4L2_EXPOSURE_AUTO			  | Auto     | Auto     |
+		| V4L2_EXPOSURE_MANUAL			  | Manual   | Manual   |
+		| V4L2_EXPOSURE_SHUTTER_PRIORITY  | Manual   | Auto     |
+		| V4L2_EXPOSURE_APERTURE_PRIORITY | Auto     | Manual   |
+*/
+
+int getExposureMode(int fh) {
+	struct v4l2_control ctrl;
+
+	memset(&ctrl, 0, sizeof(struct v4l2_control));
+
+	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
+
+	if(xioctl(fh, VIDIOC_G_CTRL, &ctrl) == -1) {
+		perror("Failed getting current exposure mode");
+		return -1;
+	}
+
+	return ctrl.value;
+}
+int setExposureMode(int fh, int mode) {
+	struct v4l2_control ctrl;
+
+	memset(&ctrl, 0, sizeof(struct v4l2_control));
+
+	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
+	ctrl.value = mode;
+
+	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
+		perror("Failed getting current exposure mode");
+		return -1;
+	}
+
+	return 0;
+}
+
+int setExposureManual(int fh) {
+	struct v4l2_control ctrl;
+
+	memset(&ctrl, 0, sizeof(struct v4l2_control));
+
+	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
+	ctrl.value = V4L2_EXPOSURE_MANUAL;
+
+	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
+		perror("Setting V4L2_CID_EXPOSURE_AUTO to V4L2_EXPOSURE_MANUAL");
+		return -1;
+	}
+
+	return 0;
+}
+
+int setExposureAuto(int fh) {
+	struct v4l2_control ctrl;
+
+	memset(&ctrl, 0, sizeof(struct v4l2_control));
+
+	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
+	ctrl.value = V4L2_EXPOSURE_AUTO;
+
+	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
+		perror("Setting V4L2_CID_EXPOSURE_AUTO to V4L2_EXPOSURE_MANUAL");
+		return -1;
+	}
+
+	return 0;
+}
+
+int getExposureAbsolute(int fh) {
+	struct v4l2_control ctrl;
+
+	memset(&ctrl, 0, sizeof(struct v4l2_control));
+
+	ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+	ctrl.value = ~0;
+
+	if (xioctl(fh,VIDIOC_G_CTRL,&ctrl) == -1) {
+      perror("Getting V4L2_CID_EXPOSURE_ABSOLUTE");
+	  return -1;
+	}
+
+	return ctrl.value;
+}
+
+int setExposureAbsolute(int fh, int exposureValue) {
+	struct v4l2_control ctrl;
+
+	memset(&ctrl, 0, sizeof(struct v4l2_control));
+
+	ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+	ctrl.value = exposureValue;
+
+	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
+		perror("Setting V4L2_CID_EXPOSURE_ABSOLUTE");
+		return -1;
+	}
+	return 0;
+}
+
+int getExposureAbsoluteRange(int fh, int* lpMin, int* lpMax) {
+	struct v4l2_queryctrl qctrl;
+
+	memset(&qctrl, 0, sizeof(struct v4l2_queryctrl));
+
+	qctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
+
+	if(xioctl(fh, VIDIOC_QUERYCTRL, &qctrl) == -1) {
+		perror("Querying V4L2_CID_EXPOSURE_ABSOLUTE");
+		return -1;
+	}
+	if((qctrl.flags & V4L2_CTRL_FLAG_DISABLED) != 0) {
+		return -1;
+	}
+
+	if(lpMin != NULL) { (*lpMin) = qctrl.minimum; }
+	if(lpMax != NULL) { (*lpMax) = qctrl.maximum; }
+	return 0;
+}
+
+/*
+  Open the device file (first check it exists, is
+  a device file, etc.)
+*/
+static char* deviceOpen_DefaultFilename = "/dev/video0";
+static enum cameraError deviceOpen(
+	int* lpDeviceOut,
+	char* deviceName
+) {
+	struct stat st;
+	int hHandle;
+
+	if(lpDeviceOut == NULL) {
+		return cameraE_InvalidParam;
+	}
+	(*lpDeviceOut) = -1;
+
+	if(deviceName == NULL) {
+		deviceName = deviceOpen_DefaultFilename;
+	}
+
+	/*
+		First check that the file exists and that we
+		are really seeing a device file
+	*/
+	if(stat(deviceName, &st) == -1) {
+		return cameraE_UnknownDevice;
+	}
+
+	if(!S_ISCHR(st.st_mode)) {
+		return cameraE_UnknownDevice;
+	}
+
+	hHandle = open(deviceName, O_RDWR|O_NONBLOCK, 0);
+	if(hHandle < 0) {
+		switch(errno) {
+			case EACCES:	return cameraE_PermissionDenied;
+			case EPERM:		return cameraE_PermissionDenied;
+			default:		return cameraE_Failed;
+		}
+	}
+
+	(*lpDeviceOut) = hHandle;
+	return cameraE_Ok;
+}
+
+static enum cameraError deviceClose(
+	int hHandle
+) {
+	if(hHandle < 0) { return cameraE_InvalidParam; }
+	close(hHandle);
+	return cameraE_Ok;
+}
+
+void captureDeviceFormatRequestDefault(struct captureDeviceFormatRequest* lpRequest) {
+	if(lpRequest == NULL) {
+		return;
+	}
+	lpRequest->dwMinWidth = CAPTUREDEVICE_DEFAULT_WIDTH;
+	lpRequest->dwMinHeight = CAPTUREDEVICE_DEFAULT_HEIGHT;
+	lpRequest->dTargetFps = 0;
+	lpRequest->pixelFormat = 0;
+	lpRequest->memory = captureDeviceMemory_MMap;
+	lpRequest->bHugePages = 0;
+}
+
+static enum v4l2_memory captureDeviceV4L2Memory(enum captureDeviceMemory memory) {
+	return (memory == captureDeviceMemory_UserPtr) ? V4L2_MEMORY_USERPTR : V4L2_MEMORY_MMAP;
+}
+
+/*
+	Allocates one anonymous pool for all USERPTR buffers. Every buffer
+	starts at a multiple of the alignment so kernels can use aligned
+	loads. Huge pages are tried explicitly (MAP_HUGETLB) first, then
+	transparently (MADV_HUGEPAGE or FreeBSD superpages), then plain pages
+*/
+static int captureDeviceUserPtrAlloc(
+	struct captureDevice* lpDevice,
+	int bHugePages
+) {
+	size_t sPage = (size_t)sysconf(_SC_PAGESIZE);
+	size_t sAlign = (bHugePages != 0) ? CAPTUREDEVICE_HUGEPAGE_SIZE : sPage;
+	size_t sStride = ((lpDevice->sizeImage + sAlign - 1) / sAlign) * sAlign;
+	int iBuf;
+
+	lpDevice->sPoolLen = sStride * lpDevice->bufferCount;
+	lpDevice->lpPool = MAP_FAILED;
+
+	if(bHugePages != 0) {
+		#ifdef MAP_HUGETLB
+			lpDevice->lpPool = mmap(NULL, lpDevice->sPoolLen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		#endif
+		#ifdef MAP_ALIGNED_SUPER
+			if(lpDevice->lpPool == MAP_FAILED) {
+				lpDevice->lpPool = mmap(NULL, lpDevice->sPoolLen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_ALIGNED_SUPER, -1, 0);
+			}
+		#endif
+	}
+	if(lpDevice->lpPool == MAP_FAILED) {
+		lpDevice->lpPool = mmap(NULL, lpDevice->sPoolLen, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(lpDevice->lpPool == MAP_FAILED) {
+			printf("%s:%u Failed to allocate %lu bytes of capture buffers\n", __FILE__, __LINE__, (unsigned long int)lpDevice->sPoolLen);
+			return 1;
+		}
+		#ifdef MADV_HUGEPAGE
+			if(bHugePages != 0) {
+				madvise(lpDevice->lpPool, lpDevice->sPoolLen, MADV_HUGEPAGE);
+			}
+		#endif
+	}
+	realtimePrefault(lpDevice->lpPool, lpDevice->sPoolLen);
+
+	for(iBuf = 0; iBuf < lpDevice->bufferCount; iBuf = iBuf + 1) {
+		lpDevice->lpBuffers[iBuf].lpBase = (void*)(((unsigned char*)lpDevice->lpPool) + sStride * iBuf);
+		lpDevice->lpBuffers[iBuf].sLen = lpDevice->sizeImage;
+	}
+	return 0;
+}
+
+/*
+	Formats the pipeline can process in order of preference. MJPEG
+	is last since every frame has to be decoded
+*/
+static const uint32_t captureDeviceFormats[] = {
+	V4L2_PIX_FMT_YUYV,
+	V4L2_PIX_FMT_GREY,
+	V4L2_PIX_FMT_MJPEG
+};
+#define CAPTUREDEVICE_FORMAT_COUNT (sizeof(captureDeviceFormats) / sizeof(uint32_t))
+
+static const char* captureDeviceFormatName(uint32_t pixelFormat) {
+	switch(pixelFormat) {
+		case V4L2_PIX_FMT_YUYV:		return "YUYV";
+		case V4L2_PIX_FMT_GREY:		return "GREY";
+		case V4L2_PIX_FMT_MJPEG:	return "MJPEG";
+		default:					return "unknown";
+	}
+}
+
+int captureParsePixelFormat(const char* lpName, uint32_t* lpFormatOut) {
+	if((lpName == NULL) || (lpFormatOut == NULL)) {
+		return 1;
+	}
+	if(strcasecmp(lpName, "yuyv") == 0) { (*lpFormatOut) = V4L2_PIX_FMT_YUYV; return 0; }
+	if(strcasecmp(lpName, "grey") == 0) { (*lpFormatOut) = V4L2_PIX_FMT_GREY; return 0; }
+	if(strcasecmp(lpName, "mjpeg") == 0) { (*lpFormatOut) = V4L2_PIX_FMT_MJPEG; return 0; }
+	if(strcasecmp(lpName, "any") == 0) { (*lpFormatOut) = 0; return 0; }
+	return 1;
+}
+
+struct captureDeviceMode {
+	unsigned long int		dwFormatRank;
+	uint32_t				pixelFormat;
+	unsigned long int		width;
+	unsigned long int		height;
+	struct v4l2_fract		interval;		/* 0/0 if the driver does not enumerate intervals */
+};
+
+static double captureDeviceModeFps(const struct captureDeviceMode* lpMode) {
+	if((lpMode->interval.numerator == 0) || (lpMode->interval.denominator == 0)) {
+		return 0;
+	}
+	return ((double)lpMode->interval.denominator) / ((double)lpMode->interval.numerator);
+}
+
+/*
+	Returns nonzero if lpCandidate is a better match for the request
+	than lpBest
+*/
+static int captureDeviceModeBetter(
+	const struct captureDeviceMode* lpCandidate,
+	const struct captureDeviceMode* lpBest,
+	const struct captureDeviceFormatRequest* lpRequest
+) {
+	double dFpsCand = captureDeviceModeFps(lpCandidate);
+	double dFpsBest = captureDeviceModeFps(lpBest);
+	unsigned long int dwPixCand = lpCandidate->width * lpCandidate->height;
+	unsigned long int dwPixBest = lpBest->width * lpBest->height;
+	int bResCand = (lpCandidate->width >= lpRequest->dwMinWidth) && (lpCandidate->height >= lpRequest->dwMinHeight);
+	int bResBest = (lpBest->width >= lpRequest->dwMinWidth) && (lpBest->height >= lpRequest->dwMinHeight);
+	int bFpsCand = (lpRequest->dTargetFps <= 0) || (dFpsCand >= lpRequest->dTargetFps * 0.999);
+	int bFpsBest = (lpRequest->dTargetFps <= 0) || (dFpsBest >= lpRequest->dTargetFps * 0.999);
+
+	/* Minimum resolution first, then frame rate */
+	if(bResCand != bResBest) { return bResCand; }
+	if(bResCand == 0) {
+		/* Nothing large enough: get as close as possible */
+		if(dwPixCand != dwPixBest) { return dwPixCand > dwPixBest; }
+		return dFpsCand > dFpsBest;
+	}
+	if(bFpsCand != bFpsBest) { return bFpsCand; }
+	if((bFpsCand == 0) || (lpRequest->dTargetFps <= 0)) {
+		/* Target not reachable or no target: fastest mode */
+		if(dFpsCand != dFpsBest) { return dFpsCand > dFpsBest; }
+	}
+
+	if(lpCandidate->dwFormatRank != lpBest->dwFormatRank) { return lpCandidate->dwFormatRank < lpBest->dwFormatRank; }
+	if(dwPixCand != dwPixBest) { return dwPixCand < dwPixBest; }
+
+	/* Same format and size: slowest interval that still meets the target, else the fastest */
+	if(lpRequest->dTargetFps > 0) {
+		return dFpsCand < dFpsBest;
+	}
+	return dFpsCand > dFpsBest;
+}
+
+static void captureDeviceConsiderMode(
+	struct captureDeviceMode* lpCandidate,
+	struct captureDeviceMode* lpBest,
+	int* lpHaveBest,
+	const struct captureDeviceFormatRequest* lpRequest
+) {
+	#ifdef DEBUG
+		printf("\t%s %lu x %lu at %lf fps\n", captureDeviceFormatName(lpCandidate->pixelFormat), lpCandidate->width, lpCandidate->height, captureDeviceModeFps(lpCandidate));
+	#endif
+	if(((*lpHaveBest) == 0) || captureDeviceModeBetter(lpCandidate, lpBest, lpRequest)) {
+		memcpy(lpBest, lpCandidate, sizeof(struct captureDeviceMode));
+		(*lpHaveBest) = 1;
+	}
+}
+
+/*
+	Enumerates the frame intervals of one frame size. Stepwise and
+	continuous ranges are reduced to the interval matching the target
+	frame rate (clamped into the range) or the fastest one
+*/
+static void captureDeviceEnumIntervals(
+	struct captureDevice* lpDevice,
+	struct captureDeviceMode* lpCandidate,
+	struct captureDeviceMode* lpBest,
+	int* lpHaveBest,
+	const struct captureDeviceFormatRequest* lpRequest
+) {
+	struct v4l2_frmivalenum ival;
+	int idx;
+
+	for(idx = 0;; idx = idx + 1) {
+		memset(&ival, 0, sizeof(ival));
+		ival.index = idx;
+		ival.pixel_format = lpCandidate->pixelFormat;
+		ival.width = lpCandidate->width;
+		ival.height = lpCandidate->height;
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_ENUM_FRAMEINTERVALS, &ival) == -1) {
+			break;
+		}
+
+		if(ival.type == V4L2_FRMIVAL_TYPE_DISCRETE) {
+			lpCandidate->interval = ival.discrete;
+			captureDeviceConsiderMode(lpCandidate, lpBest, lpHaveBest, lpRequest);
+			continue;
+		}
+
+		/* Stepwise or continuous */
+		lpCandidate->interval = ival.stepwise.min;
+		if(lpRequest->dTargetFps > 0) {
+			double dMaxFps = ((double)ival.stepwise.min.denominator) / ((double)ival.stepwise.min.numerator);
+			double dMinFps = ((double)ival.stepwise.max.denominator) / ((double)ival.stepwise.max.numerator);
+
+			if(lpRequest->dTargetFps < dMinFps) {
+				lpCandidate->interval = ival.stepwise.max;
+			} else if(lpRequest->dTargetFps < dMaxFps) {
+				lpCandidate->interval.numerator = 1000;
+				lpCandidate->interval.denominator = (uint32_t)(lpRequest->dTargetFps * 1000.0 + 0.5);
+			}
+		}
+		captureDeviceConsiderMode(lpCandidate, lpBest, lpHaveBest, lpRequest);
+		break;
+	}
+
+	if(idx == 0) {
+		/* Driver does not enumerate intervals */
+		lpCandidate->interval.numerator = 0;
+		lpCandidate->interval.denominator = 0;
+		captureDeviceConsiderMode(lpCandidate, lpBest, lpHaveBest, lpRequest);
+	}
+}
+
+static unsigned long int captureDeviceStepUp(unsigned long int dwValue, unsigned long int dwMin, unsigned long int dwMax, unsigned long int dwStep) {
+	if(dwValue < dwMin) { dwValue = dwMin; }
+	if(dwStep > 1) { dwValue = dwMin + ((dwValue - dwMin + dwStep - 1) / dwStep) * dwStep; }
+	if(dwValue > dwMax) { dwValue = dwMax; }
+	return dwValue;
+}
+
+/*
+	Takes size, pixel format, line length and buffer size from the
+	format the driver reports
+*/
+static void captureDeviceStoreFormat(
+	struct captureDevice* lpDevice,
+	const struct v4l2_format* lpFormat
+) {
+	lpDevice->width = lpFormat->fmt.pix.width;
+	lpDevice->height = lpFormat->fmt.pix.height;
+	lpDevice->pixelFormat = lpFormat->fmt.pix.pixelformat;
+	lpDevice->bytesPerLine = lpFormat->fmt.pix.bytesperline;
+	if(lpDevice->bytesPerLine == 0) {
+		if(lpDevice->pixelFormat == V4L2_PIX_FMT_YUYV) {
+			lpDevice->bytesPerLine = lpDevice->width * 2;
+		} else if(lpDevice->pixelFormat == V4L2_PIX_FMT_GREY) {
+			lpDevice->bytesPerLine = lpDevice->width;
+		}
+	}
+	lpDevice->sizeImage = (lpFormat->fmt.pix.sizeimage != 0) ? lpFormat->fmt.pix.sizeimage : lpDevice->bytesPerLine * lpDevice->height;
+	if(lpDevice->sizeImage == 0) {
+		lpDevice->sizeImage = lpDevice->width * lpDevice->height * 2; /* Upper bound for MJPEG */
+	}
+}
+
+static int captureDeviceNegotiate(
+	struct captureDevice* lpDevice,
+	const struct captureDeviceFormatRequest* lpRequest
+) {
+	struct captureDeviceMode best;
+	struct captureDeviceMode candidate;
+	int bHaveBest = 0;
+	unsigned long int dwRank;
+
+	memset(&best, 0, sizeof(best));
+
+	#ifdef DEBUG
+		printf("Doing format negotiation\n");
+	#endif
+
+	/*
+		Enumerate all formats the device offers and for every format
+		we can process all frame sizes and intervals
+	*/
+	{
+		int idx;
+		for(idx = 0;; idx = idx + 1) {
+			struct v4l2_fmtdesc fmt;
+
+			memset(&fmt, 0, sizeof(fmt));
+			fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			fmt.index = idx;
+
+			if(xioctl(lpDevice->hHandle, VIDIOC_ENUM_FMT, &fmt) == -1) {
+				#ifdef DEBUG
+					printf("Done enumeration after %u formats\n", idx);
+				#endif
+				break;
+			}
+
+			#ifdef DEBUG
+				printf("\tFormat %u with code %08x (compressed: %s): %s\n", idx, fmt.pixelformat, ((fmt.flags & V4L2_FMT_FLAG_COMPRESSED) != 0) ? "yes" : "no", fmt.description);
+			#endif
+
+			for(dwRank = 0; dwRank < CAPTUREDEVICE_FORMAT_COUNT; dwRank=dwRank+1) {
+				if(captureDeviceFormats[dwRank] == fmt.pixelformat) { break; }
+			}
+			if(dwRank >= CAPTUREDEVICE_FORMAT_COUNT) {
+				continue;
+			}
+			if((lpRequest->pixelFormat != 0) && (lpRequest->pixelFormat != fmt.pixelformat)) {
+				continue;
+			}
+
+			int iSize;
+			for(iSize = 0;; iSize = iSize + 1) {
+				struct v4l2_frmsizeenum fsize;
+
+				memset(&fsize, 0, sizeof(fsize));
+				fsize.index = iSize;
+				fsize.pixel_format = fmt.pixelformat;
+
+				if(xioctl(lpDevice->hHandle, VIDIOC_ENUM_FRAMESIZES, &fsize) == -1) {
+					break;
+				}
+
+				candidate.dwFormatRank = dwRank;
+				candidate.pixelFormat = fmt.pixelformat;
+
+				if(fsize.type == V4L2_FRMSIZE_TYPE_DISCRETE) {
+					candidate.width = fsize.discrete.width;
+					candidate.height = fsize.discrete.height;
+					captureDeviceEnumIntervals(lpDevice, &candidate, &best, &bHaveBest, lpRequest);
+					continue;
+				}
+
+				/* Stepwise or continuous: smallest size that satisfies the minimum */
+				candidate.width = captureDeviceStepUp(lpRequest->dwMinWidth, fsize.stepwise.min_width, fsize.stepwise.max_width, fsize.stepwise.step_width);
+				candidate.height = captureDeviceStepUp(lpRequest->dwMinHeight, fsize.stepwise.min_height, fsize.stepwise.max_height, fsize.stepwise.step_height);
+				captureDeviceEnumIntervals(lpDevice, &candidate, &best, &bHaveBest, lpRequest);
+				break;
+			}
+		}
+	}
+
+	if(bHaveBest == 0) {
+		/*
+			Driver does not enumerate frame sizes - simply request the
+			minimum size and let S_FMT adjust it
+		*/
+		best.pixelFormat = (lpRequest->pixelFormat != 0) ? lpRequest->pixelFormat : V4L2_PIX_FMT_YUYV;
+		best.width = lpRequest->dwMinWidth;
+		best.height = lpRequest->dwMinHeight;
+		best.interval.numerator = 0;
+		best.interval.denominator = 0;
+		if(lpRequest->dTargetFps > 0) {
+			best.interval.numerator = 1000;
+			best.interval.denominator = (uint32_t)(lpRequest->dTargetFps * 1000.0 + 0.5);
+		}
+	}
+
+	/*
+		Apply format and frame size
+	*/
+	{
+		struct v4l2_format fmt;
+
+		memset(&fmt, 0, sizeof(fmt));
+
+		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		fmt.fmt.pix.width = best.width;
+		fmt.fmt.pix.height = best.height;
+		fmt.fmt.pix.pixelformat = best.pixelFormat;
+		fmt.fmt.pix.field = V4L2_FIELD_ANY;
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_S_FMT, &fmt) == -1) {
+			printf("%s:%u Format negotiation (S_FMT) failed!\n", __FILE__, __LINE__);
+			return 1;
+		}
+
+		for(dwRank = 0; dwRank < CAPTUREDEVICE_FORMAT_COUNT; dwRank=dwRank+1) {
+			if(captureDeviceFormats[dwRank] == fmt.fmt.pix.pixelformat) { break; }
+		}
+		if(dwRank >= CAPTUREDEVICE_FORMAT_COUNT) {
+			printf("%s:%u Device delivers unsupported pixel format %08x\n", __FILE__, __LINE__, fmt.fmt.pix.pixelformat);
+			return 1;
+		}
+
+		/* Query the real size ... */
+		captureDeviceStoreFormat(lpDevice, &fmt);
+	}
+
+	/*
+		Apply the frame interval (if the driver supports it) and read back
+		what the driver really configured
+	*/
+	{
+		struct v4l2_streamparm parm;
+
+		lpDevice->dNominalFps = 0;
+
+		memset(&parm, 0, sizeof(parm));
+		parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_G_PARM, &parm) == 0) {
+			if(((parm.parm.capture.capability & V4L2_CAP_TIMEPERFRAME) != 0) && (best.interval.numerator != 0) && (best.interval.denominator != 0)) {
+				parm.parm.capture.timeperframe = best.interval;
+				if(xioctl(lpDevice->hHandle, VIDIOC_S_PARM, &parm) == -1) {
+					printf("%s:%u Setting frame interval (S_PARM) failed, continuing anyways\n", __FILE__, __LINE__);
+				}
+			}
+			if((parm.parm.capture.timeperframe.numerator != 0) && (parm.parm.capture.timeperframe.denominator != 0)) {
+				lpDevice->dNominalFps = ((double)parm.parm.capture.timeperframe.denominator) / ((double)parm.parm.capture.timeperframe.numerator);
+			}
+		}
+	}
+
+	printf("%s: %s %lu x %lu at %lf fps", lpDevice->lpDeviceName, captureDeviceFormatName(lpDevice->pixelFormat), lpDevice->width, lpDevice->height, lpDevice->dNominalFps);
+	if((lpRequest->dTargetFps > 0) && (lpDevice->dNominalFps < lpRequest->dTargetFps * 0.999)) {
+		printf(" (target of %lf fps not reachable)", lpRequest->dTargetFps);
+	}
+	if((lpDevice->width < lpRequest->dwMinWidth) || (lpDevice->height < lpRequest->dwMinHeight)) {
+		printf(" (below requested %lu x %lu)", lpRequest->dwMinWidth, lpRequest->dwMinHeight);
+	}
+	printf("\n");
+	return 0;
+}
+
+double captureDeviceDeliveredFps(
+	const struct captureDevice* lpDevice
+) {
+	double dSpan;
+
+	if((lpDevice == NULL) || (lpDevice->dwDelivered < 2)) {
+		return 0;
+	}
+	dSpan = (double)(lpDevice->tvLast.tv_sec - lpDevice->tvFirst.tv_sec) + ((double)(lpDevice->tvLast.tv_usec - lpDevice->tvFirst.tv_usec)) / 1e6;
+	if(dSpan <= 0) {
+		return 0;
+	}
+	return ((double)(lpDevice->dwDelivered - 1)) / dSpan;
+}
+
+static void captureDeviceTimingRecord(
+	struct captureDevice* lpDevice,
+	const struct v4l2_buffer* lpBuffer
+) {
+	struct captureDeviceTiming* lpTiming = &(lpDevice->timing);
+	struct timespec tsNow;
+	double dNowUsec;
+
+	clock_gettime(CLOCK_MONOTONIC, &tsNow);
+	dNowUsec = ((double)tsNow.tv_sec) * 1e6 + ((double)tsNow.tv_nsec) / 1e3;
+
+	if((lpBuffer->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+		double dLatency = dNowUsec - (((double)lpBuffer->timestamp.tv_sec) * 1e6 + (double)lpBuffer->timestamp.tv_usec);
+
+		if((lpTiming->dwLatencySamples == 0) || (dLatency < lpTiming->dLatencyMin)) { lpTiming->dLatencyMin = dLatency; }
+		if((lpTiming->dwLatencySamples == 0) || (dLatency > lpTiming->dLatencyMax)) { lpTiming->dLatencyMax = dLatency; }
+		lpTiming->dLatencySum = lpTiming->dLatencySum + dLatency;
+		lpTiming->dLatencySumSq = lpTiming->dLatencySumSq + dLatency * dLatency;
+		lpTiming->dwLatencySamples = lpTiming->dwLatencySamples + 1;
+	}
+
+	if(lpDevice->dwDelivered > 0) {
+		double dInterval = dNowUsec - (((double)lpTiming->tsLastDequeue.tv_sec) * 1e6 + ((double)lpTiming->tsLastDequeue.tv_nsec) / 1e3);
+
+		if((lpTiming->dwIntervalSamples == 0) || (dInterval < lpTiming->dIntervalMin)) { lpTiming->dIntervalMin = dInterval; }
+		if((lpTiming->dwIntervalSamples == 0) || (dInterval > lpTiming->dIntervalMax)) { lpTiming->dIntervalMax = dInterval; }
+		lpTiming->dIntervalSum = lpTiming->dIntervalSum + dInterval;
+		lpTiming->dIntervalSumSq = lpTiming->dIntervalSumSq + dInterval * dInterval;
+		lpTiming->dwIntervalSamples = lpTiming->dwIntervalSamples + 1;
+	}
+	lpTiming->tsLastDequeue = tsNow;
+}
+
+static double captureDeviceStdDev(double dSum, double dSumSq, unsigned long int dwSamples) {
+	double dMean, dVariance;
+
+	if(dwSamples < 2) { return 0; }
+	dMean = dSum / (double)dwSamples;
+	dVariance = (dSumSq - dMean * dSum) / (double)(dwSamples - 1);
+	return (dVariance > 0) ? sqrt(dVariance) : 0;
+}
+
+void captureDeviceTimingPrint(
+	FILE* fHandle,
+	const struct captureDevice* lpDevice
+) {
+	const struct captureDeviceTiming* lpTiming;
+
+	if((fHandle == NULL) || (lpDevice == NULL)) {
+		return;
+	}
+	lpTiming = &(lpDevice->timing);
+
+	if(lpTiming->dwLatencySamples > 0) {
+		fprintf(fHandle, "Dequeue latency: %lf us mean, %lf us jitter (stddev), %lf us min, %lf us max (%lu frames)\n",
+			lpTiming->dLatencySum / (double)lpTiming->dwLatencySamples,
+			captureDeviceStdDev(lpTiming->dLatencySum, lpTiming->dLatencySumSq, lpTiming->dwLatencySamples),
+			lpTiming->dLatencyMin,
+			lpTiming->dLatencyMax,
+			lpTiming->dwLatencySamples
+		);
+	} else {
+		fprintf(fHandle, "Dequeue latency: not available (no monotonic buffer timestamps)\n");
+	}
+	if(lpTiming->dwIntervalSamples > 0) {
+		fprintf(fHandle, "Dequeue interval: %lf us mean, %lf us jitter (stddev), %lf us min, %lf us max\n",
+			lpTiming->dIntervalSum / (double)lpTiming->dwIntervalSamples,
+			captureDeviceStdDev(lpTiming->dIntervalSum, lpTiming->dIntervalSumSq, lpTiming->dwIntervalSamples),
+			lpTiming->dIntervalMin,
+			lpTiming->dIntervalMax
+		);
+	}
+}
+
+int captureDeviceFrameStartedAfter(
+	struct captureDevice* lpDevice,
+	const struct v4l2_buffer* lpBuffer,
+	const struct timespec* lpNotBefore
+) {
+	long long int lStartUsec;
+	long long int lNotBeforeUsec;
+
+	if((lpDevice == NULL) || (lpBuffer == NULL) || (lpNotBefore == NULL)) {
+		return -1;
+	}
+	if((lpBuffer->flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) != V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+		return -1;
+	}
+
+	lStartUsec = ((long long int)lpBuffer->timestamp.tv_sec) * 1000000LL + (long long int)lpBuffer->timestamp.tv_usec;
+	if((lpBuffer->flags & V4L2_BUF_FLAG_TSTAMP_SRC_MASK) == V4L2_BUF_FLAG_TSTAMP_SRC_EOF) {
+		/* Timestamp taken after readout, exposure started up to one frame earlier */
+		double dFps = (lpDevice->dNominalFps > 0) ? lpDevice->dNominalFps : 30.0;
+		lStartUsec = lStartUsec - (long long int)(1000000.0 / dFps);
+	}
+	lNotBeforeUsec = ((long long int)lpNotBefore->tv_sec) * 1000000LL + (long long int)(lpNotBefore->tv_nsec / 1000);
+
+	return (lStartUsec >= lNotBeforeUsec) ? 1 : 0;
+}
+
+static int captureFrameToLumaConvert(
+	struct imgRawImage* lpImage,
+	uint32_t pixelFormat,
+	const unsigned char* lpSrc,
+	size_t sLen,
+	unsigned long int width,
+	unsigned long int height,
+	unsigned long int bytesPerLine
+) {
+	unsigned long int row;
+
+	if((lpImage == NULL) || (lpSrc == NULL) || (lpImage->lpLuma == NULL)) {
+		return 1;
+	}
+
+	switch(pixelFormat) {
+		case V4L2_PIX_FMT_YUYV:
+			if(bytesPerLine == 0) { bytesPerLine = width * 2; }
+			if(sLen < bytesPerLine * (height - 1) + width * 2) { return 1; }
+			if(bytesPerLine == width * 2) {
+				convertYUYVToLuma(lpImage, lpSrc, width, height);
+			} else {
+				/* Padded lines: convert line by line */
+				unsigned char* lpLuma = lpImage->lpLuma;
+				for(row = 0; row < height; row=row+1) {
+					lpImage->lpLuma = &(lpLuma[row * width]);
+					convertYUYVToLuma(lpImage, &(lpSrc[row * bytesPerLine]), width, 1);
+				}
+				lpImage->lpLuma = lpLuma;
+				lpImage->height = height;
+			}
+			return 0;
+
+		case V4L2_PIX_FMT_GREY:
+			if(bytesPerLine == 0) { bytesPerLine = width; }
+			if(sLen < bytesPerLine * (height - 1) + width) { return 1; }
+			for(row = 0; row < height; row=row+1) {
+				memcpy(&(lpImage->lpLuma[row * width]), &(lpSrc[row * bytesPerLine]), width);
+			}
+			lpImage->width = width;
+			lpImage->height = height;
+			return 0;
+
+		case V4L2_PIX_FMT_MJPEG:
+			return decodeJpegLuma(lpImage, lpSrc, sLen, width, height);
+
+		default:
+			return 1;
+	}
+}
+
+int captureFrameToLuma(
+	struct imgRawImage* lpImage,
+	uint32_t pixelFormat,
+	const unsigned char* lpSrc,
+	size_t sLen,
+	unsigned long int width,
+	unsigned long int height,
+	unsigned long int bytesPerLine
+) {
+	int r;
+
+	frameTraceBegin("convert");
+	r = captureFrameToLumaConvert(lpImage, pixelFormat, lpSrc, sLen, width, height, bytesPerLine);
+	frameTraceEnd("convert");
+	return r;
+}
+
+/*
+	Requests, maps (or allocates) and queues the buffers for the current
+	format and starts streaming. Drivers that do not support user
+	pointers reject the request with EINVAL, then we use driver
+	allocated buffers. On failure the caller closes the device
+*/
+static enum cameraError captureDeviceStart(
+	struct captureDevice* lpDevice
+) {
+	/*
+		Setup buffers
+	*/
+	{
+		struct v4l2_requestbuffers rqBuffers;
+		int r;
+
+		memset(&rqBuffers, 0, sizeof(rqBuffers));
+		rqBuffers.count = lpDevice->dwBufferRequest;
+		rqBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		rqBuffers.memory = captureDeviceV4L2Memory(lpDevice->memory);
+
+		r = xioctl(lpDevice->hHandle, VIDIOC_REQBUFS, &rqBuffers);
+		if((r == -1) && (lpDevice->memory == captureDeviceMemory_UserPtr)) {
+			printf("%s:%u %s does not support user pointer buffers, using mmap\n", __FILE__, __LINE__, lpDevice->lpDeviceName);
+			lpDevice->memory = captureDeviceMemory_MMap;
+
+			memset(&rqBuffers, 0, sizeof(rqBuffers));
+			rqBuffers.count = lpDevice->dwBufferRequest;
+			rqBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			rqBuffers.memory = V4L2_MEMORY_MMAP;
+			r = xioctl(lpDevice->hHandle, VIDIOC_REQBUFS, &rqBuffers);
+		}
+		if((r == -1) || (rqBuffers.count == 0)) {
+			#ifdef DEBUG
+				printf("%s:%u Requesting buffers failed!\n", __FILE__, __LINE__);
+			#endif
+			return cameraE_Failed;
+		}
+
+		lpDevice->bufferCount = rqBuffers.count;
+	}
+	#ifdef DEBUG
+		printf("Requested %d %s buffers\n", lpDevice->bufferCount, (lpDevice->memory == captureDeviceMemory_UserPtr) ? "user pointer" : "mmap");
+	#endif
+
+	/*
+		Map (or allocate) buffers
+	*/
+	{
+		lpDevice->lpBuffers = calloc(lpDevice->bufferCount, sizeof(struct imageBuffer));
+		if(lpDevice->lpBuffers == NULL) {
+			printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+			return cameraE_Failed;
+		}
+
+		int iBuf;
+		for(iBuf = 0; iBuf < lpDevice->bufferCount; iBuf = iBuf + 1) {
+			lpDevice->lpBuffers[iBuf].lpBase = MAP_FAILED;
+		}
+		if(lpDevice->memory == captureDeviceMemory_UserPtr) {
+			if(captureDeviceUserPtrAlloc(lpDevice, lpDevice->bHugePages) != 0) {
+				return cameraE_Failed;
+			}
+		}
+		for(iBuf = 0; (iBuf < lpDevice->bufferCount) && (lpDevice->memory == captureDeviceMemory_MMap); iBuf = iBuf + 1) {
+			struct v4l2_buffer vBuffer;
+
+			memset(&vBuffer, 0, sizeof(struct v4l2_buffer));
+
+			vBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			vBuffer.memory = V4L2_MEMORY_MMAP;
+			vBuffer.index = iBuf;
+
+			if(xioctl(lpDevice->hHandle, VIDIOC_QUERYBUF, &vBuffer) == -1) {
+				printf("%s:%u Failed to query buffer %d\n", __FILE__, __LINE__, iBuf);
+				return cameraE_Failed;
+			}
+
+			lpDevice->lpBuffers[iBuf].lpBase = mmap(NULL, vBuffer.length, PROT_READ|PROT_WRITE, MAP_SHARED, lpDevice->hHandle, vBuffer.m.offset);
+			lpDevice->lpBuffers[iBuf].sLen = vBuffer.length;
+
+			if(lpDevice->lpBuffers[iBuf].lpBase == MAP_FAILED) {
+				printf("%s:%u Failed to map buffer %d\n", __FILE__, __LINE__, iBuf);
+				return cameraE_Failed;
+			}
+		}
+	}
+
+	/*
+		First we queue all buffers
+	*/
+	{
+		int iBuf;
+		for(iBuf = 0; iBuf < lpDevice->bufferCount; iBuf = iBuf + 1) {
+			struct v4l2_buffer buf;
+			memset(&buf, 0, sizeof(struct v4l2_buffer));
+
+			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+			buf.memory = captureDeviceV4L2Memory(lpDevice->memory);
+			buf.index = iBuf;
+			if(lpDevice->memory == captureDeviceMemory_UserPtr) {
+				buf.m.userptr = (unsigned long)(lpDevice->lpBuffers[iBuf].lpBase);
+				buf.length = lpDevice->lpBuffers[iBuf].sLen;
+			}
+
+			if(xioctl(lpDevice->hHandle, VIDIOC_QBUF, &buf) == -1) {
+				printf("%s:%u Queueing buffer %d failed ...\n", __FILE__, __LINE__, iBuf);
+				return cameraE_Failed;
+			}
+		}
+	}
+
+	/*
+		Enable streaming
+	*/
+	{
+		enum v4l2_buf_type type;
+
+		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_STREAMON, &type) == -1) {
+			printf("%s:%u Stream on failed\n", __FILE__, __LINE__);
+			return cameraE_Failed;
+		}
+		lpDevice->bStreaming = 1;
+	}
+
+	return cameraE_Ok;
+}
+
+/*
+	Stops streaming and releases all buffers so the format or the crop
+	rectangle can be changed (or the device closed)
+*/
+static enum cameraError captureDeviceStop(
+	struct captureDevice* lpDevice
+) {
+	enum cameraError e = cameraE_Ok;
+
+	/*
+		Stop streaming
+	*/
+	if(lpDevice->bStreaming != 0) {
+		enum v4l2_buf_type type;
+
+		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_STREAMOFF, &type) == -1) {
+			printf("%s:%u Stream off failed\n", __FILE__, __LINE__);
+			e = cameraE_Failed;
+		}
+		lpDevice->bStreaming = 0;
+	}
+
+	/*
+		Release buffers ...
+	*/
+	if(lpDevice->lpBuffers != NULL) {
+		int iBuf;
+		for(iBuf = 0; (iBuf < lpDevice->bufferCount) && (lpDevice->memory == captureDeviceMemory_MMap); iBuf = iBuf + 1) {
+			if(lpDevice->lpBuffers[iBuf].lpBase != MAP_FAILED) {
+				munmap(lpDevice->lpBuffers[iBuf].lpBase, lpDevice->lpBuffers[iBuf].sLen);
+			}
+		}
+		free(lpDevice->lpBuffers);
+		lpDevice->lpBuffers = NULL;
+
+		struct v4l2_requestbuffers rqBuffers;
+
+		memset(&rqBuffers, 0, sizeof(rqBuffers));
+		rqBuffers.count = 0;
+		rqBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		rqBuffers.memory = captureDeviceV4L2Memory(lpDevice->memory);
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_REQBUFS, &rqBuffers) == -1) {
+			printf("%s:%u Releasing buffers failed!\n", __FILE__, __LINE__);
+			e = cameraE_Failed;
+		}
+	}
+
+	/* The driver has released the user pointer buffers with REQBUFS(0) */
+	if(lpDevice->lpPool != MAP_FAILED) {
+		munmap(lpDevice->lpPool, lpDevice->sPoolLen);
+		lpDevice->lpPool = MAP_FAILED;
+	}
+	return e;
+}
+
+enum cameraError captureDeviceOpen(
+	struct captureDevice* lpDevice,
+	char* lpDeviceName,
+	const struct captureDeviceFormatRequest* lpRequest,
+	int dwBufferCount
+) {
+	enum cameraError e;
+	struct captureDeviceFormatRequest reqDefault;
+
+	captureDeviceFormatRequestDefault(&reqDefault);
+
+	if((lpDevice == NULL) || (dwBufferCount < 1)) {
+		return cameraE_InvalidParam;
+	}
+
+	memset(lpDevice, 0, sizeof(struct captureDevice));
+	lpDevice->lpDeviceName = lpDeviceName;
+	lpDevice->hHandle = -1;
+	lpDevice->kq = -1;
+	lpDevice->lpPool = MAP_FAILED;
+	lpDevice->memory = (lpRequest != NULL) ? lpRequest->memory : reqDefault.memory;
+
+	/*
+		Try to open the camera
+	*/
+	e = deviceOpen(&(lpDevice->hHandle), lpDeviceName);
+	if(e != cameraE_Ok) {
+		return e;
+	}
+
+	lpDevice->kq = kqueue();
+	if(lpDevice->kq == -1) {
+		printf("%s:%u Failed to create kqueue\n", __FILE__, __LINE__);
+		captureDeviceClose(lpDevice);
+		return cameraE_Failed;
+	}
+
+	/*
+		Query capabilities
+	*/
+	{
+		struct v4l2_capability cap;
+
+		memset(&cap, 0, sizeof(cap));
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_QUERYCAP, &cap) == -1) {
+			printf("%s:%u Failed to query capabilities\n", __FILE__, __LINE__);
+			captureDeviceClose(lpDevice);
+			return cameraE_Failed;
+		}
+
+		if((cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0) {
+			printf("%s:%u Device does not support video capture\n", __FILE__, __LINE__);
+			captureDeviceClose(lpDevice);
+			return cameraE_Failed;
+		}
+
+		if((cap.capabilities & V4L2_CAP_STREAMING) == 0) {
+			printf("%s:%u Device does not support streaming\n", __FILE__, __LINE__);
+			captureDeviceClose(lpDevice);
+			return cameraE_Failed;
+		}
+
+		#ifdef DEBUG
+			printf("%s:%u Read/Write interface supported: %s\n", __FILE__, __LINE__, ((cap.capabilities & V4L2_CAP_READWRITE) != 0) ? "yes" : "no");
+			printf("%s:%u Streaming interface supported: %s\n", __FILE__, __LINE__, ((cap.capabilities & V4L2_CAP_STREAMING) != 0) ? "yes" : "no");
+		#endif
+	}
+
+	/*
+		Query cropping capabilities and set cropping rectangle
+	*/
+	for(;;) {
+		struct v4l2_cropcap cropcap;
+
+		memset(&cropcap, 0, sizeof(cropcap));
+		cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_CROPCAP, &cropcap) == -1) {
+			printf("%s:%u Failed to query cropping capabilities, continuing anyways\n", __FILE__, __LINE__);
+			break;
+		}
+
+		#ifdef DEBUG
+			printf("Cropping capabilities:\n");
+			printf("\tDefault boundaries: %d, %d, %d, %d\n", cropcap.defrect.left, cropcap.defrect.top, cropcap.defrect.width, cropcap.defrect.height);
+			printf("\tBoundaries (left, top, width, height): %d, %d, %d, %d\n", cropcap.bounds.left, cropcap.bounds.top, cropcap.bounds.width, cropcap.bounds.height);
+			printf("\tAspect ratio: %u : %u\n", cropcap.pixelaspect.numerator, cropcap.pixelaspect.denominator);
+		#endif
+
+		#ifdef DEBUG
+			printf("Setting default cropping rectangle ... ");
+		#endif
+
+		struct v4l2_crop crop;
+
+		crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		crop.c = cropcap.defrect;
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_S_CROP, &crop) == -1) {
+			#ifdef DEBUG
+				printf("failed\n");
+			#endif
+		} else {
+			#ifdef DEBUG
+				printf("ok\n");
+			#endif
+			/* Only drivers that accept a crop rectangle can read out a region of interest */
+			lpDevice->bCropSupported = 1;
+			lpDevice->rcCropDefault = cropcap.defrect;
+		}
+
+		break;
+	}
+
+	/*
+		Select and apply format, frame size and frame interval
+	*/
+	if(captureDeviceNegotiate(lpDevice, (lpRequest != NULL) ? lpRequest : &reqDefault) != 0) {
+		captureDeviceClose(lpDevice);
+		return cameraE_Failed;
+	}
+	lpDevice->dwFullWidth = lpDevice->width;
+	lpDevice->dwFullHeight = lpDevice->height;
+	lpDevice->roi.xMin = 0;
+	lpDevice->roi.xMax = lpDevice->width - 1;
+	lpDevice->roi.yMin = 0;
+	lpDevice->roi.yMax = lpDevice->height - 1;
+	if((lpDevice->rcCropDefault.width == 0) || (lpDevice->rcCropDefault.height == 0)) {
+		lpDevice->bCropSupported = 0;
+	}
+
+	/*
+		Add to kqueue ...
+	*/
+	{
+		struct kevent kev;
+
+		EV_SET(&kev, lpDevice->hHandle, EVFILT_READ, EV_ADD|EV_ENABLE|EV_CLEAR, 0, 0, NULL);
+		kevent(lpDevice->kq, &kev, 1, NULL, 0, NULL);
+	}
+
+	lpDevice->dwBufferRequest = dwBufferCount;
+	lpDevice->bHugePages = (lpRequest != NULL) ? lpRequest->bHugePages : 0;
+
+	e = captureDeviceStart(lpDevice);
+	if(e != cameraE_Ok) {
+		captureDeviceClose(lpDevice);
+		return e;
+	}
+
+	return cameraE_Ok;
+}
+
+/*
+	Programs the sensor crop rectangle and a frame size of the same
+	scale as the default crop (so no scaling is introduced) while
+	streaming is stopped, and reads back what the driver applied.
+	Selection API first, S_CROP for older drivers. Returns 0 if the
+	frame maps onto the full frame with the default scale
+*/
+static int captureDeviceApplyCrop(
+	struct captureDevice* lpDevice,
+	const struct v4l2_rect* lpCrop,
+	unsigned long int dwWidth,
+	unsigned long int dwHeight
+) {
+	const struct v4l2_rect* lpDefault = &(lpDevice->rcCropDefault);
+	struct v4l2_format fmt;
+	struct v4l2_selection sel;
+	struct v4l2_rect rcActual;
+	long int lLeft, lTop;
+
+	/* Format first, drivers adapt the crop rectangle to a new format and not the other way round */
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(xioctl(lpDevice->hHandle, VIDIOC_G_FMT, &fmt) == -1) {
+		return 1;
+	}
+	fmt.fmt.pix.width = dwWidth;
+	fmt.fmt.pix.height = dwHeight;
+	fmt.fmt.pix.bytesperline = 0;
+	fmt.fmt.pix.sizeimage = 0;
+	if(xioctl(lpDevice->hHandle, VIDIOC_S_FMT, &fmt) == -1) {
+		return 1;
+	}
+
+	memset(&sel, 0, sizeof(sel));
+	sel.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	sel.target = V4L2_SEL_TGT_CROP;
+	sel.r = (*lpCrop);
+	if(xioctl(lpDevice->hHandle, VIDIOC_S_SELECTION, &sel) == 0) {
+		rcActual = sel.r;
+	} else {
+		struct v4l2_crop crop;
+
+		memset(&crop, 0, sizeof(crop));
+		crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		crop.c = (*lpCrop);
+		if(xioctl(lpDevice->hHandle, VIDIOC_S_CROP, &crop) == -1) {
+			return 1;
+		}
+		if(xioctl(lpDevice->hHandle, VIDIOC_G_CROP, &crop) == -1) {
+			return 1;
+		}
+		rcActual = crop.c;
+	}
+
+	/* The crop may have changed the format again */
+	memset(&fmt, 0, sizeof(fmt));
+	fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(xioctl(lpDevice->hHandle, VIDIOC_G_FMT, &fmt) == -1) {
+		return 1;
+	}
+	captureDeviceStoreFormat(lpDevice, &fmt);
+
+	/* Smaller frames may be delivered faster */
+	{
+		struct v4l2_streamparm parm;
+
+		memset(&parm, 0, sizeof(parm));
+		parm.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		if(xioctl(lpDevice->hHandle, VIDIOC_G_PARM, &parm) == 0) {
+			if((parm.parm.capture.timeperframe.numerator != 0) && (parm.parm.capture.timeperframe.denominator != 0)) {
+				lpDevice->dNominalFps = ((double)parm.parm.capture.timeperframe.denominator) / ((double)parm.parm.capture.timeperframe.numerator);
+			}
+		}
+	}
+
+	/* Sensor to frame coordinates, the scale has to be the one of the full frame */
+	lLeft = ((long int)rcActual.left - (long int)lpDefault->left) * (long int)lpDevice->dwFullWidth / (long int)lpDefault->width;
+	lTop = ((long int)rcActual.top - (long int)lpDefault->top) * (long int)lpDevice->dwFullHeight / (long int)lpDefault->height;
+	if((lLeft < 0) || (lTop < 0)) {
+		return 1;
+	}
+	if(((unsigned long int)lLeft + lpDevice->width > lpDevice->dwFullWidth) || ((unsigned long int)lTop + lpDevice->height > lpDevice->dwFullHeight)) {
+		return 1;
+	}
+	if(labs((long int)((unsigned long int)rcActual.width * lpDevice->dwFullWidth / lpDefault->width) - (long int)lpDevice->width) > 1) {
+		return 1;
+	}
+	if(labs((long int)((unsigned long int)rcActual.height * lpDevice->dwFullHeight / lpDefault->height) - (long int)lpDevice->height) > 1) {
+		return 1;
+	}
+
+	lpDevice->roi.xMin = (unsigned long int)lLeft;
+	lpDevice->roi.xMax = (unsigned long int)lLeft + lpDevice->width - 1;
+	lpDevice->roi.yMin = (unsigned long int)lTop;
+	lpDevice->roi.yMax = (unsigned long int)lTop + lpDevice->height - 1;
+	return 0;
+}
+
+enum cameraError captureDeviceSetRoi(
+	struct captureDevice* lpDevice,
+	const struct rectBound* lpRoi
+) {
+	const struct v4l2_rect* lpDefault;
+	struct v4l2_rect rcCrop;
+	unsigned long int xStart, xEnd, yStart, yEnd;
+	enum cameraError e;
+	int bApplied;
+
+	if(lpDevice == NULL) {
+		return cameraE_InvalidParam;
+	}
+	if(lpDevice->bCropSupported == 0) {
+		return cameraE_Failed;
+	}
+	lpDefault = &(lpDevice->rcCropDefault);
+
+	if(lpRoi != NULL) {
+		if((lpRoi->xMin > lpRoi->xMax) || (lpRoi->yMin > lpRoi->yMax) || (lpRoi->xMax >= lpDevice->dwFullWidth) || (lpRoi->yMax >= lpDevice->dwFullHeight)) {
+			return cameraE_InvalidParam;
+		}
+
+		/* Even offsets and sizes keep YUYV pixel pairs and chroma subsampling intact */
+		xStart = lpRoi->xMin & (~1UL);
+		yStart = lpRoi->yMin & (~1UL);
+		xEnd = (lpRoi->xMax + 2) & (~1UL);
+		yEnd = (lpRoi->yMax + 2) & (~1UL);
+		if(xEnd > lpDevice->dwFullWidth) { xEnd = lpDevice->dwFullWidth; }
+		if(yEnd > lpDevice->dwFullHeight) { yEnd = lpDevice->dwFullHeight; }
+	} else {
+		xStart = 0;
+		yStart = 0;
+		xEnd = lpDevice->dwFullWidth;
+		yEnd = lpDevice->dwFullHeight;
+	}
+
+	/* Nothing to do if the frame already covers exactly this region */
+	if((lpDevice->roi.xMin == xStart) && (lpDevice->roi.xMax + 1 == xEnd) && (lpDevice->roi.yMin == yStart) && (lpDevice->roi.yMax + 1 == yEnd)) {
+		return cameraE_Ok;
+	}
+
+	if(lpRoi != NULL) {
+		rcCrop.left = lpDefault->left + (int32_t)((xStart * lpDefault->width) / lpDevice->dwFullWidth);
+		rcCrop.top = lpDefault->top + (int32_t)((yStart * lpDefault->height) / lpDevice->dwFullHeight);
+		rcCrop.width = (uint32_t)(((xEnd - xStart) * lpDefault->width) / lpDevice->dwFullWidth);
+		rcCrop.height = (uint32_t)(((yEnd - yStart) * lpDefault->height) / lpDevice->dwFullHeight);
+	} else {
+		rcCrop = (*lpDefault);
+	}
+
+	/* Buffers are sized for the old format, the stream has to be restarted */
+	e = captureDeviceStop(lpDevice);
+	if(e != cameraE_Ok) {
+		return e;
+	}
+
+	bApplied = (captureDeviceApplyCrop(lpDevice, &rcCrop, xEnd - xStart, yEnd - yStart) == 0) ? 1 : 0;
+	if((bApplied == 0) || (lpRoi == NULL)) {
+		if(bApplied == 0) {
+			printf("%s:%u %s does not read out the requested region, using the full frame\n", __FILE__, __LINE__, lpDevice->lpDeviceName);
+			lpDevice->bCropSupported = 0;
+		}
+		if((bApplied == 0) && (captureDeviceApplyCrop(lpDevice, lpDefault, lpDevice->dwFullWidth, lpDevice->dwFullHeight) != 0)) {
+			printf("%s:%u Failed to restore the full frame\n", __FILE__, __LINE__);
+		}
+		if((lpDevice->width != lpDevice->dwFullWidth) || (lpDevice->height != lpDevice->dwFullHeight)) {
+			/* Never hand out frames whose position is unknown */
+			return cameraE_Failed;
+		}
+		lpDevice->roi.xMin = 0;
+		lpDevice->roi.xMax = lpDevice->dwFullWidth - 1;
+		lpDevice->roi.yMin = 0;
+		lpDevice->roi.yMax = lpDevice->dwFullHeight - 1;
+	}
+
+	e = captureDeviceStart(lpDevice);
+	if(e != cameraE_Ok) {
+		printf("%s:%u Failed to restart streaming after changing the region of interest\n", __FILE__, __LINE__);
+		return e;
+	}
+	return (bApplied != 0) ? cameraE_Ok : cameraE_Failed;
+}
+
+enum cameraError captureDeviceDequeue(
+	struct captureDevice* lpDevice,
+	struct v4l2_buffer* lpBufferOut,
+	unsigned long int dwTimeoutMs
+) {
+	if((lpDevice == NULL) || (lpBufferOut == NULL) || (lpDevice->bStreaming == 0)) {
+		return cameraE_InvalidParam;
+	}
+
+	frameTraceBegin("dqbuf");
+	for(;;) {
+		struct kevent kev;
+		struct timespec tsTimeout;
+		int r;
+
+		tsTimeout.tv_sec = dwTimeoutMs / 1000;
+		tsTimeout.tv_nsec = (dwTimeoutMs % 1000) * 1000000;
+
+		r = kevent(lpDevice->kq, NULL, 0, &kev, 1, (dwTimeoutMs != 0) ? &tsTimeout : NULL);
+		if(r < 0) {
+			frameTraceEnd("dqbuf");
+			if(errno == EINTR) { return cameraE_Timeout; }
+			printf("%s:%u kevent failed\n", __FILE__, __LINE__);
+			return cameraE_Failed;
+		}
+		if(r == 0) {
+			frameTraceEnd("dqbuf");
+			return cameraE_Timeout;
+		}
+
+		/* We got our frame or EOF ... try to dqueue */
+		memset(lpBufferOut, 0, sizeof(struct v4l2_buffer));
+
+		lpBufferOut->type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		lpBufferOut->memory = captureDeviceV4L2Memory(lpDevice->memory);
+
+		if(xioctl(lpDevice->hHandle, VIDIOC_DQBUF, lpBufferOut) == -1) {
+			if(errno == EAGAIN) { continue; }
+
+			frameTraceEnd("dqbuf");
+			printf("%s:%u DQBUF failed\n", __FILE__, __LINE__);
+			return cameraE_Failed;
+		}
+
+		#ifdef DEBUG
+			printf("%s:%u Dequeued buffer %d\n", __FILE__, __LINE__, lpBufferOut->index);
+		#endif
+
+		captureDeviceTimingRecord(lpDevice, lpBufferOut);
+		if(lpDevice->dwDelivered == 0) {
+			lpDevice->tvFirst = lpBufferOut->timestamp;
+		}
+		lpDevice->tvLast = lpBufferOut->timestamp;
+		lpDevice->dwDelivered = lpDevice->dwDelivered + 1;
+
+		frameTraceEnd("dqbuf");
+		frameTraceSetSequence(lpBufferOut->sequence);
+		return cameraE_Ok;
+	}
+}
+
+enum cameraError captureDeviceRequeue(
+	struct captureDevice* lpDevice,
+	struct v4l2_buffer* lpBuffer
+) {
+	if((lpDevice == NULL) || (lpBuffer == NULL)) {
+		return cameraE_InvalidParam;
+	}
+
+	if(xioctl(lpDevice->hHandle, VIDIOC_QBUF, lpBuffer) == -1) {
+		printf("%s:%u Queueing buffer %d failed ...\n", __FILE__, __LINE__, lpBuffer->index);
+		return cameraE_Failed;
+	}
+	return cameraE_Ok;
+}
+
+enum cameraError captureDeviceClose(
+	struct captureDevice* lpDevice
+) {
+	enum cameraError e;
+
+	if(lpDevice == NULL) {
+		return cameraE_InvalidParam;
+	}
+
+	e = captureDeviceStop(lpDevice);
+
+	if(lpDevice->kq >= 0) {
+		close(lpDevice->kq);
+		lpDevice->kq = -1;
+	}
+
+	/*
+		Close camera at the end
+	*/
+	if(lpDevice->hHandle >= 0) {
+		deviceClose(lpDevice->hHandle);
+		lpDevice->hHandle = -1;
+	}
+	return e;
+}
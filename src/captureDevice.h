@@ -0,0 +1,248 @@
+#ifndef __CAPTUREDEVICE_H__
+#define __CAPTUREDEVICE_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include <linux/videodev2.h>
+
+#include "./webcamBlobEstimator.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Requested capture mode. Negotiation enumerates all frame sizes and
+	frame intervals of the supported pixel formats (YUYV, GREY, MJPEG)
+	and selects the mode that delivers at least dTargetFps (0 selects
+	the fastest mode) at a resolution of at least dwMinWidth x
+	dwMinHeight. Among the modes that satisfy both the uncompressed
+	formats and the smallest resolution are preferred (without target
+	among the equally fast modes). pixelFormat
+	restricts the negotiation to a single format (0 allows all).
+
+	memory selects who owns the frame buffers. With
+	captureDeviceMemory_UserPtr the application supplies page aligned
+	buffers from one pool (backed by huge pages if bHugePages is set and
+	the system provides them); if the driver rejects USERPTR the device
+	falls back to driver allocated MMAP buffers
+*/
+enum captureDeviceMemory {
+	captureDeviceMemory_MMap					= 0,
+	captureDeviceMemory_UserPtr					= 1,
+};
+
+struct captureDeviceFormatRequest {
+	unsigned long int		dwMinWidth;
+	unsigned long int		dwMinHeight;
+	double					dTargetFps;
+	uint32_t				pixelFormat;
+
+	enum captureDeviceMemory	memory;
+	int						bHugePages;
+};
+
+#define CAPTUREDEVICE_DEFAULT_WIDTH		1920
+#define CAPTUREDEVICE_DEFAULT_HEIGHT	1080
+
+/*
+	Dequeue timing in microseconds. The latency is the time from the
+	buffer timestamp to the return of captureDeviceDequeue (only counted
+	for drivers with monotonic timestamps), the interval the time
+	between two consecutive dequeues. Their spread is the jitter the
+	capture path adds on top of the camera
+*/
+struct captureDeviceTiming {
+	unsigned long int		dwLatencySamples;
+	double					dLatencySum;
+	double					dLatencySumSq;
+	double					dLatencyMin;
+	double					dLatencyMax;
+
+	unsigned long int		dwIntervalSamples;
+	double					dIntervalSum;
+	double					dIntervalSumSq;
+	double					dIntervalMin;
+	double					dIntervalMax;
+
+	struct timespec			tsLastDequeue;
+};
+
+/*
+	One V4L2 capture device in streaming mode with it's own
+	buffer ring and kqueue
+*/
+struct captureDevice {
+	char*					lpDeviceName;
+	int						hHandle;
+	int						kq;
+
+	unsigned long int		width;
+	unsigned long int		height;
+	unsigned long int		bytesPerLine;
+	unsigned long int		sizeImage;
+	uint32_t				pixelFormat;
+	double					dNominalFps;		/* As set by S_PARM, 0 if unknown */
+
+	struct imageBuffer*		lpBuffers;
+	int						bufferCount;
+	int						bStreaming;
+
+	enum captureDeviceMemory	memory;			/* Actually used, after a possible fallback */
+	void*					lpPool;				/* USERPTR buffer pool (MAP_FAILED if none) */
+	size_t					sPoolLen;
+	int						dwBufferRequest;
+	int						bHugePages;
+
+	int						bCropSupported;		/* Driver accepted the default crop rectangle */
+	struct v4l2_rect		rcCropDefault;
+	unsigned long int		dwFullWidth;		/* Frame size with the default crop rectangle */
+	unsigned long int		dwFullHeight;
+	struct rectBound		roi;				/* Current frame in full frame coordinates */
+
+	unsigned long int		dwDelivered;
+	struct timeval			tvFirst;
+	struct timeval			tvLast;
+	struct captureDeviceTiming	timing;
+};
+
+void captureDeviceFormatRequestDefault(struct captureDeviceFormatRequest* lpRequest);
+
+/*
+	Opens the device, negotiates the format and frame rate (see
+	captureDeviceFormatRequest, NULL uses the defaults), maps or
+	allocates dwBufferCount buffers, queues them and starts streaming
+*/
+enum cameraError captureDeviceOpen(
+	struct captureDevice* lpDevice,
+	char* lpDeviceName,
+	const struct captureDeviceFormatRequest* lpRequest,
+	int dwBufferCount
+);
+
+/*
+	Waits up to dwTimeoutMs milliseconds (0 waits forever) for the
+	next filled buffer and dequeues it. The buffer has to be returned
+	with captureDeviceRequeue
+*/
+enum cameraError captureDeviceDequeue(
+	struct captureDevice* lpDevice,
+	struct v4l2_buffer* lpBufferOut,
+	unsigned long int dwTimeoutMs
+);
+
+enum cameraError captureDeviceRequeue(
+	struct captureDevice* lpDevice,
+	struct v4l2_buffer* lpBuffer
+);
+
+static inline void* captureDeviceBufferData(
+	struct captureDevice* lpDevice,
+	struct v4l2_buffer* lpBuffer
+) {
+	return lpDevice->lpBuffers[lpBuffer->index].lpBase;
+}
+
+/*
+	Sensor side region of interest: programs the crop rectangle (crop
+	selection or S_CROP) so the sensor only reads out and transfers the
+	given region (full frame pixel coordinates, rounded out to even
+	offsets and sizes) and restarts streaming with buffers of the new
+	size. NULL restores the full frame. Afterwards roi holds the
+	position of the delivered frames within the full frame; coordinates
+	in the frame have to be offset by roi.xMin and roi.yMin.
+	Buffers held by the caller are invalid after the call.
+	Returns cameraE_Failed if the driver does not support cropping or
+	does not read out the region at the scale of the full frame - the
+	device then continues with the full frame (bStreaming is 0 if it
+	could not be restarted at all)
+*/
+enum cameraError captureDeviceSetRoi(
+	struct captureDevice* lpDevice,
+	const struct rectBound* lpRoi
+);
+
+/*
+	Frame rate actually delivered by the driver, measured from the
+	buffer timestamps of all frames dequeued so far
+*/
+double captureDeviceDeliveredFps(
+	const struct captureDevice* lpDevice
+);
+
+/*
+	Prints mean, standard deviation (jitter), minimum and maximum of the
+	dequeue latency and interval of all frames dequeued so far
+*/
+void captureDeviceTimingPrint(
+	FILE* fHandle,
+	const struct captureDevice* lpDevice
+);
+
+/*
+	Checks if the exposure of a dequeued buffer started at or after
+	*lpNotBefore (CLOCK_MONOTONIC). For drivers that timestamp at the
+	end of the frame one frame period is subtracted. Returns 1 if the
+	frame is recent enough, 0 if it is older and -1 if the driver does
+	not provide monotonic timestamps
+*/
+int captureDeviceFrameStartedAfter(
+	struct captureDevice* lpDevice,
+	const struct v4l2_buffer* lpBuffer,
+	const struct timespec* lpNotBefore
+);
+
+/*
+	Converts one captured frame of the given pixel format (YUYV, GREY or
+	MJPEG) into the planar luma of the image (lpLuma has to hold
+	width * height bytes). MJPEG frames are decoded directly into their
+	luma channel
+*/
+int captureFrameToLuma(
+	struct imgRawImage* lpImage,
+	uint32_t pixelFormat,
+	const unsigned char* lpSrc,
+	size_t sLen,
+	unsigned long int width,
+	unsigned long int height,
+	unsigned long int bytesPerLine
+);
+
+/*
+	Alignment of every USERPTR buffer (a huge page if the pool is backed
+	by huge pages, else a page)
+*/
+#define CAPTUREDEVICE_HUGEPAGE_SIZE		(2*1024*1024)
+
+/*
+	Parses yuyv, grey, mjpeg or any into a V4L2 pixel format (0 for any)
+*/
+int captureParsePixelFormat(const char* lpName, uint32_t* lpFormatOut);
+
+/*
+	Stops streaming, releases all buffers and closes the device
+*/
+enum cameraError captureDeviceClose(
+	struct captureDevice* lpDevice
+);
+
+/*
+	Exposure control helpers (see captureDevice.c)
+*/
+int getExposureMode(int fh);
+int setExposureMode(int fh, int mode);
+int setExposureManual(int fh);
+int setExposureAuto(int fh);
+int getExposureAbsolute(int fh);
+int setExposureAbsolute(int fh, int exposureValue);
+int getExposureAbsoluteRange(int fh, int* lpMin, int* lpMax);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __CAPTUREDEVICE_H__ */
@@ -0,0 +1,114 @@
+/*
+	Differential imaging against a rolling reference (see differenceImage.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./differenceImage.h"
+#include "./frameTrace.h"
+#include "./kernels.h"
+
+int differenceImageInit(
+	struct differenceImage* lpDiff,
+	unsigned long int dwAverageFrames
+) {
+	if(lpDiff == NULL) { return 1; }
+	memset(lpDiff, 0, sizeof(struct differenceImage));
+
+	while((lpDiff->dwShift < DIFFERENCEIMAGE_MAXSHIFT) && ((2UL << lpDiff->dwShift) <= dwAverageFrames)) {
+		lpDiff->dwShift = lpDiff->dwShift + 1;
+	}
+	return 0;
+}
+
+void differenceImageRelease(
+	struct differenceImage* lpDiff
+) {
+	if(lpDiff == NULL) { return; }
+
+	if(lpDiff->lpAverage != NULL) { free(lpDiff->lpAverage); }
+	if(lpDiff->lpReference != NULL) { free(lpDiff->lpReference); }
+	lpDiff->lpAverage = NULL;
+	lpDiff->lpReference = NULL;
+	lpDiff->sCapacity = 0;
+	lpDiff->dwReferenceFrames = 0;
+}
+
+int differenceImageReference(
+	struct differenceImage* lpDiff,
+	const struct imgRawImage* lpFrame
+) {
+	size_t sPixels;
+	size_t i;
+
+	if((lpDiff == NULL) || (lpFrame == NULL) || (lpFrame->lpLuma == NULL)) {
+		return 1;
+	}
+	sPixels = lpFrame->width * lpFrame->height;
+
+	if(lpDiff->sCapacity < sPixels) {
+		uint16_t* lpNewAverage;
+		unsigned char* lpNewReference;
+
+		lpNewAverage = realloc(lpDiff->lpAverage, sizeof(uint16_t) * sPixels);
+		if(lpNewAverage == NULL) { return 1; }
+		lpDiff->lpAverage = lpNewAverage;
+		lpNewReference = realloc(lpDiff->lpReference, sPixels);
+		if(lpNewReference == NULL) { return 1; }
+		lpDiff->lpReference = lpNewReference;
+		lpDiff->sCapacity = sPixels;
+	}
+
+	/* A new size (or the first frame) restarts the average */
+	if((lpDiff->dwReferenceFrames == 0) || (lpDiff->width != lpFrame->width) || (lpDiff->height != lpFrame->height)) {
+		for(i = 0; i < sPixels; i = i + 1) {
+			lpDiff->lpAverage[i] = (uint16_t)(((uint16_t)lpFrame->lpLuma[i]) << 8);
+		}
+		memcpy(lpDiff->lpReference, lpFrame->lpLuma, sPixels);
+		lpDiff->width = lpFrame->width;
+		lpDiff->height = lpFrame->height;
+		lpDiff->dwReferenceFrames = 1;
+		return 0;
+	}
+
+	frameTraceBegin("reference");
+	kernelTableGet()->accumulate(lpDiff->lpAverage, lpDiff->lpReference, lpFrame->lpLuma, sPixels, lpDiff->dwShift);
+	frameTraceEnd("reference");
+	lpDiff->dwReferenceFrames = lpDiff->dwReferenceFrames + 1;
+	return 0;
+}
+
+int differenceImageApply(
+	const struct differenceImage* lpDiff,
+	const struct imgRawImage* lpSignal,
+	struct imgRawImage* lpOut,
+	struct differenceImageStats* lpStats
+) {
+	uint64_t qwPositive = 0;
+	uint64_t qwNegative = 0;
+	size_t sPixels;
+
+	if((lpDiff == NULL) || (lpSignal == NULL) || (lpSignal->lpLuma == NULL) || (lpOut == NULL) || (lpOut->lpLuma == NULL)) {
+		return 1;
+	}
+	if((lpDiff->dwReferenceFrames == 0) || (lpDiff->width != lpSignal->width) || (lpDiff->height != lpSignal->height)) {
+		return 1;
+	}
+
+	sPixels = lpSignal->width * lpSignal->height;
+
+	frameTraceBegin("difference");
+	kernelTableGet()->difference(lpOut->lpLuma, lpSignal->lpLuma, lpDiff->lpReference, sPixels, &qwPositive, &qwNegative);
+	frameTraceEnd("difference");
+
+	lpOut->width = lpSignal->width;
+	lpOut->height = lpSignal->height;
+	if(lpStats != NULL) {
+		lpStats->qwPositiveSum = qwPositive;
+		lpStats->qwNegativeSum = qwNegative;
+	}
+	return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef __DIFFERENCEIMAGE_H__
+#define __DIFFERENCEIMAGE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "./webcamBlobEstimator.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Differential imaging against a rolling reference
+
+	Reference frames (RF off or at a base frequency) update a running
+	average of the luma kept in 8.8 fixed point: every update moves the
+	average by 1/2^dwShift towards the new frame, the first frame (and
+	the first frame after a size change) replaces it. dwShift 0 simply
+	keeps the last reference frame.
+
+	The signed difference of a signal frame to the reference is split
+	into it's positive part (signal brighter than the reference), which
+	is written as luma image for the detector, and the negative part.
+	Both are summed in the same pass. The reference update and the
+	difference are runtime dispatched kernels (see kernels.h), the
+	vector variants use saturating subtraction and sums of absolute
+	differences for the totals.
+*/
+struct differenceImage {
+	unsigned long int		width;
+	unsigned long int		height;
+	unsigned int			dwShift;
+	unsigned long int		dwReferenceFrames;	/* Updates since the last reset */
+
+	uint16_t*				lpAverage;			/* 8.8 fixed point */
+	unsigned char*			lpReference;		/* Rounded down to 8 bit */
+	size_t					sCapacity;
+};
+
+/*
+	Sums of the last difference: qwPositiveSum over all pixels brighter
+	than the reference, qwNegativeSum (as positive number) over all
+	darker pixels
+*/
+struct differenceImageStats {
+	uint64_t				qwPositiveSum;
+	uint64_t				qwNegativeSum;
+};
+
+#define DIFFERENCEIMAGE_MAXSHIFT		8
+
+/*
+	dwAverageFrames is the time constant of the running average in
+	frames, rounded down to a power of two (1 keeps the last reference
+	frame, at most 2^DIFFERENCEIMAGE_MAXSHIFT). Returns 0 on success
+*/
+int differenceImageInit(
+	struct differenceImage* lpDiff,
+	unsigned long int dwAverageFrames
+);
+void differenceImageRelease(
+	struct differenceImage* lpDiff
+);
+
+/*
+	Updates the rolling reference with the luma of lpFrame. Returns 0
+	on success
+*/
+int differenceImageReference(
+	struct differenceImage* lpDiff,
+	const struct imgRawImage* lpFrame
+);
+
+/*
+	Writes the positive part of lpSignal - reference into the luma of
+	lpOut (width * height bytes, width and height are set) and returns
+	the sums in lpStats (may be NULL). Fails if there is no reference
+	of the same size
+*/
+int differenceImageApply(
+	const struct differenceImage* lpDiff,
+	const struct imgRawImage* lpSignal,
+	struct imgRawImage* lpOut,
+	struct differenceImageStats* lpStats
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __DIFFERENCEIMAGE_H__ */
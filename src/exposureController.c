@@ -0,0 +1,121 @@
+/*
+	Closed loop exposure controller based on the peak statistics of
+	the blob detector (see exposureController.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <linux/videodev2.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./captureDevice.h"
+#include "./exposureController.h"
+
+int exposureControllerInit(
+	struct exposureController* lpController,
+	int hHandle,
+	double dTargetPeak
+) {
+	if((lpController == NULL) || (dTargetPeak <= 0) || (dTargetPeak >= 255)) {
+		return 1;
+	}
+
+	memset(lpController, 0, sizeof(struct exposureController));
+	lpController->hHandle = hHandle;
+	lpController->dTargetPeak = dTargetPeak;
+	lpController->dTolerance = EXPOSURECONTROLLER_DEFAULT_TOLERANCE;
+
+	lpController->dwPreviousMode = getExposureMode(hHandle);
+
+	if(setExposureManual(hHandle) != 0) {
+		printf("%s:%u Camera does not support manual exposure\n", __FILE__, __LINE__);
+		return 1;
+	}
+	if(getExposureAbsoluteRange(hHandle, &(lpController->dwExposureMin), &(lpController->dwExposureMax)) != 0) {
+		printf("%s:%u Camera does not support absolute exposure\n", __FILE__, __LINE__);
+		exposureControllerRelease(lpController);
+		return 1;
+	}
+
+	/* Start from whatever auto exposure settled at */
+	lpController->dwExposure = getExposureAbsolute(hHandle);
+	if(lpController->dwExposure < lpController->dwExposureMin) { lpController->dwExposure = lpController->dwExposureMin; }
+	if(lpController->dwExposure > lpController->dwExposureMax) { lpController->dwExposure = lpController->dwExposureMax; }
+	if(setExposureAbsolute(hHandle, lpController->dwExposure) != 0) {
+		exposureControllerRelease(lpController);
+		return 1;
+	}
+
+	printf("Exposure control: target peak %lf, exposure %d (range %d to %d)\n", dTargetPeak, lpController->dwExposure, lpController->dwExposureMin, lpController->dwExposureMax);
+	return 0;
+}
+
+int exposureControllerUpdate(
+	struct exposureController* lpController,
+	const struct blobResult* lpResult
+) {
+	double dFactor;
+	double dPeak;
+	int dwNewExposure;
+
+	if((lpController == NULL) || (lpResult == NULL)) {
+		return -1;
+	}
+
+	dPeak = (double)lpResult->dwPeakValue;
+
+	if(dPeak < EXPOSURECONTROLLER_NOISEFLOOR) {
+		/* No beam visible - nothing to regulate on, keep exposure */
+		return 0;
+	}
+
+	if((lpResult->dwSaturatedPixels > 0) || (lpResult->dwPeakValue >= 255)) {
+		/*
+			The real peak is unknown; target/255 is the smallest possible
+			overexposure, halve it once more so we end up below saturation
+		*/
+		dFactor = 0.5 * lpController->dTargetPeak / 255.0;
+	} else {
+		if(fabs(dPeak - lpController->dTargetPeak) <= lpController->dTolerance * lpController->dTargetPeak) {
+			return 0; /* Within tolerance band */
+		}
+		dFactor = lpController->dTargetPeak / dPeak;
+	}
+
+	if(dFactor < 0.125) { dFactor = 0.125; }
+	if(dFactor > 8.0) { dFactor = 8.0; }
+
+	dwNewExposure = (int)floor((double)lpController->dwExposure * dFactor + 0.5);
+	if(dwNewExposure < lpController->dwExposureMin) { dwNewExposure = lpController->dwExposureMin; }
+	if(dwNewExposure > lpController->dwExposureMax) { dwNewExposure = lpController->dwExposureMax; }
+
+	if(dwNewExposure == lpController->dwExposure) {
+		/* At the limit of the camera, this is as good as it gets */
+		return 0;
+	}
+
+	#ifdef DEBUG
+		printf("%s:%u Peak %lf (%lu saturated), exposure %d -> %d\n", __FILE__, __LINE__, dPeak, lpResult->dwSaturatedPixels, lpController->dwExposure, dwNewExposure);
+	#endif
+
+	if(setExposureAbsolute(lpController->hHandle, dwNewExposure) != 0) {
+		return -1;
+	}
+	lpController->dwExposure = dwNewExposure;
+	return 1;
+}
+
+void exposureControllerRelease(
+	struct exposureController* lpController
+) {
+	if(lpController == NULL) {
+		return;
+	}
+	if(lpController->dwPreviousMode >= 0) {
+		setExposureMode(lpController->hHandle, lpController->dwPreviousMode);
+	}
+}
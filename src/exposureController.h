@@ -0,0 +1,65 @@
+#ifndef __EXPOSURECONTROLLER_H__
+#define __EXPOSURECONTROLLER_H__
+
+#include "./blobDetector.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Closed loop exposure control
+
+	The camera is switched into manual exposure and the absolute
+	exposure is adjusted after every frame so the brightest pixel of
+	the beam settles at dTargetPeak (of 255). Since the sensor response
+	is linear below saturation the correction is a single
+	multiplicative step; saturated frames are corrected by a fixed
+	fraction since their real peak is unknown. Frames whose peak is
+	outside of the tolerance band are reported as not usable so the
+	caller can capture again at the same sweep point
+*/
+struct exposureController {
+	int						hHandle;
+
+	int						dwExposure;
+	int						dwExposureMin;
+	int						dwExposureMax;
+	int						dwPreviousMode;
+
+	double					dTargetPeak;
+	double					dTolerance;
+};
+
+#define EXPOSURECONTROLLER_DEFAULT_TOLERANCE	0.15
+#define EXPOSURECONTROLLER_NOISEFLOOR			8
+
+int exposureControllerInit(
+	struct exposureController* lpController,
+	int hHandle,
+	double dTargetPeak
+);
+
+/*
+	Feeds the result of the frame that has been captured with the
+	current exposure (lpController->dwExposure) into the controller
+	and applies the next exposure. Returns 0 if the frame has been
+	exposed acceptably, 1 if it should be discarded and -1 on error
+*/
+int exposureControllerUpdate(
+	struct exposureController* lpController,
+	const struct blobResult* lpResult
+);
+
+/*
+	Restores the exposure mode that has been active before
+*/
+void exposureControllerRelease(
+	struct exposureController* lpController
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __EXPOSURECONTROLLER_H__ */
@@ -0,0 +1,252 @@
+/*
+	Per frame timeline tracing (see frameTrace.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "./frameTrace.h"
+
+#define FRAMETRACE_CHUNKEVENTS		4096
+
+#define FRAMETRACE_HAS_COUNT		0x01
+
+struct frameTraceEvent {
+	const char*					lpName;
+	uint64_t					qwTimestampNs;
+	unsigned long int			dwSequence;
+	unsigned long int			frq;
+	unsigned long int			dwCount;
+	char						cPhase;			/* 'B' or 'E' */
+	char						bFlags;
+};
+
+struct frameTraceChunk {
+	struct frameTraceChunk*		lpNext;
+	unsigned long int			dwUsed;
+	struct frameTraceEvent		events[FRAMETRACE_CHUNKEVENTS];
+};
+
+struct frameTraceThread {
+	struct frameTraceThread*	lpNext;
+	unsigned long int			dwThreadIndex;
+
+	struct frameTraceChunk*		lpFirst;
+	struct frameTraceChunk*		lpCurrent;
+
+	unsigned long int			dwSequence;
+	unsigned long int			frq;
+	unsigned long int			dwDropped;
+};
+
+static int bFrameTraceEnabled = 0;
+static char* lpFrameTraceFile = NULL;
+static pthread_key_t keyFrameTrace;
+static pthread_mutex_t mtxFrameTrace = PTHREAD_MUTEX_INITIALIZER;
+static struct frameTraceThread* lpFrameTraceThreads = NULL;
+static unsigned long int dwFrameTraceThreadCount = 0;
+
+int frameTraceOpen(const char* lpFileName) {
+	if((lpFileName == NULL) || (bFrameTraceEnabled != 0)) {
+		return 1;
+	}
+
+	lpFrameTraceFile = strdup(lpFileName);
+	if(lpFrameTraceFile == NULL) {
+		return 1;
+	}
+	if(pthread_key_create(&keyFrameTrace, NULL) != 0) {
+		free(lpFrameTraceFile);
+		lpFrameTraceFile = NULL;
+		return 1;
+	}
+
+	bFrameTraceEnabled = 1;
+	return 0;
+}
+
+/*
+	Buffer of the calling thread, registered on first use
+*/
+static struct frameTraceThread* frameTraceGetThread(void) {
+	struct frameTraceThread* lpThread = (struct frameTraceThread*)pthread_getspecific(keyFrameTrace);
+
+	if(lpThread != NULL) {
+		return lpThread;
+	}
+
+	lpThread = (struct frameTraceThread*)malloc(sizeof(struct frameTraceThread));
+	if(lpThread == NULL) {
+		return NULL;
+	}
+	memset(lpThread, 0, sizeof(struct frameTraceThread));
+
+	pthread_mutex_lock(&mtxFrameTrace);
+	lpThread->dwThreadIndex = dwFrameTraceThreadCount + 1;
+	dwFrameTraceThreadCount = dwFrameTraceThreadCount + 1;
+	lpThread->lpNext = lpFrameTraceThreads;
+	lpFrameTraceThreads = lpThread;
+	pthread_mutex_unlock(&mtxFrameTrace);
+
+	pthread_setspecific(keyFrameTrace, lpThread);
+	return lpThread;
+}
+
+static void frameTraceRecord(
+	const char* lpName,
+	char cPhase,
+	unsigned long int dwCount,
+	char bFlags
+) {
+	struct frameTraceThread* lpThread;
+	struct frameTraceEvent* lpEvent;
+	struct timespec ts;
+
+	if(bFrameTraceEnabled == 0) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	lpThread = frameTraceGetThread();
+	if(lpThread == NULL) {
+		return;
+	}
+
+	if((lpThread->lpCurrent == NULL) || (lpThread->lpCurrent->dwUsed == FRAMETRACE_CHUNKEVENTS)) {
+		struct frameTraceChunk* lpChunk = (struct frameTraceChunk*)malloc(sizeof(struct frameTraceChunk));
+		if(lpChunk == NULL) {
+			lpThread->dwDropped = lpThread->dwDropped + 1;
+			return;
+		}
+		lpChunk->lpNext = NULL;
+		lpChunk->dwUsed = 0;
+		if(lpThread->lpCurrent == NULL) {
+			lpThread->lpFirst = lpChunk;
+		} else {
+			lpThread->lpCurrent->lpNext = lpChunk;
+		}
+		lpThread->lpCurrent = lpChunk;
+	}
+
+	lpEvent = &(lpThread->lpCurrent->events[lpThread->lpCurrent->dwUsed]);
+	lpEvent->lpName = lpName;
+	lpEvent->qwTimestampNs = ((uint64_t)ts.tv_sec) * 1000000000ULL + (uint64_t)ts.tv_nsec;
+	lpEvent->dwSequence = lpThread->dwSequence;
+	lpEvent->frq = lpThread->frq;
+	lpEvent->dwCount = dwCount;
+	lpEvent->cPhase = cPhase;
+	lpEvent->bFlags = bFlags;
+	lpThread->lpCurrent->dwUsed = lpThread->lpCurrent->dwUsed + 1;
+}
+
+void frameTraceSetSequence(unsigned long int dwSequence) {
+	struct frameTraceThread* lpThread;
+
+	if(bFrameTraceEnabled == 0) {
+		return;
+	}
+	lpThread = frameTraceGetThread();
+	if(lpThread == NULL) {
+		return;
+	}
+	lpThread->dwSequence = dwSequence;
+}
+
+void frameTraceSetFrequency(unsigned long int frq) {
+	struct frameTraceThread* lpThread;
+
+	if(bFrameTraceEnabled == 0) {
+		return;
+	}
+	lpThread = frameTraceGetThread();
+	if(lpThread == NULL) {
+		return;
+	}
+	lpThread->frq = frq;
+}
+
+void frameTraceBegin(const char* lpName) {
+	frameTraceRecord(lpName, 'B', 0, 0);
+}
+
+void frameTraceEnd(const char* lpName) {
+	frameTraceRecord(lpName, 'E', 0, 0);
+}
+
+void frameTraceEndCount(const char* lpName, unsigned long int dwCount) {
+	frameTraceRecord(lpName, 'E', dwCount, FRAMETRACE_HAS_COUNT);
+}
+
+int frameTraceClose(void) {
+	FILE* fHandle;
+	struct frameTraceThread* lpThread;
+	int bFirst = 1;
+	int iResult = 0;
+
+	if(bFrameTraceEnabled == 0) {
+		return 0;
+	}
+	bFrameTraceEnabled = 0;
+
+	fHandle = fopen(lpFrameTraceFile, "w");
+	if(fHandle == NULL) {
+		printf("%s:%u Failed to create trace file %s\n", __FILE__, __LINE__, lpFrameTraceFile);
+		iResult = 1;
+	} else {
+		fprintf(fHandle, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	}
+
+	lpThread = lpFrameTraceThreads;
+	while(lpThread != NULL) {
+		struct frameTraceThread* lpNextThread = lpThread->lpNext;
+		struct frameTraceChunk* lpChunk = lpThread->lpFirst;
+
+		if(fHandle != NULL) {
+			fprintf(fHandle, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%lu,\"args\":{\"name\":\"thread %lu\"}}", (bFirst != 0) ? "" : ",\n", lpThread->dwThreadIndex, lpThread->dwThreadIndex);
+			bFirst = 0;
+			if(lpThread->dwDropped > 0) {
+				printf("%s:%u Trace of thread %lu dropped %lu events (out of memory)\n", __FILE__, __LINE__, lpThread->dwThreadIndex, lpThread->dwDropped);
+			}
+		}
+
+		while(lpChunk != NULL) {
+			struct frameTraceChunk* lpNextChunk = lpChunk->lpNext;
+			unsigned long int i;
+
+			for(i = 0; (i < lpChunk->dwUsed) && (fHandle != NULL); i=i+1) {
+				const struct frameTraceEvent* lpEvent = &(lpChunk->events[i]);
+
+				fprintf(fHandle, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03u,\"pid\":1,\"tid\":%lu,\"args\":{\"seq\":%lu,\"frq\":%lu", lpEvent->lpName, lpEvent->cPhase, (unsigned long long int)(lpEvent->qwTimestampNs / 1000), (unsigned int)(lpEvent->qwTimestampNs % 1000), lpThread->dwThreadIndex, lpEvent->dwSequence, lpEvent->frq);
+				if((lpEvent->bFlags & FRAMETRACE_HAS_COUNT) != 0) {
+					fprintf(fHandle, ",\"count\":%lu", lpEvent->dwCount);
+				}
+				fprintf(fHandle, "}}");
+			}
+
+			free(lpChunk);
+			lpChunk = lpNextChunk;
+		}
+
+		free(lpThread);
+		lpThread = lpNextThread;
+	}
+	lpFrameTraceThreads = NULL;
+	dwFrameTraceThreadCount = 0;
+
+	if(fHandle != NULL) {
+		fprintf(fHandle, "\n]}\n");
+		if(fclose(fHandle) != 0) {
+			iResult = 1;
+		}
+	}
+
+	pthread_key_delete(keyFrameTrace);
+	free(lpFrameTraceFile);
+	lpFrameTraceFile = NULL;
+	return iResult;
+}
@@ -0,0 +1,59 @@
+#ifndef __FRAMETRACE_H__
+#define __FRAMETRACE_H__
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Per frame timeline tracing
+
+	Records begin and end events of the pipeline stages (dequeue,
+	conversion, projection, cluster tracing, JPEG and peaks.dat writes,
+	retuning, settling) with CLOCK_MONOTONIC timestamps. Every event
+	carries the sequence number of the frame and the frequency the
+	recording thread currently works on (set with frameTraceSetSequence
+	and frameTraceSetFrequency).
+
+	Every thread appends into it's own chunked buffer without locking,
+	only the first event of a thread takes a mutex to register the
+	buffer. frameTraceClose writes all events in the Chrome trace event
+	JSON format (chrome://tracing, Perfetto) and has to be called after
+	all recording threads have finished.
+
+	While tracing is not enabled every call returns immediately.
+*/
+
+/*
+	Enables tracing, events are written to lpFileName on close.
+	Returns 0 on success
+*/
+int frameTraceOpen(const char* lpFileName);
+
+/*
+	Writes the trace file and releases all buffers. Returns 0 on
+	success (or if tracing was not enabled)
+*/
+int frameTraceClose(void);
+
+/*
+	Frame sequence number and frequency attached to the following
+	events of the calling thread
+*/
+void frameTraceSetSequence(unsigned long int dwSequence);
+void frameTraceSetFrequency(unsigned long int frq);
+
+/*
+	Begin and end of a stage. lpName has to be a string constant (only
+	the pointer is stored). frameTraceEndCount additionally attaches a
+	count (for example the iterations of a loop) to the event
+*/
+void frameTraceBegin(const char* lpName);
+void frameTraceEnd(const char* lpName);
+void frameTraceEndCount(const char* lpName, unsigned long int dwCount);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __FRAMETRACE_H__ */
@@ -0,0 +1,278 @@
+/*
+	JPEG file input and output using libjpeg
+
+	See https://www.tspi.at/2020/03/20/libjpegexample.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <setjmp.h>
+
+#include <jpeglib.h>
+#include <jerror.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./jpegFile.h"
+#include "./frameTrace.h"
+
+/*
+  Write one image into a target file
+*/
+int storeJpegImageFile(const struct imgRawImage* lpImage, char* lpFilename) {
+	struct jpeg_compress_struct info;
+	struct jpeg_error_mgr err;
+
+	unsigned char* lpRowBuffer[1];
+
+	FILE* fHandle;
+
+	frameTraceBegin("storeJpegImageFile");
+	fHandle = fopen(lpFilename, "wb");
+	if(fHandle == NULL) {
+		#ifdef DEBUG
+			fprintf(stderr, "%s:%u Failed to open output file %s\n", __FILE__, __LINE__, lpFilename);
+		#endif
+		frameTraceEnd("storeJpegImageFile");
+		return 1;
+	}
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_compress(&info);
+
+	jpeg_stdio_dest(&info, fHandle);
+
+	info.image_width = lpImage->width;
+	info.image_height = lpImage->height;
+	if(lpImage->numComponents == 1) {
+		info.input_components = 1;
+		info.in_color_space = JCS_GRAYSCALE;
+	} else {
+		info.input_components = 3;
+		info.in_color_space = JCS_RGB;
+	}
+
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, 100, TRUE);
+
+	jpeg_start_compress(&info, TRUE);
+
+	/* Write every scanline ... */
+	while(info.next_scanline < info.image_height) {
+		lpRowBuffer[0] = &(lpImage->lpData[info.next_scanline * (lpImage->width * info.input_components)]);
+		jpeg_write_scanlines(&info, lpRowBuffer, 1);
+	}
+
+	jpeg_finish_compress(&info);
+	fclose(fHandle);
+
+	jpeg_destroy_compress(&info);
+	frameTraceEnd("storeJpegImageFile");
+	return 0;
+}
+
+int encodeJpegImage(
+	const struct imgRawImage* lpImage,
+	int iQuality,
+	unsigned char** lpBuffer,
+	size_t* lpCapacity,
+	size_t* lpLen
+) {
+	struct jpeg_compress_struct info;
+	struct jpeg_error_mgr err;
+	unsigned char* lpRowBuffer[1];
+	unsigned char* lpOut;
+	unsigned long int dwOutSize;
+
+	if((lpImage == NULL) || (lpImage->lpData == NULL) || (lpBuffer == NULL) || (lpCapacity == NULL) || (lpLen == NULL)) {
+		return 1;
+	}
+
+	frameTraceBegin("encodeJpegImage");
+	lpOut = (*lpBuffer);
+	dwOutSize = (lpOut != NULL) ? (unsigned long int)(*lpCapacity) : 0;
+
+	info.err = jpeg_std_error(&err);
+	jpeg_create_compress(&info);
+
+	/* libjpeg only allocates a new buffer if the passed one overflows */
+	jpeg_mem_dest(&info, &lpOut, &dwOutSize);
+
+	info.image_width = lpImage->width;
+	info.image_height = lpImage->height;
+	if(lpImage->numComponents == 1) {
+		info.input_components = 1;
+		info.in_color_space = JCS_GRAYSCALE;
+	} else {
+		info.input_components = 3;
+		info.in_color_space = JCS_RGB;
+	}
+
+	jpeg_set_defaults(&info);
+	jpeg_set_quality(&info, iQuality, TRUE);
+
+	jpeg_start_compress(&info, TRUE);
+	while(info.next_scanline < info.image_height) {
+		lpRowBuffer[0] = &(lpImage->lpData[info.next_scanline * (lpImage->width * info.input_components)]);
+		jpeg_write_scanlines(&info, lpRowBuffer, 1);
+	}
+	jpeg_finish_compress(&info);
+	jpeg_destroy_compress(&info);
+
+	if(lpOut != (*lpBuffer)) {
+		if((*lpBuffer) != NULL) { free(*lpBuffer); }
+		(*lpBuffer) = lpOut;
+		(*lpCapacity) = dwOutSize;
+	}
+	(*lpLen) = dwOutSize;
+	frameTraceEnd("encodeJpegImage");
+	return 0;
+}
+
+int storeJpegBufferFile(
+	const unsigned char* lpJpeg,
+	size_t sLen,
+	char* lpFilename
+) {
+	FILE* fHandle;
+	int rc = 0;
+
+	frameTraceBegin("storeJpegBufferFile");
+	fHandle = fopen(lpFilename, "wb");
+	if(fHandle == NULL) {
+		#ifdef DEBUG
+			fprintf(stderr, "%s:%u Failed to open output file %s\n", __FILE__, __LINE__, lpFilename);
+		#endif
+		frameTraceEnd("storeJpegBufferFile");
+		return 1;
+	}
+	if(fwrite(lpJpeg, 1, sLen, fHandle) != sLen) { rc = 1; }
+	if(fclose(fHandle) != 0) { rc = 1; }
+	frameTraceEnd("storeJpegBufferFile");
+	return rc;
+}
+
+/*
+	The default libjpeg error handler terminates the process. When
+	reading archived files we rather skip a damaged file.
+*/
+struct jpegFileErrorMgr {
+	struct jpeg_error_mgr	mgr;
+	jmp_buf					jmpError;
+};
+
+static void jpegFileErrorExit(j_common_ptr lpInfo) {
+	struct jpegFileErrorMgr* lpErr = (struct jpegFileErrorMgr*)(lpInfo->err);
+	longjmp(lpErr->jmpError, 1);
+}
+
+int loadJpegImageFile(
+	struct imgRawImage* lpImage,
+	size_t* lpCapacity,
+	char* lpFilename
+) {
+	struct jpeg_decompress_struct info;
+	struct jpegFileErrorMgr err;
+	unsigned char* lpRowBuffer[1];
+	size_t sRequired;
+	FILE* fHandle;
+
+	if((lpImage == NULL) || (lpCapacity == NULL) || (lpFilename == NULL)) {
+		return 1;
+	}
+
+	fHandle = fopen(lpFilename, "rb");
+	if(fHandle == NULL) {
+		#ifdef DEBUG
+			fprintf(stderr, "%s:%u Failed to open input file %s\n", __FILE__, __LINE__, lpFilename);
+		#endif
+		return 1;
+	}
+
+	info.err = jpeg_std_error(&(err.mgr));
+	err.mgr.error_exit = &jpegFileErrorExit;
+	if(setjmp(err.jmpError)) {
+		jpeg_destroy_decompress(&info);
+		fclose(fHandle);
+		return 1;
+	}
+
+	jpeg_create_decompress(&info);
+	jpeg_stdio_src(&info, fHandle);
+	jpeg_read_header(&info, TRUE);
+
+	/* Greyscale files (raw captures) are kept single component */
+	info.out_color_space = (info.jpeg_color_space == JCS_GRAYSCALE) ? JCS_GRAYSCALE : JCS_RGB;
+	jpeg_start_decompress(&info);
+
+	sRequired = sizeof(unsigned char) * info.output_width * info.output_height * info.output_components;
+	if((lpImage->lpData == NULL) || ((*lpCapacity) < sRequired)) {
+		unsigned char* lpNew = realloc(lpImage->lpData, sRequired);
+		if(lpNew == NULL) {
+			jpeg_destroy_decompress(&info);
+			fclose(fHandle);
+			return 1;
+		}
+		lpImage->lpData = lpNew;
+		(*lpCapacity) = sRequired;
+	}
+	lpImage->numComponents = info.output_components;
+	lpImage->width = info.output_width;
+	lpImage->height = info.output_height;
+
+	while(info.output_scanline < info.output_height) {
+		lpRowBuffer[0] = &(lpImage->lpData[info.output_scanline * (lpImage->width * lpImage->numComponents)]);
+		jpeg_read_scanlines(&info, lpRowBuffer, 1);
+	}
+
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+	fclose(fHandle);
+	return 0;
+}
+
+int decodeJpegLuma(
+	struct imgRawImage* lpImage,
+	const unsigned char* lpSrc,
+	size_t sLen,
+	unsigned long int width,
+	unsigned long int height
+) {
+	struct jpeg_decompress_struct info;
+	struct jpegFileErrorMgr err;
+	unsigned char* lpRowBuffer[1];
+
+	if((lpImage == NULL) || (lpImage->lpLuma == NULL) || (lpSrc == NULL) || (sLen == 0)) {
+		return 1;
+	}
+
+	info.err = jpeg_std_error(&(err.mgr));
+	err.mgr.error_exit = &jpegFileErrorExit;
+	if(setjmp(err.jmpError)) {
+		jpeg_destroy_decompress(&info);
+		return 1;
+	}
+
+	jpeg_create_decompress(&info);
+	jpeg_mem_src(&info, (unsigned char*)lpSrc, sLen);
+	jpeg_read_header(&info, TRUE);
+
+	/* Only the Y channel is decoded, no colour conversion */
+	info.out_color_space = JCS_GRAYSCALE;
+	jpeg_start_decompress(&info);
+
+	if((info.output_width != width) || (info.output_height != height) || (info.output_components != 1)) {
+		jpeg_destroy_decompress(&info);
+		return 1;
+	}
+
+	while(info.output_scanline < info.output_height) {
+		lpRowBuffer[0] = &(lpImage->lpLuma[info.output_scanline * width]);
+		jpeg_read_scanlines(&info, lpRowBuffer, 1);
+	}
+	lpImage->width = width;
+	lpImage->height = height;
+
+	jpeg_finish_decompress(&info);
+	jpeg_destroy_decompress(&info);
+	return 0;
+}
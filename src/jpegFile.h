@@ -0,0 +1,71 @@
+#ifndef __JPEGFILE_H__
+#define __JPEGFILE_H__
+
+#include "./webcamBlobEstimator.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Write an RGB888 or single component (greyscale) image into a JPEG file
+*/
+int storeJpegImageFile(
+	const struct imgRawImage* lpImage,
+	char* lpFilename
+);
+
+/*
+	Encode an RGB888 or single component image into memory with the
+	given quality (1 to 100). *lpBuffer (*lpCapacity bytes, may be NULL)
+	is reused if it is large enough, else it is replaced by a larger
+	malloc'ed buffer and *lpCapacity is updated. *lpLen receives the
+	size of the encoded image
+*/
+int encodeJpegImage(
+	const struct imgRawImage* lpImage,
+	int iQuality,
+	unsigned char** lpBuffer,
+	size_t* lpCapacity,
+	size_t* lpLen
+);
+
+/*
+	Write an already encoded JPEG image into a file
+*/
+int storeJpegBufferFile(
+	const unsigned char* lpJpeg,
+	size_t sLen,
+	char* lpFilename
+);
+
+/*
+	Read a JPEG file into an RGB888 (or single component for greyscale
+	files) image. The image data buffer
+	is reused in case it's capacity (*lpCapacity bytes) is sufficient,
+	else it is reallocated and *lpCapacity is updated
+*/
+int loadJpegImageFile(
+	struct imgRawImage* lpImage,
+	size_t* lpCapacity,
+	char* lpFilename
+);
+
+/*
+	Decode a JPEG image from memory (for example an MJPEG frame) into
+	the planar luma of the image. lpLuma has to hold width * height
+	bytes; frames of a different size are rejected
+*/
+int decodeJpegLuma(
+	struct imgRawImage* lpImage,
+	const unsigned char* lpSrc,
+	size_t sLen,
+	unsigned long int width,
+	unsigned long int height
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __JPEGFILE_H__ */
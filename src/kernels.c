@@ -0,0 +1,731 @@
+/*
+	Runtime dispatched pixel kernels (see kernels.h)
+
+	Every kernel has a list of variants ordered from the highest to the
+	lowest level, the scalar variant is always last. The x86 variants
+	are compiled with target attributes so the rest of the binary keeps
+	the baseline instruction set and runs on every CPU.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define KERNELS_X86
+	#include <immintrin.h>
+#endif
+
+#include "./kernels.h"
+
+/*
+	Luma weights, the same expression as the historic conversion in
+	doubles so every variant truncates the same value
+*/
+#define KERNEL_LUMA_R							0.2126
+#define KERNEL_LUMA_G							0.7152
+#define KERNEL_LUMA_B							0.0722
+
+static const char* kernelIsaNames[KERNEL_ISA_COUNT] = {
+	"scalar",
+	"sse41",
+	"avx2",
+	"avx512"
+};
+
+/*
+	Scalar kernels
+*/
+
+static unsigned char kernelYUVPixelToLuma(unsigned char y, unsigned char u, unsigned char v) {
+	signed int c = ((signed int)y) - 16;
+	signed int d = ((signed int)u) - 128;
+	signed int e = ((signed int)v) - 128;
+	signed int r = ((298 * c + 409 * e + 128) >> 8);
+	signed int g = ((298 * c - 100 * d - 208 * e + 128) >> 8);
+	signed int b = ((298 * c + 516 * d + 128) >> 8);
+
+	if(r < 0) { r = 0; } else if(r > 255) { r = 255; }
+	if(g < 0) { g = 0; } else if(g > 255) { g = 255; }
+	if(b < 0) { b = 0; } else if(b > 255) { b = 255; }
+
+	return (unsigned char)(KERNEL_LUMA_R * r + KERNEL_LUMA_G * g + KERNEL_LUMA_B * b);
+}
+
+/*
+	A trailing odd pixel has no V byte of it's own (it ends the source),
+	it takes V of the previous pair or neutral chroma if it is alone
+*/
+static void kernelYUYVToLumaScalar(unsigned char* lpDst, const unsigned char* lpSrc, unsigned long int dwPixels) {
+	unsigned long int i;
+
+	for(i = 0; i + 2 <= dwPixels; i = i + 2) {
+		const unsigned char* lpPair = &(lpSrc[i * 2]);
+		lpDst[i] = kernelYUVPixelToLuma(lpPair[0], lpPair[1], lpPair[3]);
+		lpDst[i + 1] = kernelYUVPixelToLuma(lpPair[2], lpPair[1], lpPair[3]);
+	}
+	if(i < dwPixels) {
+		lpDst[i] = kernelYUVPixelToLuma(lpSrc[i * 2], lpSrc[i * 2 + 1], (i > 0) ? lpSrc[i * 2 - 1] : 128);
+	}
+}
+
+static void kernelRGBToLumaScalar(unsigned char* lpDst, const unsigned char* lpSrc, unsigned long int dwPixels, unsigned int dwComponents) {
+	unsigned long int i;
+
+	for(i = 0; i < dwPixels; i = i + 1) {
+		const unsigned char* lpPixel = &(lpSrc[i * dwComponents]);
+		lpDst[i] = (unsigned char)(KERNEL_LUMA_R * lpPixel[0] + KERNEL_LUMA_G * lpPixel[1] + KERNEL_LUMA_B * lpPixel[2]);
+	}
+}
+
+static unsigned long int kernelProjectRowScalar(
+	const unsigned char* lpRow,
+	unsigned long int dwWidth,
+	uint32_t* lpColumnSums,
+	const uint32_t* lpIntAbove,
+	uint32_t* lpIntRow,
+	const uint64_t* lpIntSqAbove,
+	uint64_t* lpIntSqRow
+) {
+	unsigned long int dwRowSum = 0;
+	uint64_t qwRowSumSq = 0;
+	unsigned long int x;
+
+	for(x = 0; x < dwWidth; x = x + 1) {
+		lpColumnSums[x] = lpColumnSums[x] + lpRow[x];
+		dwRowSum = dwRowSum + lpRow[x];
+		qwRowSumSq = qwRowSumSq + (uint64_t)(lpRow[x]) * (uint64_t)(lpRow[x]);
+		lpIntRow[x] = lpIntAbove[x] + (uint32_t)dwRowSum;
+		lpIntSqRow[x] = lpIntSqAbove[x] + qwRowSumSq;
+	}
+	return dwRowSum;
+}
+
+/*
+	8 pixels are compared at once inside a 64 bit word: the low 7 bits
+	of every byte are offset so they carry into the byte's top bit
+	exactly if they exceed the low bits of the threshold
+*/
+static uint64_t kernelThreshold64Scalar(const unsigned char* lpPixels, unsigned int dwThreshold) {
+	const uint64_t qwLow7 = 0x7F7F7F7F7F7F7F7FULL;
+	const uint64_t qwHigh = 0x8080808080808080ULL;
+	const uint64_t qwOffset = 0x0101010101010101ULL * (uint64_t)(0x7F - (dwThreshold & 0x7F));
+	uint64_t qwResult = 0;
+	unsigned int i;
+
+	for(i = 0; i < 8; i=i+1) {
+		uint64_t qwBytes = 0;
+		uint64_t qwGreater;
+		unsigned int j;
+
+		for(j = 0; j < 8; j=j+1) {
+			qwBytes |= ((uint64_t)lpPixels[i * 8 + j]) << (j * 8);
+		}
+
+		/* top bit set where the low 7 bits exceed the low 7 bits of the threshold */
+		qwGreater = (qwBytes & qwLow7) + qwOffset;
+		if(dwThreshold < 0x80) {
+			qwGreater = (qwGreater | qwBytes) & qwHigh;
+		} else {
+			qwGreater = qwGreater & qwBytes & qwHigh;
+		}
+
+		/* gather the top bits of the 8 bytes into 8 consecutive bits */
+		qwResult |= (((qwGreater >> 7) * 0x0102040810204080ULL) >> 56) << (i * 8);
+	}
+	return qwResult;
+}
+
+/*
+	average = average - average / 2^shift + frame * 256 / 2^shift stays
+	within 0..65280 for every shift up to 8, so it never overflows 16 bit
+*/
+static void kernelAccumulateScalar(uint16_t* lpAverage, unsigned char* lpReference, const unsigned char* lpFrame, unsigned long int dwPixels, unsigned int dwShift) {
+	unsigned long int i;
+
+	for(i = 0; i < dwPixels; i = i + 1) {
+		uint16_t wAverage = lpAverage[i];
+
+		wAverage = (uint16_t)(wAverage - (wAverage >> dwShift) + (((uint16_t)lpFrame[i]) << (8 - dwShift)));
+		lpAverage[i] = wAverage;
+		lpReference[i] = (unsigned char)(wAverage >> 8);
+	}
+}
+
+static void kernelDifferenceScalar(unsigned char* lpPositive, const unsigned char* lpFrame, const unsigned char* lpReference, unsigned long int dwPixels, uint64_t* lpPositiveSum, uint64_t* lpNegativeSum) {
+	uint64_t qwPositive = 0;
+	uint64_t qwNegative = 0;
+	unsigned long int i;
+
+	for(i = 0; i < dwPixels; i = i + 1) {
+		if(lpFrame[i] > lpReference[i]) {
+			lpPositive[i] = lpFrame[i] - lpReference[i];
+			qwPositive = qwPositive + (lpFrame[i] - lpReference[i]);
+		} else {
+			lpPositive[i] = 0;
+			qwNegative = qwNegative + (lpReference[i] - lpFrame[i]);
+		}
+	}
+	(*lpPositiveSum) = qwPositive;
+	(*lpNegativeSum) = qwNegative;
+}
+
+#ifdef KERNELS_X86
+	/*
+		SSE4.1 kernels
+
+		The YUV to RGB step runs in 32 bit lanes (pmulld), the weighting
+		in doubles with the same multiplications and additions in the
+		same order as the scalar code
+	*/
+	__attribute__((target("sse4.1")))
+	static __m128i kernelLumaFromRGB32SSE41(__m128i vR, __m128i vG, __m128i vB) {
+		const __m128d vWeightR = _mm_set1_pd(KERNEL_LUMA_R);
+		const __m128d vWeightG = _mm_set1_pd(KERNEL_LUMA_G);
+		const __m128d vWeightB = _mm_set1_pd(KERNEL_LUMA_B);
+		__m128d vLo, vHi;
+
+		vLo = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vWeightR, _mm_cvtepi32_pd(vR)), _mm_mul_pd(vWeightG, _mm_cvtepi32_pd(vG))), _mm_mul_pd(vWeightB, _mm_cvtepi32_pd(vB)));
+		vR = _mm_srli_si128(vR, 8);
+		vG = _mm_srli_si128(vG, 8);
+		vB = _mm_srli_si128(vB, 8);
+		vHi = _mm_add_pd(_mm_add_pd(_mm_mul_pd(vWeightR, _mm_cvtepi32_pd(vR)), _mm_mul_pd(vWeightG, _mm_cvtepi32_pd(vG))), _mm_mul_pd(vWeightB, _mm_cvtepi32_pd(vB)));
+
+		return _mm_unpacklo_epi64(_mm_cvttpd_epi32(vLo), _mm_cvttpd_epi32(vHi));
+	}
+
+	__attribute__((target("sse4.1")))
+	static __m128i kernelYUVToLuma32SSE41(__m128i vY, __m128i vU, __m128i vV) {
+		const __m128i vZero = _mm_setzero_si128();
+		const __m128i vMax = _mm_set1_epi32(255);
+		const __m128i vRound = _mm_set1_epi32(128);
+		__m128i vC = _mm_mullo_epi32(_mm_sub_epi32(vY, _mm_set1_epi32(16)), _mm_set1_epi32(298));
+		__m128i vD = _mm_sub_epi32(vU, vRound);
+		__m128i vE = _mm_sub_epi32(vV, vRound);
+		__m128i vR, vG, vB;
+
+		vC = _mm_add_epi32(vC, vRound);
+		vR = _mm_srai_epi32(_mm_add_epi32(vC, _mm_mullo_epi32(vE, _mm_set1_epi32(409))), 8);
+		vG = _mm_srai_epi32(_mm_sub_epi32(vC, _mm_add_epi32(_mm_mullo_epi32(vD, _mm_set1_epi32(100)), _mm_mullo_epi32(vE, _mm_set1_epi32(208)))), 8);
+		vB = _mm_srai_epi32(_mm_add_epi32(vC, _mm_mullo_epi32(vD, _mm_set1_epi32(516))), 8);
+
+		vR = _mm_min_epi32(_mm_max_epi32(vR, vZero), vMax);
+		vG = _mm_min_epi32(_mm_max_epi32(vG, vZero), vMax);
+		vB = _mm_min_epi32(_mm_max_epi32(vB, vZero), vMax);
+
+		return kernelLumaFromRGB32SSE41(vR, vG, vB);
+	}
+
+	/*
+		8 pixels (16 bytes) per iteration, split into Y, U and V lanes
+		with pshufb. At least two pixels are left to the tail so a
+		trailing odd pixel finds the previous pair
+	*/
+	__attribute__((target("sse4.1")))
+	static void kernelYUYVToLumaSSE41(unsigned char* lpDst, const unsigned char* lpSrc, unsigned long int dwPixels) {
+		const __m128i vShufY0 = _mm_setr_epi8(0, -1, -1, -1, 2, -1, -1, -1, 4, -1, -1, -1, 6, -1, -1, -1);
+		const __m128i vShufU0 = _mm_setr_epi8(1, -1, -1, -1, 1, -1, -1, -1, 5, -1, -1, -1, 5, -1, -1, -1);
+		const __m128i vShufV0 = _mm_setr_epi8(3, -1, -1, -1, 3, -1, -1, -1, 7, -1, -1, -1, 7, -1, -1, -1);
+		const __m128i vShufY1 = _mm_setr_epi8(8, -1, -1, -1, 10, -1, -1, -1, 12, -1, -1, -1, 14, -1, -1, -1);
+		const __m128i vShufU1 = _mm_setr_epi8(9, -1, -1, -1, 9, -1, -1, -1, 13, -1, -1, -1, 13, -1, -1, -1);
+		const __m128i vShufV1 = _mm_setr_epi8(11, -1, -1, -1, 11, -1, -1, -1, 15, -1, -1, -1, 15, -1, -1, -1);
+		unsigned long int i;
+
+		for(i = 0; i + 8 + 2 <= dwPixels; i = i + 8) {
+			__m128i vSrc = _mm_loadu_si128((const __m128i*)(&(lpSrc[i * 2])));
+			__m128i vLo = kernelYUVToLuma32SSE41(_mm_shuffle_epi8(vSrc, vShufY0), _mm_shuffle_epi8(vSrc, vShufU0), _mm_shuffle_epi8(vSrc, vShufV0));
+			__m128i vHi = kernelYUVToLuma32SSE41(_mm_shuffle_epi8(vSrc, vShufY1), _mm_shuffle_epi8(vSrc, vShufU1), _mm_shuffle_epi8(vSrc, vShufV1));
+			__m128i vLuma = _mm_packus_epi16(_mm_packs_epi32(vLo, vHi), vLo);
+
+			_mm_storel_epi64((__m128i*)(&(lpDst[i])), vLuma);
+		}
+		kernelYUYVToLumaScalar(&(lpDst[i]), &(lpSrc[i * 2]), dwPixels - i);
+	}
+
+	/*
+		4 pixels per iteration for three component RGB. The 16 byte load
+		reads 4 bytes past the 4 pixels, so the last pixels are left to
+		the scalar loop. Other layouts (RGBX) use the scalar kernel
+	*/
+	__attribute__((target("sse4.1")))
+	static void kernelRGBToLumaSSE41(unsigned char* lpDst, const unsigned char* lpSrc, unsigned long int dwPixels, unsigned int dwComponents) {
+		const __m128i vShufR = _mm_setr_epi8(0, -1, -1, -1, 3, -1, -1, -1, 6, -1, -1, -1, 9, -1, -1, -1);
+		const __m128i vShufG = _mm_setr_epi8(1, -1, -1, -1, 4, -1, -1, -1, 7, -1, -1, -1, 10, -1, -1, -1);
+		const __m128i vShufB = _mm_setr_epi8(2, -1, -1, -1, 5, -1, -1, -1, 8, -1, -1, -1, 11, -1, -1, -1);
+		unsigned long int i = 0;
+
+		if(dwComponents == 3) {
+			for(; i + 6 <= dwPixels; i = i + 4) {
+				__m128i vSrc = _mm_loadu_si128((const __m128i*)(&(lpSrc[i * 3])));
+				__m128i vLuma = kernelLumaFromRGB32SSE41(_mm_shuffle_epi8(vSrc, vShufR), _mm_shuffle_epi8(vSrc, vShufG), _mm_shuffle_epi8(vSrc, vShufB));
+				uint32_t dwLuma;
+
+				vLuma = _mm_packus_epi16(_mm_packs_epi32(vLuma, vLuma), vLuma);
+				dwLuma = (uint32_t)_mm_cvtsi128_si32(vLuma);
+				memcpy(&(lpDst[i]), &dwLuma, sizeof(dwLuma));
+			}
+		}
+		kernelRGBToLumaScalar(&(lpDst[i]), &(lpSrc[i * dwComponents]), dwPixels - i, dwComponents);
+	}
+
+	/*
+		4 pixels per iteration: column sums in 32 bit lanes, the running
+		row sums as prefix sums inside the register plus the carry of the
+		previous pixels. Squares are summed in 32 bit lanes (exact up to
+		65536 pixels per row) and widened for the 64 bit integral image
+	*/
+	__attribute__((target("sse4.1")))
+	static unsigned long int kernelProjectRowSSE41(
+		const unsigned char* lpRow,
+		unsigned long int dwWidth,
+		uint32_t* lpColumnSums,
+		const uint32_t* lpIntAbove,
+		uint32_t* lpIntRow,
+		const uint64_t* lpIntSqAbove,
+		uint64_t* lpIntSqRow
+	) {
+		__m128i vCarry = _mm_setzero_si128();
+		__m128i vCarrySq = _mm_setzero_si128();
+		unsigned long int dwRowSum;
+		uint64_t qwRowSumSq;
+		unsigned long int x = 0;
+
+		if(dwWidth > 65536) {
+			return kernelProjectRowScalar(lpRow, dwWidth, lpColumnSums, lpIntAbove, lpIntRow, lpIntSqAbove, lpIntSqRow);
+		}
+
+		for(; x + 4 <= dwWidth; x = x + 4) {
+			uint32_t dwBytes;
+			__m128i vPixels, vSquares;
+
+			memcpy(&dwBytes, &(lpRow[x]), sizeof(dwBytes));
+			vPixels = _mm_cvtepu8_epi32(_mm_cvtsi32_si128((int)dwBytes));
+			vSquares = _mm_mullo_epi32(vPixels, vPixels);
+
+			_mm_storeu_si128((__m128i*)(&(lpColumnSums[x])), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(&(lpColumnSums[x]))), vPixels));
+
+			vPixels = _mm_add_epi32(vPixels, _mm_slli_si128(vPixels, 4));
+			vPixels = _mm_add_epi32(vPixels, _mm_slli_si128(vPixels, 8));
+			vPixels = _mm_add_epi32(vPixels, vCarry);
+			vCarry = _mm_shuffle_epi32(vPixels, 0xFF);
+			_mm_storeu_si128((__m128i*)(&(lpIntRow[x])), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(&(lpIntAbove[x]))), vPixels));
+
+			vSquares = _mm_add_epi32(vSquares, _mm_slli_si128(vSquares, 4));
+			vSquares = _mm_add_epi32(vSquares, _mm_slli_si128(vSquares, 8));
+			vSquares = _mm_add_epi32(vSquares, vCarrySq);
+			vCarrySq = _mm_shuffle_epi32(vSquares, 0xFF);
+			_mm_storeu_si128((__m128i*)(&(lpIntSqRow[x])), _mm_add_epi64(_mm_loadu_si128((const __m128i*)(&(lpIntSqAbove[x]))), _mm_cvtepu32_epi64(vSquares)));
+			_mm_storeu_si128((__m128i*)(&(lpIntSqRow[x + 2])), _mm_add_epi64(_mm_loadu_si128((const __m128i*)(&(lpIntSqAbove[x + 2]))), _mm_cvtepu32_epi64(_mm_srli_si128(vSquares, 8))));
+		}
+
+		dwRowSum = (uint32_t)_mm_cvtsi128_si32(vCarry);
+		qwRowSumSq = (uint32_t)_mm_cvtsi128_si32(vCarrySq);
+		for(; x < dwWidth; x = x + 1) {
+			lpColumnSums[x] = lpColumnSums[x] + lpRow[x];
+			dwRowSum = dwRowSum + lpRow[x];
+			qwRowSumSq = qwRowSumSq + (uint64_t)(lpRow[x]) * (uint64_t)(lpRow[x]);
+			lpIntRow[x] = lpIntAbove[x] + (uint32_t)dwRowSum;
+			lpIntSqRow[x] = lpIntSqAbove[x] + qwRowSumSq;
+		}
+		return dwRowSum;
+	}
+
+	/*
+		16 pixels per compare, the unsigned compare is done as signed
+		compare after flipping the sign bit and collected with movemask
+	*/
+	__attribute__((target("sse4.1")))
+	static uint64_t kernelThreshold64SSE41(const unsigned char* lpPixels, unsigned int dwThreshold) {
+		__m128i vSign = _mm_set1_epi8((char)0x80);
+		__m128i vThreshold = _mm_set1_epi8((char)(dwThreshold ^ 0x80));
+		uint64_t qwResult = 0;
+		unsigned int i;
+
+		for(i = 0; i < 4; i=i+1) {
+			__m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(&(lpPixels[i * 16]))), vSign);
+			qwResult |= ((uint64_t)(unsigned int)_mm_movemask_epi8(_mm_cmpgt_epi8(v, vThreshold))) << (i * 16);
+		}
+		return qwResult;
+	}
+
+	/* Sum of both 64 bit lanes (without movq, which needs a 64 bit build) */
+	__attribute__((target("sse4.1")))
+	static uint64_t kernelSumLanes64SSE41(__m128i v) {
+		uint64_t qwLanes[2];
+
+		_mm_storeu_si128((__m128i*)qwLanes, v);
+		return qwLanes[0] + qwLanes[1];
+	}
+
+	/* 16 pixels per iteration, the averages in two registers of 8 lanes */
+	__attribute__((target("sse4.1")))
+	static void kernelAccumulateSSE41(uint16_t* lpAverage, unsigned char* lpReference, const unsigned char* lpFrame, unsigned long int dwPixels, unsigned int dwShift) {
+		const __m128i vZero = _mm_setzero_si128();
+		const __m128i vShift = _mm_cvtsi32_si128((int)dwShift);
+		const __m128i vUp = _mm_cvtsi32_si128((int)(8 - dwShift));
+		unsigned long int i;
+
+		for(i = 0; i + 16 <= dwPixels; i = i + 16) {
+			__m128i vFrame = _mm_loadu_si128((const __m128i*)(&(lpFrame[i])));
+			__m128i vLo = _mm_loadu_si128((const __m128i*)(&(lpAverage[i])));
+			__m128i vHi = _mm_loadu_si128((const __m128i*)(&(lpAverage[i + 8])));
+
+			vLo = _mm_add_epi16(_mm_sub_epi16(vLo, _mm_srl_epi16(vLo, vShift)), _mm_sll_epi16(_mm_unpacklo_epi8(vFrame, vZero), vUp));
+			vHi = _mm_add_epi16(_mm_sub_epi16(vHi, _mm_srl_epi16(vHi, vShift)), _mm_sll_epi16(_mm_unpackhi_epi8(vFrame, vZero), vUp));
+
+			_mm_storeu_si128((__m128i*)(&(lpAverage[i])), vLo);
+			_mm_storeu_si128((__m128i*)(&(lpAverage[i + 8])), vHi);
+			_mm_storeu_si128((__m128i*)(&(lpReference[i])), _mm_packus_epi16(_mm_srli_epi16(vLo, 8), _mm_srli_epi16(vHi, 8)));
+		}
+		kernelAccumulateScalar(&(lpAverage[i]), &(lpReference[i]), &(lpFrame[i]), dwPixels - i, dwShift);
+	}
+
+	/*
+		16 pixels per iteration: saturating subtraction in both directions
+		gives the positive and negative part, psadbw against zero sums
+		them into two 64 bit lanes
+	*/
+	__attribute__((target("sse4.1")))
+	static void kernelDifferenceSSE41(unsigned char* lpPositive, const unsigned char* lpFrame, const unsigned char* lpReference, unsigned long int dwPixels, uint64_t* lpPositiveSum, uint64_t* lpNegativeSum) {
+		const __m128i vZero = _mm_setzero_si128();
+		__m128i vPositive = _mm_setzero_si128();
+		__m128i vNegative = _mm_setzero_si128();
+		uint64_t qwPositive, qwNegative;
+		unsigned long int i;
+
+		for(i = 0; i + 16 <= dwPixels; i = i + 16) {
+			__m128i vFrame = _mm_loadu_si128((const __m128i*)(&(lpFrame[i])));
+			__m128i vReference = _mm_loadu_si128((const __m128i*)(&(lpReference[i])));
+			__m128i vUp = _mm_subs_epu8(vFrame, vReference);
+			__m128i vDown = _mm_subs_epu8(vReference, vFrame);
+
+			_mm_storeu_si128((__m128i*)(&(lpPositive[i])), vUp);
+			vPositive = _mm_add_epi64(vPositive, _mm_sad_epu8(vUp, vZero));
+			vNegative = _mm_add_epi64(vNegative, _mm_sad_epu8(vDown, vZero));
+		}
+
+		kernelDifferenceScalar(&(lpPositive[i]), &(lpFrame[i]), &(lpReference[i]), dwPixels - i, &qwPositive, &qwNegative);
+		(*lpPositiveSum) = qwPositive + kernelSumLanes64SSE41(vPositive);
+		(*lpNegativeSum) = qwNegative + kernelSumLanes64SSE41(vNegative);
+	}
+
+	/*
+		AVX2 kernels, the same algorithms with 8 lanes of 32 bit
+	*/
+	__attribute__((target("avx2")))
+	static __m128i kernelYUVToLuma32AVX2(__m128i vYBytes, __m128i vUBytes, __m128i vVBytes) {
+		const __m256i vZero = _mm256_setzero_si256();
+		const __m256i vMax = _mm256_set1_epi32(255);
+		const __m256i vRound = _mm256_set1_epi32(128);
+		const __m256d vWeightR = _mm256_set1_pd(KERNEL_LUMA_R);
+		const __m256d vWeightG = _mm256_set1_pd(KERNEL_LUMA_G);
+		const __m256d vWeightB = _mm256_set1_pd(KERNEL_LUMA_B);
+		__m256i vC = _mm256_mullo_epi32(_mm256_sub_epi32(_mm256_cvtepu8_epi32(vYBytes), _mm256_set1_epi32(16)), _mm256_set1_epi32(298));
+		__m256i vD = _mm256_sub_epi32(_mm256_cvtepu8_epi32(vUBytes), vRound);
+		__m256i vE = _mm256_sub_epi32(_mm256_cvtepu8_epi32(vVBytes), vRound);
+		__m256i vR, vG, vB;
+		__m256d vLo, vHi;
+
+		vC = _mm256_add_epi32(vC, vRound);
+		vR = _mm256_srai_epi32(_mm256_add_epi32(vC, _mm256_mullo_epi32(vE, _mm256_set1_epi32(409))), 8);
+		vG = _mm256_srai_epi32(_mm256_sub_epi32(vC, _mm256_add_epi32(_mm256_mullo_epi32(vD, _mm256_set1_epi32(100)), _mm256_mullo_epi32(vE, _mm256_set1_epi32(208)))), 8);
+		vB = _mm256_srai_epi32(_mm256_add_epi32(vC, _mm256_mullo_epi32(vD, _mm256_set1_epi32(516))), 8);
+
+		vR = _mm256_min_epi32(_mm256_max_epi32(vR, vZero), vMax);
+		vG = _mm256_min_epi32(_mm256_max_epi32(vG, vZero), vMax);
+		vB = _mm256_min_epi32(_mm256_max_epi32(vB, vZero), vMax);
+
+		vLo = _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(vWeightR, _mm256_cvtepi32_pd(_mm256_castsi256_si128(vR))),
+			_mm256_mul_pd(vWeightG, _mm256_cvtepi32_pd(_mm256_castsi256_si128(vG)))),
+			_mm256_mul_pd(vWeightB, _mm256_cvtepi32_pd(_mm256_castsi256_si128(vB))));
+		vHi = _mm256_add_pd(_mm256_add_pd(
+			_mm256_mul_pd(vWeightR, _mm256_cvtepi32_pd(_mm256_extracti128_si256(vR, 1))),
+			_mm256_mul_pd(vWeightG, _mm256_cvtepi32_pd(_mm256_extracti128_si256(vG, 1)))),
+			_mm256_mul_pd(vWeightB, _mm256_cvtepi32_pd(_mm256_extracti128_si256(vB, 1))));
+
+		return _mm_packs_epi32(_mm256_cvttpd_epi32(vLo), _mm256_cvttpd_epi32(vHi));
+	}
+
+	/* 16 pixels (32 bytes) per iteration, the tail as with SSE4.1 */
+	__attribute__((target("avx2")))
+	static void kernelYUYVToLumaAVX2(unsigned char* lpDst, const unsigned char* lpSrc, unsigned long int dwPixels) {
+		const __m128i vShufY = _mm_setr_epi8(0, 2, 4, 6, 8, 10, 12, 14, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i vShufU = _mm_setr_epi8(1, 1, 5, 5, 9, 9, 13, 13, -1, -1, -1, -1, -1, -1, -1, -1);
+		const __m128i vShufV = _mm_setr_epi8(3, 3, 7, 7, 11, 11, 15, 15, -1, -1, -1, -1, -1, -1, -1, -1);
+		unsigned long int i;
+
+		for(i = 0; i + 16 + 2 <= dwPixels; i = i + 16) {
+			__m128i vSrc0 = _mm_loadu_si128((const __m128i*)(&(lpSrc[i * 2])));
+			__m128i vSrc1 = _mm_loadu_si128((const __m128i*)(&(lpSrc[i * 2 + 16])));
+			__m128i vLo = kernelYUVToLuma32AVX2(_mm_shuffle_epi8(vSrc0, vShufY), _mm_shuffle_epi8(vSrc0, vShufU), _mm_shuffle_epi8(vSrc0, vShufV));
+			__m128i vHi = kernelYUVToLuma32AVX2(_mm_shuffle_epi8(vSrc1, vShufY), _mm_shuffle_epi8(vSrc1, vShufU), _mm_shuffle_epi8(vSrc1, vShufV));
+
+			_mm_storeu_si128((__m128i*)(&(lpDst[i])), _mm_packus_epi16(vLo, vHi));
+		}
+		kernelYUYVToLumaSSE41(&(lpDst[i]), &(lpSrc[i * 2]), dwPixels - i);
+	}
+
+	__attribute__((target("avx2")))
+	static unsigned long int kernelProjectRowAVX2(
+		const unsigned char* lpRow,
+		unsigned long int dwWidth,
+		uint32_t* lpColumnSums,
+		const uint32_t* lpIntAbove,
+		uint32_t* lpIntRow,
+		const uint64_t* lpIntSqAbove,
+		uint64_t* lpIntSqRow
+	) {
+		const __m256i vLast = _mm256_set1_epi32(7);
+		__m256i vCarry = _mm256_setzero_si256();
+		__m256i vCarrySq = _mm256_setzero_si256();
+		unsigned long int dwRowSum;
+		uint64_t qwRowSumSq;
+		unsigned long int x = 0;
+
+		if(dwWidth > 65536) {
+			return kernelProjectRowScalar(lpRow, dwWidth, lpColumnSums, lpIntAbove, lpIntRow, lpIntSqAbove, lpIntSqRow);
+		}
+
+		for(; x + 8 <= dwWidth; x = x + 8) {
+			__m256i vPixels = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(&(lpRow[x]))));
+			__m256i vSquares = _mm256_mullo_epi32(vPixels, vPixels);
+
+			_mm256_storeu_si256((__m256i*)(&(lpColumnSums[x])), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(&(lpColumnSums[x]))), vPixels));
+
+			/* Prefix sums inside both 128 bit halves, then the low half's total into the high half */
+			vPixels = _mm256_add_epi32(vPixels, _mm256_slli_si256(vPixels, 4));
+			vPixels = _mm256_add_epi32(vPixels, _mm256_slli_si256(vPixels, 8));
+			vPixels = _mm256_add_epi32(vPixels, _mm256_permute2x128_si256(_mm256_shuffle_epi32(vPixels, 0xFF), _mm256_shuffle_epi32(vPixels, 0xFF), 0x08));
+			vPixels = _mm256_add_epi32(vPixels, vCarry);
+			vCarry = _mm256_permutevar8x32_epi32(vPixels, vLast);
+			_mm256_storeu_si256((__m256i*)(&(lpIntRow[x])), _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(&(lpIntAbove[x]))), vPixels));
+
+			vSquares = _mm256_add_epi32(vSquares, _mm256_slli_si256(vSquares, 4));
+			vSquares = _mm256_add_epi32(vSquares, _mm256_slli_si256(vSquares, 8));
+			vSquares = _mm256_add_epi32(vSquares, _mm256_permute2x128_si256(_mm256_shuffle_epi32(vSquares, 0xFF), _mm256_shuffle_epi32(vSquares, 0xFF), 0x08));
+			vSquares = _mm256_add_epi32(vSquares, vCarrySq);
+			vCarrySq = _mm256_permutevar8x32_epi32(vSquares, vLast);
+			_mm256_storeu_si256((__m256i*)(&(lpIntSqRow[x])), _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(&(lpIntSqAbove[x]))), _mm256_cvtepu32_epi64(_mm256_castsi256_si128(vSquares))));
+			_mm256_storeu_si256((__m256i*)(&(lpIntSqRow[x + 4])), _mm256_add_epi64(_mm256_loadu_si256((const __m256i*)(&(lpIntSqAbove[x + 4]))), _mm256_cvtepu32_epi64(_mm256_extracti128_si256(vSquares, 1))));
+		}
+
+		dwRowSum = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(vCarry));
+		qwRowSumSq = (uint32_t)_mm_cvtsi128_si32(_mm256_castsi256_si128(vCarrySq));
+		for(; x < dwWidth; x = x + 1) {
+			lpColumnSums[x] = lpColumnSums[x] + lpRow[x];
+			dwRowSum = dwRowSum + lpRow[x];
+			qwRowSumSq = qwRowSumSq + (uint64_t)(lpRow[x]) * (uint64_t)(lpRow[x]);
+			lpIntRow[x] = lpIntAbove[x] + (uint32_t)dwRowSum;
+			lpIntSqRow[x] = lpIntSqAbove[x] + qwRowSumSq;
+		}
+		return dwRowSum;
+	}
+
+	__attribute__((target("avx2")))
+	static uint64_t kernelThreshold64AVX2(const unsigned char* lpPixels, unsigned int dwThreshold) {
+		__m256i vSign = _mm256_set1_epi8((char)0x80);
+		__m256i vThreshold = _mm256_set1_epi8((char)(dwThreshold ^ 0x80));
+		__m256i vLo = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(&(lpPixels[0]))), vSign);
+		__m256i vHi = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(&(lpPixels[32]))), vSign);
+
+		return ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(vLo, vThreshold)))
+			| (((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpgt_epi8(vHi, vThreshold))) << 32);
+	}
+
+	/*
+		32 pixels per iteration. The pack works per 128 bit half, the
+		permute restores the pixel order of the references
+	*/
+	__attribute__((target("avx2")))
+	static void kernelAccumulateAVX2(uint16_t* lpAverage, unsigned char* lpReference, const unsigned char* lpFrame, unsigned long int dwPixels, unsigned int dwShift) {
+		const __m128i vShift = _mm_cvtsi32_si128((int)dwShift);
+		const __m128i vUp = _mm_cvtsi32_si128((int)(8 - dwShift));
+		unsigned long int i;
+
+		for(i = 0; i + 32 <= dwPixels; i = i + 32) {
+			__m256i vFrameLo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(&(lpFrame[i]))));
+			__m256i vFrameHi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(&(lpFrame[i + 16]))));
+			__m256i vLo = _mm256_loadu_si256((const __m256i*)(&(lpAverage[i])));
+			__m256i vHi = _mm256_loadu_si256((const __m256i*)(&(lpAverage[i + 16])));
+
+			vLo = _mm256_add_epi16(_mm256_sub_epi16(vLo, _mm256_srl_epi16(vLo, vShift)), _mm256_sll_epi16(vFrameLo, vUp));
+			vHi = _mm256_add_epi16(_mm256_sub_epi16(vHi, _mm256_srl_epi16(vHi, vShift)), _mm256_sll_epi16(vFrameHi, vUp));
+
+			_mm256_storeu_si256((__m256i*)(&(lpAverage[i])), vLo);
+			_mm256_storeu_si256((__m256i*)(&(lpAverage[i + 16])), vHi);
+			_mm256_storeu_si256((__m256i*)(&(lpReference[i])), _mm256_permute4x64_epi64(_mm256_packus_epi16(_mm256_srli_epi16(vLo, 8), _mm256_srli_epi16(vHi, 8)), 0xD8));
+		}
+		kernelAccumulateSSE41(&(lpAverage[i]), &(lpReference[i]), &(lpFrame[i]), dwPixels - i, dwShift);
+	}
+
+	__attribute__((target("avx2")))
+	static void kernelDifferenceAVX2(unsigned char* lpPositive, const unsigned char* lpFrame, const unsigned char* lpReference, unsigned long int dwPixels, uint64_t* lpPositiveSum, uint64_t* lpNegativeSum) {
+		const __m256i vZero = _mm256_setzero_si256();
+		__m256i vPositive = _mm256_setzero_si256();
+		__m256i vNegative = _mm256_setzero_si256();
+		uint64_t qwPositive, qwNegative;
+		unsigned long int i;
+
+		for(i = 0; i + 32 <= dwPixels; i = i + 32) {
+			__m256i vFrame = _mm256_loadu_si256((const __m256i*)(&(lpFrame[i])));
+			__m256i vReference = _mm256_loadu_si256((const __m256i*)(&(lpReference[i])));
+			__m256i vUp = _mm256_subs_epu8(vFrame, vReference);
+			__m256i vDown = _mm256_subs_epu8(vReference, vFrame);
+
+			_mm256_storeu_si256((__m256i*)(&(lpPositive[i])), vUp);
+			vPositive = _mm256_add_epi64(vPositive, _mm256_sad_epu8(vUp, vZero));
+			vNegative = _mm256_add_epi64(vNegative, _mm256_sad_epu8(vDown, vZero));
+		}
+
+		kernelDifferenceSSE41(&(lpPositive[i]), &(lpFrame[i]), &(lpReference[i]), dwPixels - i, &qwPositive, &qwNegative);
+		(*lpPositiveSum) = qwPositive + kernelSumLanes64SSE41(_mm_add_epi64(_mm256_castsi256_si128(vPositive), _mm256_extracti128_si256(vPositive, 1)));
+		(*lpNegativeSum) = qwNegative + kernelSumLanes64SSE41(_mm_add_epi64(_mm256_castsi256_si128(vNegative), _mm256_extracti128_si256(vNegative, 1)));
+	}
+
+	/*
+		AVX-512BW compares all 64 pixels unsigned into a mask register
+	*/
+	__attribute__((target("avx512f,avx512bw")))
+	static uint64_t kernelThreshold64AVX512(const unsigned char* lpPixels, unsigned int dwThreshold) {
+		return (uint64_t)_mm512_cmpgt_epu8_mask(_mm512_loadu_si512((const void*)lpPixels), _mm512_set1_epi8((char)dwThreshold));
+	}
+#endif
+
+/*
+	Variant lists, highest level first
+*/
+typedef void (*kernelGenericFn)(void);
+
+struct kernelVariant {
+	enum kernelIsa			isa;
+	kernelGenericFn			fn;
+};
+
+static const struct kernelVariant kernelVariantsYUYVToLuma[] = {
+	#ifdef KERNELS_X86
+		{ kernelIsa_AVX2,	(kernelGenericFn)kernelYUYVToLumaAVX2 },
+		{ kernelIsa_SSE41,	(kernelGenericFn)kernelYUYVToLumaSSE41 },
+	#endif
+	{ kernelIsa_Scalar,		(kernelGenericFn)kernelYUYVToLumaScalar }
+};
+static const struct kernelVariant kernelVariantsRGBToLuma[] = {
+	#ifdef KERNELS_X86
+		{ kernelIsa_SSE41,	(kernelGenericFn)kernelRGBToLumaSSE41 },
+	#endif
+	{ kernelIsa_Scalar,		(kernelGenericFn)kernelRGBToLumaScalar }
+};
+static const struct kernelVariant kernelVariantsProjectRow[] = {
+	#ifdef KERNELS_X86
+		{ kernelIsa_AVX2,	(kernelGenericFn)kernelProjectRowAVX2 },
+		{ kernelIsa_SSE41,	(kernelGenericFn)kernelProjectRowSSE41 },
+	#endif
+	{ kernelIsa_Scalar,		(kernelGenericFn)kernelProjectRowScalar }
+};
+static const struct kernelVariant kernelVariantsThreshold64[] = {
+	#ifdef KERNELS_X86
+		{ kernelIsa_AVX512,	(kernelGenericFn)kernelThreshold64AVX512 },
+		{ kernelIsa_AVX2,	(kernelGenericFn)kernelThreshold64AVX2 },
+		{ kernelIsa_SSE41,	(kernelGenericFn)kernelThreshold64SSE41 },
+	#endif
+	{ kernelIsa_Scalar,		(kernelGenericFn)kernelThreshold64Scalar }
+};
+static const struct kernelVariant kernelVariantsAccumulate[] = {
+	#ifdef KERNELS_X86
+		{ kernelIsa_AVX2,	(kernelGenericFn)kernelAccumulateAVX2 },
+		{ kernelIsa_SSE41,	(kernelGenericFn)kernelAccumulateSSE41 },
+	#endif
+	{ kernelIsa_Scalar,		(kernelGenericFn)kernelAccumulateScalar }
+};
+static const struct kernelVariant kernelVariantsDifference[] = {
+	#ifdef KERNELS_X86
+		{ kernelIsa_AVX2,	(kernelGenericFn)kernelDifferenceAVX2 },
+		{ kernelIsa_SSE41,	(kernelGenericFn)kernelDifferenceSSE41 },
+	#endif
+	{ kernelIsa_Scalar,		(kernelGenericFn)kernelDifferenceScalar }
+};
+
+static kernelGenericFn kernelVariantSelect(const struct kernelVariant* lpVariants, enum kernelIsa isa, enum kernelIsa* lpSelected) {
+	unsigned long int i;
+
+	/* The scalar variant terminates every list */
+	for(i = 0; lpVariants[i].isa > isa; i=i+1) { }
+	*lpSelected = lpVariants[i].isa;
+	return lpVariants[i].fn;
+}
+
+enum kernelIsa kernelIsaSupported(void) {
+	#ifdef KERNELS_X86
+		__builtin_cpu_init();
+		if((__builtin_cpu_supports("avx512f")) && (__builtin_cpu_supports("avx512bw"))) { return kernelIsa_AVX512; }
+		if(__builtin_cpu_supports("avx2")) { return kernelIsa_AVX2; }
+		if(__builtin_cpu_supports("sse4.1")) { return kernelIsa_SSE41; }
+	#endif
+	return kernelIsa_Scalar;
+}
+
+int kernelTableSelect(
+	struct kernelTable* lpTable,
+	enum kernelIsa isa
+) {
+	enum kernelIsa isaSupported = kernelIsaSupported();
+	int bReduced = 0;
+
+	if(lpTable == NULL) { return 1; }
+	if(isa > isaSupported) {
+		isa = isaSupported;
+		bReduced = 1;
+	}
+
+	lpTable->isa = isa;
+	lpTable->yuyvToLuma = (kernelYUYVToLumaFn)kernelVariantSelect(kernelVariantsYUYVToLuma, isa, &(lpTable->isaYUYVToLuma));
+	lpTable->rgbToLuma = (kernelRGBToLumaFn)kernelVariantSelect(kernelVariantsRGBToLuma, isa, &(lpTable->isaRGBToLuma));
+	lpTable->projectRow = (kernelProjectRowFn)kernelVariantSelect(kernelVariantsProjectRow, isa, &(lpTable->isaProjectRow));
+	lpTable->threshold64 = (kernelThreshold64Fn)kernelVariantSelect(kernelVariantsThreshold64, isa, &(lpTable->isaThreshold64));
+	lpTable->accumulate = (kernelAccumulateFn)kernelVariantSelect(kernelVariantsAccumulate, isa, &(lpTable->isaAccumulate));
+	lpTable->difference = (kernelDifferenceFn)kernelVariantSelect(kernelVariantsDifference, isa, &(lpTable->isaDifference));
+	return bReduced;
+}
+
+const char* kernelIsaName(enum kernelIsa isa) {
+	if(((int)isa < 0) || ((int)isa >= KERNEL_ISA_COUNT)) { return "unknown"; }
+	return kernelIsaNames[isa];
+}
+
+int kernelParseIsa(const char* lpName, enum kernelIsa* lpIsaOut) {
+	int i;
+
+	if((lpName == NULL) || (lpIsaOut == NULL)) { return 1; }
+	for(i = 0; i < KERNEL_ISA_COUNT; i=i+1) {
+		if(strcmp(lpName, kernelIsaNames[i]) == 0) {
+			(*lpIsaOut) = (enum kernelIsa)i;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static struct kernelTable kernelTableProcess;
+static pthread_once_t kernelTableOnce = PTHREAD_ONCE_INIT;
+
+static void kernelTableInit(void) {
+	enum kernelIsa isa = kernelIsa_AVX512;
+	const char* lpOverride = getenv(KERNEL_ENVIRONMENT);
+
+	if((lpOverride != NULL) && (lpOverride[0] != 0)) {
+		if(kernelParseIsa(lpOverride, &isa) != 0) {
+			printf("Unknown kernel level %s in %s, using the best supported one\n", lpOverride, KERNEL_ENVIRONMENT);
+			isa = kernelIsa_AVX512;
+		} else if(isa > kernelIsaSupported()) {
+			printf("Kernel level %s is not supported by this CPU, using %s\n", lpOverride, kernelIsaName(kernelIsaSupported()));
+		}
+	}
+	kernelTableSelect(&kernelTableProcess, isa);
+}
+
+const struct kernelTable* kernelTableGet(void) {
+	pthread_once(&kernelTableOnce, kernelTableInit);
+	return &kernelTableProcess;
+}
@@ -0,0 +1,159 @@
+#ifndef __KERNELS_H__
+#define __KERNELS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Runtime dispatched pixel kernels
+
+	The hot loops of the pipeline (luma conversion per pixel format,
+	projections with integral images, the threshold of the tracer and
+	the rolling reference and difference of the differential imaging)
+	are compiled in several variants for different instruction sets
+	within the same binary (scalar, SSE4.1, AVX2, AVX-512BW on x86,
+	scalar elsewhere). On first use the best variant the CPU supports is
+	selected for every kernel; kernels without a variant for the
+	selected level use the next lower one. All variants produce
+	bit identical results.
+
+	The environment variable WEBCAMBLOBESTIMATOR_KERNELS (scalar, sse41,
+	avx2 or avx512) limits the level, for example to test the fallback
+	paths. Levels the CPU does not support are reduced to the best
+	supported one.
+*/
+enum kernelIsa {
+	kernelIsa_Scalar							= 0,
+	kernelIsa_SSE41								= 1,
+	kernelIsa_AVX2								= 2,
+	kernelIsa_AVX512							= 3,
+};
+
+#define KERNEL_ISA_COUNT						4
+#define KERNEL_ENVIRONMENT						"WEBCAMBLOBESTIMATOR_KERNELS"
+
+/*
+	YUYV (4 bytes per pixel pair) to luma for dwPixels pixels. lpSrc
+	holds 2 * dwPixels bytes, an odd last pixel uses the chroma of the
+	previous pair
+*/
+typedef void (*kernelYUYVToLumaFn)(
+	unsigned char* lpDst,
+	const unsigned char* lpSrc,
+	unsigned long int dwPixels
+);
+
+/*
+	Interleaved RGB (dwComponents >= 3 bytes per pixel) to luma
+*/
+typedef void (*kernelRGBToLumaFn)(
+	unsigned char* lpDst,
+	const unsigned char* lpSrc,
+	unsigned long int dwPixels,
+	unsigned int dwComponents
+);
+
+/*
+	One row of the projection pass: adds the row to the column sums,
+	writes the integral image rows (entry x is the entry above plus the
+	sum over the row up to and including x, modulo 2^32 for the luma
+	sums) and returns the row sum
+*/
+typedef unsigned long int (*kernelProjectRowFn)(
+	const unsigned char* lpRow,
+	unsigned long int dwWidth,
+	uint32_t* lpColumnSums,
+	const uint32_t* lpIntAbove,
+	uint32_t* lpIntRow,
+	const uint64_t* lpIntSqAbove,
+	uint64_t* lpIntSqRow
+);
+
+/*
+	Bit x of the result is set if lpPixels[x] > dwThreshold (64 pixels)
+*/
+typedef uint64_t (*kernelThreshold64Fn)(
+	const unsigned char* lpPixels,
+	unsigned int dwThreshold
+);
+
+/*
+	Rolling reference update: every 8.8 fixed point average moves by
+	1/2^dwShift (dwShift 0 to 8) towards the frame, lpReference receives
+	the averages rounded down to 8 bit
+*/
+typedef void (*kernelAccumulateFn)(
+	uint16_t* lpAverage,
+	unsigned char* lpReference,
+	const unsigned char* lpFrame,
+	unsigned long int dwPixels,
+	unsigned int dwShift
+);
+
+/*
+	Writes the positive part of lpFrame - lpReference into lpPositive
+	and returns the sums of the positive and (as positive number) the
+	negative differences
+*/
+typedef void (*kernelDifferenceFn)(
+	unsigned char* lpPositive,
+	const unsigned char* lpFrame,
+	const unsigned char* lpReference,
+	unsigned long int dwPixels,
+	uint64_t* lpPositiveSum,
+	uint64_t* lpNegativeSum
+);
+
+struct kernelTable {
+	enum kernelIsa			isa;				/* Level the table was selected for */
+
+	kernelYUYVToLumaFn		yuyvToLuma;
+	kernelRGBToLumaFn		rgbToLuma;
+	kernelProjectRowFn		projectRow;
+	kernelThreshold64Fn		threshold64;
+	kernelAccumulateFn		accumulate;
+	kernelDifferenceFn		difference;
+
+	enum kernelIsa			isaYUYVToLuma;		/* Level of the selected variants */
+	enum kernelIsa			isaRGBToLuma;
+	enum kernelIsa			isaProjectRow;
+	enum kernelIsa			isaThreshold64;
+	enum kernelIsa			isaAccumulate;
+	enum kernelIsa			isaDifference;
+};
+
+/*
+	Table of the process (selected once, thread safe)
+*/
+const struct kernelTable* kernelTableGet(void);
+
+/*
+	Best level the CPU supports
+*/
+enum kernelIsa kernelIsaSupported(void);
+
+/*
+	Fills a table with the best variants up to isa (reduced to the
+	supported level). Returns 0 if the level is supported, 1 if it has
+	been reduced
+*/
+int kernelTableSelect(
+	struct kernelTable* lpTable,
+	enum kernelIsa isa
+);
+
+/*
+	Name of a level and the reverse (0 on success)
+*/
+const char* kernelIsaName(enum kernelIsa isa);
+int kernelParseIsa(const char* lpName, enum kernelIsa* lpIsaOut);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __KERNELS_H__ */
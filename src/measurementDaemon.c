@@ -0,0 +1,463 @@
+/*
+	Persistent measurement daemon (see measurementDaemon.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <math.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./captureDevice.h"
+#include "./blobEstimator.h"
+#include "./sweepScheduler.h"
+#include "./measurementDaemon.h"
+
+#define MEASUREMENTDAEMON_DEFAULT_SETTLEMS		50
+
+struct measurementDaemonContext {
+	struct blobEstimator*			lpEstimator;
+	struct blobEstimatorSettings	settings;
+	unsigned long int				dwSettleMs;
+
+	#ifdef SSG_ENABLE
+		struct siglentSSG3021x*		lpSSG3021X;
+	#endif
+
+	int								hClient;
+	int								bShutdown;
+};
+
+static volatile sig_atomic_t measurementDaemonStop = 0;
+
+static void measurementDaemonSignalHandler(int iSignal) {
+	(void)iSignal;
+	measurementDaemonStop = 1;
+}
+
+static int measurementDaemonReadFull(int hHandle, void* lpBuffer, size_t sLen) {
+	size_t sDone = 0;
+
+	while(sDone < sLen) {
+		ssize_t r = read(hHandle, ((unsigned char*)lpBuffer) + sDone, sLen - sDone);
+		if(r == 0) {
+			return 1; /* Client closed the connection */
+		}
+		if(r < 0) {
+			if((errno == EINTR) && (measurementDaemonStop == 0)) { continue; }
+			return 1;
+		}
+		sDone = sDone + (size_t)r;
+	}
+	return 0;
+}
+
+static int measurementDaemonWriteFull(int hHandle, const void* lpBuffer, size_t sLen) {
+	size_t sDone = 0;
+
+	while(sDone < sLen) {
+		ssize_t r = write(hHandle, ((const unsigned char*)lpBuffer) + sDone, sLen - sDone);
+		if(r < 0) {
+			if(errno == EINTR) { continue; }
+			return 1;
+		}
+		sDone = sDone + (size_t)r;
+	}
+	return 0;
+}
+
+static int measurementDaemonRespond(
+	struct measurementDaemonContext* lpContext,
+	uint16_t wCommand,
+	uint16_t wStatus,
+	uint32_t dwIndex,
+	const void* lpPayload,
+	uint32_t dwPayloadLen,
+	const void* lpExtra,
+	uint32_t dwExtraLen
+) {
+	struct measurementDaemonResponse resp;
+
+	resp.dwMagic = MEASUREMENTDAEMON_MAGIC;
+	resp.wCommand = wCommand;
+	resp.wStatus = wStatus;
+	resp.dwPayloadLen = dwPayloadLen + dwExtraLen;
+	resp.dwIndex = dwIndex;
+
+	if(measurementDaemonWriteFull(lpContext->hClient, &resp, sizeof(resp)) != 0) { return 1; }
+	if(dwPayloadLen > 0) {
+		if(measurementDaemonWriteFull(lpContext->hClient, lpPayload, dwPayloadLen) != 0) { return 1; }
+	}
+	if(dwExtraLen > 0) {
+		if(measurementDaemonWriteFull(lpContext->hClient, lpExtra, dwExtraLen) != 0) { return 1; }
+	}
+	return 0;
+}
+
+static void measurementDaemonFillFit(
+	double* lpValues,
+	double* lpErrors,
+	const struct profileFitResult* lpFit
+) {
+	int i;
+
+	if((lpFit == NULL) || (lpFit->bValid == 0)) {
+		for(i = 0; i < 4; i=i+1) { lpValues[i] = NAN; lpErrors[i] = NAN; }
+		return;
+	}
+	lpValues[0] = lpFit->dCenter;		lpErrors[0] = lpFit->dCenterErr;
+	lpValues[1] = lpFit->dSigma;		lpErrors[1] = lpFit->dSigmaErr;
+	lpValues[2] = lpFit->dAmplitude;	lpErrors[2] = lpFit->dAmplitudeErr;
+	lpValues[3] = lpFit->dOffset;		lpErrors[3] = lpFit->dOffsetErr;
+}
+
+static void measurementDaemonFillResult(
+	struct measurementDaemonContext* lpContext,
+	const struct blobEstimatorResult* lpResult,
+	unsigned long int frq,
+	struct measurementDaemonResult* lpOut
+) {
+	const struct captureDevice* lpDevice = blobEstimatorDevice(lpContext->lpEstimator);
+
+	memset(lpOut, 0, sizeof(struct measurementDaemonResult));
+	lpOut->qwFrequency = frq;
+	lpOut->qwTimestampUsec = ((uint64_t)lpResult->tvTimestamp.tv_sec) * 1000000ULL + (uint64_t)lpResult->tvTimestamp.tv_usec;
+	lpOut->dwSequence = lpResult->dwSequence;
+	lpOut->iExposure = lpResult->dwExposure;
+	lpOut->bDetected = (lpResult->bDetected != 0) ? 1 : 0;
+	lpOut->dwWidth = lpDevice->width;
+	lpOut->dwHeight = lpDevice->height;
+
+	measurementDaemonFillFit(lpOut->dFitX, lpOut->dFitXErr, (lpResult->bDetected != 0) ? &(lpResult->blob.fitX) : NULL);
+	measurementDaemonFillFit(lpOut->dFitY, lpOut->dFitYErr, (lpResult->bDetected != 0) ? &(lpResult->blob.fitY) : NULL);
+
+	if(lpResult->bDetected != 0) {
+		lpOut->qwClusterPixelArea = lpResult->blob.clusterPixelArea;
+		lpOut->qwSaturatedPixels = lpResult->blob.dwSaturatedPixels;
+		lpOut->dAreaSum = lpResult->blob.dAreaSum;
+		lpOut->dwPeakValue = lpResult->blob.dwPeakValue;
+		lpOut->dwXMin = lpResult->blob.bounds.xMin;
+		lpOut->dwXMax = lpResult->blob.bounds.xMax;
+		lpOut->dwYMin = lpResult->blob.bounds.yMin;
+		lpOut->dwYMax = lpResult->blob.bounds.yMax;
+	}
+}
+
+static uint16_t measurementDaemonSettingsApply(
+	struct measurementDaemonContext* lpContext,
+	const struct measurementDaemonSettings* lpSettings
+) {
+	struct blobEstimatorSettings newSettings;
+
+	memcpy(&newSettings, &(lpContext->settings), sizeof(struct blobEstimatorSettings));
+	newSettings.detector.dProjectionThreshold = lpSettings->dProjectionThreshold;
+	newSettings.detector.dAssociationThreshold = lpSettings->dAssociationThreshold;
+	newSettings.dExposureTarget = lpSettings->dExposureTarget;
+	newSettings.dStabilityTolerance = lpSettings->dStabilityTolerance;
+	newSettings.dwMaxAttempts = lpSettings->dwMaxAttempts;
+
+	if((newSettings.detector.dProjectionThreshold <= 0) || (newSettings.detector.dProjectionThreshold >= 1)) { return measurementDaemonStatus_InvalidRequest; }
+	if((newSettings.detector.dAssociationThreshold <= 0) || (newSettings.detector.dAssociationThreshold >= 1)) { return measurementDaemonStatus_InvalidRequest; }
+
+	switch(blobEstimatorConfigure(lpContext->lpEstimator, &newSettings)) {
+		case cameraE_Ok:			break;
+		case cameraE_InvalidParam:	return measurementDaemonStatus_InvalidRequest;
+		default:					return measurementDaemonStatus_Failed;
+	}
+	memcpy(&(lpContext->settings), &newSettings, sizeof(struct blobEstimatorSettings));
+	lpContext->dwSettleMs = lpSettings->dwSettleMs;
+	return measurementDaemonStatus_Ok;
+}
+
+static int measurementDaemonDetect(
+	struct measurementDaemonContext* lpContext,
+	const struct measurementDaemonRequest* lpRequest,
+	const struct timespec* lpReceived
+) {
+	unsigned long int dwCount = (lpRequest->dwCount == 0) ? 1 : lpRequest->dwCount;
+	unsigned long int i;
+
+	for(i = 0; i < dwCount; i=i+1) {
+		struct blobEstimatorResult res;
+		struct measurementDaemonResult out;
+		const struct timespec* lpNotBefore = NULL;
+
+		/* Only the first frame can be older than the request */
+		if(((lpRequest->wFlags & MEASUREMENTDAEMON_FLAG_FRESH) != 0) && (i == 0)) {
+			lpNotBefore = lpReceived;
+		}
+
+		if(blobEstimatorGrab(lpContext->lpEstimator, lpNotBefore, &res) != cameraE_Ok) {
+			return measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Failed, i, NULL, 0, NULL, 0);
+		}
+		measurementDaemonFillResult(lpContext, &res, 0, &out);
+
+		if(lpRequest->wCommand == measurementDaemonCommand_Capture) {
+			/* Only a single image per request */
+			const struct imgRawImage* lpImg = blobEstimatorImage(lpContext->lpEstimator);
+			if(measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Ok, i, &out, sizeof(out), lpImg->lpLuma, out.dwWidth * out.dwHeight) != 0) { return 1; }
+			return measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Ok, 1, NULL, 0, NULL, 0);
+		}
+		if(measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Ok, i, &out, sizeof(out), NULL, 0) != 0) { return 1; }
+	}
+
+	return measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Ok, dwCount, NULL, 0, NULL, 0);
+}
+
+static int measurementDaemonSweep(
+	struct measurementDaemonContext* lpContext,
+	const struct measurementDaemonRequest* lpRequest,
+	const struct measurementDaemonSweep* lpSweepRequest
+) {
+	#ifndef SSG_ENABLE
+		(void)lpSweepRequest;
+		return measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Unsupported, 0, NULL, 0, NULL, 0);
+	#else
+		struct sweepScheduler sweep;
+		unsigned long int frq;
+		unsigned long int dwIndex = 0;
+		int bRfEnabled = 0;
+		uint16_t wStatus = measurementDaemonStatus_Ok;
+		struct timespec tsSettled;
+
+		if(lpContext->lpSSG3021X == NULL) {
+			return measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Unsupported, 0, NULL, 0, NULL, 0);
+		}
+		if(sweepSchedulerInit(&sweep, lpSweepRequest->qwFrqStart, lpSweepRequest->qwFrqEnd, lpSweepRequest->qwFrqStep, lpSweepRequest->dwBudget, 0, 0) != 0) {
+			return measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_InvalidRequest, 0, NULL, 0, NULL, 0);
+		}
+
+		if((lpContext->lpSSG3021X->vtbl->rfOutEnable(lpContext->lpSSG3021X, 0) != labE_Ok) || (lpContext->lpSSG3021X->vtbl->rfSetPower(lpContext->lpSSG3021X, lpSweepRequest->dPower) != labE_Ok)) {
+			sweepSchedulerRelease(&sweep);
+			return measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Failed, 0, NULL, 0, NULL, 0);
+		}
+
+		while((measurementDaemonStop == 0) && (sweepSchedulerNext(&sweep, &frq) == 0)) {
+			struct blobEstimatorResult res;
+			struct measurementDaemonResult out;
+
+			if(sweepRetune(lpContext->lpSSG3021X, frq, &bRfEnabled) != labE_Ok) {
+				wStatus = measurementDaemonStatus_Failed;
+				break;
+			}
+			sweepSettleDeadline(&tsSettled, lpContext->dwSettleMs);
+
+			if(blobEstimatorGrab(lpContext->lpEstimator, &tsSettled, &res) != cameraE_Ok) {
+				wStatus = measurementDaemonStatus_Failed;
+				break;
+			}
+			sweepSchedulerRecord(&sweep, frq, (res.bDetected != 0) ? &(res.blob) : NULL, res.dwExposure);
+
+			measurementDaemonFillResult(lpContext, &res, frq, &out);
+			if(measurementDaemonRespond(lpContext, lpRequest->wCommand, measurementDaemonStatus_Ok, dwIndex, &out, sizeof(out), NULL, 0) != 0) {
+				wStatus = measurementDaemonStatus_Failed;
+				break;
+			}
+			dwIndex = dwIndex + 1;
+		}
+
+		lpContext->lpSSG3021X->vtbl->rfOutEnable(lpContext->lpSSG3021X, 0);
+		sweepSchedulerRelease(&sweep);
+
+		return measurementDaemonRespond(lpContext, lpRequest->wCommand, wStatus, dwIndex, NULL, 0, NULL, 0);
+	#endif
+}
+
+/*
+	Serves all requests of one client until it disconnects
+*/
+static void measurementDaemonServe(struct measurementDaemonContext* lpContext) {
+	while((measurementDaemonStop == 0) && (lpContext->bShutdown == 0)) {
+		struct measurementDaemonRequest req;
+		unsigned char bPayload[MEASUREMENTDAEMON_MAXPAYLOAD];
+		struct timespec tsReceived;
+		int r = 0;
+
+		if(measurementDaemonReadFull(lpContext->hClient, &req, sizeof(req)) != 0) {
+			return;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &tsReceived);
+
+		if((req.dwMagic != MEASUREMENTDAEMON_MAGIC) || (req.dwPayloadLen > MEASUREMENTDAEMON_MAXPAYLOAD)) {
+			/* Framing lost, the connection can not be recovered */
+			measurementDaemonRespond(lpContext, req.wCommand, measurementDaemonStatus_InvalidRequest, 0, NULL, 0, NULL, 0);
+			return;
+		}
+		if(req.dwPayloadLen > 0) {
+			if(measurementDaemonReadFull(lpContext->hClient, bPayload, req.dwPayloadLen) != 0) {
+				return;
+			}
+		}
+
+		switch(req.wCommand) {
+			case measurementDaemonCommand_Ping:
+				r = measurementDaemonRespond(lpContext, req.wCommand, measurementDaemonStatus_Ok, 0, NULL, 0, NULL, 0);
+				break;
+			case measurementDaemonCommand_Settings:
+				if(req.dwPayloadLen != sizeof(struct measurementDaemonSettings)) {
+					r = measurementDaemonRespond(lpContext, req.wCommand, measurementDaemonStatus_InvalidRequest, 0, NULL, 0, NULL, 0);
+				} else {
+					struct measurementDaemonSettings settings;
+					memcpy(&settings, bPayload, sizeof(settings));
+					r = measurementDaemonRespond(lpContext, req.wCommand, measurementDaemonSettingsApply(lpContext, &settings), 0, NULL, 0, NULL, 0);
+				}
+				break;
+			case measurementDaemonCommand_Detect:
+			case measurementDaemonCommand_Capture:
+				r = measurementDaemonDetect(lpContext, &req, &tsReceived);
+				break;
+			case measurementDaemonCommand_Sweep:
+				if(req.dwPayloadLen != sizeof(struct measurementDaemonSweep)) {
+					r = measurementDaemonRespond(lpContext, req.wCommand, measurementDaemonStatus_InvalidRequest, 0, NULL, 0, NULL, 0);
+				} else {
+					struct measurementDaemonSweep sweep;
+					memcpy(&sweep, bPayload, sizeof(sweep));
+					r = measurementDaemonSweep(lpContext, &req, &sweep);
+				}
+				break;
+			case measurementDaemonCommand_Shutdown:
+				lpContext->bShutdown = 1;
+				r = measurementDaemonRespond(lpContext, req.wCommand, measurementDaemonStatus_Ok, 0, NULL, 0, NULL, 0);
+				break;
+			default:
+				r = measurementDaemonRespond(lpContext, req.wCommand, measurementDaemonStatus_Unsupported, 0, NULL, 0, NULL, 0);
+				break;
+		}
+		if(r != 0) {
+			return;
+		}
+	}
+}
+
+int measurementDaemon(
+	char* lpSocketPath,
+	char* lpDeviceName,
+	const struct captureDeviceFormatRequest* lpRequest,
+	const struct blobEstimatorSettings* lpSettings,
+	char* lpSSGAddress
+) {
+	struct measurementDaemonContext ctx;
+	struct sockaddr_un addr;
+	struct sigaction sa;
+	int hListen;
+	unsigned long int dwClients = 0;
+
+	if((lpSocketPath == NULL) || (lpDeviceName == NULL)) {
+		return 1;
+	}
+	if(strlen(lpSocketPath) >= sizeof(addr.sun_path)) {
+		printf("%s:%u Socket path %s too long\n", __FILE__, __LINE__, lpSocketPath);
+		return 1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.hClient = -1;
+	ctx.dwSettleMs = MEASUREMENTDAEMON_DEFAULT_SETTLEMS;
+	if(lpSettings != NULL) {
+		memcpy(&(ctx.settings), lpSettings, sizeof(struct blobEstimatorSettings));
+	} else {
+		blobEstimatorSettingsDefault(&(ctx.settings));
+	}
+
+	#ifdef SSG_ENABLE
+		if(lpSSGAddress != NULL) {
+			if(siglentSSG3021xConnect(&(ctx.lpSSG3021X), lpSSGAddress) != labE_Ok) {
+				printf("Failed to connect to SSG3021X\n");
+				return 2;
+			}
+			ctx.lpSSG3021X->vtbl->rfOutEnable(ctx.lpSSG3021X, 0);
+		}
+	#else
+		(void)lpSSGAddress;
+	#endif
+
+	/*
+		The camera stays open and streaming for the whole lifetime of the
+		daemon
+	*/
+	if(blobEstimatorOpen(&(ctx.lpEstimator), lpDeviceName, lpRequest) != cameraE_Ok) {
+		printf("Failed to open camera\n");
+		#ifdef SSG_ENABLE
+			if(ctx.lpSSG3021X != NULL) { ctx.lpSSG3021X->vtbl->disconnect(ctx.lpSSG3021X); }
+		#endif
+		return 2;
+	}
+	if(blobEstimatorConfigure(ctx.lpEstimator, &(ctx.settings)) != cameraE_Ok) {
+		printf("%s:%u Failed to configure capture (exposure control)\n", __FILE__, __LINE__);
+		blobEstimatorClose(ctx.lpEstimator);
+		#ifdef SSG_ENABLE
+			if(ctx.lpSSG3021X != NULL) { ctx.lpSSG3021X->vtbl->disconnect(ctx.lpSSG3021X); }
+		#endif
+		return 2;
+	}
+
+	hListen = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(hListen < 0) {
+		printf("%s:%u Failed to create socket: %s\n", __FILE__, __LINE__, strerror(errno));
+		blobEstimatorClose(ctx.lpEstimator);
+		return 2;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, lpSocketPath, sizeof(addr.sun_path) - 1);
+	unlink(lpSocketPath); /* Stale socket of a previous instance */
+	if((bind(hListen, (struct sockaddr*)&addr, sizeof(addr)) != 0) || (listen(hListen, 4) != 0)) {
+		printf("%s:%u Failed to listen on %s: %s\n", __FILE__, __LINE__, lpSocketPath, strerror(errno));
+		close(hListen);
+		blobEstimatorClose(ctx.lpEstimator);
+		return 2;
+	}
+	chmod(lpSocketPath, 0660);
+
+	/* No SA_RESTART so accept and read return on signals */
+	measurementDaemonStop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &measurementDaemonSignalHandler;
+	sigemptyset(&(sa.sa_mask));
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Serving %s on %s\n", lpDeviceName, lpSocketPath);
+
+	while((measurementDaemonStop == 0) && (ctx.bShutdown == 0)) {
+		ctx.hClient = accept(hListen, NULL, NULL);
+		if(ctx.hClient < 0) {
+			if(errno == EINTR) { continue; }
+			printf("%s:%u Accept failed: %s\n", __FILE__, __LINE__, strerror(errno));
+			break;
+		}
+		dwClients = dwClients + 1;
+		measurementDaemonServe(&ctx);
+		close(ctx.hClient);
+		ctx.hClient = -1;
+	}
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	signal(SIGPIPE, SIG_DFL);
+
+	close(hListen);
+	unlink(lpSocketPath);
+
+	printf("Served %lu clients, delivered frame rate %lf fps\n", dwClients, captureDeviceDeliveredFps(blobEstimatorDevice(ctx.lpEstimator)));
+
+	blobEstimatorClose(ctx.lpEstimator);
+	#ifdef SSG_ENABLE
+		if(ctx.lpSSG3021X != NULL) {
+			ctx.lpSSG3021X->vtbl->rfOutEnable(ctx.lpSSG3021X, 0);
+			ctx.lpSSG3021X->vtbl->disconnect(ctx.lpSSG3021X);
+		}
+	#endif
+	return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef __MEASUREMENTDAEMON_H__
+#define __MEASUREMENTDAEMON_H__
+
+#include <stdint.h>
+
+#include "./captureDevice.h"
+#include "./blobEstimator.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Persistent measurement daemon
+
+	Keeps the camera streaming (and the exposure converged) between
+	measurements and serves requests on a local Unix stream socket.
+	Clients are served one after another, every client may send any
+	number of requests over it's connection.
+
+	All messages use fixed size structures in host byte order without
+	padding. Every request starts with a
+	measurementDaemonRequest header followed by dwPayloadLen bytes of
+	command specific payload. Every response starts with a
+	measurementDaemonResponse header followed by dwPayloadLen bytes.
+
+		PING		No payload. Answered with an empty response
+		SETTINGS	Payload measurementDaemonSettings. Applies detector
+					thresholds, exposure control and stability check
+		DETECT		No payload, dwCount frames (0 is one frame). Answered
+					with one measurementDaemonResult per frame
+		CAPTURE		No payload. Answered with one measurementDaemonResult
+					followed by the luma image (dwWidth * dwHeight bytes)
+		SWEEP		Payload measurementDaemonSweep. Answered with one
+					measurementDaemonResult per sweep point in measurement
+					order (only available with signal generator support)
+		SHUTDOWN	No payload. Answered with an empty response, then the
+					daemon terminates
+
+	Commands that deliver results send one response per record
+	(dwIndex counting from 0) and terminate with an empty response that
+	carries the final status. With MEASUREMENTDAEMON_FLAG_FRESH frames
+	whose exposure started before the request arrived (for example the
+	frame in flight at that moment) are discarded.
+*/
+
+#define MEASUREMENTDAEMON_MAGIC					0x31454257		/* "WBE1" */
+#define MEASUREMENTDAEMON_MAXPAYLOAD			256
+
+enum measurementDaemonCommand {
+	measurementDaemonCommand_Ping				= 0,
+	measurementDaemonCommand_Settings			= 1,
+	measurementDaemonCommand_Detect				= 2,
+	measurementDaemonCommand_Capture			= 3,
+	measurementDaemonCommand_Sweep				= 4,
+	measurementDaemonCommand_Shutdown			= 5,
+};
+
+enum measurementDaemonStatus {
+	measurementDaemonStatus_Ok					= 0,
+	measurementDaemonStatus_Failed				= 1,
+	measurementDaemonStatus_Unsupported			= 2,
+	measurementDaemonStatus_InvalidRequest		= 3,
+};
+
+#define MEASUREMENTDAEMON_FLAG_FRESH			0x0001
+
+struct measurementDaemonRequest {
+	uint32_t				dwMagic;
+	uint16_t				wCommand;
+	uint16_t				wFlags;
+	uint32_t				dwCount;
+	uint32_t				dwPayloadLen;
+};
+
+struct measurementDaemonResponse {
+	uint32_t				dwMagic;
+	uint16_t				wCommand;
+	uint16_t				wStatus;
+	uint32_t				dwPayloadLen;
+	uint32_t				dwIndex;
+};
+
+struct measurementDaemonSettings {
+	double					dProjectionThreshold;
+	double					dAssociationThreshold;
+	double					dExposureTarget;		/* 0 disables exposure control */
+	double					dStabilityTolerance;	/* 0 disables the stability check */
+	uint32_t				dwMaxAttempts;
+	uint32_t				dwSettleMs;				/* Settle time after retuning in sweeps */
+};
+
+struct measurementDaemonSweep {
+	uint64_t				qwFrqStart;
+	uint64_t				qwFrqEnd;
+	uint64_t				qwFrqStep;
+	double					dPower;
+	uint32_t				dwBudget;				/* 0 for a fixed sweep, else adaptive */
+	uint32_t				dwReserved;
+};
+
+/*
+	One detection. qwTimestampUsec is the buffer timestamp, bDetected
+	is 0 if no cluster has been found (bounds and sums are 0, fits NaN
+	then), iExposure is -1 without exposure control
+*/
+struct measurementDaemonResult {
+	uint64_t				qwFrequency;
+	uint64_t				qwTimestampUsec;
+	uint64_t				qwClusterPixelArea;
+	uint64_t				qwSaturatedPixels;
+	double					dAreaSum;
+
+	uint32_t				dwSequence;
+	int32_t					iExposure;
+	uint32_t				bDetected;
+	uint32_t				dwPeakValue;
+	uint32_t				dwXMin;
+	uint32_t				dwXMax;
+	uint32_t				dwYMin;
+	uint32_t				dwYMax;
+	uint32_t				dwWidth;
+	uint32_t				dwHeight;
+
+	/* Gaussian fits of the projections (center, sigma, amplitude, offset), NaN if not valid */
+	double					dFitX[4];
+	double					dFitXErr[4];
+	double					dFitY[4];
+	double					dFitYErr[4];
+};
+
+/*
+	Runs the daemon on lpSocketPath until SHUTDOWN, SIGINT or SIGTERM.
+	lpSSGAddress is the address of the signal generator used for sweeps
+	(NULL if none, ignored without SSG_ENABLE)
+*/
+int measurementDaemon(
+	char* lpSocketPath,
+	char* lpDeviceName,
+	const struct captureDeviceFormatRequest* lpRequest,
+	const struct blobEstimatorSettings* lpSettings,
+	char* lpSSGAddress
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __MEASUREMENTDAEMON_H__ */
@@ -0,0 +1,837 @@
+/*
+	Sweep video container, Motion JPEG in AVI (see mjpegAvi.h)
+
+	Layout of every segment:
+
+		RIFF 'AVI '
+			LIST 'hdrl'
+				'avih'					Main header
+				LIST 'strl'				Per stream: 'strh', 'strf' and 'strn'
+			LIST 'movi'
+				'00dc', '01dc', ...		One chunk per frame (stream number + 'dc')
+			'idx1'						Index, offsets relative to the 'movi' fourcc
+
+	All values are little endian and assembled byte by byte so the file
+	does not depend on the layout of structures on the host.
+*/
+
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE		/* asprintf */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "./mjpegAvi.h"
+#include "./frameTrace.h"
+
+#define MJPEGAVI_AVIH_SIZE				56
+#define MJPEGAVI_STRH_SIZE				56
+#define MJPEGAVI_STRF_SIZE				40
+#define MJPEGAVI_STRN_SIZE				16
+#define MJPEGAVI_STRL_SIZE				(12 + (8 + MJPEGAVI_STRH_SIZE) + (8 + MJPEGAVI_STRF_SIZE) + (8 + MJPEGAVI_STRN_SIZE))
+#define MJPEGAVI_HEADER_SIZE(streams)	(12 + 12 + (8 + MJPEGAVI_AVIH_SIZE) + (streams) * MJPEGAVI_STRL_SIZE + 12)
+
+#define MJPEGAVI_AVIF_HASINDEX			0x00000010
+#define MJPEGAVI_AVIF_ISINTERLEAVED		0x00000100
+#define MJPEGAVI_AVIIF_KEYFRAME			0x00000010
+
+/* Buffer of the stream the frames are written through */
+#define MJPEGAVI_IOBUFFER				(4UL*1024UL*1024UL)
+
+struct mjpegAviIndexEntry {
+	unsigned char			id[4];
+	uint32_t				flags;
+	uint32_t				offset;
+	uint32_t				size;
+};
+
+struct mjpegAvi {
+	char*					lpBaseName;
+	unsigned long int		dwSegment;
+	FILE*					fHandle;
+	char*					lpIoBuffer;
+
+	unsigned long int		dwFps;
+	struct mjpegAviStreamInfo	streams[MJPEGAVI_MAXSTREAMS];
+	unsigned long int		dwStreamCount;
+
+	uint64_t				qwOffset;			/* End of the written data */
+	uint64_t				qwMoviList;			/* Offset of LIST 'movi' */
+	uint32_t				dwFrames[MJPEGAVI_MAXSTREAMS];
+	uint32_t				dwMaxChunk;
+
+	struct mjpegAviIndexEntry*	lpIndex;
+	unsigned long int		dwIndexCount;
+	unsigned long int		dwIndexCapacity;
+};
+
+struct mjpegAviFile {
+	int*					lpFiles;			/* One descriptor per segment */
+	unsigned long int		dwSegmentCount;
+
+	struct mjpegAviStreamInfo	streams[MJPEGAVI_MAXSTREAMS];
+	unsigned long int		dwStreamCount;
+
+	struct mjpegAviFrameInfo*	lpFrames;
+	unsigned long int		dwFrameCount;
+	unsigned long int		dwFrameCapacity;
+};
+
+static void mjpegAviPut16(unsigned char* lpDst, uint16_t wValue) {
+	lpDst[0] = (unsigned char)(wValue & 0xFF);
+	lpDst[1] = (unsigned char)((wValue >> 8) & 0xFF);
+}
+static void mjpegAviPut32(unsigned char* lpDst, uint32_t dwValue) {
+	lpDst[0] = (unsigned char)(dwValue & 0xFF);
+	lpDst[1] = (unsigned char)((dwValue >> 8) & 0xFF);
+	lpDst[2] = (unsigned char)((dwValue >> 16) & 0xFF);
+	lpDst[3] = (unsigned char)((dwValue >> 24) & 0xFF);
+}
+static uint32_t mjpegAviGet32(const unsigned char* lpSrc) {
+	return ((uint32_t)lpSrc[0]) | (((uint32_t)lpSrc[1]) << 8) | (((uint32_t)lpSrc[2]) << 16) | (((uint32_t)lpSrc[3]) << 24);
+}
+static unsigned char* mjpegAviPutChunk(unsigned char* lpDst, const char* lpId, uint32_t dwSize) {
+	memcpy(lpDst, lpId, 4);
+	mjpegAviPut32(&(lpDst[4]), dwSize);
+	return &(lpDst[8]);
+}
+
+/*
+	Header of the current segment. Sizes and counts are 0 until the
+	segment is finalized
+*/
+static void mjpegAviBuildHeader(const struct mjpegAvi* lpAvi, unsigned char* lpHeader, uint32_t dwRiffSize, uint32_t dwMoviSize, int bIndexed) {
+	unsigned char* lpPos = lpHeader;
+	unsigned long int i;
+
+	memset(lpHeader, 0, MJPEGAVI_HEADER_SIZE(lpAvi->dwStreamCount));
+
+	lpPos = mjpegAviPutChunk(lpPos, "RIFF", dwRiffSize);
+	memcpy(lpPos, "AVI ", 4); lpPos = &(lpPos[4]);
+	lpPos = mjpegAviPutChunk(lpPos, "LIST", 4 + (8 + MJPEGAVI_AVIH_SIZE) + lpAvi->dwStreamCount * MJPEGAVI_STRL_SIZE);
+	memcpy(lpPos, "hdrl", 4); lpPos = &(lpPos[4]);
+
+	lpPos = mjpegAviPutChunk(lpPos, "avih", MJPEGAVI_AVIH_SIZE);
+	mjpegAviPut32(&(lpPos[0]), (uint32_t)(1000000UL / lpAvi->dwFps));			/* dwMicroSecPerFrame */
+	mjpegAviPut32(&(lpPos[4]), (uint32_t)(lpAvi->dwMaxChunk * lpAvi->dwFps));	/* dwMaxBytesPerSec */
+	mjpegAviPut32(&(lpPos[12]), (bIndexed != 0) ? (MJPEGAVI_AVIF_HASINDEX | MJPEGAVI_AVIF_ISINTERLEAVED) : MJPEGAVI_AVIF_ISINTERLEAVED);
+	mjpegAviPut32(&(lpPos[16]), lpAvi->dwFrames[0]);							/* dwTotalFrames */
+	mjpegAviPut32(&(lpPos[24]), (uint32_t)lpAvi->dwStreamCount);
+	mjpegAviPut32(&(lpPos[28]), lpAvi->dwMaxChunk);							/* dwSuggestedBufferSize */
+	mjpegAviPut32(&(lpPos[32]), lpAvi->streams[0].width);
+	mjpegAviPut32(&(lpPos[36]), lpAvi->streams[0].height);
+	lpPos = &(lpPos[MJPEGAVI_AVIH_SIZE]);
+
+	for(i = 0; i < lpAvi->dwStreamCount; i=i+1) {
+		const struct mjpegAviStreamInfo* lpStream = &(lpAvi->streams[i]);
+
+		lpPos = mjpegAviPutChunk(lpPos, "LIST", MJPEGAVI_STRL_SIZE - 8);
+		memcpy(lpPos, "strl", 4); lpPos = &(lpPos[4]);
+
+		lpPos = mjpegAviPutChunk(lpPos, "strh", MJPEGAVI_STRH_SIZE);
+		memcpy(&(lpPos[0]), "vids", 4);
+		memcpy(&(lpPos[4]), "MJPG", 4);
+		mjpegAviPut32(&(lpPos[20]), 1);										/* dwScale */
+		mjpegAviPut32(&(lpPos[24]), (uint32_t)lpAvi->dwFps);					/* dwRate */
+		mjpegAviPut32(&(lpPos[32]), lpAvi->dwFrames[i]);						/* dwLength */
+		mjpegAviPut32(&(lpPos[36]), lpAvi->dwMaxChunk);						/* dwSuggestedBufferSize */
+		mjpegAviPut32(&(lpPos[40]), 0xFFFFFFFF);								/* dwQuality (default) */
+		mjpegAviPut16(&(lpPos[52]), (uint16_t)lpStream->width);				/* rcFrame right, bottom */
+		mjpegAviPut16(&(lpPos[54]), (uint16_t)lpStream->height);
+		lpPos = &(lpPos[MJPEGAVI_STRH_SIZE]);
+
+		lpPos = mjpegAviPutChunk(lpPos, "strf", MJPEGAVI_STRF_SIZE);
+		mjpegAviPut32(&(lpPos[0]), MJPEGAVI_STRF_SIZE);						/* biSize */
+		mjpegAviPut32(&(lpPos[4]), lpStream->width);
+		mjpegAviPut32(&(lpPos[8]), lpStream->height);
+		mjpegAviPut16(&(lpPos[12]), 1);										/* biPlanes */
+		mjpegAviPut16(&(lpPos[14]), 24);										/* biBitCount */
+		memcpy(&(lpPos[16]), "MJPG", 4);
+		mjpegAviPut32(&(lpPos[20]), lpStream->width * lpStream->height * 3);	/* biSizeImage */
+		lpPos = &(lpPos[MJPEGAVI_STRF_SIZE]);
+
+		lpPos = mjpegAviPutChunk(lpPos, "strn", MJPEGAVI_STRN_SIZE);
+		memcpy(lpPos, lpStream->strName, MJPEGAVI_STRN_SIZE - 1);
+		lpPos = &(lpPos[MJPEGAVI_STRN_SIZE]);
+	}
+
+	lpPos = mjpegAviPutChunk(lpPos, "LIST", dwMoviSize);
+	memcpy(lpPos, "movi", 4);
+}
+
+/* Name of segment n: the base name for 0, else <base>-<n>.avi */
+static char* mjpegAviSegmentName(const char* lpBaseName, unsigned long int dwSegment) {
+	const char* lpExtension;
+	char* lpName = NULL;
+
+	if(dwSegment == 0) {
+		return strdup(lpBaseName);
+	}
+
+	lpExtension = strrchr(lpBaseName, '.');
+	if((lpExtension == NULL) || (strchr(lpExtension, '/') != NULL)) {
+		lpExtension = &(lpBaseName[strlen(lpBaseName)]);
+	}
+	if(asprintf(&lpName, "%.*s-%03lu%s", (int)(lpExtension - lpBaseName), lpBaseName, dwSegment, lpExtension) < 0) {
+		return NULL;
+	}
+	return lpName;
+}
+
+static int mjpegAviOpenSegment(struct mjpegAvi* lpAvi) {
+	unsigned char header[MJPEGAVI_HEADER_SIZE(MJPEGAVI_MAXSTREAMS)];
+	char* lpName;
+	unsigned long int i;
+
+	lpName = mjpegAviSegmentName(lpAvi->lpBaseName, lpAvi->dwSegment);
+	if(lpName == NULL) {
+		return 1;
+	}
+
+	lpAvi->fHandle = fopen(lpName, "wb");
+	if(lpAvi->fHandle == NULL) {
+		printf("%s:%u Failed to create %s (%s)\n", __FILE__, __LINE__, lpName, strerror(errno));
+		free(lpName);
+		return 1;
+	}
+	if(lpAvi->dwSegment > 0) {
+		printf("Sweep video continues in %s\n", lpName);
+	}
+	free(lpName);
+
+	setvbuf(lpAvi->fHandle, lpAvi->lpIoBuffer, _IOFBF, MJPEGAVI_IOBUFFER);
+
+	for(i = 0; i < MJPEGAVI_MAXSTREAMS; i=i+1) {
+		lpAvi->dwFrames[i] = 0;
+	}
+	lpAvi->dwMaxChunk = 0;
+	lpAvi->dwIndexCount = 0;
+
+	mjpegAviBuildHeader(lpAvi, header, 0, 0, 0);
+	if(fwrite(header, MJPEGAVI_HEADER_SIZE(lpAvi->dwStreamCount), 1, lpAvi->fHandle) != 1) {
+		fclose(lpAvi->fHandle);
+		lpAvi->fHandle = NULL;
+		return 1;
+	}
+	lpAvi->qwOffset = MJPEGAVI_HEADER_SIZE(lpAvi->dwStreamCount);
+	lpAvi->qwMoviList = lpAvi->qwOffset - 12;
+	return 0;
+}
+
+/*
+	Writes the index and patches the header of the current segment
+*/
+static int mjpegAviFinalizeSegment(struct mjpegAvi* lpAvi) {
+	unsigned char header[MJPEGAVI_HEADER_SIZE(MJPEGAVI_MAXSTREAMS)];
+	unsigned char entry[16];
+	uint64_t qwIndex = lpAvi->qwOffset;
+	unsigned long int i;
+	int rc = 0;
+
+	if(lpAvi->fHandle == NULL) {
+		return 1;
+	}
+
+	mjpegAviPutChunk(entry, "idx1", (uint32_t)(lpAvi->dwIndexCount * 16));
+	if(fwrite(entry, 8, 1, lpAvi->fHandle) != 1) { rc = 1; }
+	for(i = 0; (i < lpAvi->dwIndexCount) && (rc == 0); i=i+1) {
+		memcpy(&(entry[0]), lpAvi->lpIndex[i].id, 4);
+		mjpegAviPut32(&(entry[4]), lpAvi->lpIndex[i].flags);
+		mjpegAviPut32(&(entry[8]), lpAvi->lpIndex[i].offset);
+		mjpegAviPut32(&(entry[12]), lpAvi->lpIndex[i].size);
+		if(fwrite(entry, 16, 1, lpAvi->fHandle) != 1) { rc = 1; }
+	}
+	lpAvi->qwOffset = lpAvi->qwOffset + 8 + lpAvi->dwIndexCount * 16;
+
+	if(rc == 0) {
+		mjpegAviBuildHeader(lpAvi, header, (uint32_t)(lpAvi->qwOffset - 8), (uint32_t)(qwIndex - (lpAvi->qwMoviList + 8)), 1);
+		if((fseeko(lpAvi->fHandle, 0, SEEK_SET) != 0) || (fwrite(header, MJPEGAVI_HEADER_SIZE(lpAvi->dwStreamCount), 1, lpAvi->fHandle) != 1)) {
+			rc = 1;
+		}
+	}
+	if(fclose(lpAvi->fHandle) != 0) { rc = 1; }
+	lpAvi->fHandle = NULL;
+	return rc;
+}
+
+static void mjpegAviRelease(struct mjpegAvi* lpAvi) {
+	if(lpAvi->fHandle != NULL) { fclose(lpAvi->fHandle); }
+	if(lpAvi->lpIoBuffer != NULL) { free(lpAvi->lpIoBuffer); }
+	if(lpAvi->lpIndex != NULL) { free(lpAvi->lpIndex); }
+	if(lpAvi->lpBaseName != NULL) { free(lpAvi->lpBaseName); }
+	free(lpAvi);
+}
+
+int mjpegAviCreate(
+	struct mjpegAvi** lpAviOut,
+	const char* lpFilename,
+	unsigned long int dwFps,
+	const struct mjpegAviStreamInfo* lpStreams,
+	unsigned long int dwStreamCount
+) {
+	struct mjpegAvi* lpAvi;
+	unsigned long int i;
+
+	if((lpAviOut == NULL) || (lpFilename == NULL) || (lpStreams == NULL) || (dwStreamCount == 0) || (dwStreamCount > MJPEGAVI_MAXSTREAMS)) {
+		return 1;
+	}
+	(*lpAviOut) = NULL;
+
+	lpAvi = calloc(1, sizeof(struct mjpegAvi));
+	if(lpAvi == NULL) {
+		return 1;
+	}
+	lpAvi->dwFps = (dwFps > 0) ? dwFps : MJPEGAVI_DEFAULT_FPS;
+	lpAvi->dwStreamCount = dwStreamCount;
+	for(i = 0; i < dwStreamCount; i=i+1) {
+		memcpy(&(lpAvi->streams[i]), &(lpStreams[i]), sizeof(struct mjpegAviStreamInfo));
+		lpAvi->streams[i].strName[sizeof(lpAvi->streams[i].strName) - 1] = 0;
+	}
+
+	lpAvi->lpBaseName = strdup(lpFilename);
+	lpAvi->lpIoBuffer = malloc(MJPEGAVI_IOBUFFER);
+	if((lpAvi->lpBaseName == NULL) || (lpAvi->lpIoBuffer == NULL)) {
+		mjpegAviRelease(lpAvi);
+		return 1;
+	}
+
+	if(mjpegAviOpenSegment(lpAvi) != 0) {
+		mjpegAviRelease(lpAvi);
+		return 1;
+	}
+
+	(*lpAviOut) = lpAvi;
+	return 0;
+}
+
+int mjpegAviAppend(
+	struct mjpegAvi* lpAvi,
+	unsigned long int dwStream,
+	const unsigned char* lpJpeg,
+	size_t sLen,
+	uint64_t frequency
+) {
+	char strComment[64];
+	unsigned char header[8];
+	unsigned char comment[4];
+	size_t sCommentLen = 0;
+	size_t sChunkLen = 0;
+	struct mjpegAviIndexEntry* lpEntry;
+	int rc = 0;
+
+	if((lpAvi == NULL) || (dwStream >= lpAvi->dwStreamCount)) {
+		return 1;
+	}
+	if(sLen > 0) {
+		if((lpJpeg == NULL) || (sLen < 4) || (lpJpeg[0] != 0xFF) || (lpJpeg[1] != 0xD8)) {
+			return 1;
+		}
+		sCommentLen = (size_t)snprintf(strComment, sizeof(strComment), "%s%llu", MJPEGAVI_COMMENT, (unsigned long long int)frequency);
+		sChunkLen = sLen + 4 + sCommentLen;
+	}
+
+	/* Start the next segment if the chunk and the grown index would not fit */
+	if((lpAvi->dwIndexCount > 0) && (lpAvi->qwOffset + 8 + sChunkLen + 1 + 8 + (lpAvi->dwIndexCount + 1) * 16 > MJPEGAVI_MAXFILESIZE)) {
+		if(mjpegAviFinalizeSegment(lpAvi) != 0) {
+			printf("%s:%u Failed to finalize sweep video segment %lu\n", __FILE__, __LINE__, lpAvi->dwSegment);
+		}
+		lpAvi->dwSegment = lpAvi->dwSegment + 1;
+		if(mjpegAviOpenSegment(lpAvi) != 0) {
+			return 1;
+		}
+	}
+	if(lpAvi->fHandle == NULL) {
+		return 1;
+	}
+
+	if(lpAvi->dwIndexCount == lpAvi->dwIndexCapacity) {
+		unsigned long int dwNewCapacity = (lpAvi->dwIndexCapacity == 0) ? 1024 : lpAvi->dwIndexCapacity * 2;
+		struct mjpegAviIndexEntry* lpNew = realloc(lpAvi->lpIndex, sizeof(struct mjpegAviIndexEntry) * dwNewCapacity);
+		if(lpNew == NULL) { return 1; }
+		lpAvi->lpIndex = lpNew;
+		lpAvi->dwIndexCapacity = dwNewCapacity;
+	}
+
+	frameTraceBegin("mjpegAviAppend");
+
+	lpEntry = &(lpAvi->lpIndex[lpAvi->dwIndexCount]);
+	lpEntry->id[0] = (unsigned char)('0' + (dwStream / 10));
+	lpEntry->id[1] = (unsigned char)('0' + (dwStream % 10));
+	lpEntry->id[2] = 'd';
+	lpEntry->id[3] = 'c';
+	lpEntry->flags = (sLen > 0) ? MJPEGAVI_AVIIF_KEYFRAME : 0;
+	lpEntry->offset = (uint32_t)(lpAvi->qwOffset - (lpAvi->qwMoviList + 8));
+	lpEntry->size = (uint32_t)sChunkLen;
+
+	memcpy(header, lpEntry->id, 4);
+	mjpegAviPut32(&(header[4]), (uint32_t)sChunkLen);
+	if(fwrite(header, 8, 1, lpAvi->fHandle) != 1) { rc = 1; }
+
+	if((rc == 0) && (sLen > 0)) {
+		/* SOI, the comment segment and the rest of the image */
+		comment[0] = 0xFF;
+		comment[1] = 0xFE;
+		comment[2] = (unsigned char)(((sCommentLen + 2) >> 8) & 0xFF);
+		comment[3] = (unsigned char)((sCommentLen + 2) & 0xFF);
+
+		if(
+			(fwrite(lpJpeg, 2, 1, lpAvi->fHandle) != 1)
+			|| (fwrite(comment, 4, 1, lpAvi->fHandle) != 1)
+			|| (fwrite(strComment, sCommentLen, 1, lpAvi->fHandle) != 1)
+			|| (fwrite(&(lpJpeg[2]), sLen - 2, 1, lpAvi->fHandle) != 1)
+		) {
+			rc = 1;
+		}
+		if((rc == 0) && ((sChunkLen & 1) != 0)) {
+			if(fputc(0, lpAvi->fHandle) == EOF) { rc = 1; }
+		}
+	}
+
+	frameTraceEnd("mjpegAviAppend");
+
+	if(rc != 0) {
+		printf("%s:%u Failed to write sweep video frame (%s)\n", __FILE__, __LINE__, strerror(errno));
+		return 1;
+	}
+
+	lpAvi->qwOffset = lpAvi->qwOffset + 8 + sChunkLen + (sChunkLen & 1);
+	lpAvi->dwIndexCount = lpAvi->dwIndexCount + 1;
+	lpAvi->dwFrames[dwStream] = lpAvi->dwFrames[dwStream] + 1;
+	if(sChunkLen > lpAvi->dwMaxChunk) {
+		lpAvi->dwMaxChunk = (uint32_t)sChunkLen;
+	}
+	return 0;
+}
+
+int mjpegAviClose(
+	struct mjpegAvi* lpAvi
+) {
+	int rc;
+
+	if(lpAvi == NULL) {
+		return 1;
+	}
+
+	rc = mjpegAviFinalizeSegment(lpAvi);
+	mjpegAviRelease(lpAvi);
+	return rc;
+}
+
+/*
+	Reading side
+*/
+
+static int mjpegAviFileAddFrame(struct mjpegAviFile* lpFile, int hFile, unsigned long int dwStream, uint64_t qwOffset, uint32_t dwLength) {
+	struct mjpegAviFrameInfo* lpFrame;
+	unsigned char head[64];
+
+	if(lpFile->dwFrameCount == lpFile->dwFrameCapacity) {
+		unsigned long int dwNewCapacity = (lpFile->dwFrameCapacity == 0) ? 1024 : lpFile->dwFrameCapacity * 2;
+		struct mjpegAviFrameInfo* lpNew = realloc(lpFile->lpFrames, sizeof(struct mjpegAviFrameInfo) * dwNewCapacity);
+		if(lpNew == NULL) { return 1; }
+		lpFile->lpFrames = lpNew;
+		lpFile->dwFrameCapacity = dwNewCapacity;
+	}
+
+	lpFrame = &(lpFile->lpFrames[lpFile->dwFrameCount]);
+	memset(lpFrame, 0, sizeof(struct mjpegAviFrameInfo));
+	lpFrame->dwStream = dwStream;
+	lpFrame->dwSegment = lpFile->dwSegmentCount - 1;
+	lpFrame->offset = qwOffset;
+	lpFrame->length = dwLength;
+
+	/* The frequency comment directly follows SOI */
+	if(dwLength > 4 + strlen(MJPEGAVI_COMMENT)) {
+		size_t sHead = (dwLength < sizeof(head)) ? dwLength : sizeof(head);
+
+		if(pread(hFile, head, sHead, (off_t)qwOffset) == (ssize_t)sHead) {
+			size_t sCommentLen = (((size_t)head[4]) << 8) | head[5];
+
+			if((head[0] == 0xFF) && (head[1] == 0xD8) && (head[2] == 0xFF) && (head[3] == 0xFE) && (sCommentLen >= 2) && (4 + sCommentLen <= sHead)) {
+				char strComment[64];
+
+				memcpy(strComment, &(head[6]), sCommentLen - 2);
+				strComment[sCommentLen - 2] = 0;
+				if(strncmp(strComment, MJPEGAVI_COMMENT, strlen(MJPEGAVI_COMMENT)) == 0) {
+					lpFrame->frequency = strtoull(&(strComment[strlen(MJPEGAVI_COMMENT)]), NULL, 10);
+				}
+			}
+		}
+	}
+
+	lpFile->dwFrameCount = lpFile->dwFrameCount + 1;
+	return 0;
+}
+
+static void mjpegAviFileParseStreams(struct mjpegAviFile* lpFile, int hFile, uint64_t qwStart, uint64_t qwEnd) {
+	unsigned char chunk[12];
+	uint64_t qwPos = qwStart;
+
+	while(qwPos + 8 <= qwEnd) {
+		uint32_t dwSize;
+
+		if(pread(hFile, chunk, 12, (off_t)qwPos) != 12) { return; }
+		dwSize = mjpegAviGet32(&(chunk[4]));
+
+		if((memcmp(chunk, "LIST", 4) == 0) && (memcmp(&(chunk[8]), "strl", 4) == 0)) {
+			if(lpFile->dwStreamCount < MJPEGAVI_MAXSTREAMS) {
+				lpFile->dwStreamCount = lpFile->dwStreamCount + 1;
+			}
+			mjpegAviFileParseStreams(lpFile, hFile, qwPos + 12, qwPos + 8 + dwSize);
+		} else if((memcmp(chunk, "strf", 4) == 0) && (lpFile->dwStreamCount > 0)) {
+			unsigned char strf[12];
+			if(pread(hFile, strf, sizeof(strf), (off_t)(qwPos + 8)) == sizeof(strf)) {
+				lpFile->streams[lpFile->dwStreamCount - 1].width = mjpegAviGet32(&(strf[4]));
+				lpFile->streams[lpFile->dwStreamCount - 1].height = mjpegAviGet32(&(strf[8]));
+			}
+		} else if((memcmp(chunk, "strn", 4) == 0) && (lpFile->dwStreamCount > 0)) {
+			struct mjpegAviStreamInfo* lpStream = &(lpFile->streams[lpFile->dwStreamCount - 1]);
+			size_t sName = (dwSize < sizeof(lpStream->strName) - 1) ? dwSize : sizeof(lpStream->strName) - 1;
+
+			memset(lpStream->strName, 0, sizeof(lpStream->strName));
+			if(pread(hFile, lpStream->strName, sName, (off_t)(qwPos + 8)) != (ssize_t)sName) {
+				lpStream->strName[0] = 0;
+			}
+		}
+		qwPos = qwPos + 8 + dwSize + (dwSize & 1);
+	}
+}
+
+/*
+	Walks the frame chunks of the movi list (or up to the end of the
+	file for unfinished segments). 'rec ' lists are descended into
+*/
+static int mjpegAviFileParseMovi(struct mjpegAviFile* lpFile, int hFile, uint64_t qwStart, uint64_t qwEnd) {
+	unsigned char chunk[12];
+	uint64_t qwPos = qwStart;
+
+	while(qwPos + 8 <= qwEnd) {
+		uint32_t dwSize;
+
+		if(pread(hFile, chunk, 8, (off_t)qwPos) != 8) { break; }
+		dwSize = mjpegAviGet32(&(chunk[4]));
+
+		if(memcmp(chunk, "LIST", 4) == 0) {
+			qwPos = qwPos + 12;
+			continue;
+		}
+		if(qwPos + 8 + dwSize > qwEnd) {
+			break; /* Truncated last frame */
+		}
+		if((chunk[0] >= '0') && (chunk[0] <= '9') && (chunk[1] >= '0') && (chunk[1] <= '9') && (chunk[2] == 'd') && ((chunk[3] == 'c') || (chunk[3] == 'b'))) {
+			unsigned long int dwStream = (unsigned long int)((chunk[0] - '0') * 10 + (chunk[1] - '0'));
+			if(dwStream < lpFile->dwStreamCount) {
+				if(mjpegAviFileAddFrame(lpFile, hFile, dwStream, qwPos + 8, dwSize) != 0) { return 1; }
+			}
+		}
+		qwPos = qwPos + 8 + dwSize + (dwSize & 1);
+	}
+	return 0;
+}
+
+/*
+	Appends the streams and frames of one segment. The stream layout of
+	continuation segments has to match the first segment
+*/
+static int mjpegAviFileOpenSegment(struct mjpegAviFile* lpFile, const char* lpFilename) {
+	unsigned char chunk[12];
+	struct stat st;
+	uint64_t qwPos = 12;
+	uint64_t qwEnd;
+	unsigned long int dwStreamCount = lpFile->dwStreamCount;
+	int hFile;
+
+	hFile = open(lpFilename, O_RDONLY);
+	if(hFile < 0) {
+		return 1;
+	}
+	lpFile->lpFiles[lpFile->dwSegmentCount] = hFile;
+	lpFile->dwSegmentCount = lpFile->dwSegmentCount + 1;
+
+	if((fstat(hFile, &st) != 0) || (pread(hFile, chunk, 12, 0) != 12) || (memcmp(chunk, "RIFF", 4) != 0) || (memcmp(&(chunk[8]), "AVI ", 4) != 0)) {
+		printf("%s:%u %s is not an AVI file\n", __FILE__, __LINE__, lpFilename);
+		return 1;
+	}
+	qwEnd = (uint64_t)st.st_size;
+	lpFile->dwStreamCount = 0;
+
+	while(qwPos + 12 <= qwEnd) {
+		uint32_t dwSize;
+		uint64_t qwChunkEnd;
+
+		if(pread(hFile, chunk, 12, (off_t)qwPos) != 12) { break; }
+		dwSize = mjpegAviGet32(&(chunk[4]));
+		qwChunkEnd = qwPos + 8 + dwSize;
+
+		if((memcmp(chunk, "LIST", 4) == 0) && (memcmp(&(chunk[8]), "hdrl", 4) == 0)) {
+			mjpegAviFileParseStreams(lpFile, hFile, qwPos + 12, (qwChunkEnd < qwEnd) ? qwChunkEnd : qwEnd);
+			if((lpFile->dwSegmentCount > 1) && (lpFile->dwStreamCount != dwStreamCount)) {
+				printf("%s:%u %s has %lu streams instead of %lu\n", __FILE__, __LINE__, lpFilename, lpFile->dwStreamCount, dwStreamCount);
+				return 1;
+			}
+		} else if((memcmp(chunk, "LIST", 4) == 0) && (memcmp(&(chunk[8]), "movi", 4) == 0)) {
+			if((dwSize == 0) || (qwChunkEnd > qwEnd)) {
+				/* Unfinished segment, the frames run up to the end of the file */
+				printf("%s:%u %s has not been finalized, scanning frames\n", __FILE__, __LINE__, lpFilename);
+				qwChunkEnd = qwEnd;
+			}
+			if(mjpegAviFileParseMovi(lpFile, hFile, qwPos + 12, qwChunkEnd) != 0) {
+				return 1;
+			}
+		}
+		qwPos = qwChunkEnd + (dwSize & 1);
+	}
+
+	if(lpFile->dwStreamCount == 0) {
+		printf("%s:%u %s contains no video stream\n", __FILE__, __LINE__, lpFilename);
+		return 1;
+	}
+	return 0;
+}
+
+int mjpegAviFileOpen(
+	struct mjpegAviFile** lpFileOut,
+	const char* lpFilename
+) {
+	struct mjpegAviFile* lpFile;
+	unsigned long int dwSegmentCapacity = 0;
+
+	if((lpFileOut == NULL) || (lpFilename == NULL)) {
+		return 1;
+	}
+	(*lpFileOut) = NULL;
+
+	lpFile = calloc(1, sizeof(struct mjpegAviFile));
+	if(lpFile == NULL) {
+		return 1;
+	}
+
+	/* Continuation segments are read until the next numbered file is missing */
+	for(;;) {
+		char* lpName;
+		int rc;
+
+		if(lpFile->dwSegmentCount == dwSegmentCapacity) {
+			unsigned long int dwNewCapacity = (dwSegmentCapacity == 0) ? 4 : dwSegmentCapacity * 2;
+			int* lpNew = realloc(lpFile->lpFiles, sizeof(int) * dwNewCapacity);
+			if(lpNew == NULL) {
+				mjpegAviFileClose(lpFile);
+				return 1;
+			}
+			lpFile->lpFiles = lpNew;
+			dwSegmentCapacity = dwNewCapacity;
+		}
+
+		lpName = mjpegAviSegmentName(lpFilename, lpFile->dwSegmentCount);
+		if(lpName == NULL) {
+			mjpegAviFileClose(lpFile);
+			return 1;
+		}
+		if((lpFile->dwSegmentCount > 0) && (access(lpName, F_OK) != 0)) {
+			free(lpName);
+			break;
+		}
+		rc = mjpegAviFileOpenSegment(lpFile, lpName);
+		free(lpName);
+		if(rc != 0) {
+			mjpegAviFileClose(lpFile);
+			return 1;
+		}
+	}
+
+	(*lpFileOut) = lpFile;
+	return 0;
+}
+
+unsigned long int mjpegAviFileStreamCount(
+	struct mjpegAviFile* lpFile
+) {
+	if(lpFile == NULL) { return 0; }
+	return lpFile->dwStreamCount;
+}
+
+int mjpegAviFileStreamInfo(
+	struct mjpegAviFile* lpFile,
+	unsigned long int dwStream,
+	struct mjpegAviStreamInfo* lpInfoOut
+) {
+	if((lpFile == NULL) || (lpInfoOut == NULL) || (dwStream >= lpFile->dwStreamCount)) {
+		return 1;
+	}
+	memcpy(lpInfoOut, &(lpFile->streams[dwStream]), sizeof(struct mjpegAviStreamInfo));
+	return 0;
+}
+
+unsigned long int mjpegAviFileFrameCount(
+	struct mjpegAviFile* lpFile
+) {
+	if(lpFile == NULL) { return 0; }
+	return lpFile->dwFrameCount;
+}
+
+int mjpegAviFileFrameInfo(
+	struct mjpegAviFile* lpFile,
+	unsigned long int dwFrame,
+	struct mjpegAviFrameInfo* lpInfoOut
+) {
+	if((lpFile == NULL) || (lpInfoOut == NULL) || (dwFrame >= lpFile->dwFrameCount)) {
+		return 1;
+	}
+	memcpy(lpInfoOut, &(lpFile->lpFrames[dwFrame]), sizeof(struct mjpegAviFrameInfo));
+	return 0;
+}
+
+int mjpegAviFileReadFrame(
+	struct mjpegAviFile* lpFile,
+	unsigned long int dwFrame,
+	void* lpBuffer,
+	size_t sBufferSize,
+	size_t* lpBytesRead
+) {
+	const struct mjpegAviFrameInfo* lpFrame;
+
+	if((lpFile == NULL) || (dwFrame >= lpFile->dwFrameCount)) {
+		return 1;
+	}
+	lpFrame = &(lpFile->lpFrames[dwFrame]);
+
+	if(lpBytesRead != NULL) { (*lpBytesRead) = lpFrame->length; }
+	if((lpBuffer == NULL) || (sBufferSize < lpFrame->length)) {
+		return 1;
+	}
+	if(pread(lpFile->lpFiles[lpFrame->dwSegment], lpBuffer, lpFrame->length, (off_t)lpFrame->offset) != (ssize_t)lpFrame->length) {
+		return 1;
+	}
+	return 0;
+}
+
+int mjpegAviFileClose(
+	struct mjpegAviFile* lpFile
+) {
+	unsigned long int i;
+
+	if(lpFile == NULL) {
+		return 1;
+	}
+	for(i = 0; i < lpFile->dwSegmentCount; i=i+1) {
+		if(lpFile->lpFiles[i] >= 0) { close(lpFile->lpFiles[i]); }
+	}
+	if(lpFile->lpFiles != NULL) { free(lpFile->lpFiles); }
+	if(lpFile->lpFrames != NULL) { free(lpFile->lpFrames); }
+	free(lpFile);
+	return 0;
+}
+
+/*
+	Extractor
+*/
+
+static int mjpegAviExtractSelected(uint64_t frequency, char** lpFrequencies, unsigned long int dwFrequencyCount) {
+	unsigned long int i;
+
+	for(i = 0; i < dwFrequencyCount; i=i+1) {
+		unsigned long long int qwFrq;
+		char cTrailing;
+
+		if(strcmp(lpFrequencies[i], "all") == 0) { return 1; }
+		if((sscanf(lpFrequencies[i], "%llu%c", &qwFrq, &cTrailing) == 1) && (qwFrq == frequency)) { return 1; }
+	}
+	return 0;
+}
+
+int mjpegAviExtract(
+	const char* lpFilename,
+	const char* lpPrefix,
+	char** lpFrequencies,
+	unsigned long int dwFrequencyCount
+) {
+	struct mjpegAviFile* lpFile;
+	char* lpDerivedPrefix = NULL;
+	unsigned char* lpBuffer = NULL;
+	size_t sCapacity = 0;
+	unsigned long int dwWritten = 0;
+	unsigned long int i;
+	int rc = 0;
+
+	if(mjpegAviFileOpen(&lpFile, lpFilename) != 0) {
+		return 1;
+	}
+
+	if(dwFrequencyCount == 0) {
+		for(i = 0; i < lpFile->dwStreamCount; i=i+1) {
+			printf("# Stream %lu: %s %ux%u\n", i, lpFile->streams[i].strName, lpFile->streams[i].width, lpFile->streams[i].height);
+		}
+		printf("# FRAME STREAM FREQUENCY BYTES\n");
+		for(i = 0; i < lpFile->dwFrameCount; i=i+1) {
+			const struct mjpegAviFrameInfo* lpFrame = &(lpFile->lpFrames[i]);
+			printf("%lu %s %llu %lu\n", i, lpFile->streams[lpFrame->dwStream].strName, (unsigned long long int)lpFrame->frequency, (unsigned long int)lpFrame->length);
+		}
+		mjpegAviFileClose(lpFile);
+		return 0;
+	}
+
+	/* By default the files are named after the container without it's extension */
+	if(lpPrefix == NULL) {
+		const char* lpExtension = strrchr(lpFilename, '.');
+
+		if((lpExtension == NULL) || (strchr(lpExtension, '/') != NULL)) {
+			lpExtension = &(lpFilename[strlen(lpFilename)]);
+		}
+		if(asprintf(&lpDerivedPrefix, "%.*s", (int)(lpExtension - lpFilename), lpFilename) < 0) {
+			mjpegAviFileClose(lpFile);
+			return 1;
+		}
+		lpPrefix = lpDerivedPrefix;
+	}
+
+	for(i = 0; i < lpFile->dwFrameCount; i=i+1) {
+		const struct mjpegAviFrameInfo* lpFrame = &(lpFile->lpFrames[i]);
+		char* lpOutName = NULL;
+		FILE* fHandle;
+
+		if((lpFrame->length == 0) || (mjpegAviExtractSelected(lpFrame->frequency, lpFrequencies, dwFrequencyCount) == 0)) {
+			continue;
+		}
+
+		if(sCapacity < lpFrame->length) {
+			unsigned char* lpNew = realloc(lpBuffer, lpFrame->length);
+			if(lpNew == NULL) { rc = 1; break; }
+			lpBuffer = lpNew;
+			sCapacity = lpFrame->length;
+		}
+		if(mjpegAviFileReadFrame(lpFile, i, lpBuffer, sCapacity, NULL) != 0) {
+			printf("%s:%u Failed to read frame %lu\n", __FILE__, __LINE__, i);
+			rc = 1;
+			continue;
+		}
+
+		if(asprintf(&lpOutName, "%s%llu-%s.jpg", lpPrefix, (unsigned long long int)lpFrame->frequency, lpFile->streams[lpFrame->dwStream].strName) < 0) {
+			rc = 1;
+			break;
+		}
+		fHandle = fopen(lpOutName, "wb");
+		if((fHandle == NULL) || (fwrite(lpBuffer, lpFrame->length, 1, fHandle) != 1)) {
+			printf("%s:%u Failed to write %s\n", __FILE__, __LINE__, lpOutName);
+			rc = 1;
+		} else {
+			dwWritten = dwWritten + 1;
+		}
+		if(fHandle != NULL) { fclose(fHandle); }
+		free(lpOutName);
+	}
+
+	printf("Extracted %lu frames\n", dwWritten);
+
+	if(lpBuffer != NULL) { free(lpBuffer); }
+	if(lpDerivedPrefix != NULL) { free(lpDerivedPrefix); }
+	mjpegAviFileClose(lpFile);
+	return rc;
+}
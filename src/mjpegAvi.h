@@ -0,0 +1,136 @@
+#ifndef __MJPEGAVI_H__
+#define __MJPEGAVI_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Sweep video container (Motion JPEG in AVI)
+
+	All frames of a run are appended to one RIFF AVI file with one MJPEG
+	video stream per kind of frame (for example the raw and the
+	annotated cluster frame of every sweep point), so any video player
+	shows the sweep as a movie. Every frame is a complete JPEG image
+	with a comment segment (COM marker) "WBE frq=<frequency>" inserted
+	right after SOI, which keeps the frequency with the frame even if
+	the file is remuxed by other tools. Streams without a frame for a
+	sweep point get an empty chunk (shown as repeated frame).
+
+	Frames are written sequentially through a large stdio buffer. The
+	header is written with zero sizes first and patched together with
+	the idx1 index when the file is closed; unfinished files are read
+	by walking the chunks of the movi list. Files are limited to
+	MJPEGAVI_MAXFILESIZE (the AVI 1.0 limit most players accept), longer
+	runs continue in numbered segments (run.avi, run-001.avi, ...).
+*/
+
+#define MJPEGAVI_MAXSTREAMS				4
+#define MJPEGAVI_MAXFILESIZE			(1024UL*1024UL*1024UL)
+#define MJPEGAVI_DEFAULT_FPS			10
+#define MJPEGAVI_DEFAULT_QUALITY		100
+#define MJPEGAVI_COMMENT				"WBE frq="
+
+struct mjpegAviStreamInfo {
+	char					strName[16];		/* Zero terminated */
+	uint32_t				width;
+	uint32_t				height;
+};
+
+struct mjpegAviFrameInfo {
+	unsigned long int		dwStream;
+	unsigned long int		dwSegment;			/* 0 for the first file */
+	uint64_t				frequency;
+	uint64_t				offset;				/* Of the JPEG data in the segment */
+	uint32_t				length;				/* 0 for skipped frames */
+};
+
+struct mjpegAvi;
+struct mjpegAviFile;
+
+/*
+	Writing side. lpFilename is the name of the first segment
+*/
+int mjpegAviCreate(
+	struct mjpegAvi** lpAviOut,
+	const char* lpFilename,
+	unsigned long int dwFps,
+	const struct mjpegAviStreamInfo* lpStreams,
+	unsigned long int dwStreamCount
+);
+
+/*
+	Appends one encoded frame (a JPEG image starting with SOI) to the
+	stream. sLen 0 (lpJpeg may be NULL) records an empty frame
+*/
+int mjpegAviAppend(
+	struct mjpegAvi* lpAvi,
+	unsigned long int dwStream,
+	const unsigned char* lpJpeg,
+	size_t sLen,
+	uint64_t frequency
+);
+
+int mjpegAviClose(
+	struct mjpegAvi* lpAvi
+);
+
+/*
+	Reading side. lpFilename is the name of the first segment, the
+	numbered continuation segments next to it are opened as well and
+	their frames follow the frames of the previous segment.
+	mjpegAviFileReadFrame reports the frame length in *lpBytesRead even
+	if the buffer is too small so the caller can grow it and retry
+*/
+int mjpegAviFileOpen(
+	struct mjpegAviFile** lpFileOut,
+	const char* lpFilename
+);
+unsigned long int mjpegAviFileStreamCount(
+	struct mjpegAviFile* lpFile
+);
+int mjpegAviFileStreamInfo(
+	struct mjpegAviFile* lpFile,
+	unsigned long int dwStream,
+	struct mjpegAviStreamInfo* lpInfoOut
+);
+unsigned long int mjpegAviFileFrameCount(
+	struct mjpegAviFile* lpFile
+);
+int mjpegAviFileFrameInfo(
+	struct mjpegAviFile* lpFile,
+	unsigned long int dwFrame,
+	struct mjpegAviFrameInfo* lpInfoOut
+);
+int mjpegAviFileReadFrame(
+	struct mjpegAviFile* lpFile,
+	unsigned long int dwFrame,
+	void* lpBuffer,
+	size_t sBufferSize,
+	size_t* lpBytesRead
+);
+int mjpegAviFileClose(
+	struct mjpegAviFile* lpFile
+);
+
+/*
+	Extractor: without frequencies all frames are listed, else the
+	frames of the given frequencies ("all" for every frame) are written
+	as <prefix><frq>-<stream>.jpg, the names of the per point files of
+	the JPEG output
+*/
+int mjpegAviExtract(
+	const char* lpFilename,
+	const char* lpPrefix,
+	char** lpFrequencies,
+	unsigned long int dwFrequencyCount
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __MJPEGAVI_H__ */
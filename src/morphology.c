@@ -0,0 +1,329 @@
+/*
+	Binary morphology on bit packed masks (see morphology.h)
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "./morphology.h"
+#include "./kernels.h"
+
+int morphologyScratchInit(struct morphologyScratch* lpScratch) {
+	if(lpScratch == NULL) { return 1; }
+	memset(lpScratch, 0, sizeof(struct morphologyScratch));
+	return 0;
+}
+
+void morphologyScratchRelease(struct morphologyScratch* lpScratch) {
+	if(lpScratch == NULL) { return; }
+
+	if(lpScratch->lpPrefix != NULL) { free(lpScratch->lpPrefix); }
+	if(lpScratch->lpSuffix != NULL) { free(lpScratch->lpSuffix); }
+	if(lpScratch->lpTemp != NULL) { free(lpScratch->lpTemp); }
+	memset(lpScratch, 0, sizeof(struct morphologyScratch));
+}
+
+static int morphologyReserveLines(struct morphologyScratch* lpScratch, size_t sWords) {
+	if(lpScratch->sLineCapacity < sWords) {
+		uint64_t* lpNew = realloc(lpScratch->lpPrefix, sizeof(uint64_t) * sWords);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpPrefix = lpNew;
+		lpNew = realloc(lpScratch->lpSuffix, sizeof(uint64_t) * sWords);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpSuffix = lpNew;
+		lpScratch->sLineCapacity = sWords;
+	}
+	return 0;
+}
+
+static int morphologyReserveTemp(struct morphologyScratch* lpScratch, size_t sWords) {
+	if(lpScratch->sTempCapacity < sWords) {
+		uint64_t* lpNew = realloc(lpScratch->lpTemp, sizeof(uint64_t) * sWords);
+		if(lpNew == NULL) { return 1; }
+		lpScratch->lpTemp = lpNew;
+		lpScratch->sTempCapacity = sWords;
+	}
+	return 0;
+}
+
+int morphologyScratchReserve(
+	struct morphologyScratch* lpScratch,
+	unsigned long int dwStride,
+	unsigned long int dwRows,
+	unsigned long int dwRadius
+) {
+	if(lpScratch == NULL) { return 1; }
+	if(morphologyReserveLines(lpScratch, dwStride * (dwRows + 2 * dwRadius)) != 0) { return 1; }
+	if(morphologyReserveTemp(lpScratch, dwStride * dwRows) != 0) { return 1; }
+	return 0;
+}
+
+/*
+	Masks of the first and last word of a row that select the pixels
+	xMin..xMax (both are applied if the region fits into one word)
+*/
+static uint64_t morphologyFirstMask(unsigned long int xMin) {
+	return (~((uint64_t)0)) << (xMin & 63);
+}
+static uint64_t morphologyLastMask(unsigned long int xMax) {
+	return ((xMax & 63) == 63) ? ~((uint64_t)0) : ((((uint64_t)1) << ((xMax & 63) + 1)) - 1);
+}
+
+static void morphologyClipRows(
+	uint64_t* lpMask,
+	unsigned long int dwStride,
+	const struct morphologyRegion* lpRegion
+) {
+	unsigned long int wMin = lpRegion->xMin >> 6;
+	unsigned long int wMax = lpRegion->xMax >> 6;
+	uint64_t qwFirst = morphologyFirstMask(lpRegion->xMin);
+	uint64_t qwLast = morphologyLastMask(lpRegion->xMax);
+	unsigned long int y;
+
+	for(y = lpRegion->yMin; y <= lpRegion->yMax; y=y+1) {
+		lpMask[y * dwStride + wMin] &= qwFirst;
+		lpMask[y * dwStride + wMax] &= qwLast;
+	}
+}
+
+void morphologyThreshold(
+	uint64_t* lpMask,
+	unsigned long int dwStride,
+	const unsigned char* lpLuma,
+	unsigned long int dwLumaStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned int dwThreshold
+) {
+	unsigned long int wMin = lpRegion->xMin >> 6;
+	unsigned long int wMax = lpRegion->xMax >> 6;
+	kernelThreshold64Fn lpThreshold64 = kernelTableGet()->threshold64;
+	unsigned long int x, y, w;
+
+	for(y = lpRegion->yMin; y <= lpRegion->yMax; y=y+1) {
+		const unsigned char* lpRow = &(lpLuma[y * dwLumaStride]);
+		uint64_t* lpMaskRow = &(lpMask[y * dwStride]);
+
+		for(w = wMin; w <= wMax; w=w+1) {
+			if(dwThreshold > 254) {
+				lpMaskRow[w] = 0;
+			} else if((w * 64 + 64) <= dwLumaStride) {
+				lpMaskRow[w] = lpThreshold64(&(lpRow[w * 64]), dwThreshold);
+			} else {
+				/* Partial word at the end of the row */
+				uint64_t qwBits = 0;
+				for(x = w * 64; x < dwLumaStride; x=x+1) {
+					if(lpRow[x] > dwThreshold) { qwBits |= ((uint64_t)1) << (x & 63); }
+				}
+				lpMaskRow[w] = qwBits;
+			}
+		}
+	}
+
+	morphologyClipRows(lpMask, dwStride, lpRegion);
+}
+
+/*
+	lpRow |= lpRow moved by dwShift pixels towards larger (Up) or
+	smaller (Down) x. Bits moved out of the nWords words are lost
+*/
+static void morphologyRowShiftOrUp(uint64_t* lpRow, unsigned long int nWords, unsigned long int dwShift) {
+	unsigned long int dwWords = dwShift >> 6;
+	unsigned int dwBits = dwShift & 63;
+	unsigned long int w;
+
+	for(w = nWords; w > dwWords; w=w-1) {
+		unsigned long int j = w - 1;
+		uint64_t qwMoved = lpRow[j - dwWords] << dwBits;
+		if((dwBits != 0) && (j - dwWords > 0)) {
+			qwMoved |= lpRow[j - dwWords - 1] >> (64 - dwBits);
+		}
+		lpRow[j] |= qwMoved;
+	}
+}
+static void morphologyRowShiftOrDown(uint64_t* lpRow, unsigned long int nWords, unsigned long int dwShift) {
+	unsigned long int dwWords = dwShift >> 6;
+	unsigned int dwBits = dwShift & 63;
+	unsigned long int j;
+
+	for(j = 0; j + dwWords < nWords; j=j+1) {
+		uint64_t qwMoved = lpRow[j + dwWords] >> dwBits;
+		if((dwBits != 0) && (j + dwWords + 1 < nWords)) {
+			qwMoved |= lpRow[j + dwWords + 1] << (64 - dwBits);
+		}
+		lpRow[j] |= qwMoved;
+	}
+}
+
+/*
+	Dilation of one row by dwRadius pixels in both directions. Each
+	shift doubles the covered distance, the last one only covers the
+	remainder (overlapping the previous range)
+*/
+static void morphologyRowDilate(uint64_t* lpRow, unsigned long int nWords, unsigned long int dwRadius) {
+	unsigned long int dwCovered;
+
+	dwCovered = 1;
+	while(dwCovered * 2 <= dwRadius + 1) {
+		morphologyRowShiftOrUp(lpRow, nWords, dwCovered);
+		dwCovered = dwCovered * 2;
+	}
+	if(dwCovered < dwRadius + 1) {
+		morphologyRowShiftOrUp(lpRow, nWords, dwRadius + 1 - dwCovered);
+	}
+
+	dwCovered = 1;
+	while(dwCovered * 2 <= dwRadius + 1) {
+		morphologyRowShiftOrDown(lpRow, nWords, dwCovered);
+		dwCovered = dwCovered * 2;
+	}
+	if(dwCovered < dwRadius + 1) {
+		morphologyRowShiftOrDown(lpRow, nWords, dwRadius + 1 - dwCovered);
+	}
+}
+
+int morphologyDilate(
+	struct morphologyScratch* lpScratch,
+	uint64_t* lpDst,
+	const uint64_t* lpSrc,
+	unsigned long int dwStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned long int dwRadius
+) {
+	unsigned long int wMin, nWords, nRows, nLines, dwBlock;
+	unsigned long int e, y, w;
+
+	if((lpScratch == NULL) || (lpDst == NULL) || (lpSrc == NULL) || (lpRegion == NULL)) { return 1; }
+	if((lpRegion->xMin > lpRegion->xMax) || (lpRegion->yMin > lpRegion->yMax)) { return 1; }
+
+	wMin = lpRegion->xMin >> 6;
+	nWords = (lpRegion->xMax >> 6) - wMin + 1;
+	nRows = lpRegion->yMax - lpRegion->yMin + 1;
+
+	/*
+		van Herk/Gil-Werman along the columns: the rows are extended by
+		dwRadius empty rows on both ends and split into blocks of
+		2 dwRadius + 1 rows. Prefix holds the OR from the start of the
+		block, Suffix the OR up to the end of the block; every window
+		of the block size starting at line e is Suffix[e] | Prefix[e + 2r]
+	*/
+	nLines = nRows + 2 * dwRadius;
+	dwBlock = 2 * dwRadius + 1;
+	if(morphologyReserveLines(lpScratch, nLines * nWords) != 0) { return 1; }
+
+	for(e = 0; e < nLines; e=e+1) {
+		uint64_t* lpPrefix = &(lpScratch->lpPrefix[e * nWords]);
+		const uint64_t* lpIn = ((e >= dwRadius) && (e - dwRadius < nRows)) ? &(lpSrc[(lpRegion->yMin + e - dwRadius) * dwStride + wMin]) : NULL;
+
+		if((e % dwBlock) == 0) {
+			for(w = 0; w < nWords; w=w+1) { lpPrefix[w] = (lpIn != NULL) ? lpIn[w] : 0; }
+		} else if(lpIn != NULL) {
+			for(w = 0; w < nWords; w=w+1) { lpPrefix[w] = lpPrefix[w - nWords] | lpIn[w]; }
+		} else {
+			memcpy(lpPrefix, lpPrefix - nWords, sizeof(uint64_t) * nWords);
+		}
+	}
+	for(e = nLines; e > 0; e=e-1) {
+		uint64_t* lpSuffix = &(lpScratch->lpSuffix[(e - 1) * nWords]);
+		const uint64_t* lpIn = ((e - 1 >= dwRadius) && (e - 1 - dwRadius < nRows)) ? &(lpSrc[(lpRegion->yMin + e - 1 - dwRadius) * dwStride + wMin]) : NULL;
+
+		if(((e % dwBlock) == 0) || (e == nLines)) {
+			for(w = 0; w < nWords; w=w+1) { lpSuffix[w] = (lpIn != NULL) ? lpIn[w] : 0; }
+		} else if(lpIn != NULL) {
+			for(w = 0; w < nWords; w=w+1) { lpSuffix[w] = lpSuffix[w + nWords] | lpIn[w]; }
+		} else {
+			memcpy(lpSuffix, lpSuffix + nWords, sizeof(uint64_t) * nWords);
+		}
+	}
+
+	/* Prefix and suffix are complete, lpDst may alias lpSrc from here on */
+	for(y = 0; y < nRows; y=y+1) {
+		const uint64_t* lpSuffix = &(lpScratch->lpSuffix[y * nWords]);
+		const uint64_t* lpPrefix = &(lpScratch->lpPrefix[(y + 2 * dwRadius) * nWords]);
+		uint64_t* lpOut = &(lpDst[(lpRegion->yMin + y) * dwStride + wMin]);
+
+		for(w = 0; w < nWords; w=w+1) { lpOut[w] = lpSuffix[w] | lpPrefix[w]; }
+		morphologyRowDilate(lpOut, nWords, dwRadius);
+	}
+
+	morphologyClipRows(lpDst, dwStride, lpRegion);
+	return 0;
+}
+
+/*
+	Erosion is the complement of the dilated complement. Since pixels
+	outside of the region are background in the complement they count
+	as foreground here, the region border itself does not erode
+*/
+int morphologyErode(
+	struct morphologyScratch* lpScratch,
+	uint64_t* lpDst,
+	const uint64_t* lpSrc,
+	unsigned long int dwStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned long int dwRadius
+) {
+	unsigned long int wMin, wMax, y, w;
+
+	if((lpScratch == NULL) || (lpDst == NULL) || (lpSrc == NULL) || (lpRegion == NULL)) { return 1; }
+	if((lpRegion->xMin > lpRegion->xMax) || (lpRegion->yMin > lpRegion->yMax)) { return 1; }
+
+	wMin = lpRegion->xMin >> 6;
+	wMax = lpRegion->xMax >> 6;
+
+	for(y = lpRegion->yMin; y <= lpRegion->yMax; y=y+1) {
+		for(w = wMin; w <= wMax; w=w+1) { lpDst[y * dwStride + w] = ~lpSrc[y * dwStride + w]; }
+	}
+	morphologyClipRows(lpDst, dwStride, lpRegion);
+
+	if(morphologyDilate(lpScratch, lpDst, lpDst, dwStride, lpRegion, dwRadius) != 0) { return 1; }
+
+	for(y = lpRegion->yMin; y <= lpRegion->yMax; y=y+1) {
+		for(w = wMin; w <= wMax; w=w+1) { lpDst[y * dwStride + w] = ~lpDst[y * dwStride + w]; }
+	}
+	morphologyClipRows(lpDst, dwStride, lpRegion);
+	return 0;
+}
+
+long int morphologyReconstruct(
+	struct morphologyScratch* lpScratch,
+	uint64_t* lpMarker,
+	const uint64_t* lpMask,
+	unsigned long int dwStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned long int dwRadius
+) {
+	unsigned long int wMin, wMax, y, w;
+	long int dwSteps = 0;
+	int bChanged;
+
+	if((lpScratch == NULL) || (lpMarker == NULL) || (lpMask == NULL) || (lpRegion == NULL)) { return -1; }
+	if((lpRegion->xMin > lpRegion->xMax) || (lpRegion->yMin > lpRegion->yMax)) { return -1; }
+
+	wMin = lpRegion->xMin >> 6;
+	wMax = lpRegion->xMax >> 6;
+
+	if(morphologyReserveTemp(lpScratch, dwStride * (lpRegion->yMax + 1)) != 0) { return -1; }
+
+	/*
+		Every step grows the marker by dwRadius inside the mask, the
+		marker only grows so it is stable once a step adds nothing
+	*/
+	do {
+		if(morphologyDilate(lpScratch, lpScratch->lpTemp, lpMarker, dwStride, lpRegion, dwRadius) != 0) { return -1; }
+		dwSteps = dwSteps + 1;
+
+		bChanged = 0;
+		for(y = lpRegion->yMin; y <= lpRegion->yMax; y=y+1) {
+			for(w = wMin; w <= wMax; w=w+1) {
+				uint64_t qwNew = lpScratch->lpTemp[y * dwStride + w] & lpMask[y * dwStride + w];
+				if(qwNew != lpMarker[y * dwStride + w]) {
+					lpMarker[y * dwStride + w] = qwNew;
+					bChanged = 1;
+				}
+			}
+		}
+	} while(bChanged != 0);
+
+	return dwSteps;
+}
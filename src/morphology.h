@@ -0,0 +1,114 @@
+#ifndef __MORPHOLOGY_H__
+#define __MORPHOLOGY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Binary morphology on bit packed masks
+
+	A mask stores one bit per pixel, pixel x of row y is bit (x & 63) of
+	word y * dwStride + (x >> 6). All operations work on a rectangular
+	region of the mask (inclusive bounds) and only touch the words that
+	cover the region; bits of these words outside of the region are
+	cleared. Pixels outside of the region count as background.
+
+	Dilation and erosion use a square structuring element of the given
+	radius (Chebyshev distance) and are separable: along the columns the
+	van Herk/Gil-Werman algorithm combines whole words (64 pixels) with
+	three operations per word independent of the radius, along the rows
+	the shifted words are combined by doubling the covered distance
+	(logarithmic in the radius, again 64 pixels per operation).
+*/
+struct morphologyRegion {
+	unsigned long int		xMin;
+	unsigned long int		xMax;
+	unsigned long int		yMin;
+	unsigned long int		yMax;
+};
+
+/*
+	Working memory of the operations, reused between calls (only grows)
+*/
+struct morphologyScratch {
+	uint64_t*				lpPrefix;
+	uint64_t*				lpSuffix;
+	size_t					sLineCapacity;
+
+	uint64_t*				lpTemp;
+	size_t					sTempCapacity;
+};
+
+int morphologyScratchInit(struct morphologyScratch* lpScratch);
+void morphologyScratchRelease(struct morphologyScratch* lpScratch);
+
+/*
+	Allocates the working memory for operations on masks of up to
+	dwRows rows of dwStride words with radii up to dwRadius up front
+	(it is grown on demand otherwise). Returns 0 on success
+*/
+int morphologyScratchReserve(
+	struct morphologyScratch* lpScratch,
+	unsigned long int dwStride,
+	unsigned long int dwRows,
+	unsigned long int dwRadius
+);
+
+/*
+	Sets every bit of the region whose luma (dwLumaStride bytes per row)
+	exceeds dwThreshold
+*/
+void morphologyThreshold(
+	uint64_t* lpMask,
+	unsigned long int dwStride,
+	const unsigned char* lpLuma,
+	unsigned long int dwLumaStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned int dwThreshold
+);
+
+/*
+	Dilation and erosion of lpSrc into lpDst (may be the same mask)
+	with a (2 dwRadius + 1) square. Returns 0 on success
+*/
+int morphologyDilate(
+	struct morphologyScratch* lpScratch,
+	uint64_t* lpDst,
+	const uint64_t* lpSrc,
+	unsigned long int dwStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned long int dwRadius
+);
+int morphologyErode(
+	struct morphologyScratch* lpScratch,
+	uint64_t* lpDst,
+	const uint64_t* lpSrc,
+	unsigned long int dwStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned long int dwRadius
+);
+
+/*
+	Geodesic reconstruction: grows lpMarker to all pixels of lpMask that
+	are connected to it by steps of at most dwRadius pixels (Chebyshev
+	distance) through lpMask. lpMarker has to be a subset of lpMask.
+	Returns the number of dilation steps or -1 on failure
+*/
+long int morphologyReconstruct(
+	struct morphologyScratch* lpScratch,
+	uint64_t* lpMarker,
+	const uint64_t* lpMask,
+	unsigned long int dwStride,
+	const struct morphologyRegion* lpRegion,
+	unsigned long int dwRadius
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __MORPHOLOGY_H__ */
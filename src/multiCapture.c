@@ -0,0 +1,557 @@
+/*
+	Concurrent multi camera capture
+
+	Every device owns a capture thread that does nothing but dequeue
+	V4L2 buffers, copy them into a free slot of the devices ring and
+	requeue them immediately - the driver never waits for analysis. If
+	no slot is free the frame is dropped and counted.
+
+	A shared pool of analysis workers picks filled slots round robin
+	across all devices (per device fairness). Slots of a device are
+	retired strictly in capture order so the per device result files
+	stay ordered even though frames are analyzed out of order.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <sys/time.h>
+
+#include <linux/videodev2.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./captureDevice.h"
+#include "./multiCapture.h"
+#include "./frameTrace.h"
+#include "./realtime.h"
+
+#define MULTICAPTURE_V4L2BUFFERS		4
+#define MULTICAPTURE_SLOTS				4
+#define MULTICAPTURE_DEQUEUE_TIMEOUTMS	250
+
+enum multiCaptureSlotState {
+	multiCaptureSlot_Free,
+	multiCaptureSlot_Filling,
+	multiCaptureSlot_Ready,
+	multiCaptureSlot_Analyzing,
+	multiCaptureSlot_Done
+};
+
+struct multiCaptureSlot {
+	enum multiCaptureSlotState	state;
+
+	unsigned char*				lpData;
+	size_t						sLen;
+	size_t						sBytesUsed;
+
+	unsigned long int			dwSequence;
+	struct timeval				tvTimestamp;
+	struct timespec				tsCaptured;
+
+	int							iStatus;
+	struct blobResult			result;
+};
+
+struct multiCaptureContext;
+
+struct multiCaptureDevice {
+	struct multiCaptureContext*	lpContext;
+
+	char*						lpDeviceName;
+	char*						lpPrefix;
+	FILE*						fPeaks;
+
+	struct captureDevice		dev;
+	int							bOpen;
+	pthread_t					thrCapture;
+	int							bCaptureRunning;
+
+	struct multiCaptureSlot*	lpSlots;
+	unsigned long int			dwSlotCount;
+	unsigned long int			dwFill;			/* Next slot filled by the capture thread */
+	unsigned long int			dwDispatch;		/* Next slot handed to a worker */
+	unsigned long int			dwRetire;		/* Next slot written to the result file */
+
+	unsigned long int			dwCaptured;
+	unsigned long int			dwDropped;
+	unsigned long int			dwAnalyzed;
+	unsigned long int			dwFailed;
+	double						dLatencySum;
+	double						dLatencyMax;
+};
+
+struct multiCaptureWorker {
+	struct multiCaptureContext*	lpContext;
+	pthread_t					thrWorker;
+
+	struct imgRawImage			img;
+	size_t						sLumaCapacity;
+	struct blobDetectorScratch	scratch;
+};
+
+struct multiCaptureContext {
+	const struct blobDetectorParams*	lpParams;
+	const struct captureDeviceFormatRequest*	lpRequest;
+	unsigned long int			dwFrames;
+
+	pthread_mutex_t				mtxState;
+	pthread_cond_t				condWork;
+
+	struct multiCaptureDevice*	lpDevices;
+	unsigned long int			dwDeviceCount;
+	unsigned long int			dwRoundRobin;
+	unsigned long int			dwCaptureActive;
+
+	struct multiCaptureWorker*	lpWorkers;
+	unsigned long int			dwWorkerCount;
+};
+
+static volatile sig_atomic_t multiCaptureStop = 0;
+
+static void multiCaptureSignalHandler(int sig) {
+	(void)sig;
+	multiCaptureStop = 1;
+}
+
+static double multiCaptureElapsed(const struct timespec* lpFrom, const struct timespec* lpTo) {
+	return (double)(lpTo->tv_sec - lpFrom->tv_sec) + ((double)(lpTo->tv_nsec - lpFrom->tv_nsec)) / 1e9;
+}
+
+static void* multiCaptureThread(void* lpArg) {
+	struct multiCaptureDevice* lpDev = (struct multiCaptureDevice*)lpArg;
+	struct multiCaptureContext* lpContext = lpDev->lpContext;
+	enum cameraError e;
+
+	realtimeEnterThread(realtimeRole_Capture, (unsigned long int)(lpDev - lpContext->lpDevices));
+
+	while(multiCaptureStop == 0) {
+		struct v4l2_buffer buf;
+		struct multiCaptureSlot* lpSlot = NULL;
+		struct timespec tsNow;
+
+		if((lpContext->dwFrames != 0) && (lpDev->dwCaptured >= lpContext->dwFrames)) {
+			break;
+		}
+
+		e = captureDeviceDequeue(&(lpDev->dev), &buf, MULTICAPTURE_DEQUEUE_TIMEOUTMS);
+		if(e == cameraE_Timeout) {
+			continue;
+		}
+		if(e != cameraE_Ok) {
+			printf("%s:%u %s: Failed to dequeue frame, stopping capture\n", __FILE__, __LINE__, lpDev->lpDeviceName);
+			break;
+		}
+		clock_gettime(CLOCK_MONOTONIC, &tsNow);
+
+		pthread_mutex_lock(&(lpContext->mtxState));
+		if(lpDev->lpSlots[lpDev->dwFill].state == multiCaptureSlot_Free) {
+			lpSlot = &(lpDev->lpSlots[lpDev->dwFill]);
+			lpSlot->state = multiCaptureSlot_Filling;
+			lpDev->dwFill = (lpDev->dwFill + 1) % lpDev->dwSlotCount;
+		} else {
+			lpDev->dwDropped = lpDev->dwDropped + 1;
+		}
+		pthread_mutex_unlock(&(lpContext->mtxState));
+
+		if(lpSlot != NULL) {
+			lpSlot->sBytesUsed = (buf.bytesused < lpSlot->sLen) ? buf.bytesused : lpSlot->sLen;
+			memcpy(lpSlot->lpData, captureDeviceBufferData(&(lpDev->dev), &buf), lpSlot->sBytesUsed);
+			lpSlot->dwSequence = buf.sequence;
+			lpSlot->tvTimestamp = buf.timestamp;
+			lpSlot->tsCaptured = tsNow;
+
+			pthread_mutex_lock(&(lpContext->mtxState));
+			lpSlot->state = multiCaptureSlot_Ready;
+			lpDev->dwCaptured = lpDev->dwCaptured + 1;
+			pthread_cond_signal(&(lpContext->condWork));
+			pthread_mutex_unlock(&(lpContext->mtxState));
+		}
+
+		if(captureDeviceRequeue(&(lpDev->dev), &buf) != cameraE_Ok) {
+			printf("%s:%u %s: Failed to requeue buffer, stopping capture\n", __FILE__, __LINE__, lpDev->lpDeviceName);
+			break;
+		}
+	}
+
+	pthread_mutex_lock(&(lpContext->mtxState));
+	lpDev->bCaptureRunning = 0;
+	lpContext->dwCaptureActive = lpContext->dwCaptureActive - 1;
+	pthread_cond_broadcast(&(lpContext->condWork));
+	pthread_mutex_unlock(&(lpContext->mtxState));
+
+	return NULL;
+}
+
+/*
+	Picks the next ready slot, starting at the device after the one
+	that has been served last. Called with mtxState held
+*/
+static struct multiCaptureSlot* multiCaptureNextFrame(struct multiCaptureContext* lpContext, struct multiCaptureDevice** lpDeviceOut) {
+	unsigned long int i;
+
+	for(i = 0; i < lpContext->dwDeviceCount; i=i+1) {
+		unsigned long int dwDevice = (lpContext->dwRoundRobin + i) % lpContext->dwDeviceCount;
+		struct multiCaptureDevice* lpDev = &(lpContext->lpDevices[dwDevice]);
+		struct multiCaptureSlot* lpSlot = &(lpDev->lpSlots[lpDev->dwDispatch]);
+
+		if(lpSlot->state != multiCaptureSlot_Ready) {
+			continue;
+		}
+
+		lpSlot->state = multiCaptureSlot_Analyzing;
+		lpDev->dwDispatch = (lpDev->dwDispatch + 1) % lpDev->dwSlotCount;
+		lpContext->dwRoundRobin = (dwDevice + 1) % lpContext->dwDeviceCount;
+
+		(*lpDeviceOut) = lpDev;
+		return lpSlot;
+	}
+	return NULL;
+}
+
+/*
+	Writes all finished slots at the head of the devices ring in
+	capture order and releases them. Called with mtxState held
+*/
+static void multiCaptureRetire(struct multiCaptureDevice* lpDev) {
+	struct timespec tsNow;
+
+	clock_gettime(CLOCK_MONOTONIC, &tsNow);
+
+	while(lpDev->lpSlots[lpDev->dwRetire].state == multiCaptureSlot_Done) {
+		struct multiCaptureSlot* lpSlot = &(lpDev->lpSlots[lpDev->dwRetire]);
+		struct rectBound* lpB = &(lpSlot->result.bounds);
+		double dLatency = multiCaptureElapsed(&(lpSlot->tsCaptured), &tsNow);
+
+		if(lpSlot->iStatus == 0) {
+			frameTraceSetSequence(lpSlot->dwSequence);
+			frameTraceBegin("peaksWrite");
+			fprintf(lpDev->fPeaks, "%lu %lu.%06lu %lu %lu %lu %lu %lu %lu %lf %lu", lpSlot->dwSequence, (unsigned long int)lpSlot->tvTimestamp.tv_sec, (unsigned long int)lpSlot->tvTimestamp.tv_usec, lpB->xMin, lpB->xMax, lpB->yMin, lpB->yMax, lpB->xMax-lpB->xMin, lpB->yMax-lpB->yMin, lpSlot->result.dAreaSum, lpSlot->result.clusterPixelArea);
+			profileFitPrint(lpDev->fPeaks, &(lpSlot->result.fitX));
+			profileFitPrint(lpDev->fPeaks, &(lpSlot->result.fitY));
+			fprintf(lpDev->fPeaks, "\n");
+			frameTraceEnd("peaksWrite");
+			lpDev->dwAnalyzed = lpDev->dwAnalyzed + 1;
+		} else {
+			lpDev->dwFailed = lpDev->dwFailed + 1;
+		}
+
+		lpDev->dLatencySum = lpDev->dLatencySum + dLatency;
+		if(dLatency > lpDev->dLatencyMax) {
+			lpDev->dLatencyMax = dLatency;
+		}
+
+		lpSlot->state = multiCaptureSlot_Free;
+		lpDev->dwRetire = (lpDev->dwRetire + 1) % lpDev->dwSlotCount;
+	}
+}
+
+static int multiCaptureAnalyze(struct multiCaptureWorker* lpWorker, struct multiCaptureDevice* lpDev, struct multiCaptureSlot* lpSlot) {
+	unsigned long int width = lpDev->dev.width;
+	unsigned long int height = lpDev->dev.height;
+	size_t sLuma = width * height;
+
+	frameTraceSetSequence(lpSlot->dwSequence);
+
+	if(lpWorker->sLumaCapacity < sLuma) {
+		unsigned char* lpNew = realloc(lpWorker->img.lpLuma, sLuma);
+		if(lpNew == NULL) {
+			return 1;
+		}
+		lpWorker->img.lpLuma = lpNew;
+		lpWorker->sLumaCapacity = sLuma;
+	}
+	lpWorker->img.width = width;
+	lpWorker->img.height = height;
+	lpWorker->img.numComponents = 1;
+	lpWorker->img.lpData = lpWorker->img.lpLuma;
+
+	if(captureFrameToLuma(&(lpWorker->img), lpDev->dev.pixelFormat, lpSlot->lpData, lpSlot->sBytesUsed, width, height, lpDev->dev.bytesPerLine) != 0) {
+		return 1; /* Truncated or corrupt frame */
+	}
+	return blobDetect(&(lpWorker->img), lpWorker->lpContext->lpParams, &(lpWorker->scratch), &(lpSlot->result));
+}
+
+static void* multiCaptureWorkerThread(void* lpArg) {
+	struct multiCaptureWorker* lpWorker = (struct multiCaptureWorker*)lpArg;
+	struct multiCaptureContext* lpContext = lpWorker->lpContext;
+
+	realtimeEnterThread(realtimeRole_Analysis, (unsigned long int)(lpWorker - lpContext->lpWorkers));
+
+	pthread_mutex_lock(&(lpContext->mtxState));
+	for(;;) {
+		struct multiCaptureDevice* lpDev = NULL;
+		struct multiCaptureSlot* lpSlot = multiCaptureNextFrame(lpContext, &lpDev);
+
+		if(lpSlot != NULL) {
+			pthread_mutex_unlock(&(lpContext->mtxState));
+			lpSlot->iStatus = multiCaptureAnalyze(lpWorker, lpDev, lpSlot);
+			pthread_mutex_lock(&(lpContext->mtxState));
+
+			lpSlot->state = multiCaptureSlot_Done;
+			multiCaptureRetire(lpDev);
+			continue;
+		}
+
+		if(lpContext->dwCaptureActive == 0) {
+			break; /* No capture thread left and nothing queued */
+		}
+		pthread_cond_wait(&(lpContext->condWork), &(lpContext->mtxState));
+	}
+	pthread_mutex_unlock(&(lpContext->mtxState));
+
+	return NULL;
+}
+
+static void multiCaptureRelease(struct multiCaptureContext* lpContext) {
+	unsigned long int i, j;
+
+	if(lpContext->lpWorkers != NULL) {
+		for(i = 0; i < lpContext->dwWorkerCount; i=i+1) {
+			if(lpContext->lpWorkers[i].img.lpLuma != NULL) { free(lpContext->lpWorkers[i].img.lpLuma); }
+			blobDetectorScratchRelease(&(lpContext->lpWorkers[i].scratch));
+		}
+		free(lpContext->lpWorkers);
+	}
+	if(lpContext->lpDevices != NULL) {
+		for(i = 0; i < lpContext->dwDeviceCount; i=i+1) {
+			struct multiCaptureDevice* lpDev = &(lpContext->lpDevices[i]);
+
+			if(lpDev->bOpen != 0) { captureDeviceClose(&(lpDev->dev)); }
+			if(lpDev->fPeaks != NULL) { fclose(lpDev->fPeaks); }
+			if(lpDev->lpSlots != NULL) {
+				for(j = 0; j < lpDev->dwSlotCount; j=j+1) {
+					if(lpDev->lpSlots[j].lpData != NULL) { free(lpDev->lpSlots[j].lpData); }
+				}
+				free(lpDev->lpSlots);
+			}
+			if(lpDev->lpDeviceName != NULL) { free(lpDev->lpDeviceName); }
+		}
+		free(lpContext->lpDevices);
+	}
+	pthread_cond_destroy(&(lpContext->condWork));
+	pthread_mutex_destroy(&(lpContext->mtxState));
+}
+
+static int multiCaptureOpenDevice(struct multiCaptureContext* lpContext, struct multiCaptureDevice* lpDev, char* lpSpec) {
+	char* lpSeparator;
+	char* lpFilename = NULL;
+	unsigned long int i;
+
+	lpDev->lpContext = lpContext;
+
+	/* CAPDEV:PREFIX */
+	lpSeparator = strrchr(lpSpec, ':');
+	if((lpSeparator == NULL) || (lpSeparator == lpSpec) || (lpSeparator[1] == 0)) {
+		printf("%s:%u Invalid device specification %s (expecting CAPDEV:PREFIX)\n", __FILE__, __LINE__, lpSpec);
+		return 1;
+	}
+	lpDev->lpDeviceName = strndup(lpSpec, lpSeparator - lpSpec);
+	lpDev->lpPrefix = &(lpSeparator[1]);
+	if(lpDev->lpDeviceName == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		return 1;
+	}
+
+	if(captureDeviceOpen(&(lpDev->dev), lpDev->lpDeviceName, lpContext->lpRequest, MULTICAPTURE_V4L2BUFFERS) != cameraE_Ok) {
+		printf("%s:%u Failed to open camera %s\n", __FILE__, __LINE__, lpDev->lpDeviceName);
+		return 1;
+	}
+	lpDev->bOpen = 1;
+
+	lpDev->dwSlotCount = MULTICAPTURE_SLOTS;
+	lpDev->lpSlots = calloc(lpDev->dwSlotCount, sizeof(struct multiCaptureSlot));
+	if(lpDev->lpSlots == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		return 1;
+	}
+	for(i = 0; i < lpDev->dwSlotCount; i=i+1) {
+		lpDev->lpSlots[i].sLen = lpDev->dev.sizeImage;
+		lpDev->lpSlots[i].lpData = malloc(lpDev->lpSlots[i].sLen);
+		if(lpDev->lpSlots[i].lpData == NULL) {
+			printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+			return 1;
+		}
+		lpDev->lpSlots[i].state = multiCaptureSlot_Free;
+		realtimePrefault(lpDev->lpSlots[i].lpData, lpDev->lpSlots[i].sLen);
+	}
+
+	if(asprintf(&lpFilename, "%s-peaks.dat", lpDev->lpPrefix) < 0) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		return 1;
+	}
+	lpDev->fPeaks = fopen(lpFilename, "a");
+	if(lpDev->fPeaks == NULL) {
+		printf("%s:%u Failed to open %s\n", __FILE__, __LINE__, lpFilename);
+		free(lpFilename);
+		return 1;
+	}
+	free(lpFilename);
+
+	printf("%s: -> %s-peaks.dat\n", lpDev->lpDeviceName, lpDev->lpPrefix);
+	return 0;
+}
+
+int multiCapture(
+	char** lpDeviceSpecs,
+	unsigned long int dwDeviceCount,
+	const struct captureDeviceFormatRequest* lpRequest,
+	unsigned long int dwFrames,
+	unsigned long int dwThreads,
+	const struct blobDetectorParams* lpParams
+) {
+	struct multiCaptureContext ctx;
+	struct timespec tsStart, tsEnd;
+	struct sigaction sa;
+	unsigned long int i;
+	unsigned long int dwCaptureStarted = 0;
+	unsigned long int dwWorkersStarted = 0;
+	int rc = 0;
+
+	if((lpDeviceSpecs == NULL) || (dwDeviceCount == 0)) {
+		return 1;
+	}
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.lpParams = lpParams;
+	ctx.lpRequest = lpRequest;
+	ctx.dwFrames = dwFrames;
+	pthread_mutex_init(&(ctx.mtxState), NULL);
+	pthread_cond_init(&(ctx.condWork), NULL);
+
+	ctx.lpDevices = calloc(dwDeviceCount, sizeof(struct multiCaptureDevice));
+	if(ctx.lpDevices == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		multiCaptureRelease(&ctx);
+		return 1;
+	}
+	ctx.dwDeviceCount = dwDeviceCount;
+
+	for(i = 0; i < dwDeviceCount; i=i+1) {
+		if(multiCaptureOpenDevice(&ctx, &(ctx.lpDevices[i]), lpDeviceSpecs[i]) != 0) {
+			multiCaptureRelease(&ctx);
+			return 2;
+		}
+	}
+
+	if(dwThreads == 0) {
+		long lCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+		dwThreads = (lCPUs > 0) ? (unsigned long int)lCPUs : 1;
+	}
+
+	ctx.lpWorkers = calloc(dwThreads, sizeof(struct multiCaptureWorker));
+	if(ctx.lpWorkers == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		multiCaptureRelease(&ctx);
+		return 1;
+	}
+	ctx.dwWorkerCount = dwThreads;
+	for(i = 0; i < dwThreads; i=i+1) {
+		ctx.lpWorkers[i].lpContext = &ctx;
+		blobDetectorScratchInit(&(ctx.lpWorkers[i].scratch));
+	}
+
+	/* Every worker gets buffers for the largest device up front so analysis does not allocate */
+	{
+		unsigned long int dwMaxWidth = 0;
+		unsigned long int dwMaxHeight = 0;
+
+		for(i = 0; i < dwDeviceCount; i=i+1) {
+			if(ctx.lpDevices[i].dev.width > dwMaxWidth) { dwMaxWidth = ctx.lpDevices[i].dev.width; }
+			if(ctx.lpDevices[i].dev.height > dwMaxHeight) { dwMaxHeight = ctx.lpDevices[i].dev.height; }
+		}
+		for(i = 0; i < dwThreads; i=i+1) {
+			struct multiCaptureWorker* lpWorker = &(ctx.lpWorkers[i]);
+
+			lpWorker->img.lpLuma = malloc(dwMaxWidth * dwMaxHeight);
+			if((lpWorker->img.lpLuma == NULL) || (blobDetectorScratchPrepare(&(lpWorker->scratch), lpParams, dwMaxWidth, dwMaxHeight) != 0)) {
+				printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+				multiCaptureRelease(&ctx);
+				return 1;
+			}
+			lpWorker->sLumaCapacity = dwMaxWidth * dwMaxHeight;
+			realtimePrefault(lpWorker->img.lpLuma, lpWorker->sLumaCapacity);
+		}
+	}
+
+	multiCaptureStop = 0;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = &multiCaptureSignalHandler;
+	sigemptyset(&(sa.sa_mask));
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &tsStart);
+
+	for(dwCaptureStarted = 0; dwCaptureStarted < dwDeviceCount; dwCaptureStarted=dwCaptureStarted+1) {
+		struct multiCaptureDevice* lpDev = &(ctx.lpDevices[dwCaptureStarted]);
+
+		lpDev->bCaptureRunning = 1;
+		ctx.dwCaptureActive = ctx.dwCaptureActive + 1;
+		if(pthread_create(&(lpDev->thrCapture), NULL, &multiCaptureThread, lpDev) != 0) {
+			printf("%s:%u Failed to start capture thread for %s\n", __FILE__, __LINE__, lpDev->lpDeviceName);
+			lpDev->bCaptureRunning = 0;
+			ctx.dwCaptureActive = ctx.dwCaptureActive - 1;
+			multiCaptureStop = 1;
+			rc = 2;
+			break;
+		}
+	}
+
+	for(dwWorkersStarted = 0; dwWorkersStarted < dwThreads; dwWorkersStarted=dwWorkersStarted+1) {
+		if(pthread_create(&(ctx.lpWorkers[dwWorkersStarted].thrWorker), NULL, &multiCaptureWorkerThread, &(ctx.lpWorkers[dwWorkersStarted])) != 0) {
+			printf("%s:%u Failed to start worker %lu\n", __FILE__, __LINE__, dwWorkersStarted);
+			break;
+		}
+	}
+	if(dwWorkersStarted == 0) {
+		/* No pool at all - analyze on the calling thread */
+		multiCaptureWorkerThread(&(ctx.lpWorkers[0]));
+	}
+
+	for(i = 0; i < dwCaptureStarted; i=i+1) {
+		pthread_join(ctx.lpDevices[i].thrCapture, NULL);
+	}
+	for(i = 0; i < dwWorkersStarted; i=i+1) {
+		pthread_join(ctx.lpWorkers[i].thrWorker, NULL);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &tsEnd);
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+
+	{
+		double dSeconds = multiCaptureElapsed(&tsStart, &tsEnd);
+		unsigned long int dwTotal = 0;
+
+		for(i = 0; i < ctx.dwDeviceCount; i=i+1) {
+			struct multiCaptureDevice* lpDev = &(ctx.lpDevices[i]);
+			unsigned long int dwRetired = lpDev->dwAnalyzed + lpDev->dwFailed;
+
+			printf("%s: %lu captured, %lu dropped, %lu analyzed, %lu failed, latency %lf ms avg %lf ms max, %lf frames/s (camera delivered %lf fps)\n",
+				lpDev->lpDeviceName,
+				lpDev->dwCaptured,
+				lpDev->dwDropped,
+				lpDev->dwAnalyzed,
+				lpDev->dwFailed,
+				(dwRetired > 0) ? lpDev->dLatencySum * 1000.0 / (double)dwRetired : 0.0,
+				lpDev->dLatencyMax * 1000.0,
+				(dSeconds > 0) ? ((double)lpDev->dwAnalyzed) / dSeconds : 0.0,
+				captureDeviceDeliveredFps(&(lpDev->dev))
+			);
+			captureDeviceTimingPrint(stdout, &(lpDev->dev));
+			dwTotal = dwTotal + lpDev->dwAnalyzed;
+		}
+		printf("Analyzed %lu frames from %lu devices on %lu threads in %lf s (%lf frames/s)\n", dwTotal, ctx.dwDeviceCount, (dwWorkersStarted > 0) ? dwWorkersStarted : 1, dSeconds, (dSeconds > 0) ? ((double)dwTotal) / dSeconds : 0.0);
+	}
+
+	multiCaptureRelease(&ctx);
+	return rc;
+}
@@ -0,0 +1,44 @@
+#ifndef __MULTICAPTURE_H__
+#define __MULTICAPTURE_H__
+
+#include "./blobDetector.h"
+#include "./captureDevice.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Concurrent capture from several cameras in one process
+
+	Every device is given as CAPDEV:PREFIX (for example
+	/dev/video0:beamline1). Each device gets it's own capture thread
+	and ring of frame slots; a full ring drops the newest frame instead
+	of stalling the driver. All devices share one pool of dwThreads
+	analysis workers (0 uses one per online CPU) that pick frames round
+	robin across devices so a fast camera cannot starve the others.
+	Every device negotiates it's mode according to lpRequest.
+
+	Results are appended per device in capture order to
+
+		<prefix>-peaks.dat		sequence timestamp xmin xmax ymin ymax
+								width height areasum clusterpixels
+
+	dwFrames is the number of frames to analyze per device (0 runs
+	until SIGINT or SIGTERM). Per device statistics are printed at the
+	end
+*/
+int multiCapture(
+	char** lpDeviceSpecs,
+	unsigned long int dwDeviceCount,
+	const struct captureDeviceFormatRequest* lpRequest,
+	unsigned long int dwFrames,
+	unsigned long int dwThreads,
+	const struct blobDetectorParams* lpParams
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __MULTICAPTURE_H__ */
@@ -0,0 +1,735 @@
+/*
+	Live preview over HTTP (see previewServer.h)
+
+	A single server thread handles the listening socket, all viewers
+	(non blocking sockets in one poll loop) and the JPEG encoder. The
+	capture thread renders the preview sized frame into a staging buffer
+	that is owned by the capture thread while bStagingReady is 0 and by
+	the server thread while it is 1, a pipe wakes up the server thread.
+
+	Encoded frames are kept in a small pool and reference counted by the
+	viewers still sending them (only ever touched by the server thread).
+	Every viewer always continues with the latest frame once the
+	previous one has been sent completely.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./jpegFile.h"
+#include "./realtime.h"
+#include "./frameTrace.h"
+#include "./previewServer.h"
+
+#define PREVIEWSERVER_FRAMES					(PREVIEWSERVER_MAXCLIENTS + 2)
+#define PREVIEWSERVER_REQUESTSIZE				1024
+#define PREVIEWSERVER_HEADSIZE					512
+#define PREVIEWSERVER_BOUNDARY					"wbeframe"
+
+struct previewFrame {
+	unsigned char*				lpData;
+	size_t						sCapacity;
+	size_t						sLen;
+	unsigned long int			dwRefs;				/* Viewers sending this frame */
+};
+
+enum previewClientState {
+	previewClientState_Request,						/* Reading the request */
+	previewClientState_Stream,						/* Multipart stream */
+	previewClientState_Single,						/* One frame, then close */
+	previewClientState_Static,						/* Fixed response, then close */
+};
+
+struct previewClient {
+	int							hSocket;
+	enum previewClientState		state;
+
+	char						szRequest[PREVIEWSERVER_REQUESTSIZE];
+	size_t						sRequestLen;
+
+	/* Pending response: szHead, the frame data (if any) and szTail */
+	char						szHead[PREVIEWSERVER_HEADSIZE];
+	size_t						sHeadLen;
+	struct previewFrame*		lpFrame;
+	const char*					lpTail;
+	size_t						sTailLen;
+	size_t						sOffset;
+	int							bPending;
+	int							bHeaderSent;
+
+	unsigned long int			dwGeneration;		/* Of the last frame sent */
+};
+
+struct previewServer {
+	struct previewServerSettings	settings;
+
+	int							hListen;
+	int							hWake[2];
+	pthread_t					thrServer;
+
+	pthread_mutex_t				mtxStaging;
+	int							bShutdown;
+	int							bStagingReady;
+	unsigned long int			dwViewers;			/* Clients waiting for frames */
+
+	/* Preview sized RGB frame (see above for ownership) */
+	struct imgRawImage			staging;
+	size_t						sStagingCapacity;
+	struct timespec				tsNextFrame;
+
+	/* Server thread only */
+	struct previewClient		clients[PREVIEWSERVER_MAXCLIENTS];
+	unsigned long int			dwClients;
+	struct previewFrame			frames[PREVIEWSERVER_FRAMES];
+	struct previewFrame*		lpCurrent;
+	unsigned long int			dwGeneration;
+};
+
+static const char previewServerIndex[] =
+	"<!DOCTYPE html>\n<html><head><title>webcamBlobEstimator</title></head>\n"
+	"<body style=\"background:#202020;margin:0\"><img src=\"/stream\" style=\"display:block;margin:auto;max-width:100%\"></body></html>\n";
+
+void previewServerSettingsDefault(struct previewServerSettings* lpSettings) {
+	if(lpSettings == NULL) { return; }
+
+	memset(lpSettings, 0, sizeof(struct previewServerSettings));
+	lpSettings->port = PREVIEWSERVER_DEFAULT_PORT;
+	lpSettings->dMaxFps = PREVIEWSERVER_DEFAULT_FPS;
+	lpSettings->dwMaxWidth = PREVIEWSERVER_DEFAULT_WIDTH;
+	lpSettings->iQuality = PREVIEWSERVER_DEFAULT_QUALITY;
+}
+
+int previewServerParse(const char* lpSpec, struct previewServerSettings* lpSettings) {
+	unsigned long int dwPort = 0;
+	double dFps = 0;
+	unsigned long int dwWidth = 0;
+	int iQuality = 0;
+	int iFields;
+
+	if((lpSpec == NULL) || (lpSettings == NULL)) { return 1; }
+
+	iFields = sscanf(lpSpec, "%lu:%lf:%lu:%d", &dwPort, &dFps, &dwWidth, &iQuality);
+	if(iFields < 1) { return 1; }
+
+	if((dwPort == 0) || (dwPort > 65535)) { return 1; }
+	lpSettings->port = (unsigned short int)dwPort;
+	if(iFields >= 2) {
+		if(dFps <= 0) { return 1; }
+		lpSettings->dMaxFps = dFps;
+	}
+	if(iFields >= 3) {
+		if(dwWidth < 16) { return 1; }
+		lpSettings->dwMaxWidth = dwWidth;
+	}
+	if(iFields >= 4) {
+		if((iQuality < 1) || (iQuality > 100)) { return 1; }
+		lpSettings->iQuality = iQuality;
+	}
+	return 0;
+}
+
+/*
+	Server thread
+*/
+static void previewFrameRelease(struct previewFrame* lpFrame) {
+	if(lpFrame == NULL) { return; }
+	lpFrame->dwRefs = lpFrame->dwRefs - 1;
+}
+
+static struct previewFrame* previewServerFreeFrame(struct previewServer* lpServer) {
+	unsigned long int i;
+
+	/* One more frame than clients plus the current one, so there is always a free one */
+	for(i = 0; i < PREVIEWSERVER_FRAMES; i=i+1) {
+		if((lpServer->frames[i].dwRefs == 0) && (&(lpServer->frames[i]) != lpServer->lpCurrent)) {
+			return &(lpServer->frames[i]);
+		}
+	}
+	return NULL;
+}
+
+static void previewServerEncode(struct previewServer* lpServer) {
+	struct previewFrame* lpFrame = previewServerFreeFrame(lpServer);
+
+	if(lpFrame == NULL) { return; }
+	if(encodeJpegImage(&(lpServer->staging), lpServer->settings.iQuality, &(lpFrame->lpData), &(lpFrame->sCapacity), &(lpFrame->sLen)) != 0) {
+		return;
+	}
+	lpServer->lpCurrent = lpFrame;
+	lpServer->dwGeneration = lpServer->dwGeneration + 1;
+}
+
+/*
+	Starts sending the current frame to a waiting viewer
+*/
+static void previewClientNextFrame(struct previewServer* lpServer, struct previewClient* lpClient) {
+	int iLen;
+
+	if((lpClient->bPending != 0) || (lpServer->lpCurrent == NULL) || (lpClient->dwGeneration == lpServer->dwGeneration)) {
+		return;
+	}
+
+	if(lpClient->state == previewClientState_Single) {
+		iLen = snprintf(lpClient->szHead, sizeof(lpClient->szHead),
+			"HTTP/1.0 200 OK\r\nContent-Type: image/jpeg\r\nContent-Length: %lu\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n",
+			(unsigned long int)lpServer->lpCurrent->sLen);
+		lpClient->lpTail = "";
+		lpClient->sTailLen = 0;
+	} else {
+		iLen = snprintf(lpClient->szHead, sizeof(lpClient->szHead),
+			"%s--" PREVIEWSERVER_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %lu\r\n\r\n",
+			(lpClient->bHeaderSent == 0) ? "HTTP/1.0 200 OK\r\nContent-Type: multipart/x-mixed-replace; boundary=" PREVIEWSERVER_BOUNDARY "\r\nCache-Control: no-cache\r\nConnection: close\r\n\r\n" : "",
+			(unsigned long int)lpServer->lpCurrent->sLen);
+		lpClient->lpTail = "\r\n";
+		lpClient->sTailLen = 2;
+	}
+	if((iLen < 0) || ((size_t)iLen >= sizeof(lpClient->szHead))) { return; }
+
+	lpClient->sHeadLen = (size_t)iLen;
+	lpClient->lpFrame = lpServer->lpCurrent;
+	lpClient->lpFrame->dwRefs = lpClient->lpFrame->dwRefs + 1;
+	lpClient->sOffset = 0;
+	lpClient->bPending = 1;
+	lpClient->bHeaderSent = 1;
+	lpClient->dwGeneration = lpServer->dwGeneration;
+}
+
+static void previewClientStatic(struct previewClient* lpClient, const char* lpStatus, const char* lpType, const char* lpBody) {
+	int iLen;
+
+	iLen = snprintf(lpClient->szHead, sizeof(lpClient->szHead),
+		"HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n%s",
+		lpStatus, lpType, (unsigned long int)strlen(lpBody), lpBody);
+	if((iLen < 0) || ((size_t)iLen >= sizeof(lpClient->szHead))) { iLen = (int)(sizeof(lpClient->szHead) - 1); }
+
+	lpClient->state = previewClientState_Static;
+	lpClient->sHeadLen = (size_t)iLen;
+	lpClient->lpFrame = NULL;
+	lpClient->lpTail = "";
+	lpClient->sTailLen = 0;
+	lpClient->sOffset = 0;
+	lpClient->bPending = 1;
+}
+
+/*
+	Returns 1 if the connection should be closed
+*/
+static int previewClientRead(struct previewServer* lpServer, struct previewClient* lpClient) {
+	ssize_t r;
+	char szPath[64];
+
+	if(lpClient->state != previewClientState_Request) {
+		/* Viewers do not send anything after the request, only detect the close */
+		char bDiscard[256];
+		r = read(lpClient->hSocket, bDiscard, sizeof(bDiscard));
+		if(r == 0) { return 1; }
+		if((r < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) { return 1; }
+		return 0;
+	}
+
+	r = read(lpClient->hSocket, &(lpClient->szRequest[lpClient->sRequestLen]), sizeof(lpClient->szRequest) - 1 - lpClient->sRequestLen);
+	if(r == 0) { return 1; }
+	if(r < 0) {
+		return ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR)) ? 0 : 1;
+	}
+	lpClient->sRequestLen = lpClient->sRequestLen + (size_t)r;
+	lpClient->szRequest[lpClient->sRequestLen] = 0;
+
+	if(strstr(lpClient->szRequest, "\r\n\r\n") == NULL) {
+		if(lpClient->sRequestLen >= sizeof(lpClient->szRequest) - 1) {
+			previewClientStatic(lpClient, "431 Request Header Fields Too Large", "text/plain", "Request too large\n");
+		}
+		return 0;
+	}
+
+	if(sscanf(lpClient->szRequest, "GET %63s", szPath) != 1) {
+		previewClientStatic(lpClient, "405 Method Not Allowed", "text/plain", "Only GET is supported\n");
+	} else if(strcmp(szPath, "/") == 0) {
+		previewClientStatic(lpClient, "200 OK", "text/html", previewServerIndex);
+	} else if((strcmp(szPath, "/stream") == 0) || (strcmp(szPath, "/frame.jpg") == 0)) {
+		lpClient->state = (strcmp(szPath, "/stream") == 0) ? previewClientState_Stream : previewClientState_Single;
+
+		/* Single images always wait for the next frame */
+		lpClient->dwGeneration = (lpClient->state == previewClientState_Single) ? lpServer->dwGeneration : (unsigned long int)(~0UL);
+		pthread_mutex_lock(&(lpServer->mtxStaging));
+		lpServer->dwViewers = lpServer->dwViewers + 1;
+		pthread_mutex_unlock(&(lpServer->mtxStaging));
+		previewClientNextFrame(lpServer, lpClient);
+	} else {
+		previewClientStatic(lpClient, "404 Not Found", "text/plain", "Not found\n");
+	}
+	return 0;
+}
+
+/*
+	Returns 1 if the connection should be closed
+*/
+static int previewClientWrite(struct previewServer* lpServer, struct previewClient* lpClient) {
+	for(;;) {
+		struct iovec iov[3];
+		int iIov = 0;
+		size_t sFrameLen = (lpClient->lpFrame != NULL) ? lpClient->lpFrame->sLen : 0;
+		size_t sOffset = lpClient->sOffset;
+		ssize_t r;
+
+		if(sOffset < lpClient->sHeadLen) {
+			iov[iIov].iov_base = &(lpClient->szHead[sOffset]);
+			iov[iIov].iov_len = lpClient->sHeadLen - sOffset;
+			iIov = iIov + 1;
+			sOffset = 0;
+		} else {
+			sOffset = sOffset - lpClient->sHeadLen;
+		}
+		if(sOffset < sFrameLen) {
+			iov[iIov].iov_base = &(lpClient->lpFrame->lpData[sOffset]);
+			iov[iIov].iov_len = sFrameLen - sOffset;
+			iIov = iIov + 1;
+			sOffset = 0;
+		} else {
+			sOffset = sOffset - sFrameLen;
+		}
+		if(sOffset < lpClient->sTailLen) {
+			iov[iIov].iov_base = (void*)(&(lpClient->lpTail[sOffset]));
+			iov[iIov].iov_len = lpClient->sTailLen - sOffset;
+			iIov = iIov + 1;
+		}
+
+		if(iIov == 0) {
+			/* Response complete */
+			previewFrameRelease(lpClient->lpFrame);
+			lpClient->lpFrame = NULL;
+			lpClient->bPending = 0;
+			if(lpClient->state != previewClientState_Stream) { return 1; }
+
+			previewClientNextFrame(lpServer, lpClient);
+			if(lpClient->bPending == 0) { return 0; }
+			continue;
+		}
+
+		r = writev(lpClient->hSocket, iov, iIov);
+		if(r < 0) {
+			if(errno == EINTR) { continue; }
+			return ((errno == EAGAIN) || (errno == EWOULDBLOCK)) ? 0 : 1;
+		}
+		lpClient->sOffset = lpClient->sOffset + (size_t)r;
+	}
+}
+
+static void previewClientClose(struct previewServer* lpServer, unsigned long int dwClient) {
+	struct previewClient* lpClient = &(lpServer->clients[dwClient]);
+
+	if((lpClient->state == previewClientState_Stream) || (lpClient->state == previewClientState_Single)) {
+		pthread_mutex_lock(&(lpServer->mtxStaging));
+		lpServer->dwViewers = lpServer->dwViewers - 1;
+		pthread_mutex_unlock(&(lpServer->mtxStaging));
+	}
+	previewFrameRelease(lpClient->lpFrame);
+	close(lpClient->hSocket);
+
+	/* Keep the client array dense */
+	lpServer->dwClients = lpServer->dwClients - 1;
+	if(dwClient != lpServer->dwClients) {
+		memcpy(lpClient, &(lpServer->clients[lpServer->dwClients]), sizeof(struct previewClient));
+	}
+}
+
+static void previewServerAccept(struct previewServer* lpServer) {
+	for(;;) {
+		struct previewClient* lpClient;
+		int hClient = accept(lpServer->hListen, NULL, NULL);
+
+		if(hClient < 0) { return; }
+		if(lpServer->dwClients >= PREVIEWSERVER_MAXCLIENTS) {
+			close(hClient);
+			continue;
+		}
+		fcntl(hClient, F_SETFL, fcntl(hClient, F_GETFL) | O_NONBLOCK);
+
+		lpClient = &(lpServer->clients[lpServer->dwClients]);
+		memset(lpClient, 0, sizeof(struct previewClient));
+		lpClient->hSocket = hClient;
+		lpClient->state = previewClientState_Request;
+		lpServer->dwClients = lpServer->dwClients + 1;
+	}
+}
+
+static void* previewServerThread(void* lpArg) {
+	struct previewServer* lpServer = (struct previewServer*)lpArg;
+	struct pollfd fds[PREVIEWSERVER_MAXCLIENTS + 2];
+
+	realtimeEnterThread(realtimeRole_Writer, 1);
+
+	for(;;) {
+		unsigned long int dwPolled = lpServer->dwClients;
+		unsigned long int i;
+		int bStagingReady;
+
+		fds[0].fd = lpServer->hWake[0];
+		fds[0].events = POLLIN;
+		fds[1].fd = lpServer->hListen;
+		fds[1].events = POLLIN;
+		for(i = 0; i < dwPolled; i=i+1) {
+			fds[i+2].fd = lpServer->clients[i].hSocket;
+			fds[i+2].events = (lpServer->clients[i].bPending != 0) ? (POLLIN|POLLOUT) : POLLIN;
+			fds[i+2].revents = 0;
+		}
+
+		if(poll(fds, dwPolled + 2, -1) < 0) {
+			if(errno == EINTR) { continue; }
+			printf("%s:%u Preview server poll failed: %s\n", __FILE__, __LINE__, strerror(errno));
+			break;
+		}
+
+		if((fds[0].revents & POLLIN) != 0) {
+			char bDrain[64];
+			while(read(lpServer->hWake[0], bDrain, sizeof(bDrain)) > 0) { }
+		}
+
+		pthread_mutex_lock(&(lpServer->mtxStaging));
+		if(lpServer->bShutdown != 0) {
+			pthread_mutex_unlock(&(lpServer->mtxStaging));
+			break;
+		}
+		bStagingReady = lpServer->bStagingReady;
+		pthread_mutex_unlock(&(lpServer->mtxStaging));
+
+		if(bStagingReady != 0) {
+			previewServerEncode(lpServer);
+
+			pthread_mutex_lock(&(lpServer->mtxStaging));
+			lpServer->bStagingReady = 0;
+			pthread_mutex_unlock(&(lpServer->mtxStaging));
+		}
+
+		/* Walk backwards, closing moves the last client into the slot */
+		for(i = dwPolled; i > 0; i=i-1) {
+			struct previewClient* lpClient = &(lpServer->clients[i-1]);
+			short int revents = fds[i+1].revents;
+			int bClose = 0;
+
+			if((revents & (POLLERR|POLLNVAL)) != 0) {
+				bClose = 1;
+			} else if((revents & (POLLIN|POLLHUP)) != 0) {
+				bClose = previewClientRead(lpServer, lpClient);
+			}
+			if(bClose == 0) {
+				previewClientNextFrame(lpServer, lpClient);
+				if(lpClient->bPending != 0) {
+					bClose = previewClientWrite(lpServer, lpClient);
+				}
+			}
+			if(bClose != 0) {
+				previewClientClose(lpServer, i-1);
+			}
+		}
+
+		if((fds[1].revents & POLLIN) != 0) {
+			previewServerAccept(lpServer);
+		}
+	}
+
+	while(lpServer->dwClients > 0) {
+		previewClientClose(lpServer, lpServer->dwClients - 1);
+	}
+	return NULL;
+}
+
+static void previewServerRelease(struct previewServer* lpServer) {
+	unsigned long int i;
+
+	for(i = 0; i < PREVIEWSERVER_FRAMES; i=i+1) {
+		if(lpServer->frames[i].lpData != NULL) { free(lpServer->frames[i].lpData); }
+	}
+	if(lpServer->staging.lpData != NULL) { free(lpServer->staging.lpData); }
+	if(lpServer->hListen >= 0) { close(lpServer->hListen); }
+	if(lpServer->hWake[0] >= 0) { close(lpServer->hWake[0]); }
+	if(lpServer->hWake[1] >= 0) { close(lpServer->hWake[1]); }
+	free(lpServer);
+}
+
+int previewServerStart(
+	struct previewServer** lpServerOut,
+	const struct previewServerSettings* lpSettings
+) {
+	struct previewServer* lpServer;
+	struct sockaddr_in addr;
+	pthread_attr_t attr;
+	struct sched_param sp;
+	int iReuse = 1;
+	int r;
+
+	if((lpServerOut == NULL) || (lpSettings == NULL)) { return 1; }
+	(*lpServerOut) = NULL;
+
+	lpServer = calloc(1, sizeof(struct previewServer));
+	if(lpServer == NULL) {
+		return 1;
+	}
+	memcpy(&(lpServer->settings), lpSettings, sizeof(struct previewServerSettings));
+	lpServer->hListen = -1;
+	lpServer->hWake[0] = -1;
+	lpServer->hWake[1] = -1;
+
+	if(pipe(lpServer->hWake) != 0) {
+		lpServer->hWake[0] = -1;
+		lpServer->hWake[1] = -1;
+		previewServerRelease(lpServer);
+		return 1;
+	}
+	fcntl(lpServer->hWake[0], F_SETFL, fcntl(lpServer->hWake[0], F_GETFL) | O_NONBLOCK);
+	fcntl(lpServer->hWake[1], F_SETFL, fcntl(lpServer->hWake[1], F_GETFL) | O_NONBLOCK);
+
+	/* Loopback only, the preview is meant for the operator on this machine */
+	lpServer->hListen = socket(AF_INET, SOCK_STREAM, 0);
+	if(lpServer->hListen < 0) {
+		printf("%s:%u Failed to create socket: %s\n", __FILE__, __LINE__, strerror(errno));
+		previewServerRelease(lpServer);
+		return 1;
+	}
+	setsockopt(lpServer->hListen, SOL_SOCKET, SO_REUSEADDR, &iReuse, sizeof(iReuse));
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(lpSettings->port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if((bind(lpServer->hListen, (struct sockaddr*)&addr, sizeof(addr)) != 0) || (listen(lpServer->hListen, 8) != 0)) {
+		printf("%s:%u Failed to listen on 127.0.0.1:%u: %s\n", __FILE__, __LINE__, (unsigned int)lpSettings->port, strerror(errno));
+		previewServerRelease(lpServer);
+		return 1;
+	}
+	fcntl(lpServer->hListen, F_SETFL, fcntl(lpServer->hListen, F_GETFL) | O_NONBLOCK);
+
+	if(pthread_mutex_init(&(lpServer->mtxStaging), NULL) != 0) {
+		previewServerRelease(lpServer);
+		return 1;
+	}
+
+	/*
+		The server never runs with the SCHED_FIFO priority the capture
+		thread may have (threads inherit it by default)
+	*/
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	memset(&sp, 0, sizeof(sp));
+	pthread_attr_setschedparam(&attr, &sp);
+	r = pthread_create(&(lpServer->thrServer), &attr, &previewServerThread, lpServer);
+	pthread_attr_destroy(&attr);
+	if(r != 0) {
+		pthread_mutex_destroy(&(lpServer->mtxStaging));
+		previewServerRelease(lpServer);
+		return 1;
+	}
+
+	printf("Serving live preview on http://127.0.0.1:%u/\n", (unsigned int)lpSettings->port);
+	(*lpServerOut) = lpServer;
+	return 0;
+}
+
+void previewServerStop(
+	struct previewServer* lpServer
+) {
+	if(lpServer == NULL) { return; }
+
+	pthread_mutex_lock(&(lpServer->mtxStaging));
+	lpServer->bShutdown = 1;
+	pthread_mutex_unlock(&(lpServer->mtxStaging));
+	if(write(lpServer->hWake[1], "x", 1) < 0) { /* The pipe is full, the thread wakes up anyway */ }
+
+	pthread_join(lpServer->thrServer, NULL);
+	pthread_mutex_destroy(&(lpServer->mtxStaging));
+	previewServerRelease(lpServer);
+}
+
+/*
+	Capture thread
+*/
+static int previewServerDue(struct previewServer* lpServer, struct timespec* lpNow) {
+	int bDue;
+
+	/* Never wait for the server thread, skip the frame if it holds the lock */
+	if(pthread_mutex_trylock(&(lpServer->mtxStaging)) != 0) {
+		return 0;
+	}
+	bDue = ((lpServer->dwViewers > 0) && (lpServer->bStagingReady == 0) && (lpServer->bShutdown == 0)) ? 1 : 0;
+	pthread_mutex_unlock(&(lpServer->mtxStaging));
+	if(bDue == 0) { return 0; }
+
+	clock_gettime(CLOCK_MONOTONIC, lpNow);
+	if((lpNow->tv_sec < lpServer->tsNextFrame.tv_sec) || ((lpNow->tv_sec == lpServer->tsNextFrame.tv_sec) && (lpNow->tv_nsec < lpServer->tsNextFrame.tv_nsec))) {
+		return 0;
+	}
+	return 1;
+}
+
+/*
+	Box filtered reduction of the region by dwStep in both directions,
+	cluster pixels blue and the cluster bounds red as in the cluster
+	image
+*/
+static void previewServerRender(
+	struct imgRawImage* lpOut,
+	const struct imgRawImage* lpImage,
+	const struct blobDetectorScratch* lpScratch,
+	const struct blobResult* lpResult,
+	const struct rectBound* lpRegion,
+	unsigned long int dwStep
+) {
+	unsigned long int dwArea = dwStep * dwStep;
+	unsigned long int x, y, bx, by;
+
+	for(y = 0; y < lpOut->height; y=y+1) {
+		unsigned char* lpDst = &(lpOut->lpData[y * lpOut->width * 3]);
+		unsigned long int srcY = lpRegion->yMin + y * dwStep;
+
+		for(x = 0; x < lpOut->width; x=x+1) {
+			unsigned long int srcX = lpRegion->xMin + x * dwStep;
+			unsigned long int dwSum = 0;
+			int bCluster = 0;
+
+			for(by = 0; by < dwStep; by=by+1) {
+				const unsigned char* lpSrc = &(lpImage->lpLuma[(srcY + by) * lpImage->width + srcX]);
+				for(bx = 0; bx < dwStep; bx=bx+1) {
+					dwSum = dwSum + lpSrc[bx];
+				}
+			}
+
+			/* Only blocks overlapping the cluster bounds can contain cluster pixels */
+			if((lpResult != NULL) && (srcX + dwStep > lpResult->bounds.xMin) && (srcX <= lpResult->bounds.xMax) && (srcY + dwStep > lpResult->bounds.yMin) && (srcY <= lpResult->bounds.yMax)) {
+				for(by = 0; (by < dwStep) && (bCluster == 0); by=by+1) {
+					for(bx = 0; bx < dwStep; bx=bx+1) {
+						if(BLOBDETECTOR_VISITED(lpScratch, srcX + bx, srcY + by) != 0) {
+							bCluster = 1;
+							break;
+						}
+					}
+				}
+			}
+
+			if(bCluster != 0) {
+				lpDst[x*3 + 0] = 0;
+				lpDst[x*3 + 1] = 0;
+				lpDst[x*3 + 2] = 255;
+			} else {
+				unsigned char bValue = (unsigned char)(dwSum / dwArea);
+				lpDst[x*3 + 0] = bValue;
+				lpDst[x*3 + 1] = bValue;
+				lpDst[x*3 + 2] = bValue;
+			}
+		}
+	}
+
+	if(lpResult != NULL) {
+		long int x0 = ((long int)lpResult->bounds.xMin - (long int)lpRegion->xMin) / (long int)dwStep;
+		long int x1 = ((long int)lpResult->bounds.xMax - (long int)lpRegion->xMin) / (long int)dwStep;
+		long int y0 = ((long int)lpResult->bounds.yMin - (long int)lpRegion->yMin) / (long int)dwStep;
+		long int y1 = ((long int)lpResult->bounds.yMax - (long int)lpRegion->yMin) / (long int)dwStep;
+		long int i;
+
+		if(x0 < 0) { x0 = 0; }
+		if(y0 < 0) { y0 = 0; }
+		if(x1 >= (long int)lpOut->width) { x1 = (long int)lpOut->width - 1; }
+		if(y1 >= (long int)lpOut->height) { y1 = (long int)lpOut->height - 1; }
+		if((x0 > x1) || (y0 > y1)) { return; }
+
+		for(i = x0; i <= x1; i=i+1) {
+			unsigned char* lpTop = &(lpOut->lpData[(y0 * (long int)lpOut->width + i) * 3]);
+			unsigned char* lpBottom = &(lpOut->lpData[(y1 * (long int)lpOut->width + i) * 3]);
+			lpTop[0] = 255; lpTop[1] = 0; lpTop[2] = 0;
+			lpBottom[0] = 255; lpBottom[1] = 0; lpBottom[2] = 0;
+		}
+		for(i = y0; i <= y1; i=i+1) {
+			unsigned char* lpLeft = &(lpOut->lpData[(i * (long int)lpOut->width + x0) * 3]);
+			unsigned char* lpRight = &(lpOut->lpData[(i * (long int)lpOut->width + x1) * 3]);
+			lpLeft[0] = 255; lpLeft[1] = 0; lpLeft[2] = 0;
+			lpRight[0] = 255; lpRight[1] = 0; lpRight[2] = 0;
+		}
+	}
+}
+
+int previewServerSubmit(
+	struct previewServer* lpServer,
+	const struct imgRawImage* lpImage,
+	const struct blobDetectorScratch* lpScratch,
+	const struct blobResult* lpResult
+) {
+	struct timespec tsNow;
+	struct rectBound region;
+	unsigned long int dwStep;
+	unsigned long int dwWidth, dwHeight;
+	long int dwIntervalNs;
+
+	if((lpServer == NULL) || (lpImage == NULL) || (lpImage->lpLuma == NULL) || (lpImage->width == 0) || (lpImage->height == 0)) {
+		return 1;
+	}
+	if(lpScratch == NULL) { lpResult = NULL; }
+	if(previewServerDue(lpServer, &tsNow) == 0) {
+		return 1;
+	}
+
+	frameTraceBegin("preview");
+
+	region.xMin = 0;
+	region.yMin = 0;
+	region.xMax = lpImage->width - 1;
+	region.yMax = lpImage->height - 1;
+	if((lpServer->settings.dwCropMargin > 0) && (lpResult != NULL)) {
+		unsigned long int dwMargin = lpServer->settings.dwCropMargin;
+
+		region.xMin = (lpResult->bounds.xMin > dwMargin) ? lpResult->bounds.xMin - dwMargin : 0;
+		region.yMin = (lpResult->bounds.yMin > dwMargin) ? lpResult->bounds.yMin - dwMargin : 0;
+		if(lpResult->bounds.xMax + dwMargin < region.xMax) { region.xMax = lpResult->bounds.xMax + dwMargin; }
+		if(lpResult->bounds.yMax + dwMargin < region.yMax) { region.yMax = lpResult->bounds.yMax + dwMargin; }
+	}
+
+	dwStep = (region.xMax - region.xMin + lpServer->settings.dwMaxWidth) / lpServer->settings.dwMaxWidth;
+	dwWidth = (region.xMax - region.xMin + 1) / dwStep;
+	dwHeight = (region.yMax - region.yMin + 1) / dwStep;
+	if(dwHeight == 0) { dwHeight = 1; dwStep = 1; dwWidth = region.xMax - region.xMin + 1; }
+
+	if(lpServer->sStagingCapacity < dwWidth * dwHeight * 3) {
+		unsigned char* lpNew = realloc(lpServer->staging.lpData, dwWidth * dwHeight * 3);
+		if(lpNew == NULL) {
+			frameTraceEnd("preview");
+			return 1;
+		}
+		lpServer->staging.lpData = lpNew;
+		lpServer->sStagingCapacity = dwWidth * dwHeight * 3;
+	}
+	lpServer->staging.numComponents = 3;
+	lpServer->staging.width = dwWidth;
+	lpServer->staging.height = dwHeight;
+	lpServer->staging.lpLuma = NULL;
+
+	previewServerRender(&(lpServer->staging), lpImage, lpScratch, lpResult, &region, dwStep);
+
+	pthread_mutex_lock(&(lpServer->mtxStaging));
+	lpServer->bStagingReady = 1;
+	pthread_mutex_unlock(&(lpServer->mtxStaging));
+	if(write(lpServer->hWake[1], "x", 1) < 0) { /* Already signalled */ }
+
+	dwIntervalNs = (long int)(1000000000.0 / lpServer->settings.dMaxFps);
+	lpServer->tsNextFrame.tv_sec = tsNow.tv_sec + dwIntervalNs / 1000000000L;
+	lpServer->tsNextFrame.tv_nsec = tsNow.tv_nsec + dwIntervalNs % 1000000000L;
+	if(lpServer->tsNextFrame.tv_nsec >= 1000000000L) {
+		lpServer->tsNextFrame.tv_sec = lpServer->tsNextFrame.tv_sec + 1;
+		lpServer->tsNextFrame.tv_nsec = lpServer->tsNextFrame.tv_nsec - 1000000000L;
+	}
+
+	frameTraceEnd("preview");
+	return 0;
+}
@@ -0,0 +1,89 @@
+#ifndef __PREVIEWSERVER_H__
+#define __PREVIEWSERVER_H__
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Live preview over HTTP
+
+	A small embedded HTTP server on the loopback interface that serves
+	the annotated frame to any number of viewers:
+
+		/				Page showing the stream
+		/stream			multipart/x-mixed-replace MJPEG stream
+		/frame.jpg		The next frame as single JPEG image
+
+	The capture loop offers every analyzed frame with
+	previewServerSubmit. Frames are only taken if a viewer is connected,
+	the preview interval (1 / dMaxFps) has passed and the previous
+	preview frame has been encoded; the frame is then reduced to at most
+	dwMaxWidth pixels wide (box filter, optionally cropped to the cluster
+	bounds plus dwCropMargin pixels) and annotated into a preview sized
+	buffer. Encoding and all socket I/O happen on the server thread, one
+	encoded frame is shared by all viewers. Slow viewers skip frames
+	instead of holding back capture or other viewers.
+*/
+
+#define PREVIEWSERVER_DEFAULT_PORT				8080
+#define PREVIEWSERVER_DEFAULT_FPS				5
+#define PREVIEWSERVER_DEFAULT_WIDTH				640
+#define PREVIEWSERVER_DEFAULT_QUALITY			75
+#define PREVIEWSERVER_MAXCLIENTS				16
+
+struct previewServerSettings {
+	unsigned short int		port;
+	double					dMaxFps;
+	unsigned long int		dwMaxWidth;
+	int						iQuality;
+	unsigned long int		dwCropMargin;		/* 0 shows the whole frame */
+};
+
+struct previewServer;
+
+void previewServerSettingsDefault(struct previewServerSettings* lpSettings);
+
+/*
+	Parses PORT[:FPS[:WIDTH[:QUALITY]]], missing entries keep their
+	value. Returns 0 on success
+*/
+int previewServerParse(const char* lpSpec, struct previewServerSettings* lpSettings);
+
+/*
+	Binds to 127.0.0.1:port and starts the server thread (normal
+	scheduling, pinned like the raw recording writer)
+*/
+int previewServerStart(
+	struct previewServer** lpServerOut,
+	const struct previewServerSettings* lpSettings
+);
+
+/*
+	Offers an analyzed frame (lpImage->lpLuma) and it's detection
+	(lpResult in image coordinates with the visited mask in lpScratch,
+	NULL if nothing has been detected). Never blocks; returns 0 if the
+	frame has been taken for the preview, 1 if it has been skipped
+*/
+int previewServerSubmit(
+	struct previewServer* lpServer,
+	const struct imgRawImage* lpImage,
+	const struct blobDetectorScratch* lpScratch,
+	const struct blobResult* lpResult
+);
+
+/*
+	Disconnects all viewers and stops the server thread
+*/
+void previewServerStop(
+	struct previewServer* lpServer
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __PREVIEWSERVER_H__ */
@@ -0,0 +1,278 @@
+/*
+	Gaussian plus offset fit of the detector projections (see profileFit.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "./profileFit.h"
+
+/*
+	Parameters in the order amplitude, center, sigma, offset
+*/
+#define PROFILEFIT_A		0
+#define PROFILEFIT_C		1
+#define PROFILEFIT_S		2
+#define PROFILEFIT_O		3
+
+/*
+	Solves the 4x4 system a x = b by gaussian elimination with partial
+	pivoting. a and b are destroyed. Returns 1 if a is singular
+*/
+static int profileFitSolve(double a[4][4], double b[4], double x[4]) {
+	int i, j, k;
+
+	for(i = 0; i < 4; i=i+1) {
+		int iPivot = i;
+		for(j = i + 1; j < 4; j=j+1) {
+			if(fabs(a[j][i]) > fabs(a[iPivot][i])) { iPivot = j; }
+		}
+		if(fabs(a[iPivot][i]) < 1e-300) {
+			return 1;
+		}
+		if(iPivot != i) {
+			double dTmp;
+			for(k = 0; k < 4; k=k+1) { dTmp = a[i][k]; a[i][k] = a[iPivot][k]; a[iPivot][k] = dTmp; }
+			dTmp = b[i]; b[i] = b[iPivot]; b[iPivot] = dTmp;
+		}
+		for(j = i + 1; j < 4; j=j+1) {
+			double dFactor = a[j][i] / a[i][i];
+			for(k = i; k < 4; k=k+1) { a[j][k] = a[j][k] - dFactor * a[i][k]; }
+			b[j] = b[j] - dFactor * b[i];
+		}
+	}
+	for(i = 3; i >= 0; i=i-1) {
+		double dSum = b[i];
+		for(k = i + 1; k < 4; k=k+1) { dSum = dSum - a[i][k] * x[k]; }
+		x[i] = dSum / a[i][i];
+	}
+	return 0;
+}
+
+/*
+	Builds J^T J and J^T r at p and returns the sum of squared residuals
+*/
+static double profileFitNormal(
+	const double* lpValues,
+	unsigned long int dwFirst,
+	unsigned long int dwLast,
+	const double p[4],
+	double jtj[4][4],
+	double jtr[4]
+) {
+	unsigned long int i;
+	int j, k;
+	double dSSR = 0;
+	double dInvS2 = 1.0 / (p[PROFILEFIT_S] * p[PROFILEFIT_S]);
+
+	memset(jtj, 0, sizeof(double) * 16);
+	memset(jtr, 0, sizeof(double) * 4);
+
+	for(i = dwFirst; i <= dwLast; i=i+1) {
+		double dX = (double)i - p[PROFILEFIT_C];
+		double dE = exp(-0.5 * dX * dX * dInvS2);
+		double dR = lpValues[i] - (p[PROFILEFIT_A] * dE + p[PROFILEFIT_O]);
+		double dJ[4];
+
+		dJ[PROFILEFIT_A] = dE;
+		dJ[PROFILEFIT_C] = p[PROFILEFIT_A] * dE * dX * dInvS2;
+		dJ[PROFILEFIT_S] = p[PROFILEFIT_A] * dE * dX * dX * dInvS2 / p[PROFILEFIT_S];
+		dJ[PROFILEFIT_O] = 1.0;
+
+		for(j = 0; j < 4; j=j+1) {
+			for(k = j; k < 4; k=k+1) { jtj[j][k] = jtj[j][k] + dJ[j] * dJ[k]; }
+			jtr[j] = jtr[j] + dJ[j] * dR;
+		}
+		dSSR = dSSR + dR * dR;
+	}
+	for(j = 0; j < 4; j=j+1) {
+		for(k = 0; k < j; k=k+1) { jtj[j][k] = jtj[k][j]; }
+	}
+	return dSSR;
+}
+
+static double profileFitSSR(
+	const double* lpValues,
+	unsigned long int dwFirst,
+	unsigned long int dwLast,
+	const double p[4]
+) {
+	unsigned long int i;
+	double dSSR = 0;
+	double dInvS2 = 1.0 / (p[PROFILEFIT_S] * p[PROFILEFIT_S]);
+
+	for(i = dwFirst; i <= dwLast; i=i+1) {
+		double dX = (double)i - p[PROFILEFIT_C];
+		double dR = lpValues[i] - (p[PROFILEFIT_A] * exp(-0.5 * dX * dX * dInvS2) + p[PROFILEFIT_O]);
+		dSSR = dSSR + dR * dR;
+	}
+	return dSSR;
+}
+
+static void profileFitInvalidate(struct profileFitResult* lpResult) {
+	lpResult->bValid = 0;
+	lpResult->dCenter = lpResult->dCenterErr = NAN;
+	lpResult->dSigma = lpResult->dSigmaErr = NAN;
+	lpResult->dAmplitude = lpResult->dAmplitudeErr = NAN;
+	lpResult->dOffset = lpResult->dOffsetErr = NAN;
+}
+
+int profileFitGaussian(
+	const double* lpValues,
+	unsigned long int dwFirst,
+	unsigned long int dwLast,
+	struct profileFitResult* lpResult
+) {
+	unsigned long int i;
+	unsigned long int dwBins;
+	double dMin, dMax;
+	double p[4];
+	double jtj[4][4];
+	double jtr[4];
+	double dSSR;
+	double dLambda = 1e-3;
+	int bConverged = 0;
+
+	if(lpResult == NULL) {
+		return 1;
+	}
+	memset(lpResult, 0, sizeof(struct profileFitResult));
+	profileFitInvalidate(lpResult);
+
+	if((lpValues == NULL) || (dwLast < dwFirst) || (dwLast - dwFirst + 1 < 5)) {
+		return 1;
+	}
+	dwBins = dwLast - dwFirst + 1;
+
+	/*
+		Initial guess: offset from the minimum, center from the first
+		moment and sigma from the number of bins above half maximum
+	*/
+	dMin = dMax = lpValues[dwFirst];
+	for(i = dwFirst; i <= dwLast; i=i+1) {
+		if(lpValues[i] < dMin) { dMin = lpValues[i]; }
+		if(lpValues[i] > dMax) { dMax = lpValues[i]; }
+	}
+	if(dMax <= dMin) {
+		return 1;
+	}
+	{
+		double dHalf = dMin + 0.5 * (dMax - dMin);
+		double dSumW = 0;
+		double dSumWX = 0;
+		unsigned long int dwAboveHalf = 0;
+
+		for(i = dwFirst; i <= dwLast; i=i+1) {
+			if(lpValues[i] > dHalf) {
+				double dW = lpValues[i] - dMin;
+				dSumW = dSumW + dW;
+				dSumWX = dSumWX + dW * (double)i;
+				dwAboveHalf = dwAboveHalf + 1;
+			}
+		}
+		p[PROFILEFIT_A] = dMax - dMin;
+		p[PROFILEFIT_C] = dSumWX / dSumW;
+		p[PROFILEFIT_S] = ((double)dwAboveHalf) / 2.3548;
+		p[PROFILEFIT_O] = dMin;
+		if(p[PROFILEFIT_S] < 0.5) { p[PROFILEFIT_S] = 0.5; }
+	}
+
+	/*
+		Levenberg-Marquardt
+	*/
+	dSSR = profileFitNormal(lpValues, dwFirst, dwLast, p, jtj, jtr);
+	for(lpResult->dwIterations = 0; lpResult->dwIterations < PROFILEFIT_MAXITERATIONS; lpResult->dwIterations = lpResult->dwIterations + 1) {
+		double dNewSSR = dSSR;
+		double pNew[4];
+		int bImproved = 0;
+
+		while(dLambda < 1e10) {
+			double a[4][4];
+			double b[4];
+			double dDelta[4];
+			int j, k;
+
+			for(j = 0; j < 4; j=j+1) {
+				for(k = 0; k < 4; k=k+1) { a[j][k] = jtj[j][k]; }
+				a[j][j] = a[j][j] * (1.0 + dLambda);
+				b[j] = jtr[j];
+			}
+			if(profileFitSolve(a, b, dDelta) != 0) {
+				dLambda = dLambda * 10;
+				continue;
+			}
+			for(j = 0; j < 4; j=j+1) { pNew[j] = p[j] + dDelta[j]; }
+			if(pNew[PROFILEFIT_S] <= 0) {
+				dLambda = dLambda * 10;
+				continue;
+			}
+
+			dNewSSR = profileFitSSR(lpValues, dwFirst, dwLast, pNew);
+			if(dNewSSR < dSSR) {
+				bImproved = 1;
+				dLambda = dLambda * 0.1;
+				break;
+			}
+			dLambda = dLambda * 10;
+		}
+
+		if(bImproved == 0) {
+			bConverged = 1; /* No step reduces the residual any more */
+			break;
+		}
+
+		memcpy(p, pNew, sizeof(p));
+		if(dSSR - dNewSSR <= 1e-9 * dSSR) {
+			dSSR = profileFitNormal(lpValues, dwFirst, dwLast, p, jtj, jtr);
+			bConverged = 1;
+			break;
+		}
+		dSSR = profileFitNormal(lpValues, dwFirst, dwLast, p, jtj, jtr);
+	}
+
+	if((bConverged == 0) || (p[PROFILEFIT_A] <= 0) || (p[PROFILEFIT_C] < (double)dwFirst) || (p[PROFILEFIT_C] > (double)dwLast) || (p[PROFILEFIT_S] > (double)dwBins)) {
+		return 1;
+	}
+
+	/*
+		Covariance: (J^T J)^-1 scaled by the residual variance
+	*/
+	{
+		double dVariance = dSSR / (double)(dwBins - 4);
+		double dErr[4];
+		int j, k;
+
+		for(j = 0; j < 4; j=j+1) {
+			double a[4][4];
+			double b[4] = { 0, 0, 0, 0 };
+			double dColumn[4];
+
+			for(k = 0; k < 4; k=k+1) { memcpy(a[k], jtj[k], sizeof(a[k])); }
+			b[j] = 1.0;
+			if(profileFitSolve(a, b, dColumn) != 0) {
+				return 1;
+			}
+			dErr[j] = (dColumn[j] > 0) ? sqrt(dColumn[j] * dVariance) : NAN;
+		}
+
+		lpResult->bValid = 1;
+		lpResult->dAmplitude = p[PROFILEFIT_A];
+		lpResult->dAmplitudeErr = dErr[PROFILEFIT_A];
+		lpResult->dCenter = p[PROFILEFIT_C];
+		lpResult->dCenterErr = dErr[PROFILEFIT_C];
+		lpResult->dSigma = p[PROFILEFIT_S];
+		lpResult->dSigmaErr = dErr[PROFILEFIT_S];
+		lpResult->dOffset = p[PROFILEFIT_O];
+		lpResult->dOffsetErr = dErr[PROFILEFIT_O];
+	}
+	return 0;
+}
+
+void profileFitPrint(
+	FILE* fHandle,
+	const struct profileFitResult* lpResult
+) {
+	fprintf(fHandle, " %lf %lf %lf %lf %lf %lf %lf", lpResult->dCenter, lpResult->dCenterErr, lpResult->dSigma, lpResult->dSigmaErr, lpResult->dAmplitude, lpResult->dAmplitudeErr, lpResult->dOffset);
+}
@@ -0,0 +1,62 @@
+#ifndef __PROFILEFIT_H__
+#define __PROFILEFIT_H__
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Gaussian plus offset fit of a one dimensional profile
+
+		f(x) = dAmplitude * exp(-(x - dCenter)^2 / (2 dSigma^2)) + dOffset
+
+	The initial guess is taken from the moments of the profile above
+	it's minimum, it is refined by a few Levenberg-Marquardt iterations.
+	The uncertainties are the standard errors from the covariance
+	matrix scaled by the residual variance. If the fit does not converge
+	(or the profile has less than 5 bins) bValid is 0 and all values
+	are NaN
+*/
+struct profileFitResult {
+	int						bValid;
+	unsigned int			dwIterations;
+
+	double					dCenter;
+	double					dCenterErr;
+	double					dSigma;
+	double					dSigmaErr;
+	double					dAmplitude;
+	double					dAmplitudeErr;
+	double					dOffset;
+	double					dOffsetErr;
+};
+
+#define PROFILEFIT_MAXITERATIONS		20
+
+/*
+	Fits the bins dwFirst..dwLast (inclusive) of lpValues, x is the bin
+	index. Returns 0 if the fit converged
+*/
+int profileFitGaussian(
+	const double* lpValues,
+	unsigned long int dwFirst,
+	unsigned long int dwLast,
+	struct profileFitResult* lpResult
+);
+
+/*
+	Appends the center, sigma and amplitude (each followed by it's
+	uncertainty) and the offset as space separated columns
+*/
+void profileFitPrint(
+	FILE* fHandle,
+	const struct profileFitResult* lpResult
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __PROFILEFIT_H__ */
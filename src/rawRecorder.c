@@ -0,0 +1,627 @@
+/*
+	Raw frame recorder
+
+	Appends every dequeued V4L2 buffer unmodified into one preallocated
+	file. The capture loop only copies the buffer into one of a fixed
+	number of block aligned slots; a dedicated writer thread collects
+	all pending slots and writes them sequentially with a single
+	pwritev. In case the writer falls behind frames are dropped (and
+	counted) instead of stalling capture.
+
+	See rawRecorder.h for the container layout.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include "./rawRecorder.h"
+#include "./realtime.h"
+
+#define RAWRECORDER_SLOTCOUNT			8
+#define RAWRECORDER_MAXIOV				16
+#define RAWRECORDER_ROUNDUP(x)			((((x) + RAWRECORDER_BLOCKSIZE - 1) / RAWRECORDER_BLOCKSIZE) * RAWRECORDER_BLOCKSIZE)
+
+struct rawRecorderSlot {
+	unsigned char*				lpData;
+	size_t						sRecordLen;
+};
+
+struct rawRecorder {
+	int							hFile;
+	int							bDirectIO;
+
+	struct rawRecorderFileHeader*	lpHeader;	/* One aligned block */
+
+	size_t						sSlotSize;
+	struct rawRecorderSlot		slots[RAWRECORDER_SLOTCOUNT];
+	unsigned long int			dwHead;
+	unsigned long int			dwTail;
+	unsigned long int			dwPending;
+
+	pthread_mutex_t				mtxQueue;
+	pthread_cond_t				condQueue;
+	pthread_t					thrWriter;
+	int							bShutdown;
+	int							bWriteFailed;
+
+	uint64_t					qwWriteOffset;
+	uint64_t					qwAllocated;
+	uint64_t					qwPreallocateChunk;
+
+	struct rawRecorderIndexEntry*	lpIndex;
+	unsigned long int			dwIndexCount;
+	unsigned long int			dwIndexCapacity;
+
+	unsigned long int			dwDropped;
+};
+
+struct rawRecording {
+	int							hFile;
+	struct rawRecorderFileHeader	header;
+
+	struct rawRecorderIndexEntry*	lpIndex;
+	unsigned long int			dwIndexCount;
+};
+
+static void* rawRecorderAlignedAlloc(size_t sLen) {
+	void* lpMem = NULL;
+	if(posix_memalign(&lpMem, RAWRECORDER_BLOCKSIZE, sLen) != 0) {
+		return NULL;
+	}
+	memset(lpMem, 0, sLen);
+	return lpMem;
+}
+
+/*
+	Write a full buffer (or vector) at a given position, repeating
+	on partial writes and interrupts
+*/
+static int rawRecorderWriteFull(int hFile, struct iovec* lpIov, int iovCount, uint64_t qwOffset) {
+	while(iovCount > 0) {
+		ssize_t r = pwritev(hFile, lpIov, iovCount, (off_t)qwOffset);
+		if(r < 0) {
+			if(errno == EINTR) { continue; }
+			return 1;
+		}
+		qwOffset = qwOffset + r;
+		while((iovCount > 0) && ((size_t)r >= lpIov[0].iov_len)) {
+			r = r - lpIov[0].iov_len;
+			lpIov = &(lpIov[1]);
+			iovCount = iovCount - 1;
+		}
+		if(iovCount > 0) {
+			lpIov[0].iov_base = ((unsigned char*)lpIov[0].iov_base) + r;
+			lpIov[0].iov_len = lpIov[0].iov_len - r;
+		}
+	}
+	return 0;
+}
+
+static int rawRecorderEnsureAllocated(struct rawRecorder* lpRecorder, uint64_t qwEnd) {
+	uint64_t qwGrow;
+
+	if(qwEnd <= lpRecorder->qwAllocated) { return 0; }
+
+	qwGrow = lpRecorder->qwPreallocateChunk;
+	if(qwGrow < (qwEnd - lpRecorder->qwAllocated)) {
+		qwGrow = RAWRECORDER_ROUNDUP(qwEnd - lpRecorder->qwAllocated);
+	}
+
+	/*
+		Not every filesystem supports preallocation (ZFS for example) - in
+		that case we simply continue with an ordinary growing file
+	*/
+	if(posix_fallocate(lpRecorder->hFile, (off_t)lpRecorder->qwAllocated, (off_t)qwGrow) != 0) {
+		lpRecorder->qwPreallocateChunk = 0;
+		lpRecorder->qwAllocated = ~((uint64_t)0);
+		return 0;
+	}
+	lpRecorder->qwAllocated = lpRecorder->qwAllocated + qwGrow;
+	return 0;
+}
+
+static int rawRecorderAddIndex(struct rawRecorder* lpRecorder, struct rawRecorderFrameHeader* lpFrame, uint64_t qwOffset) {
+	if(lpRecorder->dwIndexCount == lpRecorder->dwIndexCapacity) {
+		unsigned long int dwNewCapacity = (lpRecorder->dwIndexCapacity == 0) ? 1024 : lpRecorder->dwIndexCapacity * 2;
+		struct rawRecorderIndexEntry* lpNew = realloc(lpRecorder->lpIndex, sizeof(struct rawRecorderIndexEntry) * dwNewCapacity);
+		if(lpNew == NULL) {
+			return 1;
+		}
+		lpRecorder->lpIndex = lpNew;
+		lpRecorder->dwIndexCapacity = dwNewCapacity;
+	}
+
+	lpRecorder->lpIndex[lpRecorder->dwIndexCount].offset = qwOffset;
+	lpRecorder->lpIndex[lpRecorder->dwIndexCount].sequence = lpFrame->sequence;
+	lpRecorder->lpIndex[lpRecorder->dwIndexCount].timestampSec = lpFrame->timestampSec;
+	lpRecorder->lpIndex[lpRecorder->dwIndexCount].timestampUsec = lpFrame->timestampUsec;
+	lpRecorder->lpIndex[lpRecorder->dwIndexCount].frequency = lpFrame->frequency;
+	lpRecorder->dwIndexCount = lpRecorder->dwIndexCount + 1;
+	return 0;
+}
+
+static void* rawRecorderWriterThread(void* lpArg) {
+	struct rawRecorder* lpRecorder = (struct rawRecorder*)lpArg;
+
+	realtimeEnterThread(realtimeRole_Writer, 0);
+
+	for(;;) {
+		struct iovec iov[RAWRECORDER_MAXIOV];
+		unsigned long int dwFirst;
+		unsigned long int dwCount;
+		unsigned long int i;
+		uint64_t qwBatchLen = 0;
+		uint64_t qwOffset;
+
+		pthread_mutex_lock(&(lpRecorder->mtxQueue));
+		while((lpRecorder->dwPending == 0) && (lpRecorder->bShutdown == 0)) {
+			pthread_cond_wait(&(lpRecorder->condQueue), &(lpRecorder->mtxQueue));
+		}
+		if(lpRecorder->dwPending == 0) {
+			pthread_mutex_unlock(&(lpRecorder->mtxQueue));
+			break;
+		}
+		dwFirst = lpRecorder->dwTail;
+		dwCount = lpRecorder->dwPending;
+		pthread_mutex_unlock(&(lpRecorder->mtxQueue));
+
+		if(dwCount > RAWRECORDER_MAXIOV) { dwCount = RAWRECORDER_MAXIOV; }
+
+		/* Gather all pending slots into one sequential write */
+		for(i = 0; i < dwCount; i=i+1) {
+			struct rawRecorderSlot* lpSlot = &(lpRecorder->slots[(dwFirst + i) % RAWRECORDER_SLOTCOUNT]);
+			iov[i].iov_base = lpSlot->lpData;
+			iov[i].iov_len = lpSlot->sRecordLen;
+			qwBatchLen = qwBatchLen + lpSlot->sRecordLen;
+		}
+
+		qwOffset = lpRecorder->qwWriteOffset;
+		if(lpRecorder->bWriteFailed == 0) {
+			rawRecorderEnsureAllocated(lpRecorder, qwOffset + qwBatchLen);
+			if(rawRecorderWriteFull(lpRecorder->hFile, iov, (int)dwCount, qwOffset) != 0) {
+				perror("Raw recorder write failed");
+				lpRecorder->bWriteFailed = 1;
+			} else {
+				for(i = 0; i < dwCount; i=i+1) {
+					struct rawRecorderSlot* lpSlot = &(lpRecorder->slots[(dwFirst + i) % RAWRECORDER_SLOTCOUNT]);
+					rawRecorderAddIndex(lpRecorder, (struct rawRecorderFrameHeader*)(lpSlot->lpData), qwOffset);
+					qwOffset = qwOffset + lpSlot->sRecordLen;
+				}
+				lpRecorder->qwWriteOffset = qwOffset;
+			}
+		}
+
+		pthread_mutex_lock(&(lpRecorder->mtxQueue));
+		lpRecorder->dwTail = (lpRecorder->dwTail + dwCount) % RAWRECORDER_SLOTCOUNT;
+		lpRecorder->dwPending = lpRecorder->dwPending - dwCount;
+		pthread_mutex_unlock(&(lpRecorder->mtxQueue));
+	}
+
+	return NULL;
+}
+
+static void rawRecorderRelease(struct rawRecorder* lpRecorder) {
+	unsigned long int i;
+
+	for(i = 0; i < RAWRECORDER_SLOTCOUNT; i=i+1) {
+		if(lpRecorder->slots[i].lpData != NULL) { free(lpRecorder->slots[i].lpData); }
+	}
+	if(lpRecorder->lpHeader != NULL) { free(lpRecorder->lpHeader); }
+	if(lpRecorder->lpIndex != NULL) { free(lpRecorder->lpIndex); }
+	if(lpRecorder->hFile >= 0) { close(lpRecorder->hFile); }
+	free(lpRecorder);
+}
+
+int rawRecorderCreate(
+	struct rawRecorder** lpRecorderOut,
+	char* lpFilename,
+	uint32_t pixelFormat,
+	uint32_t width,
+	uint32_t height,
+	uint32_t bytesPerLine,
+	size_t sMaxFrameSize,
+	unsigned long int dwPreallocateMBytes,
+	int bDirectIO
+) {
+	struct rawRecorder* lpRecorder;
+	struct iovec iov;
+	pthread_attr_t attr;
+	struct sched_param sp;
+	unsigned long int i;
+	int iFlags;
+	int r;
+
+	if((lpRecorderOut == NULL) || (lpFilename == NULL) || (sMaxFrameSize == 0)) {
+		return 1;
+	}
+	(*lpRecorderOut) = NULL;
+
+	lpRecorder = calloc(1, sizeof(struct rawRecorder));
+	if(lpRecorder == NULL) {
+		return 1;
+	}
+	lpRecorder->hFile = -1;
+
+	iFlags = O_WRONLY|O_CREAT|O_TRUNC;
+	#ifdef O_DIRECT
+		if(bDirectIO != 0) {
+			lpRecorder->hFile = open(lpFilename, iFlags|O_DIRECT, 0644);
+			if(lpRecorder->hFile < 0) {
+				printf("%s:%u O_DIRECT not supported for %s, using buffered writes\n", __FILE__, __LINE__, lpFilename);
+			} else {
+				lpRecorder->bDirectIO = 1;
+			}
+		}
+	#endif
+	if(lpRecorder->hFile < 0) {
+		lpRecorder->hFile = open(lpFilename, iFlags, 0644);
+	}
+	if(lpRecorder->hFile < 0) {
+		printf("%s:%u Failed to open recording file %s\n", __FILE__, __LINE__, lpFilename);
+		free(lpRecorder);
+		return 1;
+	}
+
+	lpRecorder->sSlotSize = RAWRECORDER_ROUNDUP(sizeof(struct rawRecorderFrameHeader) + sMaxFrameSize);
+	for(i = 0; i < RAWRECORDER_SLOTCOUNT; i=i+1) {
+		lpRecorder->slots[i].lpData = rawRecorderAlignedAlloc(lpRecorder->sSlotSize);
+		if(lpRecorder->slots[i].lpData == NULL) {
+			printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+			rawRecorderRelease(lpRecorder);
+			return 1;
+		}
+	}
+
+	lpRecorder->lpHeader = rawRecorderAlignedAlloc(RAWRECORDER_BLOCKSIZE);
+	if(lpRecorder->lpHeader == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		rawRecorderRelease(lpRecorder);
+		return 1;
+	}
+	memcpy(lpRecorder->lpHeader->magic, RAWRECORDER_MAGIC, sizeof(lpRecorder->lpHeader->magic));
+	lpRecorder->lpHeader->version = 1;
+	lpRecorder->lpHeader->headerSize = RAWRECORDER_BLOCKSIZE;
+	lpRecorder->lpHeader->pixelFormat = pixelFormat;
+	lpRecorder->lpHeader->width = width;
+	lpRecorder->lpHeader->height = height;
+	lpRecorder->lpHeader->bytesPerLine = bytesPerLine;
+
+	/* Preallocate the whole expected recording in one go */
+	lpRecorder->qwAllocated = 0;
+	lpRecorder->qwPreallocateChunk = RAWRECORDER_ROUNDUP(((uint64_t)dwPreallocateMBytes) * 1024 * 1024);
+	if(lpRecorder->qwPreallocateChunk < lpRecorder->sSlotSize * RAWRECORDER_SLOTCOUNT) {
+		lpRecorder->qwPreallocateChunk = lpRecorder->sSlotSize * RAWRECORDER_SLOTCOUNT;
+	}
+	rawRecorderEnsureAllocated(lpRecorder, RAWRECORDER_BLOCKSIZE + ((uint64_t)dwPreallocateMBytes) * 1024 * 1024);
+
+	/* Header without index marks an unfinished recording */
+	iov.iov_base = lpRecorder->lpHeader;
+	iov.iov_len = RAWRECORDER_BLOCKSIZE;
+	if(rawRecorderWriteFull(lpRecorder->hFile, &iov, 1, 0) != 0) {
+		printf("%s:%u Failed to write recording header\n", __FILE__, __LINE__);
+		rawRecorderRelease(lpRecorder);
+		return 1;
+	}
+	lpRecorder->qwWriteOffset = RAWRECORDER_BLOCKSIZE;
+
+	if(pthread_mutex_init(&(lpRecorder->mtxQueue), NULL) != 0) {
+		rawRecorderRelease(lpRecorder);
+		return 1;
+	}
+	if(pthread_cond_init(&(lpRecorder->condQueue), NULL) != 0) {
+		pthread_mutex_destroy(&(lpRecorder->mtxQueue));
+		rawRecorderRelease(lpRecorder);
+		return 1;
+	}
+	/*
+		The writer never runs with the SCHED_FIFO priority the capture
+		thread may have (threads inherit it by default)
+	*/
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	memset(&sp, 0, sizeof(sp));
+	pthread_attr_setschedparam(&attr, &sp);
+	r = pthread_create(&(lpRecorder->thrWriter), &attr, &rawRecorderWriterThread, lpRecorder);
+	pthread_attr_destroy(&attr);
+	if(r != 0) {
+		pthread_cond_destroy(&(lpRecorder->condQueue));
+		pthread_mutex_destroy(&(lpRecorder->mtxQueue));
+		rawRecorderRelease(lpRecorder);
+		return 1;
+	}
+
+	(*lpRecorderOut) = lpRecorder;
+	return 0;
+}
+
+int rawRecorderAppend(
+	struct rawRecorder* lpRecorder,
+	void* lpData,
+	size_t sLen,
+	uint64_t sequence,
+	struct timeval* lpTimestamp,
+	uint64_t frequency
+) {
+	struct rawRecorderSlot* lpSlot;
+	struct rawRecorderFrameHeader* lpFrame;
+	size_t sRecordLen;
+
+	if((lpRecorder == NULL) || (lpData == NULL)) {
+		return 1;
+	}
+	if(sizeof(struct rawRecorderFrameHeader) + sLen > lpRecorder->sSlotSize) {
+		return 1;
+	}
+
+	pthread_mutex_lock(&(lpRecorder->mtxQueue));
+	if(lpRecorder->dwPending == RAWRECORDER_SLOTCOUNT) {
+		lpRecorder->dwDropped = lpRecorder->dwDropped + 1;
+		pthread_mutex_unlock(&(lpRecorder->mtxQueue));
+		return 1;
+	}
+	/* Single producer: the head slot is not touched by the writer until published */
+	lpSlot = &(lpRecorder->slots[lpRecorder->dwHead]);
+	pthread_mutex_unlock(&(lpRecorder->mtxQueue));
+
+	sRecordLen = RAWRECORDER_ROUNDUP(sizeof(struct rawRecorderFrameHeader) + sLen);
+
+	lpFrame = (struct rawRecorderFrameHeader*)(lpSlot->lpData);
+	lpFrame->magic = RAWRECORDER_FRAMEMAGIC;
+	lpFrame->headerSize = sizeof(struct rawRecorderFrameHeader);
+	lpFrame->sequence = sequence;
+	lpFrame->timestampSec = (lpTimestamp != NULL) ? lpTimestamp->tv_sec : 0;
+	lpFrame->timestampUsec = (lpTimestamp != NULL) ? lpTimestamp->tv_usec : 0;
+	lpFrame->frequency = frequency;
+	lpFrame->payloadLength = sLen;
+	lpFrame->recordLength = sRecordLen;
+
+	memcpy(&(lpSlot->lpData[sizeof(struct rawRecorderFrameHeader)]), lpData, sLen);
+	memset(&(lpSlot->lpData[sizeof(struct rawRecorderFrameHeader) + sLen]), 0, sRecordLen - sizeof(struct rawRecorderFrameHeader) - sLen);
+	lpSlot->sRecordLen = sRecordLen;
+
+	pthread_mutex_lock(&(lpRecorder->mtxQueue));
+	lpRecorder->dwHead = (lpRecorder->dwHead + 1) % RAWRECORDER_SLOTCOUNT;
+	lpRecorder->dwPending = lpRecorder->dwPending + 1;
+	pthread_cond_signal(&(lpRecorder->condQueue));
+	pthread_mutex_unlock(&(lpRecorder->mtxQueue));
+
+	return 0;
+}
+
+int rawRecorderClose(
+	struct rawRecorder* lpRecorder
+) {
+	struct iovec iov;
+	size_t sIndexLen;
+	void* lpIndexBlock;
+	int rc = 0;
+
+	if(lpRecorder == NULL) {
+		return 1;
+	}
+
+	pthread_mutex_lock(&(lpRecorder->mtxQueue));
+	lpRecorder->bShutdown = 1;
+	pthread_cond_signal(&(lpRecorder->condQueue));
+	pthread_mutex_unlock(&(lpRecorder->mtxQueue));
+	pthread_join(lpRecorder->thrWriter, NULL);
+
+	pthread_cond_destroy(&(lpRecorder->condQueue));
+	pthread_mutex_destroy(&(lpRecorder->mtxQueue));
+
+	if(lpRecorder->dwDropped > 0) {
+		printf("%s:%u Raw recorder dropped %lu frames\n", __FILE__, __LINE__, lpRecorder->dwDropped);
+	}
+
+	/*
+		Append the index (padded to the block size) and
+		finalize the header
+	*/
+	sIndexLen = RAWRECORDER_ROUNDUP(sizeof(struct rawRecorderIndexEntry) * lpRecorder->dwIndexCount);
+	if(sIndexLen == 0) { sIndexLen = RAWRECORDER_BLOCKSIZE; }
+	lpIndexBlock = rawRecorderAlignedAlloc(sIndexLen);
+	if(lpIndexBlock == NULL) {
+		printf("%s:%u Out of memory, recording left without index\n", __FILE__, __LINE__);
+		rc = 1;
+	} else {
+		if(lpRecorder->dwIndexCount > 0) {
+			memcpy(lpIndexBlock, lpRecorder->lpIndex, sizeof(struct rawRecorderIndexEntry) * lpRecorder->dwIndexCount);
+		}
+
+		iov.iov_base = lpIndexBlock;
+		iov.iov_len = sIndexLen;
+		if(rawRecorderWriteFull(lpRecorder->hFile, &iov, 1, lpRecorder->qwWriteOffset) != 0) {
+			printf("%s:%u Failed to write recording index\n", __FILE__, __LINE__);
+			rc = 1;
+		} else {
+			lpRecorder->lpHeader->frameCount = lpRecorder->dwIndexCount;
+			lpRecorder->lpHeader->indexOffset = lpRecorder->qwWriteOffset;
+		}
+		free(lpIndexBlock);
+	}
+
+	lpRecorder->lpHeader->dataEnd = lpRecorder->qwWriteOffset;
+	iov.iov_base = lpRecorder->lpHeader;
+	iov.iov_len = RAWRECORDER_BLOCKSIZE;
+	if(rawRecorderWriteFull(lpRecorder->hFile, &iov, 1, 0) != 0) {
+		printf("%s:%u Failed to finalize recording header\n", __FILE__, __LINE__);
+		rc = 1;
+	}
+
+	/* Release the unused part of the preallocation */
+	if(ftruncate(lpRecorder->hFile, (off_t)(lpRecorder->qwWriteOffset + ((rc == 0) ? sIndexLen : 0))) != 0) {
+		rc = 1;
+	}
+
+	rawRecorderRelease(lpRecorder);
+	return rc;
+}
+
+int rawRecordingOpen(
+	struct rawRecording** lpRecordingOut,
+	char* lpFilename
+) {
+	struct rawRecording* lpRecording;
+
+	if((lpRecordingOut == NULL) || (lpFilename == NULL)) {
+		return 1;
+	}
+	(*lpRecordingOut) = NULL;
+
+	lpRecording = calloc(1, sizeof(struct rawRecording));
+	if(lpRecording == NULL) {
+		return 1;
+	}
+
+	lpRecording->hFile = open(lpFilename, O_RDONLY);
+	if(lpRecording->hFile < 0) {
+		free(lpRecording);
+		return 1;
+	}
+
+	if((pread(lpRecording->hFile, &(lpRecording->header), sizeof(struct rawRecorderFileHeader), 0) != sizeof(struct rawRecorderFileHeader))
+		|| (memcmp(lpRecording->header.magic, RAWRECORDER_MAGIC, sizeof(lpRecording->header.magic)) != 0)) {
+		printf("%s:%u %s is not a raw recording\n", __FILE__, __LINE__, lpFilename);
+		rawRecordingClose(lpRecording);
+		return 1;
+	}
+
+	if(lpRecording->header.indexOffset != 0) {
+		size_t sIndexLen = sizeof(struct rawRecorderIndexEntry) * lpRecording->header.frameCount;
+
+		lpRecording->lpIndex = malloc((sIndexLen > 0) ? sIndexLen : 1);
+		if(lpRecording->lpIndex == NULL) {
+			rawRecordingClose(lpRecording);
+			return 1;
+		}
+		if(pread(lpRecording->hFile, lpRecording->lpIndex, sIndexLen, (off_t)lpRecording->header.indexOffset) != (ssize_t)sIndexLen) {
+			printf("%s:%u Failed to read index of %s\n", __FILE__, __LINE__, lpFilename);
+			rawRecordingClose(lpRecording);
+			return 1;
+		}
+		lpRecording->dwIndexCount = lpRecording->header.frameCount;
+	} else {
+		/*
+			Unfinished recording - rebuild the index by walking
+			the record headers
+		*/
+		uint64_t qwOffset = lpRecording->header.headerSize;
+		unsigned long int dwCapacity = 0;
+
+		printf("%s:%u %s has no index, scanning records\n", __FILE__, __LINE__, lpFilename);
+		for(;;) {
+			struct rawRecorderFrameHeader frame;
+
+			if(pread(lpRecording->hFile, &frame, sizeof(frame), (off_t)qwOffset) != sizeof(frame)) { break; }
+			if((frame.magic != RAWRECORDER_FRAMEMAGIC) || (frame.recordLength == 0)) { break; }
+
+			if(lpRecording->dwIndexCount == dwCapacity) {
+				struct rawRecorderIndexEntry* lpNew;
+				dwCapacity = (dwCapacity == 0) ? 1024 : dwCapacity * 2;
+				lpNew = realloc(lpRecording->lpIndex, sizeof(struct rawRecorderIndexEntry) * dwCapacity);
+				if(lpNew == NULL) {
+					rawRecordingClose(lpRecording);
+					return 1;
+				}
+				lpRecording->lpIndex = lpNew;
+			}
+			lpRecording->lpIndex[lpRecording->dwIndexCount].offset = qwOffset;
+			lpRecording->lpIndex[lpRecording->dwIndexCount].sequence = frame.sequence;
+			lpRecording->lpIndex[lpRecording->dwIndexCount].timestampSec = frame.timestampSec;
+			lpRecording->lpIndex[lpRecording->dwIndexCount].timestampUsec = frame.timestampUsec;
+			lpRecording->lpIndex[lpRecording->dwIndexCount].frequency = frame.frequency;
+			lpRecording->dwIndexCount = lpRecording->dwIndexCount + 1;
+
+			qwOffset = qwOffset + frame.recordLength;
+		}
+	}
+
+	(*lpRecordingOut) = lpRecording;
+	return 0;
+}
+
+unsigned long int rawRecordingFrameCount(
+	struct rawRecording* lpRecording
+) {
+	if(lpRecording == NULL) { return 0; }
+	return lpRecording->dwIndexCount;
+}
+
+struct rawRecorderFileHeader* rawRecordingHeader(
+	struct rawRecording* lpRecording
+) {
+	if(lpRecording == NULL) { return NULL; }
+	return &(lpRecording->header);
+}
+
+int rawRecordingFrameInfo(
+	struct rawRecording* lpRecording,
+	unsigned long int dwFrame,
+	struct rawRecorderIndexEntry* lpEntryOut
+) {
+	if((lpRecording == NULL) || (lpEntryOut == NULL) || (dwFrame >= lpRecording->dwIndexCount)) {
+		return 1;
+	}
+	memcpy(lpEntryOut, &(lpRecording->lpIndex[dwFrame]), sizeof(struct rawRecorderIndexEntry));
+	return 0;
+}
+
+int rawRecordingReadFrame(
+	struct rawRecording* lpRecording,
+	unsigned long int dwFrame,
+	struct rawRecorderIndexEntry* lpEntryOut,
+	void* lpBuffer,
+	size_t sBufferSize,
+	size_t* lpBytesRead
+) {
+	struct rawRecorderFrameHeader frame;
+	uint64_t qwOffset;
+
+	if((lpRecording == NULL) || (dwFrame >= lpRecording->dwIndexCount)) {
+		return 1;
+	}
+
+	qwOffset = lpRecording->lpIndex[dwFrame].offset;
+	if(lpEntryOut != NULL) {
+		memcpy(lpEntryOut, &(lpRecording->lpIndex[dwFrame]), sizeof(struct rawRecorderIndexEntry));
+	}
+
+	if(pread(lpRecording->hFile, &frame, sizeof(frame), (off_t)qwOffset) != sizeof(frame)) {
+		return 1;
+	}
+	if(lpBytesRead != NULL) {
+		(*lpBytesRead) = frame.payloadLength;
+	}
+	if((frame.magic != RAWRECORDER_FRAMEMAGIC) || (frame.payloadLength > sBufferSize)) {
+		return 1;
+	}
+	if(lpBuffer != NULL) {
+		if(pread(lpRecording->hFile, lpBuffer, frame.payloadLength, (off_t)(qwOffset + frame.headerSize)) != (ssize_t)frame.payloadLength) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int rawRecordingClose(
+	struct rawRecording* lpRecording
+) {
+	if(lpRecording == NULL) {
+		return 1;
+	}
+	if(lpRecording->lpIndex != NULL) { free(lpRecording->lpIndex); }
+	if(lpRecording->hFile >= 0) { close(lpRecording->hFile); }
+	free(lpRecording);
+	return 0;
+}
@@ -0,0 +1,134 @@
+#ifndef __RAWRECORDER_H__
+#define __RAWRECORDER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Raw frame recorder container
+
+	The file consists of one 4096 byte header block, a sequence of
+	frame records and the frame index. Every record starts with a
+	rawRecorderFrameHeader followed by the unmodified buffer as
+	dequeued from V4L2 and is padded to the block size so all writes
+	are aligned (required for O_DIRECT).
+
+	The index is written after the last record when the recording is
+	closed and referenced by indexOffset in the file header. In case
+	a recording has not been closed (indexOffset == 0) the records can
+	still be recovered by walking the record headers sequentially.
+*/
+
+#define RAWRECORDER_BLOCKSIZE			4096
+#define RAWRECORDER_MAGIC				"WBERAW01"
+#define RAWRECORDER_FRAMEMAGIC			0x46454257 /* "WBEF" */
+
+struct rawRecorderFileHeader {
+	char				magic[8];
+	uint32_t			version;
+	uint32_t			headerSize;
+
+	uint32_t			pixelFormat;
+	uint32_t			width;
+	uint32_t			height;
+	uint32_t			bytesPerLine;
+
+	uint64_t			frameCount;
+	uint64_t			indexOffset;
+	uint64_t			dataEnd;
+};
+
+struct rawRecorderFrameHeader {
+	uint32_t			magic;
+	uint32_t			headerSize;
+
+	uint64_t			sequence;
+	int64_t				timestampSec;
+	int64_t				timestampUsec;
+	uint64_t			frequency;
+
+	uint64_t			payloadLength;
+	uint64_t			recordLength;
+};
+
+struct rawRecorderIndexEntry {
+	uint64_t			offset;
+	uint64_t			sequence;
+	int64_t				timestampSec;
+	int64_t				timestampUsec;
+	uint64_t			frequency;
+};
+
+struct rawRecorder;
+struct rawRecording;
+
+/*
+	Writing side. rawRecorderAppend is called from the capture loop
+	and never blocks - in case all slots are still pending the frame
+	is dropped and counted.
+*/
+int rawRecorderCreate(
+	struct rawRecorder** lpRecorderOut,
+	char* lpFilename,
+	uint32_t pixelFormat,
+	uint32_t width,
+	uint32_t height,
+	uint32_t bytesPerLine,
+	size_t sMaxFrameSize,
+	unsigned long int dwPreallocateMBytes,
+	int bDirectIO
+);
+int rawRecorderAppend(
+	struct rawRecorder* lpRecorder,
+	void* lpData,
+	size_t sLen,
+	uint64_t sequence,
+	struct timeval* lpTimestamp,
+	uint64_t frequency
+);
+int rawRecorderClose(
+	struct rawRecorder* lpRecorder
+);
+
+/*
+	Reading side (random access via the index). rawRecordingReadFrame
+	reports the payload length in *lpBytesRead even if the buffer is
+	too small so the caller can grow it and retry
+*/
+int rawRecordingOpen(
+	struct rawRecording** lpRecordingOut,
+	char* lpFilename
+);
+unsigned long int rawRecordingFrameCount(
+	struct rawRecording* lpRecording
+);
+struct rawRecorderFileHeader* rawRecordingHeader(
+	struct rawRecording* lpRecording
+);
+int rawRecordingFrameInfo(
+	struct rawRecording* lpRecording,
+	unsigned long int dwFrame,
+	struct rawRecorderIndexEntry* lpEntryOut
+);
+int rawRecordingReadFrame(
+	struct rawRecording* lpRecording,
+	unsigned long int dwFrame,
+	struct rawRecorderIndexEntry* lpEntryOut,
+	void* lpBuffer,
+	size_t sBufferSize,
+	size_t* lpBytesRead
+);
+int rawRecordingClose(
+	struct rawRecording* lpRecording
+);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __RAWRECORDER_H__ */
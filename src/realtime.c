@@ -0,0 +1,190 @@
+/*
+	Real time settings of the capture path (see realtime.h)
+*/
+
+#ifndef _GNU_SOURCE
+	#define _GNU_SOURCE		/* cpu_set_t and pthread_setaffinity_np on Linux */
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <sys/mman.h>
+
+#ifdef __FreeBSD__
+	#include <pthread_np.h>
+	#include <sys/param.h>
+	#include <sys/cpuset.h>
+	typedef cpuset_t realtimeCpuSet;
+#else
+	typedef cpu_set_t realtimeCpuSet;
+#endif
+
+#include "./realtime.h"
+
+static struct realtimeSettings realtimeCurrent;
+static int bRealtimeConfigured = 0;
+
+/* Every kind of failure is only reported once, not once per thread */
+static pthread_mutex_t mtxRealtimeReport = PTHREAD_MUTEX_INITIALIZER;
+static int bRealtimeReportedPin = 0;
+static int bRealtimeReportedPriority = 0;
+
+void realtimeSettingsDefault(struct realtimeSettings* lpSettings) {
+	if(lpSettings == NULL) { return; }
+	memset(lpSettings, 0, sizeof(struct realtimeSettings));
+}
+
+static int realtimeParseRange(const char* lpSpec, size_t sLen, struct realtimeCpus* lpCpus) {
+	char szRange[32];
+	unsigned long int dwFirst, dwLast;
+	char cTrailing;
+
+	if(sLen == 0) {
+		lpCpus->bPinned = 0;
+		return 0;
+	}
+	if(sLen >= sizeof(szRange)) {
+		return 1;
+	}
+	memcpy(szRange, lpSpec, sLen);
+	szRange[sLen] = 0;
+
+	if(sscanf(szRange, "%lu-%lu%c", &dwFirst, &dwLast, &cTrailing) == 2) {
+		if(dwLast < dwFirst) { return 1; }
+	} else if(sscanf(szRange, "%lu%c", &dwFirst, &cTrailing) == 1) {
+		dwLast = dwFirst;
+	} else {
+		return 1;
+	}
+
+	lpCpus->bPinned = 1;
+	lpCpus->dwFirst = dwFirst;
+	lpCpus->dwLast = dwLast;
+	return 0;
+}
+
+int realtimeParseCpus(const char* lpSpec, struct realtimeSettings* lpSettings) {
+	struct realtimeCpus* lpRoles[3];
+	unsigned long int i;
+
+	if((lpSpec == NULL) || (lpSettings == NULL)) { return 1; }
+
+	lpRoles[0] = &(lpSettings->capture);
+	lpRoles[1] = &(lpSettings->analysis);
+	lpRoles[2] = &(lpSettings->writer);
+
+	for(i = 0; i < 3; i=i+1) {
+		const char* lpEnd = strchr(lpSpec, ':');
+		size_t sLen = (lpEnd != NULL) ? (size_t)(lpEnd - lpSpec) : strlen(lpSpec);
+
+		if(realtimeParseRange(lpSpec, sLen, lpRoles[i]) != 0) { return 1; }
+		if(lpEnd == NULL) { return 0; }
+		lpSpec = &(lpEnd[1]);
+	}
+	return 1; /* More than three entries */
+}
+
+int realtimeConfigure(const struct realtimeSettings* lpSettings) {
+	if(lpSettings == NULL) { return 1; }
+
+	memcpy(&realtimeCurrent, lpSettings, sizeof(struct realtimeSettings));
+	bRealtimeConfigured = 1;
+
+	if(realtimeCurrent.bLockMemory != 0) {
+		/* Future mappings (V4L2 buffers, scratch memory) are locked as they are created */
+		if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+			printf("Failed to lock memory (%s), continuing with pageable memory (buffers are still prefaulted)\n", strerror(errno));
+		}
+	}
+	return 0;
+}
+
+void realtimeEnterThread(enum realtimeRole role, unsigned long int dwIndex) {
+	const struct realtimeCpus* lpCpus;
+	int r;
+
+	if(bRealtimeConfigured == 0) { return; }
+
+	switch(role) {
+		case realtimeRole_Capture:		lpCpus = &(realtimeCurrent.capture); break;
+		case realtimeRole_Analysis:		lpCpus = &(realtimeCurrent.analysis); break;
+		case realtimeRole_Writer:		lpCpus = &(realtimeCurrent.writer); break;
+		default:						return;
+	}
+
+	if(lpCpus->bPinned != 0) {
+		realtimeCpuSet cpus;
+		unsigned long int dwCpu = lpCpus->dwFirst + dwIndex % (lpCpus->dwLast - lpCpus->dwFirst + 1);
+
+		if(dwCpu < CPU_SETSIZE) {
+			CPU_ZERO(&cpus);
+			CPU_SET(dwCpu, &cpus);
+			r = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+		} else {
+			r = EINVAL;
+		}
+		if(r != 0) {
+			pthread_mutex_lock(&mtxRealtimeReport);
+			if(bRealtimeReportedPin == 0) {
+				printf("Failed to pin thread to CPU %lu (%s), leaving it to the scheduler\n", dwCpu, strerror(r));
+				bRealtimeReportedPin = 1;
+			}
+			pthread_mutex_unlock(&mtxRealtimeReport);
+		}
+	}
+
+	if((role == realtimeRole_Capture) && (realtimeCurrent.iCapturePriority > 0)) {
+		struct sched_param sp;
+		int iMin = sched_get_priority_min(SCHED_FIFO);
+		int iMax = sched_get_priority_max(SCHED_FIFO);
+
+		memset(&sp, 0, sizeof(sp));
+		sp.sched_priority = realtimeCurrent.iCapturePriority;
+		if(sp.sched_priority < iMin) { sp.sched_priority = iMin; }
+		if(sp.sched_priority > iMax) { sp.sched_priority = iMax; }
+
+		r = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+		if(r != 0) {
+			pthread_mutex_lock(&mtxRealtimeReport);
+			if(bRealtimeReportedPriority == 0) {
+				printf("Failed to set SCHED_FIFO priority %d (%s), capturing with normal scheduling\n", sp.sched_priority, strerror(r));
+				bRealtimeReportedPriority = 1;
+			}
+			pthread_mutex_unlock(&mtxRealtimeReport);
+		}
+	} else if(role != realtimeRole_Capture) {
+		/* Threads started from a capture thread inherit it's real time policy */
+		struct sched_param sp;
+		int iPolicy;
+
+		if((pthread_getschedparam(pthread_self(), &iPolicy, &sp) == 0) && (iPolicy != SCHED_OTHER)) {
+			memset(&sp, 0, sizeof(sp));
+			pthread_setschedparam(pthread_self(), SCHED_OTHER, &sp);
+		}
+	}
+}
+
+void realtimePrefault(void* lpBuffer, size_t sLen) {
+	volatile unsigned char* lpBytes = (volatile unsigned char*)lpBuffer;
+	long lPageSize;
+	size_t i;
+
+	if((bRealtimeConfigured == 0) || (realtimeCurrent.bLockMemory == 0) || (lpBuffer == NULL) || (sLen == 0)) {
+		return;
+	}
+
+	lPageSize = sysconf(_SC_PAGESIZE);
+	if(lPageSize <= 0) { lPageSize = 4096; }
+
+	/* Write access so copy on write and zero pages are resolved too */
+	for(i = 0; i < sLen; i = i + (size_t)lPageSize) {
+		lpBytes[i] = lpBytes[i];
+	}
+	lpBytes[sLen - 1] = lpBytes[sLen - 1];
+}
@@ -0,0 +1,86 @@
+#ifndef __REALTIME_H__
+#define __REALTIME_H__
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Real time settings of the capture path
+
+	The settings are process wide: realtimeConfigure is called once at
+	startup (before the camera is opened and before any thread is
+	started), every thread of the capture path calls realtimeEnterThread
+	with it's role when it starts.
+
+		capture, analysis, writer	CPUs the threads of the role are
+									pinned to (dwFirst..dwLast, one CPU
+									per thread chosen round robin by the
+									thread index). bPinned 0 leaves them
+									to the scheduler
+		iCapturePriority			SCHED_FIFO priority of the capture
+									threads, 0 keeps normal scheduling.
+									Analysis and writer threads always
+									run with SCHED_OTHER
+		bLockMemory					Lock all current and future memory
+									(mlockall) and prefault buffers that
+									are set up before capture starts
+
+	Missing privileges (or platforms without support) are reported
+	once and the affected setting is skipped, capture continues with
+	normal scheduling and pageable memory.
+*/
+struct realtimeCpus {
+	int						bPinned;
+	unsigned long int		dwFirst;
+	unsigned long int		dwLast;
+};
+
+struct realtimeSettings {
+	struct realtimeCpus		capture;
+	struct realtimeCpus		analysis;
+	struct realtimeCpus		writer;
+	int						iCapturePriority;
+	int						bLockMemory;
+};
+
+enum realtimeRole {
+	realtimeRole_Capture						= 0,
+	realtimeRole_Analysis						= 1,
+	realtimeRole_Writer							= 2,
+};
+
+void realtimeSettingsDefault(struct realtimeSettings* lpSettings);
+
+/*
+	Parses CAPTURE[:ANALYSIS[:WRITER]] where every entry is a CPU (N),
+	a range (N-M) or empty to leave the role unpinned. Returns 0 on
+	success
+*/
+int realtimeParseCpus(const char* lpSpec, struct realtimeSettings* lpSettings);
+
+/*
+	Stores the settings and locks the memory if requested. Returns 0
+	on success (failures to lock are reported but not fatal)
+*/
+int realtimeConfigure(const struct realtimeSettings* lpSettings);
+
+/*
+	Applies pinning and scheduling of the role to the calling thread.
+	dwIndex selects the CPU within the roles range
+*/
+void realtimeEnterThread(enum realtimeRole role, unsigned long int dwIndex);
+
+/*
+	Touches every page of the buffer so it is backed by memory before
+	capture starts (only if memory locking has been requested)
+*/
+void realtimePrefault(void* lpBuffer, size_t sLen);
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __REALTIME_H__ */
@@ -0,0 +1,599 @@
+/*
+	Golden result regression test for the blob detector
+
+	Runs the detector on every entry of a corpus file and compares
+	bounding box, cluster pixel area, area sum and (for synthetic beams)
+	the profile fits against the expected values. The corpus is a plain
+	text file, one entry per line:
+
+		tolerance BOX AREA SUM [CENTER SIGMA]
+			Tolerances for all following entries: BOX is the allowed
+			deviation of every bound in pixels, AREA and SUM are
+			relative deviations of the cluster pixel area and area sum.
+			CENTER is the allowed deviation of the fitted centers in
+			pixels and SIGMA the relative deviation of the fitted
+			widths; without them the fits are not compared
+
+		jpeg FILENAME XMIN XMAX YMIN YMAX PIXELAREA AREASUM
+			Archived capture (for example doc/testoutput/test03-raw.jpg)
+			with it's golden result
+
+		gauss WIDTH HEIGHT CX CY SIGMAX SIGMAY AMPLITUDE NOISE
+			Synthetic elliptical gaussian beam centered at (CX, CY)
+			with uniform noise of +-NOISE on a dark background. The
+			amplitude may exceed 255, the beam is then clipped like a
+			saturated sensor. The expected values are calculated from
+			the beam parameters (see regressionGaussExpected). The fits
+			of the projections have to reproduce center and sigma of
+			the beam (only the center for clipped beams, their
+			projections are no gaussians)
+
+		kernels WIDTH HEIGHT
+			Compares every kernel variant the CPU supports (see
+			kernels.h) against the scalar kernels on random frames of
+			the given size; odd sizes cover the tails of the vector loops
+
+	Empty lines and lines starting with # are ignored, filenames are
+	relative to the working directory. With -u the measured values are
+	printed as corpus lines (to create golden values for new captures
+	after the change has been verified).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./jpegFile.h"
+#include "./kernels.h"
+
+#ifndef M_PI
+	#define M_PI 3.14159265358979323846
+#endif
+
+struct regressionTolerance {
+	unsigned long int		dwBox;
+	double					dArea;
+	double					dSum;
+
+	int						bFit;
+	double					dCenter;
+	double					dSigma;
+};
+
+struct regressionContext {
+	struct imgRawImage			img;
+	size_t						sImgCapacity;
+	size_t						sLumaCapacity;
+	struct blobDetectorScratch	scratch;
+	struct blobDetectorParams	params;
+
+	struct regressionTolerance	tolerance;
+	int							bUpdate;
+
+	unsigned long int			dwPassed;
+	unsigned long int			dwFailed;
+};
+
+static void printUsage(char* argv[]) {
+	printf("Usage: %s [-u] CORPUS\n", argv[0]);
+	printf("\n");
+	printf("Runs the blob detector on all entries of the corpus file and compares\n");
+	printf("the results against the golden values. Exits with 0 if all entries pass\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-u\n\t\tPrint the measured values as corpus lines instead of comparing\n");
+}
+
+static int regressionReserveLuma(struct regressionContext* lpContext, unsigned long int width, unsigned long int height) {
+	if(lpContext->sLumaCapacity < width * height) {
+		unsigned char* lpNew = realloc(lpContext->img.lpLuma, sizeof(unsigned char) * width * height);
+		if(lpNew == NULL) { return 1; }
+		lpContext->img.lpLuma = lpNew;
+		lpContext->sLumaCapacity = width * height;
+	}
+	return 0;
+}
+
+/*
+	Deterministic noise source so every run sees the same frames
+*/
+static unsigned long int regressionRandom(unsigned long int* lpState) {
+	(*lpState) = ((*lpState) * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return (*lpState) >> 8;
+}
+
+static int regressionRenderGauss(
+	struct regressionContext* lpContext,
+	unsigned long int width,
+	unsigned long int height,
+	double dCX,
+	double dCY,
+	double dSigmaX,
+	double dSigmaY,
+	double dAmplitude,
+	unsigned long int dwNoise
+) {
+	unsigned long int x,y;
+	unsigned long int dwState = 1;
+
+	if(regressionReserveLuma(lpContext, width, height) != 0) { return 1; }
+	lpContext->img.width = width;
+	lpContext->img.height = height;
+	lpContext->img.numComponents = 1;
+
+	for(y = 0; y < height; y=y+1) {
+		double dY = ((double)y - dCY) / dSigmaY;
+		for(x = 0; x < width; x=x+1) {
+			double dX = ((double)x - dCX) / dSigmaX;
+			double dValue = dAmplitude * exp(-0.5 * (dX*dX + dY*dY));
+
+			if(dwNoise > 0) {
+				dValue = dValue + (double)(regressionRandom(&dwState) % (2 * dwNoise + 1)) - (double)dwNoise;
+			}
+			dValue = floor(dValue + 0.5);
+			if(dValue < 0) { dValue = 0; }
+			if(dValue > 255) { dValue = 255; }
+			lpContext->img.lpLuma[x + y * width] = (unsigned char)dValue;
+		}
+	}
+	return 0;
+}
+
+/*
+	Expected result of a gaussian beam: the detector associates every
+	pixel above half of the brightest pixel T = (A + NOISE) / 2 (at
+	most 255 / 2), i.e. the ellipse with normalized radius
+	r0^2 = 2 ln(A/T). The area sum is the integral of the clipped beam
+	over that ellipse; for A > 255 the inner ellipse r1^2 = 2 ln(A/255)
+	is flat at 255. Along the edge the noise pushes single pixels above
+	the threshold, the bounding box is given by A g = T - NOISE
+*/
+static void regressionGaussExpected(
+	unsigned long int width,
+	unsigned long int height,
+	double dCX,
+	double dCY,
+	double dSigmaX,
+	double dSigmaY,
+	double dAmplitude,
+	unsigned long int dwNoise,
+	struct blobResult* lpExpected
+) {
+	double dPeak = floor(dAmplitude + 0.5) + (double)dwNoise;
+	double dThreshold;
+	double dR0Sq;
+	double dRBox;
+	double dHalfX;
+	double dHalfY;
+
+	if(dPeak > 255) { dPeak = 255; }
+	dThreshold = floor(0.5 * dPeak);
+	dR0Sq = 2.0 * log(dAmplitude / dThreshold);
+	dRBox = sqrt(2.0 * log(dAmplitude / (dThreshold - (double)dwNoise)));
+	dHalfX = floor(dSigmaX * dRBox);
+	dHalfY = floor(dSigmaY * dRBox);
+
+	memset(lpExpected, 0, sizeof(struct blobResult));
+	lpExpected->bounds.xMin = (dCX - dHalfX > 0) ? (unsigned long int)(dCX - dHalfX) : 0;
+	lpExpected->bounds.xMax = (dCX + dHalfX < (double)(width - 1)) ? (unsigned long int)(dCX + dHalfX) : width - 1;
+	lpExpected->bounds.yMin = (dCY - dHalfY > 0) ? (unsigned long int)(dCY - dHalfY) : 0;
+	lpExpected->bounds.yMax = (dCY + dHalfY < (double)(height - 1)) ? (unsigned long int)(dCY + dHalfY) : height - 1;
+
+	lpExpected->clusterPixelArea = (unsigned long int)floor(M_PI * dR0Sq * dSigmaX * dSigmaY + 0.5);
+	if(dAmplitude > 255) {
+		double dR1Sq = 2.0 * log(dAmplitude / 255.0);
+		lpExpected->dAreaSum = M_PI * dSigmaX * dSigmaY * (255.0 * dR1Sq + 2.0 * (255.0 - dThreshold));
+	} else {
+		lpExpected->dAreaSum = 2.0 * M_PI * dSigmaX * dSigmaY * (dAmplitude - dThreshold);
+	}
+
+	/* The projections of the beam are gaussians with the same center and sigma */
+	lpExpected->fitX.bValid = 1;
+	lpExpected->fitX.dCenter = dCX;
+	lpExpected->fitX.dSigma = (dAmplitude > 255) ? NAN : dSigmaX;
+	lpExpected->fitY.bValid = 1;
+	lpExpected->fitY.dCenter = dCY;
+	lpExpected->fitY.dSigma = (dAmplitude > 255) ? NAN : dSigmaY;
+}
+
+static int regressionBoundOk(unsigned long int dwMeasured, unsigned long int dwExpected, unsigned long int dwTolerance) {
+	if(dwMeasured > dwExpected) { return ((dwMeasured - dwExpected) <= dwTolerance) ? 1 : 0; }
+	return ((dwExpected - dwMeasured) <= dwTolerance) ? 1 : 0;
+}
+
+static int regressionRelativeOk(double dMeasured, double dExpected, double dTolerance) {
+	if(dExpected == 0) { return (dMeasured == 0) ? 1 : 0; }
+	return (fabs(dMeasured - dExpected) <= dTolerance * fabs(dExpected)) ? 1 : 0;
+}
+
+static void regressionCompare(
+	struct regressionContext* lpContext,
+	const char* lpName,
+	const struct blobResult* lpMeasured,
+	const struct blobResult* lpExpected
+) {
+	const struct regressionTolerance* lpTol = &(lpContext->tolerance);
+	int bOk = 1;
+
+	if(regressionBoundOk(lpMeasured->bounds.xMin, lpExpected->bounds.xMin, lpTol->dwBox) == 0) { bOk = 0; }
+	if(regressionBoundOk(lpMeasured->bounds.xMax, lpExpected->bounds.xMax, lpTol->dwBox) == 0) { bOk = 0; }
+	if(regressionBoundOk(lpMeasured->bounds.yMin, lpExpected->bounds.yMin, lpTol->dwBox) == 0) { bOk = 0; }
+	if(regressionBoundOk(lpMeasured->bounds.yMax, lpExpected->bounds.yMax, lpTol->dwBox) == 0) { bOk = 0; }
+	if(regressionRelativeOk((double)lpMeasured->clusterPixelArea, (double)lpExpected->clusterPixelArea, lpTol->dArea) == 0) { bOk = 0; }
+	if(regressionRelativeOk(lpMeasured->dAreaSum, lpExpected->dAreaSum, lpTol->dSum) == 0) { bOk = 0; }
+
+	/* Fits are only compared if the expected result carries them (NaN sigma checks the center only) */
+	if((lpTol->bFit != 0) && (lpExpected->fitX.bValid != 0)) {
+		if((lpMeasured->fitX.bValid == 0) || (lpMeasured->fitY.bValid == 0)) { bOk = 0; }
+		if(!(fabs(lpMeasured->fitX.dCenter - lpExpected->fitX.dCenter) <= lpTol->dCenter)) { bOk = 0; }
+		if(!(fabs(lpMeasured->fitY.dCenter - lpExpected->fitY.dCenter) <= lpTol->dCenter)) { bOk = 0; }
+		if(!isnan(lpExpected->fitX.dSigma) && (regressionRelativeOk(lpMeasured->fitX.dSigma, lpExpected->fitX.dSigma, lpTol->dSigma) == 0)) { bOk = 0; }
+		if(!isnan(lpExpected->fitY.dSigma) && (regressionRelativeOk(lpMeasured->fitY.dSigma, lpExpected->fitY.dSigma, lpTol->dSigma) == 0)) { bOk = 0; }
+	}
+
+	if(bOk != 0) {
+		printf("PASS %s\n", lpName);
+		lpContext->dwPassed = lpContext->dwPassed + 1;
+	} else {
+		printf("FAIL %s\n", lpName);
+		printf("\tmeasured x %lu-%lu y %lu-%lu area %lu sum %lf\n", lpMeasured->bounds.xMin, lpMeasured->bounds.xMax, lpMeasured->bounds.yMin, lpMeasured->bounds.yMax, lpMeasured->clusterPixelArea, lpMeasured->dAreaSum);
+		printf("\texpected x %lu-%lu y %lu-%lu area %lu sum %lf\n", lpExpected->bounds.xMin, lpExpected->bounds.xMax, lpExpected->bounds.yMin, lpExpected->bounds.yMax, lpExpected->clusterPixelArea, lpExpected->dAreaSum);
+		if((lpTol->bFit != 0) && (lpExpected->fitX.bValid != 0)) {
+			printf("\tmeasured fit center %lf,%lf sigma %lf,%lf\n", lpMeasured->fitX.dCenter, lpMeasured->fitY.dCenter, lpMeasured->fitX.dSigma, lpMeasured->fitY.dSigma);
+			printf("\texpected fit center %lf,%lf sigma %lf,%lf\n", lpExpected->fitX.dCenter, lpExpected->fitY.dCenter, lpExpected->fitX.dSigma, lpExpected->fitY.dSigma);
+		}
+		lpContext->dwFailed = lpContext->dwFailed + 1;
+	}
+}
+
+static int regressionRunJpeg(struct regressionContext* lpContext, char* lpLine, unsigned long int dwLine) {
+	char strFilename[1024];
+	struct blobResult expected;
+	struct blobResult measured;
+
+	memset(&expected, 0, sizeof(struct blobResult));
+	if(sscanf(lpLine, "jpeg %1023s %lu %lu %lu %lu %lu %lf", strFilename, &(expected.bounds.xMin), &(expected.bounds.xMax), &(expected.bounds.yMin), &(expected.bounds.yMax), &(expected.clusterPixelArea), &(expected.dAreaSum)) != 7) {
+		printf("%s:%u Malformed corpus line %lu\n", __FILE__, __LINE__, dwLine);
+		return 1;
+	}
+
+	if(loadJpegImageFile(&(lpContext->img), &(lpContext->sImgCapacity), strFilename) != 0) {
+		printf("%s:%u Failed to load %s\n", __FILE__, __LINE__, strFilename);
+		return 1;
+	}
+	if(regressionReserveLuma(lpContext, lpContext->img.width, lpContext->img.height) != 0) { return 1; }
+	greyscale(&(lpContext->img));
+
+	if((blobDetect(&(lpContext->img), &(lpContext->params), &(lpContext->scratch), &measured) != 0) || (blobResultSignificant(&measured) == 0)) {
+		printf("FAIL %s (no cluster detected)\n", strFilename);
+		lpContext->dwFailed = lpContext->dwFailed + 1;
+		return 0;
+	}
+
+	if(lpContext->bUpdate != 0) {
+		printf("jpeg %s %lu %lu %lu %lu %lu %lf\n", strFilename, measured.bounds.xMin, measured.bounds.xMax, measured.bounds.yMin, measured.bounds.yMax, measured.clusterPixelArea, measured.dAreaSum);
+		return 0;
+	}
+
+	regressionCompare(lpContext, strFilename, &measured, &expected);
+	return 0;
+}
+
+static int regressionRunGauss(struct regressionContext* lpContext, char* lpLine, unsigned long int dwLine) {
+	unsigned long int width, height, dwNoise;
+	double dCX, dCY, dSigmaX, dSigmaY, dAmplitude;
+	struct blobResult expected;
+	struct blobResult measured;
+	char strName[256];
+
+	if(sscanf(lpLine, "gauss %lu %lu %lf %lf %lf %lf %lf %lu", &width, &height, &dCX, &dCY, &dSigmaX, &dSigmaY, &dAmplitude, &dwNoise) != 8) {
+		printf("%s:%u Malformed corpus line %lu\n", __FILE__, __LINE__, dwLine);
+		return 1;
+	}
+	if((width == 0) || (height == 0) || (dSigmaX <= 0) || (dSigmaY <= 0) || (dAmplitude <= 4 * (double)dwNoise + 4)) {
+		printf("%s:%u Invalid beam parameters in corpus line %lu\n", __FILE__, __LINE__, dwLine);
+		return 1;
+	}
+	snprintf(strName, sizeof(strName), "gauss %lux%lu at %.1lf,%.1lf sigma %.1lf,%.1lf amplitude %.0lf noise %lu", width, height, dCX, dCY, dSigmaX, dSigmaY, dAmplitude, dwNoise);
+
+	if(regressionRenderGauss(lpContext, width, height, dCX, dCY, dSigmaX, dSigmaY, dAmplitude, dwNoise) != 0) {
+		return 1;
+	}
+	if((blobDetect(&(lpContext->img), &(lpContext->params), &(lpContext->scratch), &measured) != 0) || (blobResultSignificant(&measured) == 0)) {
+		printf("FAIL %s (no cluster detected)\n", strName);
+		lpContext->dwFailed = lpContext->dwFailed + 1;
+		return 0;
+	}
+
+	if(lpContext->bUpdate != 0) {
+		printf("# %s: x %lu-%lu y %lu-%lu area %lu sum %lf\n", strName, measured.bounds.xMin, measured.bounds.xMax, measured.bounds.yMin, measured.bounds.yMax, measured.clusterPixelArea, measured.dAreaSum);
+		printf("%s", lpLine);
+		return 0;
+	}
+
+	regressionGaussExpected(width, height, dCX, dCY, dSigmaX, dSigmaY, dAmplitude, dwNoise, &expected);
+	regressionCompare(lpContext, strName, &measured, &expected);
+	return 0;
+}
+
+/*
+	Runs all kernels of one table on the frame and stores the outputs.
+	lpSums holds width column sums, lpInt and lpIntSq (width + 1) *
+	(height + 1) entries and lpMask one word per 64 pixel block and
+	tested threshold. The rolling reference (lpAverage, lpReference) is
+	updated with every shift in turn, lpPositive and the sums are the
+	difference of the RGB luma to the final reference
+*/
+struct regressionKernelOutput {
+	unsigned char*				lpYUYVLuma;
+	unsigned char*				lpRGBLuma;
+	uint32_t*					lpSums;
+	unsigned long int*			lpRowSums;
+	uint32_t*					lpInt;
+	uint64_t*					lpIntSq;
+	uint64_t*					lpMask;
+	uint16_t*					lpAverage;
+	unsigned char*				lpReference;
+	unsigned char*				lpPositive;
+	uint64_t					qwPositiveSum;
+	uint64_t					qwNegativeSum;
+};
+
+static const unsigned int regressionKernelThresholds[] = { 0, 1, 63, 64, 127, 128, 129, 200, 254, 255 };
+#define REGRESSION_KERNEL_THRESHOLDS (sizeof(regressionKernelThresholds) / sizeof(regressionKernelThresholds[0]))
+
+static int regressionKernelAlloc(struct regressionKernelOutput* lpOut, unsigned long int width, unsigned long int height) {
+	memset(lpOut, 0, sizeof(struct regressionKernelOutput));
+	lpOut->lpYUYVLuma = malloc(width * height);
+	lpOut->lpRGBLuma = malloc(width * height);
+	lpOut->lpSums = calloc(width, sizeof(uint32_t));
+	lpOut->lpRowSums = calloc(height, sizeof(unsigned long int));
+	lpOut->lpInt = calloc((width + 1) * (height + 1), sizeof(uint32_t));
+	lpOut->lpIntSq = calloc((width + 1) * (height + 1), sizeof(uint64_t));
+	lpOut->lpMask = calloc(((width * height) / 64) * REGRESSION_KERNEL_THRESHOLDS + 1, sizeof(uint64_t));
+	lpOut->lpAverage = malloc(sizeof(uint16_t) * width * height);
+	lpOut->lpReference = malloc(width * height);
+	lpOut->lpPositive = malloc(width * height);
+	if((lpOut->lpYUYVLuma == NULL) || (lpOut->lpRGBLuma == NULL) || (lpOut->lpSums == NULL) || (lpOut->lpRowSums == NULL) || (lpOut->lpInt == NULL) || (lpOut->lpIntSq == NULL) || (lpOut->lpMask == NULL)) {
+		return 1;
+	}
+	if((lpOut->lpAverage == NULL) || (lpOut->lpReference == NULL) || (lpOut->lpPositive == NULL)) {
+		return 1;
+	}
+	return 0;
+}
+
+static void regressionKernelRelease(struct regressionKernelOutput* lpOut) {
+	if(lpOut->lpYUYVLuma != NULL) { free(lpOut->lpYUYVLuma); }
+	if(lpOut->lpRGBLuma != NULL) { free(lpOut->lpRGBLuma); }
+	if(lpOut->lpSums != NULL) { free(lpOut->lpSums); }
+	if(lpOut->lpRowSums != NULL) { free(lpOut->lpRowSums); }
+	if(lpOut->lpInt != NULL) { free(lpOut->lpInt); }
+	if(lpOut->lpIntSq != NULL) { free(lpOut->lpIntSq); }
+	if(lpOut->lpMask != NULL) { free(lpOut->lpMask); }
+	if(lpOut->lpAverage != NULL) { free(lpOut->lpAverage); }
+	if(lpOut->lpReference != NULL) { free(lpOut->lpReference); }
+	if(lpOut->lpPositive != NULL) { free(lpOut->lpPositive); }
+	memset(lpOut, 0, sizeof(struct regressionKernelOutput));
+}
+
+static void regressionKernelRun(
+	const struct kernelTable* lpTable,
+	const unsigned char* lpYUYV,
+	const unsigned char* lpRGB,
+	unsigned long int width,
+	unsigned long int height,
+	struct regressionKernelOutput* lpOut
+) {
+	unsigned long int dwStride = width + 1;
+	unsigned long int dwBlocks = (width * height) / 64;
+	unsigned long int y, i, t;
+
+	lpTable->yuyvToLuma(lpOut->lpYUYVLuma, lpYUYV, width * height);
+	lpTable->rgbToLuma(lpOut->lpRGBLuma, lpRGB, width * height, 3);
+
+	/* The projections run on the converted luma like blobDetect */
+	for(y = 0; y < height; y=y+1) {
+		lpOut->lpRowSums[y] = lpTable->projectRow(
+			&(lpOut->lpRGBLuma[y * width]),
+			width,
+			lpOut->lpSums,
+			&(lpOut->lpInt[y * dwStride + 1]),
+			&(lpOut->lpInt[(y + 1) * dwStride + 1]),
+			&(lpOut->lpIntSq[y * dwStride + 1]),
+			&(lpOut->lpIntSq[(y + 1) * dwStride + 1])
+		);
+	}
+
+	for(t = 0; t < REGRESSION_KERNEL_THRESHOLDS; t=t+1) {
+		for(i = 0; i < dwBlocks; i=i+1) {
+			lpOut->lpMask[t * dwBlocks + i] = lpTable->threshold64(&(lpOut->lpYUYVLuma[i * 64]), regressionKernelThresholds[t]);
+		}
+	}
+
+	/* Reference from the YUYV luma, alternately updated with both frames */
+	for(i = 0; i < width * height; i=i+1) {
+		lpOut->lpAverage[i] = (uint16_t)(((uint16_t)lpOut->lpYUYVLuma[i]) << 8);
+	}
+	for(t = 0; t <= 8; t=t+1) {
+		lpTable->accumulate(lpOut->lpAverage, lpOut->lpReference, ((t & 1) == 0) ? lpOut->lpRGBLuma : lpOut->lpYUYVLuma, width * height, (unsigned int)t);
+	}
+	lpTable->difference(lpOut->lpPositive, lpOut->lpRGBLuma, lpOut->lpReference, width * height, &(lpOut->qwPositiveSum), &(lpOut->qwNegativeSum));
+}
+
+static int regressionRunKernels(struct regressionContext* lpContext, char* lpLine, unsigned long int dwLine) {
+	unsigned long int width, height;
+	unsigned long int i;
+	unsigned char* lpYUYV;
+	unsigned char* lpRGB;
+	uint32_t dwRandom = 0x12345678;
+	struct kernelTable tblScalar;
+	struct regressionKernelOutput outScalar;
+	int iIsa;
+	int iResult = 0;
+
+	if(sscanf(lpLine, "kernels %lu %lu", &width, &height) != 2) {
+		printf("%s:%u Malformed corpus line %lu\n", __FILE__, __LINE__, dwLine);
+		return 1;
+	}
+	if((width == 0) || (height == 0)) {
+		printf("%s:%u Invalid frame size in corpus line %lu\n", __FILE__, __LINE__, dwLine);
+		return 1;
+	}
+	if(lpContext->bUpdate != 0) {
+		printf("%s", lpLine);
+		return 0;
+	}
+
+	/* Random frames from a fixed seed so failures are reproducible */
+	lpYUYV = malloc(width * height * 2);
+	lpRGB = malloc(width * height * 3);
+	if((lpYUYV == NULL) || (lpRGB == NULL) || (regressionKernelAlloc(&outScalar, width, height) != 0)) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		if(lpYUYV != NULL) { free(lpYUYV); }
+		if(lpRGB != NULL) { free(lpRGB); }
+		regressionKernelRelease(&outScalar);
+		return 1;
+	}
+	for(i = 0; i < width * height * 2; i=i+1) {
+		dwRandom = dwRandom * 1664525 + 1013904223;
+		lpYUYV[i] = (unsigned char)(dwRandom >> 24);
+	}
+	for(i = 0; i < width * height * 3; i=i+1) {
+		dwRandom = dwRandom * 1664525 + 1013904223;
+		lpRGB[i] = (unsigned char)(dwRandom >> 24);
+	}
+
+	kernelTableSelect(&tblScalar, kernelIsa_Scalar);
+	regressionKernelRun(&tblScalar, lpYUYV, lpRGB, width, height, &outScalar);
+
+	for(iIsa = kernelIsa_SSE41; iIsa <= (int)kernelIsaSupported(); iIsa=iIsa+1) {
+		struct kernelTable tbl;
+		struct regressionKernelOutput out;
+		int bOk = 1;
+
+		kernelTableSelect(&tbl, (enum kernelIsa)iIsa);
+		if(regressionKernelAlloc(&out, width, height) != 0) {
+			printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+			regressionKernelRelease(&out);
+			iResult = 1;
+			break;
+		}
+		regressionKernelRun(&tbl, lpYUYV, lpRGB, width, height, &out);
+
+		if(memcmp(out.lpYUYVLuma, outScalar.lpYUYVLuma, width * height) != 0) { printf("\tyuyvToLuma (%s) differs\n", kernelIsaName(tbl.isaYUYVToLuma)); bOk = 0; }
+		if(memcmp(out.lpRGBLuma, outScalar.lpRGBLuma, width * height) != 0) { printf("\trgbToLuma (%s) differs\n", kernelIsaName(tbl.isaRGBToLuma)); bOk = 0; }
+		if(
+			(memcmp(out.lpSums, outScalar.lpSums, sizeof(uint32_t) * width) != 0)
+			|| (memcmp(out.lpRowSums, outScalar.lpRowSums, sizeof(unsigned long int) * height) != 0)
+			|| (memcmp(out.lpInt, outScalar.lpInt, sizeof(uint32_t) * (width + 1) * (height + 1)) != 0)
+			|| (memcmp(out.lpIntSq, outScalar.lpIntSq, sizeof(uint64_t) * (width + 1) * (height + 1)) != 0)
+		) {
+			printf("\tprojectRow (%s) differs\n", kernelIsaName(tbl.isaProjectRow));
+			bOk = 0;
+		}
+		if(memcmp(out.lpMask, outScalar.lpMask, sizeof(uint64_t) * ((width * height) / 64) * REGRESSION_KERNEL_THRESHOLDS) != 0) { printf("\tthreshold64 (%s) differs\n", kernelIsaName(tbl.isaThreshold64)); bOk = 0; }
+		if((memcmp(out.lpAverage, outScalar.lpAverage, sizeof(uint16_t) * width * height) != 0) || (memcmp(out.lpReference, outScalar.lpReference, width * height) != 0)) { printf("\taccumulate (%s) differs\n", kernelIsaName(tbl.isaAccumulate)); bOk = 0; }
+		if((memcmp(out.lpPositive, outScalar.lpPositive, width * height) != 0) || (out.qwPositiveSum != outScalar.qwPositiveSum) || (out.qwNegativeSum != outScalar.qwNegativeSum)) { printf("\tdifference (%s) differs\n", kernelIsaName(tbl.isaDifference)); bOk = 0; }
+
+		if(bOk != 0) {
+			printf("PASS kernels %s %lux%lu\n", kernelIsaName(tbl.isa), width, height);
+			lpContext->dwPassed = lpContext->dwPassed + 1;
+		} else {
+			printf("FAIL kernels %s %lux%lu\n", kernelIsaName(tbl.isa), width, height);
+			lpContext->dwFailed = lpContext->dwFailed + 1;
+		}
+		regressionKernelRelease(&out);
+	}
+
+	regressionKernelRelease(&outScalar);
+	free(lpYUYV);
+	free(lpRGB);
+	return iResult;
+}
+
+int main(int argc, char* argv[]) {
+	struct regressionContext ctx;
+	FILE* fCorpus;
+	char strLine[2048];
+	unsigned long int dwLine = 0;
+	int iErrors = 0;
+	int opt;
+
+	memset(&ctx, 0, sizeof(struct regressionContext));
+	ctx.tolerance.dwBox = 0;
+	ctx.tolerance.dArea = 0;
+	ctx.tolerance.dSum = 0;
+	ctx.tolerance.bFit = 0;
+
+	while((opt = getopt(argc, argv, "u")) != -1) {
+		switch(opt) {
+			case 'u':	ctx.bUpdate = 1; break;
+			default:	printUsage(argv); return 1;
+		}
+	}
+	if(optind + 1 != argc) {
+		printUsage(argv);
+		return 1;
+	}
+
+	fCorpus = fopen(argv[optind], "r");
+	if(fCorpus == NULL) {
+		printf("%s:%u Failed to open corpus %s\n", __FILE__, __LINE__, argv[optind]);
+		return 1;
+	}
+
+	if(ctx.bUpdate == 0) {
+		printf("Kernels: %s\n", kernelIsaName(kernelTableGet()->isa));
+	}
+
+	blobDetectorParamsDefault(&(ctx.params));
+	if(blobDetectorScratchInit(&(ctx.scratch)) != 0) {
+		fclose(fCorpus);
+		return 1;
+	}
+
+	while(fgets(strLine, sizeof(strLine), fCorpus) != NULL) {
+		char* lpLine = strLine;
+		dwLine = dwLine + 1;
+
+		while((*lpLine == ' ') || (*lpLine == '\t')) { lpLine++; }
+		if((*lpLine == '#') || (*lpLine == '\n') || (*lpLine == '\r') || (*lpLine == 0)) {
+			if(ctx.bUpdate != 0) { printf("%s", strLine); }
+			continue;
+		}
+
+		if(strncmp(lpLine, "tolerance", 9) == 0) {
+			int iFields = sscanf(lpLine, "tolerance %lu %lf %lf %lf %lf", &(ctx.tolerance.dwBox), &(ctx.tolerance.dArea), &(ctx.tolerance.dSum), &(ctx.tolerance.dCenter), &(ctx.tolerance.dSigma));
+			if((iFields != 3) && (iFields != 5)) {
+				printf("%s:%u Malformed corpus line %lu\n", __FILE__, __LINE__, dwLine);
+				iErrors = iErrors + 1;
+			}
+			ctx.tolerance.bFit = (iFields == 5) ? 1 : 0;
+			if(ctx.bUpdate != 0) { printf("%s", strLine); }
+		} else if(strncmp(lpLine, "jpeg", 4) == 0) {
+			iErrors = iErrors + regressionRunJpeg(&ctx, lpLine, dwLine);
+		} else if(strncmp(lpLine, "gauss", 5) == 0) {
+			iErrors = iErrors + regressionRunGauss(&ctx, lpLine, dwLine);
+		} else if(strncmp(lpLine, "kernels", 7) == 0) {
+			iErrors = iErrors + regressionRunKernels(&ctx, lpLine, dwLine);
+		} else {
+			printf("%s:%u Unknown entry in corpus line %lu\n", __FILE__, __LINE__, dwLine);
+			iErrors = iErrors + 1;
+		}
+	}
+	fclose(fCorpus);
+
+	blobDetectorScratchRelease(&(ctx.scratch));
+	if(ctx.img.lpData != NULL) { free(ctx.img.lpData); }
+	if(ctx.img.lpLuma != NULL) { free(ctx.img.lpLuma); }
+
+	if(ctx.bUpdate == 0) {
+		printf("%lu passed, %lu failed, %d corpus errors\n", ctx.dwPassed, ctx.dwFailed, iErrors);
+	}
+	return ((ctx.dwFailed == 0) && (iErrors == 0)) ? 0 : 1;
+}
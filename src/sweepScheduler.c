@@ -0,0 +1,290 @@
+/*
+	Fixed and adaptive frequency sweep scheduling (see sweepScheduler.h)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./sweepScheduler.h"
+#include "./frameTrace.h"
+
+int sweepSchedulerInit(
+	struct sweepScheduler* lpScheduler,
+	unsigned long int frqStart,
+	unsigned long int frqEnd,
+	unsigned long int frqStep,
+	unsigned long int dwBudget,
+	unsigned long int frqMinStep,
+	double dTolerance
+) {
+	if((lpScheduler == NULL) || (frqEnd < frqStart)) {
+		return 1;
+	}
+
+	memset(lpScheduler, 0, sizeof(struct sweepScheduler));
+	lpScheduler->frqStart = frqStart;
+	lpScheduler->frqEnd = frqEnd;
+	lpScheduler->frqStep = frqStep;
+	lpScheduler->frqMinStep = (frqMinStep != 0) ? frqMinStep : frqStep / SWEEPSCHEDULER_DEFAULT_MINSTEPDIV;
+	if(lpScheduler->frqMinStep == 0) {
+		lpScheduler->frqMinStep = 1;
+	}
+	lpScheduler->bAdaptive = (dwBudget != 0) ? 1 : 0;
+	lpScheduler->dwBudget = dwBudget;
+	lpScheduler->dTolerance = (dTolerance > 0) ? dTolerance : SWEEPSCHEDULER_DEFAULT_TOLERANCE;
+	lpScheduler->frqNextCoarse = frqStart;
+	lpScheduler->bCoarseDone = 0;
+	return 0;
+}
+
+void sweepSchedulerRelease(
+	struct sweepScheduler* lpScheduler
+) {
+	if(lpScheduler == NULL) {
+		return;
+	}
+	if(lpScheduler->lpPoints != NULL) {
+		free(lpScheduler->lpPoints);
+		lpScheduler->lpPoints = NULL;
+	}
+	lpScheduler->dwPointCount = 0;
+	lpScheduler->dwPointCapacity = 0;
+}
+
+/*
+	Index of the first point with a frequency >= frq
+*/
+static unsigned long int sweepSchedulerLowerBound(struct sweepScheduler* lpScheduler, unsigned long int frq) {
+	unsigned long int dwLow = 0;
+	unsigned long int dwHigh = lpScheduler->dwPointCount;
+
+	while(dwLow < dwHigh) {
+		unsigned long int dwMid = dwLow + (dwHigh - dwLow) / 2;
+		if(lpScheduler->lpPoints[dwMid].frq < frq) {
+			dwLow = dwMid + 1;
+		} else {
+			dwHigh = dwMid;
+		}
+	}
+	return dwLow;
+}
+
+/*
+	Inserts a not yet measured point, keeping the list sorted
+*/
+static int sweepSchedulerInsert(struct sweepScheduler* lpScheduler, unsigned long int frq) {
+	unsigned long int dwIndex;
+
+	if(lpScheduler->dwPointCount == lpScheduler->dwPointCapacity) {
+		unsigned long int dwNewCapacity = (lpScheduler->dwPointCapacity == 0) ? 64 : lpScheduler->dwPointCapacity * 2;
+		struct sweepPoint* lpNew = realloc(lpScheduler->lpPoints, sizeof(struct sweepPoint) * dwNewCapacity);
+		if(lpNew == NULL) {
+			return 1;
+		}
+		lpScheduler->lpPoints = lpNew;
+		lpScheduler->dwPointCapacity = dwNewCapacity;
+	}
+
+	dwIndex = sweepSchedulerLowerBound(lpScheduler, frq);
+	memmove(&(lpScheduler->lpPoints[dwIndex + 1]), &(lpScheduler->lpPoints[dwIndex]), sizeof(struct sweepPoint) * (lpScheduler->dwPointCount - dwIndex));
+	memset(&(lpScheduler->lpPoints[dwIndex]), 0, sizeof(struct sweepPoint));
+	lpScheduler->lpPoints[dwIndex].frq = frq;
+	lpScheduler->lpPoints[dwIndex].dwExposure = -1;
+	lpScheduler->dwPointCount = lpScheduler->dwPointCount + 1;
+	return 0;
+}
+
+int sweepSchedulerNext(
+	struct sweepScheduler* lpScheduler,
+	unsigned long int* lpFrqOut
+) {
+	unsigned long int i;
+	unsigned long int dwBest = 0;
+	double dBestScore = 0;
+
+	if((lpScheduler == NULL) || (lpFrqOut == NULL)) {
+		return 1;
+	}
+
+	/*
+		Coarse pass
+	*/
+	if(lpScheduler->bCoarseDone == 0) {
+		unsigned long int frq = lpScheduler->frqNextCoarse;
+
+		if((lpScheduler->frqStep == 0) || (lpScheduler->frqEnd - frq < lpScheduler->frqStep)) {
+			lpScheduler->bCoarseDone = 1;
+		} else {
+			lpScheduler->frqNextCoarse = frq + lpScheduler->frqStep;
+		}
+		if(sweepSchedulerInsert(lpScheduler, frq) != 0) {
+			return 1;
+		}
+		(*lpFrqOut) = frq;
+		return 0;
+	}
+
+	if((lpScheduler->bAdaptive == 0) || (lpScheduler->dwPointCount >= lpScheduler->dwBudget)) {
+		return 1;
+	}
+
+	/*
+		Refinement: bisect the interval with the largest change
+	*/
+	for(i = 0; i + 1 < lpScheduler->dwPointCount; i=i+1) {
+		const struct sweepPoint* lpA = &(lpScheduler->lpPoints[i]);
+		const struct sweepPoint* lpB = &(lpScheduler->lpPoints[i+1]);
+		double dScore;
+
+		if((lpA->bValid == 0) || (lpB->bValid == 0) || (lpA->frq == 0)) {
+			continue;
+		}
+		if(lpB->frq - lpA->frq < 2 * lpScheduler->frqMinStep) {
+			continue;
+		}
+
+		dScore = blobResultRelativeChange(&(lpA->result), &(lpB->result));
+		if((dScore > lpScheduler->dTolerance) && (dScore > dBestScore)) {
+			dBestScore = dScore;
+			dwBest = i;
+		}
+	}
+
+	if(dBestScore <= 0) {
+		return 1; /* Converged */
+	}
+
+	{
+		unsigned long int frq = lpScheduler->lpPoints[dwBest].frq + (lpScheduler->lpPoints[dwBest+1].frq - lpScheduler->lpPoints[dwBest].frq) / 2;
+
+		#ifdef DEBUG
+			printf("%s:%u Refining between %lu and %lu (change %lf): %lu\n", __FILE__, __LINE__, lpScheduler->lpPoints[dwBest].frq, lpScheduler->lpPoints[dwBest+1].frq, dBestScore, frq);
+		#endif
+
+		if(sweepSchedulerInsert(lpScheduler, frq) != 0) {
+			return 1;
+		}
+		(*lpFrqOut) = frq;
+	}
+	return 0;
+}
+
+int sweepSchedulerRecord(
+	struct sweepScheduler* lpScheduler,
+	unsigned long int frq,
+	const struct blobResult* lpResult,
+	int dwExposure
+) {
+	unsigned long int dwIndex;
+	struct sweepPoint* lpPoint;
+
+	if(lpScheduler == NULL) {
+		return 1;
+	}
+
+	dwIndex = sweepSchedulerLowerBound(lpScheduler, frq);
+	if((dwIndex >= lpScheduler->dwPointCount) || (lpScheduler->lpPoints[dwIndex].frq != frq)) {
+		return 1; /* Not scheduled */
+	}
+
+	lpPoint = &(lpScheduler->lpPoints[dwIndex]);
+	lpPoint->dwExposure = dwExposure;
+	if(lpResult != NULL) {
+		memcpy(&(lpPoint->result), lpResult, sizeof(struct blobResult));
+		lpPoint->bValid = 1;
+	} else {
+		/* Failed points are kept so they are not scheduled again */
+		lpPoint->bValid = 0;
+	}
+	return 0;
+}
+
+int sweepSchedulerWrite(
+	struct sweepScheduler* lpScheduler,
+	char* lpFilename
+) {
+	unsigned long int i;
+	FILE* fHandle;
+
+	if((lpScheduler == NULL) || (lpFilename == NULL)) {
+		return 1;
+	}
+
+	frameTraceBegin("peaksWrite");
+	fHandle = fopen(lpFilename, "a");
+	if(fHandle == NULL) {
+		frameTraceEnd("peaksWrite");
+		printf("%s:%u Failed to write %s\n", __FILE__, __LINE__, lpFilename);
+		return 1;
+	}
+
+	for(i = 0; i < lpScheduler->dwPointCount; i=i+1) {
+		const struct sweepPoint* lpPoint = &(lpScheduler->lpPoints[i]);
+		const struct rectBound* lpB = &(lpPoint->result.bounds);
+
+		if(lpPoint->bValid == 0) {
+			continue;
+		}
+		if(lpPoint->dwExposure >= 0) {
+			fprintf(fHandle, "%lu %lu %lu %lu %lu %lu %lu %lf %lu %d", lpPoint->frq, lpB->xMin, lpB->xMax, lpB->yMin, lpB->yMax, lpB->xMax-lpB->xMin, lpB->yMax-lpB->yMin, lpPoint->result.dAreaSum, lpPoint->result.clusterPixelArea, lpPoint->dwExposure);
+		} else {
+			fprintf(fHandle, "%lu %lu %lu %lu %lu %lu %lu %lf %lu", lpPoint->frq, lpB->xMin, lpB->xMax, lpB->yMin, lpB->yMax, lpB->xMax-lpB->xMin, lpB->yMax-lpB->yMin, lpPoint->result.dAreaSum, lpPoint->result.clusterPixelArea);
+		}
+		profileFitPrint(fHandle, &(lpPoint->result.fitX));
+		profileFitPrint(fHandle, &(lpPoint->result.fitY));
+		fprintf(fHandle, "\n");
+	}
+
+	fclose(fHandle);
+	frameTraceEnd("peaksWrite");
+	return 0;
+}
+
+void sweepSettleDeadline(
+	struct timespec* lpDeadline,
+	unsigned long int dwSettleMs
+) {
+	clock_gettime(CLOCK_MONOTONIC, lpDeadline);
+	lpDeadline->tv_sec = lpDeadline->tv_sec + dwSettleMs / 1000;
+	lpDeadline->tv_nsec = lpDeadline->tv_nsec + (dwSettleMs % 1000) * 1000000L;
+	if(lpDeadline->tv_nsec >= 1000000000L) {
+		lpDeadline->tv_sec = lpDeadline->tv_sec + 1;
+		lpDeadline->tv_nsec = lpDeadline->tv_nsec - 1000000000L;
+	}
+}
+
+#ifdef SSG_ENABLE
+	enum labError sweepRetune(
+		struct siglentSSG3021x* lpSSG3021X,
+		unsigned long int frq,
+		int* lpRfEnabled
+	) {
+		enum labError le;
+
+		if(frq == 0) {
+			if((*lpRfEnabled) != 0) {
+				le = lpSSG3021X->vtbl->rfOutEnable(lpSSG3021X, 0);
+				if(le != labE_Ok) { return le; }
+				(*lpRfEnabled) = 0;
+			}
+			return labE_Ok;
+		}
+
+		frameTraceSetFrequency(frq);
+		frameTraceBegin("rfSetFrequency");
+		le = lpSSG3021X->vtbl->rfSetFrequency(lpSSG3021X, frq);
+		frameTraceEnd("rfSetFrequency");
+		if(le != labE_Ok) { return le; }
+
+		if((*lpRfEnabled) == 0) {
+			le = lpSSG3021X->vtbl->rfOutEnable(lpSSG3021X, 1);
+			if(le != labE_Ok) { return le; }
+			(*lpRfEnabled) = 1;
+		}
+		return labE_Ok;
+	}
+#endif
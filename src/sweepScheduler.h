@@ -0,0 +1,129 @@
+#ifndef __SWEEPSCHEDULER_H__
+#define __SWEEPSCHEDULER_H__
+
+#include <time.h>
+
+#include "./blobDetector.h"
+
+#ifdef SSG_ENABLE
+	#include "labtypes.h"
+	#include "siglent_ssg3021x.h"
+#endif
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+/*
+	Frequency sweep scheduler
+
+	A fixed sweep simply walks frqStart..frqEnd in frqStep. An adaptive
+	sweep does the same coarse pass and afterwards repeatedly bisects
+	the interval between two neighbouring points whose cluster widths,
+	area sum or pixel area differ the most (relative change above
+	dTolerance) until the point budget is used up or no interval wider
+	than 2 * frqMinStep changes by more than the tolerance.
+
+	A frequency of 0 is the RF off reference and never refined.
+*/
+struct sweepPoint {
+	unsigned long int		frq;
+	int						bValid;
+	int						dwExposure;
+	struct blobResult		result;
+};
+
+struct sweepScheduler {
+	unsigned long int		frqStart;
+	unsigned long int		frqEnd;
+	unsigned long int		frqStep;
+	unsigned long int		frqMinStep;
+
+	int						bAdaptive;
+	unsigned long int		dwBudget;
+	double					dTolerance;
+
+	unsigned long int		frqNextCoarse;
+	int						bCoarseDone;
+
+	struct sweepPoint*		lpPoints;		/* Sorted by frequency */
+	unsigned long int		dwPointCount;
+	unsigned long int		dwPointCapacity;
+};
+
+#define SWEEPSCHEDULER_DEFAULT_TOLERANCE	0.1
+#define SWEEPSCHEDULER_DEFAULT_MINSTEPDIV	64
+
+/*
+	dwBudget == 0 selects a fixed sweep. frqMinStep == 0 uses
+	frqStep / SWEEPSCHEDULER_DEFAULT_MINSTEPDIV
+*/
+int sweepSchedulerInit(
+	struct sweepScheduler* lpScheduler,
+	unsigned long int frqStart,
+	unsigned long int frqEnd,
+	unsigned long int frqStep,
+	unsigned long int dwBudget,
+	unsigned long int frqMinStep,
+	double dTolerance
+);
+
+void sweepSchedulerRelease(
+	struct sweepScheduler* lpScheduler
+);
+
+/*
+	Returns 0 and the next frequency to measure or 1 if the sweep is
+	finished
+*/
+int sweepSchedulerNext(
+	struct sweepScheduler* lpScheduler,
+	unsigned long int* lpFrqOut
+);
+
+/*
+	Records the result of a measured point (lpResult == NULL if the
+	detection failed, dwExposure < 0 if not known)
+*/
+int sweepSchedulerRecord(
+	struct sweepScheduler* lpScheduler,
+	unsigned long int frq,
+	const struct blobResult* lpResult,
+	int dwExposure
+);
+
+/*
+	Appends all valid points in frequency order in peaks.dat format
+*/
+int sweepSchedulerWrite(
+	struct sweepScheduler* lpScheduler,
+	char* lpFilename
+);
+
+/*
+	Calculates the point in time (CLOCK_MONOTONIC) dwSettleMs from now
+	after which frames can be used
+*/
+void sweepSettleDeadline(
+	struct timespec* lpDeadline,
+	unsigned long int dwSettleMs
+);
+
+#ifdef SSG_ENABLE
+	/*
+		Tunes the generator to the next sweep point. Frequency 0 is the
+		reference point with disabled RF output. *lpRfEnabled tracks the
+		state of the RF output
+	*/
+	enum labError sweepRetune(
+		struct siglentSSG3021x* lpSSG3021X,
+		unsigned long int frq,
+		int* lpRfEnabled
+	);
+#endif
+
+#ifdef __cplusplus
+    } /* extern "C" { */
+#endif
+
+#endif /* #ifndef __SWEEPSCHEDULER_H__ */
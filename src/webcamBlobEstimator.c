@@ -25,15 +25,26 @@
 #include <unistd.h>
 
 #include <math.h>
+#include <time.h>
+#include <signal.h>
 
 #include <sys/stat.h>
-#include <sys/mman.h>
-#include <sys/event.h>
-
-#include <jpeglib.h>
-#include <jerror.h>
 
 #include "./webcamBlobEstimator.h"
+#include "./blobDetector.h"
+#include "./jpegFile.h"
+#include "./rawRecorder.h"
+#include "./batchProcessor.h"
+#include "./captureDevice.h"
+#include "./multiCapture.h"
+#include "./sweepScheduler.h"
+#include "./blobEstimator.h"
+#include "./measurementDaemon.h"
+#include "./frameTrace.h"
+#include "./realtime.h"
+#include "./differenceImage.h"
+#include "./mjpegAvi.h"
+#include "./previewServer.h"
 
 #ifndef __cplusplus
 	typedef int bool;
@@ -41,126 +52,108 @@
 	#define false 0
 #endif
 
+/*
+	Settle time after retuning and default stability limit
+*/
+#define SETTLE_DEFAULT_MS			50
+#define STABILITY_DEFAULT_TOLERANCE	0.05
+
+#ifndef SSG_ENABLE
+	/*
+		Without a sweep a single frame is captured, or frames are
+		captured until SIGINT or SIGTERM while the preview is served
+	*/
+	static volatile sig_atomic_t captureStop = 0;
+
+	static void captureSignalHandler(int sig) {
+		(void)sig;
+		captureStop = 1;
+	}
+#endif
+
 static void printUsage(char* argv[]) {
-	printf("Usage: %s CAPDEV TARGETFILE [FRQSTART FRQEND FRQSTEP SSGPOWER SSGIP]\n", argv[0]);
+	printf("Usage: %s [OPTIONS] CAPDEV TARGETFILE [FRQSTART FRQEND FRQSTEP SSGPOWER SSGIP]\n", argv[0]);
+	printf("       %s -B [-j THREADS] [-t FACTOR] [-a FACTOR] [-d RADIUS] [-g RADIUS[:PASSES]] INPUT [INPUT ...]\n", argv[0]);
+	#ifdef SSG_ENABLE
+		printf("       %s -S SOCKET [-s WIDTHxHEIGHT] [-f FPS] [-m FORMAT] [-u|-H] [-c CPUS] [-P PRIO] [-L] [-e PEAK] [-t FACTOR] [-a FACTOR] [-d RADIUS] [-g RADIUS[:PASSES]] CAPDEV [SSGIP]\n", argv[0]);
+	#else
+		printf("       %s -S SOCKET [-s WIDTHxHEIGHT] [-f FPS] [-m FORMAT] [-u|-H] [-c CPUS] [-P PRIO] [-L] [-e PEAK] [-t FACTOR] [-a FACTOR] [-d RADIUS] [-g RADIUS[:PASSES]] CAPDEV\n", argv[0]);
+	#endif
+	printf("       %s -X VIDEO [FRQ ...|all]\n", argv[0]);
+	printf("       %s -M [-n FRAMES] [-j THREADS] [-s WIDTHxHEIGHT] [-f FPS] [-m FORMAT] [-u|-H] [-c CPUS] [-P PRIO] [-L] [-t FACTOR] [-a FACTOR] [-d RADIUS] [-g RADIUS[:PASSES]] CAPDEV:PREFIX [CAPDEV:PREFIX ...]\n", argv[0]);
 	printf("\n");
 	printf("Captures into a specified failename. Also runs blob detection and exports / prints blob information\n");
 	printf("\n");
 	printf("Arguments:\n");
 	printf("\tCAPDEV\n\t\tCapture device (for example /dev/video0)\n");
 	printf("\tTARGETFILE\n\t\tTarget filename prefix excluding the extension\n");
+	printf("\n");
+	printf("Options:\n");
+	printf("\t-r RAWFILE\n\t\tRecord every captured buffer unmodified (with timestamp, sequence\n\t\tnumber and frequency) into a single raw recording file\n");
+	printf("\t-p MBYTES\n\t\tSize to preallocate for the raw recording (default: estimated from sweep)\n");
+	printf("\t-D\n\t\tUse O_DIRECT for the raw recording\n");
+	printf("\t-V VIDEO[:QUALITY]\n\t\tWrite the raw and cluster images of all points into the single Motion\n\t\tJPEG AVI file VIDEO (JPEG quality, default %u) instead of two JPEG files\n\t\tper point (not with -R)\n", MJPEGAVI_DEFAULT_QUALITY);
+	printf("\t-o PORT[:FPS[:WIDTH[:QUALITY]]]\n\t\tServe a live MJPEG preview of the annotated frame on\n\t\thttp://127.0.0.1:PORT/ with at most FPS frames per second (default %u),\n\t\tWIDTH pixels wide (default %u) and JPEG quality QUALITY (default %u).\n\t\tReplaces current-raw.jpg and current-cluster.jpg.\n\t\tWithout sweep support frames are captured until SIGINT or SIGTERM\n", PREVIEWSERVER_DEFAULT_FPS, PREVIEWSERVER_DEFAULT_WIDTH, PREVIEWSERVER_DEFAULT_QUALITY);
+	printf("\t-C MARGIN\n\t\tCrop the preview to the cluster bounds plus MARGIN pixels while a blob\n\t\tis detected\n");
+	printf("\t-s WIDTHxHEIGHT\n\t\tMinimum capture resolution (default %ux%u)\n", CAPTUREDEVICE_DEFAULT_WIDTH, CAPTUREDEVICE_DEFAULT_HEIGHT);
+	printf("\t-f FPS\n\t\tTarget frame rate, selects the smallest mode that delivers at least\n\t\tFPS frames per second (default: fastest mode)\n");
+	printf("\t-m FORMAT\n\t\tRestrict the pixel format to yuyv, grey or mjpeg (default: any)\n");
+	printf("\t-u\n\t\tCapture into page aligned application buffers (V4L2 user pointers),\n\t\tfalls back to driver buffers if the driver does not support them\n");
+	printf("\t-H\n\t\tLike -u with the buffers backed by huge pages where available\n");
+	printf("\t-c CAPTURE[:ANALYSIS[:WRITER]]\n\t\tPin capture, analysis and raw recording writer threads to a CPU (N)\n\t\tor a range of CPUs (N-M, one CPU per thread), empty entries stay unpinned\n");
+	printf("\t-P PRIO\n\t\tRun the capture threads with SCHED_FIFO at priority PRIO\n");
+	printf("\t-L\n\t\tLock all memory (mlockall) and prefault frame and scratch buffers\n\t\tbefore capture starts\n");
+	printf("\t-R MARGIN\n\t\tTrack the blob with a sensor side region of interest: only read out\n\t\tthe cluster bounds plus MARGIN pixels, the full frame if the blob is lost\n\t\t(drivers that support cropping, not with -r)\n");
+	printf("\t-e PEAK\n\t\tClosed loop exposure control: switch to manual exposure and regulate\n\t\tthe brightest beam pixel to PEAK (of 255). Badly exposed frames are\n\t\tcaptured again, the exposure is logged as last column of peaks.dat\n");
+	#ifdef SSG_ENABLE
+		printf("\t-A BUDGET[:MINSTEP]\n\t\tAdaptive sweep: after the coarse pass in FRQSTEP bisect intervals where\n\t\tthe blob metrics change until BUDGET points have been measured or no\n\t\tinterval wider than 2*MINSTEP (default FRQSTEP/%u) changes anymore\n", SWEEPSCHEDULER_DEFAULT_MINSTEPDIV);
+		printf("\t-T TOLERANCE\n\t\tRelative change of width, area or intensity that triggers refinement\n\t\t(default %.2f)\n", SWEEPSCHEDULER_DEFAULT_TOLERANCE);
+		printf("\t-w MS\n\t\tSettle time after retuning. Frames whose exposure started earlier are\n\t\tdiscarded based on their timestamp (default %u ms)\n", SETTLE_DEFAULT_MS);
+		printf("\t-W TOLERANCE\n\t\tAdditionally wait until the blob metrics of two consecutive frames\n\t\tdiffer by less than TOLERANCE (relative, for example %.2f)\n", STABILITY_DEFAULT_TOLERANCE);
+		printf("\t-I FRAMES[:REFFRQ]\n\t\tDifferential imaging: capture a reference frame with RF off (or at\n\t\tREFFRQ) before every sweep point and analyze the difference to a rolling\n\t\treference averaged over FRAMES reference frames. Difference sums are\n\t\tappended to diffstat.dat (not with -e or -R)\n");
+	#endif
+	printf("\t-t FACTOR\n\t\tProjection threshold relative to the projection peak (default %.2f)\n", BLOBDETECTOR_DEFAULT_PROJECTIONTHRESHOLD);
+	printf("\t-a FACTOR\n\t\tCluster association threshold relative to the brightest pixel (default %.2f)\n", BLOBDETECTOR_DEFAULT_ASSOCIATIONTHRESHOLD);
+	printf("\t-d RADIUS\n\t\tJoin pixels over the association threshold to the cluster up to RADIUS\n\t\tpixels away from a cluster pixel (default %u)\n", BLOBDETECTOR_DEFAULT_GAPRADIUS);
+	printf("\t-x TRACEFILE\n\t\tRecord begin and end of every pipeline stage of every frame and write\n\t\tthem as Chrome trace event JSON into TRACEFILE at exit\n");
+	printf("\t-g RADIUS[:PASSES]\n\t\tTake seed and brightest pixel from the candidate box smoothed by PASSES\n\t\tbox filters of RADIUS (default %u passes, approximately gaussian)\n", BLOBDETECTOR_DEFAULT_SMOOTHPASSES);
+	printf("\n");
+	printf("Multi camera capture (-M):\n");
+	printf("\tCaptures from all given devices concurrently, each with it's own capture\n\tthread. Frames are analyzed on a shared pool of -j THREADS (default: all\n\tcores), results are appended to <PREFIX>-peaks.dat. -n FRAMES stops after\n\tthe given number of frames per device (default: run until interrupted)\n");
+	printf("\n");
+	printf("Measurement daemon (-S):\n");
+	printf("\tKeeps the camera streaming and serves detect, capture and sweep requests\n\ton the Unix socket SOCKET (binary protocol, see src/measurementDaemon.h)\n\tuntil a shutdown request, SIGINT or SIGTERM\n");
+	printf("\n");
+	printf("Batch reprocessing (-B):\n");
+	printf("\tEvery INPUT is either a raw recording (-r), a sweep video (-V) or a sweep\n\tdirectory containing <prefix><frq>-raw.jpg files. Frames are analyzed in\n\tparallel on all cores (or -j THREADS), results are written in peaks.dat\n\tformat into <recording>-peaks.dat or <directory>/peaks-reprocessed.dat\n");
+	printf("\n");
+	printf("Sweep video extraction (-X):\n");
+	printf("\tLists the frames of the sweep video VIDEO or writes the frames of the\n\tgiven frequencies (all for every frame) as <video><frq>-raw.jpg and\n\t<video><frq>-cluster.jpg, <video> being the file name without extension\n");
 }
 
 
-static void drawRect(
-	struct imgRawImage* lpImage,
-	unsigned long int xStart,
-	unsigned long int xEnd,
-	unsigned long int yStart,
-	unsigned long int yEnd,
-	unsigned long int lineWidth
-) {
-	unsigned long int x,y;
-	for(x = xStart; x <= xEnd; x=x+1) {
-		for(y = yStart; (y < yStart + lineWidth) && (y < lpImage->height); y=y+1) {
-			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
-		}
-	}
-
-	for(x = xStart; x <= xEnd; x=x+1) {
-		for(y = yEnd; (y < yEnd + lineWidth) && (y < lpImage->height); y=y+1) {
-			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
-		}
-	}
-
-	for(y = yStart; y <= yEnd; y=y+1) {
-		for(x = xStart; (x < xStart + lineWidth) && (x < lpImage->width); x=x+1) {
-			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
-		}
-	}
-
-	for(y = yStart; y <= yEnd; y=y+1) {
-		for(x = xEnd; (x < xEnd + lineWidth) && (x < lpImage->width); x=x+1) {
-			lpImage->lpData[(x + y * lpImage->width) * lpImage->numComponents] = 255;
-		}
-	}
-
-}
-
-static void greyscale(
-	struct imgRawImage* lpImage
-) {
-	unsigned long int i;
-
-	for(i = 0; i < (lpImage->width * lpImage->height); i=i+1) {
-		double grey = 0.2126 * lpImage->lpData[i * lpImage->numComponents + 0]
-						+ 0.7152 * lpImage->lpData[i * lpImage->numComponents + 1]
-						+ 0.0722 * lpImage->lpData[i * lpImage->numComponents + 2];
-
-		lpImage->lpData[i * lpImage->numComponents + 0] = (unsigned char)grey;
-		lpImage->lpData[i * lpImage->numComponents + 1] = (unsigned char)grey;
-		lpImage->lpData[i * lpImage->numComponents + 2] = (unsigned char)grey;
-	}
-}
 
+/*
+	Dumps the projections of the last detection (indexed in full frame
+	coordinates, lpFrame is the position of the analyzed frame), prints
+	the result and
+	(in a fixed sweep) appends it to peaks.dat. dwExposure is appended as
+	additional column if exposure control is active (>= 0)
+*/
 #ifdef SSG_ENABLE
 	static int createHistograms(
 		unsigned long int frq,
+		bool bAppendPeaks,
 #else
 	static int createHistograms(
 #endif
-	struct imgRawImage* lpImage,
 	char* lpFilenamePrefix,
-	struct histogramBuffer** lpHistXOut,
-	struct histogramBuffer** lpHistYOut,
-	struct rectBound* lpRegion
+	const struct blobDetectorScratch* lpScratch,
+	const struct rectBound* lpFrame,
+	const struct blobResult* lpResult,
+	int dwExposure
 ) {
-	struct histogramBuffer* lpNewHistX;
-	struct histogramBuffer* lpNewHistY;
 	unsigned long int i;
-	unsigned long int x,y,c;
-
-	struct rectBound bounds;
-
-	if(lpRegion != NULL) {
-		bounds.xMin = lpRegion->xMin;
-		bounds.xMax = lpRegion->xMax;
-		bounds.yMin = lpRegion->yMin;
-		bounds.yMax = lpRegion->yMax;
-	} else {
-		bounds.xMin = 0;
-		bounds.yMin = 0;
-		bounds.xMax = lpImage->width;
-		bounds.yMin = lpImage->height;
-	}
-
-	/*
-		Create histogram X and histogram Y
-	*/
-	lpNewHistX = malloc(sizeof(struct histogramBuffer) + sizeof(double)*(lpImage->width));
-	if(lpNewHistX == NULL) {
-		return 1;
-	}
-	lpNewHistY = malloc(sizeof(struct histogramBuffer) + sizeof(double)*(lpImage->height));
-	if(lpNewHistY == NULL) {
-		free(lpNewHistX);
-		return 1;
-	}
-
-	lpNewHistX->sLen = lpImage->width;
-	lpNewHistY->sLen = lpImage->height;
-
-	for(i = 0; i < lpImage->width; i=i+1)  { lpNewHistX->dValues[i] = 0; }
-	for(i = 0; i < lpImage->height; i=i+1) { lpNewHistY->dValues[i] = 0; }
-
-	for(x = 0; x < lpImage->width; x=x+1) {
-		for(y = 0; y < lpImage->height; y=y+1) {
-			for(c = 1; c < lpImage->numComponents; c=c+1) {
-				lpNewHistX->dValues[x] = lpNewHistX->dValues[x] + ((double)lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents + c])/255.0;
-				lpNewHistY->dValues[y] = lpNewHistY->dValues[y] + ((double)lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents + c])/255.0;
-			}
-		}
-	}
 
 	/*
 		Dump raw histogram data
@@ -172,19 +165,15 @@ static void greyscale(
 		#else
 			if(asprintf(&lpFilename, "%s%lu-histrawx.dat", lpFilenamePrefix, frq) < 0) {
 		#endif
-			free(lpNewHistX);
-			free(lpNewHistY);
 			return 1;
 		}
 		FILE* fHandle = fopen(lpFilename, "w");
 		if(fHandle == NULL) {
 			free(lpFilename);
-			free(lpNewHistX);
-			free(lpNewHistY);
 			return 1;
 		}
-		for(i = 0; i < lpNewHistX->sLen; i=i+1) {
-			fprintf(fHandle, "%lu\t%lf\n", i, lpNewHistX->dValues[i]);
+		for(i = 0; i < lpScratch->lpHistX->sLen; i=i+1) {
+			fprintf(fHandle, "%lu\t%lf\n", lpFrame->xMin + i, lpScratch->lpHistX->dValues[i]);
 		}
 		fclose(fHandle);
 		free(lpFilename);
@@ -196,431 +185,250 @@ static void greyscale(
 		#else
 			if(asprintf(&lpFilename, "%s%lu-histrawy.dat", lpFilenamePrefix, frq) < 0) {
 		#endif
-			free(lpNewHistX);
-			free(lpNewHistY);
 			return 1;
 		}
 		FILE* fHandle = fopen(lpFilename, "w");
 		if(fHandle == NULL) {
 			free(lpFilename);
-			free(lpNewHistX);
-			free(lpNewHistY);
 			return 1;
 		}
-		for(i = 0; i < lpNewHistY->sLen; i=i+1) {
-			fprintf(fHandle, "%lu\t%lf\n", i, lpNewHistY->dValues[i]);
+		for(i = 0; i < lpScratch->lpHistY->sLen; i=i+1) {
+			fprintf(fHandle, "%lu\t%lf\n", lpFrame->yMin + i, lpScratch->lpHistY->dValues[i]);
 		}
 		fclose(fHandle);
 		free(lpFilename);
 	}
 
-	/*
-		Normalize histograms (for peak search)
-		and perform absolute peak search in parallel
-	*/
-	unsigned long int absPeakX = 0;
-	unsigned long int absPeakY = 0;
-	double dAvgX = 0;
-	double dAvgY = 0;
-	double dStdDevX = 0;
-	double dStdDevY = 0;
-	double dHistAbsX = 0;
-	double dHistAbsY = 0;
-	{
-		double dMin = lpNewHistX->dValues[0];
-		double dMax = lpNewHistX->dValues[0];
-		for(i = 0; i < lpNewHistX->sLen; i=i+1) {
-			if(lpNewHistX->dValues[i] < dMin) { dMin = lpNewHistX->dValues[i]; }
-			if(lpNewHistX->dValues[i] > dMax) { dMax = lpNewHistX->dValues[i]; absPeakX = i; }
-			dAvgX = dAvgX + lpNewHistX->dValues[i];
-		}
-		dAvgX = dAvgX / ((double)lpNewHistX->sLen);
-		dHistAbsX = dMax;
-	}
 	{
-		double dMin = lpNewHistY->dValues[0];
-		double dMax = lpNewHistY->dValues[0];
-		for(i = 0; i < lpNewHistY->sLen; i=i+1) {
-			if(lpNewHistY->dValues[i] < dMin) { dMin = lpNewHistY->dValues[i]; }
-			if(lpNewHistY->dValues[i] > dMax) { dMax = lpNewHistY->dValues[i]; absPeakY = i; }
-			dAvgY = dAvgY + lpNewHistY->dValues[i];
-		}
-		dAvgY = dAvgY / ((double)lpNewHistY->sLen);
-		dHistAbsY = dMax;
-	}
-	{
-		for(i = 0; i < lpNewHistX->sLen; i=i+1) {
-			dStdDevX = dStdDevX + (lpNewHistX->dValues[i] - dAvgX)*(lpNewHistX->dValues[i] - dAvgX);
+		unsigned long int peakXMin = lpResult->bounds.xMin;
+		unsigned long int peakXMax = lpResult->bounds.xMax;
+		unsigned long int peakYMin = lpResult->bounds.yMin;
+		unsigned long int peakYMax = lpResult->bounds.yMax;
+		double dAreaSum = lpResult->dAreaSum;
+		unsigned long int clusterPixelArea = lpResult->clusterPixelArea;
+
+		printf("# Estimated peak\n#\tx: %lu %lu\n#\ty : %lu %lu\n#\tWidths: %lu %lu\n#\tArea sum: %lf\n#\tCluster pixel area: %lu\n", peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea);
+		printf("#\tFit x: center %lf +- %lf, sigma %lf +- %lf\n#\tFit y: center %lf +- %lf, sigma %lf +- %lf\n", lpResult->fitX.dCenter, lpResult->fitX.dCenterErr, lpResult->fitX.dSigma, lpResult->fitX.dSigmaErr, lpResult->fitY.dCenter, lpResult->fitY.dCenterErr, lpResult->fitY.dSigma, lpResult->fitY.dSigmaErr);
+		printf("#\tBackground: %lf +- %lf\n", lpResult->dBackground, lpResult->dBackgroundStdDev);
+		if(dwExposure >= 0) {
+			printf("#\tExposure: %d (peak %u)\n%lu %lu %lu %lu %lu %lu %lf %lu %d", dwExposure, lpResult->dwPeakValue, peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea, dwExposure);
+		} else {
+			printf("%lu %lu %lu %lu %lu %lu %lf %lu", peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea);
 		}
-		dStdDevX = sqrt(dStdDevX / ((double)lpNewHistX->sLen));
-
-		for(i = 0; i < lpNewHistY->sLen; i=i+1) {
-			dStdDevY = dStdDevY + (lpNewHistY->dValues[i] - dAvgY)*(lpNewHistY->dValues[i] - dAvgY);
+		profileFitPrint(stdout, &(lpResult->fitX));
+		profileFitPrint(stdout, &(lpResult->fitY));
+		printf("\n");
+		#ifdef SSG_ENABLE
+		if(bAppendPeaks == true) {
+			frameTraceBegin("peaksWrite");
+			FILE* fHandle = fopen("peaks.dat", "a");
+			if(dwExposure >= 0) {
+				fprintf(fHandle, "%lu %lu %lu %lu %lu %lu %lu %lf %lu %d", frq, peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea, dwExposure);
+			} else {
+				fprintf(fHandle, "%lu %lu %lu %lu %lu %lu %lu %lf %lu", frq, peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea);
+			}
+			profileFitPrint(fHandle, &(lpResult->fitX));
+			profileFitPrint(fHandle, &(lpResult->fitY));
+			fprintf(fHandle, "\n");
+			fclose(fHandle);
+			frameTraceEnd("peaksWrite");
 		}
-		dStdDevY = sqrt(dStdDevY / ((double)lpNewHistY->sLen));
+		#endif
 	}
 
-	/*
-		Calculate width of peaks
+	return 0;
+}
 
-		The seed is given by the local max.
+/* Writes the trace after all threads have been joined, whichever way main returns */
+static void frameTraceAtExit(void) {
+	frameTraceClose();
+}
 
-		The width is determined by associating every pixel with the peak that's above
-		average (?), expanding from the seed ...
+int main(int argc, char* argv[]) {
+	enum cameraError e;
+	struct blobEstimator* lpEstimator;
+	struct blobEstimatorSettings estimatorSettings;
+	const struct captureDevice* lpCamDevice;
+
+	struct imgRawImage clusterImg;
+
+	char* lpRawRecordingFile = NULL;
+	unsigned long int dwRawPreallocateMBytes = 0;
+	bool bRawDirectIO = false;
+	struct rawRecorder* lpRawRecorder = NULL;
+
+	char* lpVideoFile = NULL;
+	int iVideoQuality = MJPEGAVI_DEFAULT_QUALITY;
+	struct mjpegAvi* lpVideo = NULL;
+	unsigned char* lpEncoded = NULL;
+	size_t sEncodedCapacity = 0;
+	int iExitCode = 0;
+	bool bExtractMode = false;
+
+	bool bPreview = false;
+	struct previewServerSettings previewSettings;
+	struct previewServer* lpPreview = NULL;
+
+	bool bBatchMode = false;
+	bool bMultiMode = false;
+	char* lpDaemonSocket = NULL;
+	unsigned long int dwMultiFrames = 0;
+	unsigned long int dwBatchThreads = 0;
+	unsigned long int dwRoiMargin = 0;
+	struct blobDetectorParams detectorParams;
+	struct captureDeviceFormatRequest formatRequest;
+	struct realtimeSettings realtimeSettings;
+	bool bExposureControl = false;
+	double dExposureTarget = 0;
+	unsigned long int frq = 0;
+	#ifdef SSG_ENABLE
+		unsigned long int dwSweepBudget = 0;
+		unsigned long int frqSweepMinStep = 0;
+		double dSweepTolerance = SWEEPSCHEDULER_DEFAULT_TOLERANCE;
+		struct sweepScheduler sweep;
+		bool bSweepDone = false;
+		bool bRfEnabled = false;
+
+		unsigned long int dwSettleMs = SETTLE_DEFAULT_MS;
+		struct timespec tsSettled;
+		unsigned long int dwGateDiscarded = 0;
+
+		bool bStabilize = false;
+		double dStabilityTolerance = STABILITY_DEFAULT_TOLERANCE;
+
+		bool bDifferential = false;
+		unsigned long int dwReferenceFrames = 1;
+		unsigned long int frqReference = 0;
+		struct differenceImage diffImage;
+		struct imgRawImage diffImg;
+		struct blobDetectorScratch diffScratch;
+		FILE* fDiffStat = NULL;
+	#endif
 
-		this yields a candidate cluster
+	blobDetectorParamsDefault(&detectorParams);
+	captureDeviceFormatRequestDefault(&formatRequest);
+	realtimeSettingsDefault(&realtimeSettings);
+	previewServerSettingsDefault(&previewSettings);
 
-		Then we will determine the maximum pixel value (or one of the max) in
-		the candidate cluster and trace all pixels from there on in an iterative
-		fashion
+	/*
+		Options precede the positional arguments. After parsing
+		argv is shifted so the positional arguments keep their indices
 	*/
-	double dThreasholdX = dHistAbsX * 0.2;
-	double dThreasholdY = dHistAbsY * 0.2;
 	{
-		unsigned long int peakXMin = absPeakX;
-		unsigned long int peakXMax = absPeakX;
-		unsigned long int peakYMin = absPeakY;
-		unsigned long int peakYMax = absPeakY;
-		unsigned long int x,y;
-
-		double dAreaSum = 0;
-
-		while((peakXMin > 0) && ((double)lpNewHistX->dValues[peakXMin-1] > (dThreasholdX))) { peakXMin = peakXMin - 1; }
-		while((peakXMax < (lpNewHistX->sLen-1)) && ((double)lpNewHistX->dValues[peakXMax+1] > (dThreasholdX))) { peakXMax = peakXMax + 1; }
-
-		while((peakYMin > 0) && ((double)lpNewHistY->dValues[peakYMin-1] > (dThreasholdY))) { peakYMin = peakYMin - 1; }
-		while((peakYMax < (lpNewHistY->sLen-1)) && ((double)lpNewHistY->dValues[peakYMax+1] > (dThreasholdY))) { peakYMax = peakYMax + 1; }
-
-		/* located candidate ... now locate absolute maximum */
-		double dMaxPixelValueInCluster = 0;
-		unsigned long int seedX, seedY;
-		for(x = peakXMin; x <= peakXMax; x=x+1) {
-			for(y = peakYMin; y <= peakYMax; y=y+1) {
-				if(lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents] > dMaxPixelValueInCluster) {
-					dMaxPixelValueInCluster = lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents];
-					seedX = x;
-					seedY = y;
-				}
+		int opt;
+		while((opt = getopt(argc, argv, "r:p:DV:Xo:C:BMS:n:j:s:f:m:uHc:P:LR:e:A:T:w:W:I:t:a:d:g:x:")) != -1) {
+			switch(opt) {
+				case 'r':	lpRawRecordingFile = optarg; break;
+				case 'p':	if(sscanf(optarg, "%lu", &dwRawPreallocateMBytes) != 1) { printUsage(argv); return 1; } break;
+				case 'D':	bRawDirectIO = true; break;
+				case 'V':
+					lpVideoFile = optarg;
+					{
+						char* lpQuality = strrchr(optarg, ':');
+						if(lpQuality != NULL) {
+							if((sscanf(&(lpQuality[1]), "%d", &iVideoQuality) != 1) || (iVideoQuality < 1) || (iVideoQuality > 100)) { printUsage(argv); return 1; }
+							(*lpQuality) = 0;
+						}
+					}
+					break;
+				case 'X':	bExtractMode = true; break;
+				case 'o':	if(previewServerParse(optarg, &previewSettings) != 0) { printUsage(argv); return 1; } bPreview = true; break;
+				case 'C':	if((sscanf(optarg, "%lu", &(previewSettings.dwCropMargin)) != 1) || (previewSettings.dwCropMargin == 0)) { printUsage(argv); return 1; } break;
+				case 'B':	bBatchMode = true; break;
+				case 'M':	bMultiMode = true; break;
+				case 'S':	lpDaemonSocket = optarg; break;
+				case 'n':	if(sscanf(optarg, "%lu", &dwMultiFrames) != 1) { printUsage(argv); return 1; } break;
+				case 'j':	if(sscanf(optarg, "%lu", &dwBatchThreads) != 1) { printUsage(argv); return 1; } break;
+				case 's':	if(sscanf(optarg, "%lux%lu", &(formatRequest.dwMinWidth), &(formatRequest.dwMinHeight)) != 2) { printUsage(argv); return 1; } break;
+				case 'f':	if(sscanf(optarg, "%lf", &(formatRequest.dTargetFps)) != 1) { printUsage(argv); return 1; } break;
+				case 'm':	if(captureParsePixelFormat(optarg, &(formatRequest.pixelFormat)) != 0) { printUsage(argv); return 1; } break;
+				case 'c':	if(realtimeParseCpus(optarg, &realtimeSettings) != 0) { printUsage(argv); return 1; } break;
+				case 'P':	if(sscanf(optarg, "%d", &(realtimeSettings.iCapturePriority)) != 1) { printUsage(argv); return 1; } break;
+				case 'L':	realtimeSettings.bLockMemory = 1; break;
+				case 'R':	if((sscanf(optarg, "%lu", &dwRoiMargin) != 1) || (dwRoiMargin == 0)) { printUsage(argv); return 1; } break;
+				case 'u':	formatRequest.memory = captureDeviceMemory_UserPtr; break;
+				case 'H':	formatRequest.memory = captureDeviceMemory_UserPtr; formatRequest.bHugePages = 1; break;
+				case 'e':	if(sscanf(optarg, "%lf", &dExposureTarget) != 1) { printUsage(argv); return 1; } bExposureControl = true; break;
+				#ifdef SSG_ENABLE
+					case 'A':	if(sscanf(optarg, "%lu:%lu", &dwSweepBudget, &frqSweepMinStep) < 1) { printUsage(argv); return 1; } break;
+					case 'T':	if(sscanf(optarg, "%lf", &dSweepTolerance) != 1) { printUsage(argv); return 1; } break;
+					case 'w':	if(sscanf(optarg, "%lu", &dwSettleMs) != 1) { printUsage(argv); return 1; } break;
+					case 'W':	if(sscanf(optarg, "%lf", &dStabilityTolerance) != 1) { printUsage(argv); return 1; } bStabilize = true; break;
+					case 'I':	if((sscanf(optarg, "%lu:%lu", &dwReferenceFrames, &frqReference) < 1) || (dwReferenceFrames == 0)) { printUsage(argv); return 1; } bDifferential = true; break;
+				#endif
+				case 't':	if(sscanf(optarg, "%lf", &(detectorParams.dProjectionThreshold)) != 1) { printUsage(argv); return 1; } break;
+				case 'a':	if(sscanf(optarg, "%lf", &(detectorParams.dAssociationThreshold)) != 1) { printUsage(argv); return 1; } break;
+				case 'd':	if(sscanf(optarg, "%lu", &(detectorParams.dwGapRadius)) != 1) { printUsage(argv); return 1; } break;
+				case 'g':	if(sscanf(optarg, "%lu:%lu", &(detectorParams.dwSmoothRadius), &(detectorParams.dwSmoothPasses)) < 1) { printUsage(argv); return 1; } break;
+				case 'x':
+					if(frameTraceOpen(optarg) != 0) { printf("%s:%u Failed to enable tracing\n", __FILE__, __LINE__); return 1; }
+					atexit(frameTraceAtExit);
+					break;
+				default:	printUsage(argv); return 1;
 			}
 		}
 
-		/* Now trace the cluster from seeds on ... */
-		int done = 0;
-
-		double peakXMinReal = absPeakX;
-		double peakYMinReal = absPeakY;
-		double peakXMaxReal = absPeakX;
-		double peakYMaxReal = absPeakY;
-		unsigned long int clusterPixelArea = 1;
+		/* Before any buffer is allocated so memory locking covers everything */
+		realtimeConfigure(&realtimeSettings);
 
-		for(x = peakXMin; x <= peakXMax; x=x+1) {
-			for(y = peakYMin; y <= peakYMax; y=y+1) {
-				lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents+2] = 0; /* We use the blue channel ... */
-			}
+		if(bExtractMode == true) {
+			if(optind >= argc) { printUsage(argv); return 1; }
+			return (mjpegAviExtract(argv[optind], NULL, &(argv[optind + 1]), argc - optind - 1) == 0) ? 0 : 2;
 		}
-		lpImage->lpData[(seedX + seedY * lpImage->width)*lpImage->numComponents+2] = 255; /* We use the blue channel ... */
-		while(done == 0) {
-			done = 1;
-			for(x = peakXMin; x <= peakXMax; x=x+1) {
-				for(y = peakYMin; y <= peakYMax; y=y+1) {
-					/*
-						If we have found a blue pixel we will look at it's neighbors
-						any neighbor with a value over threashold will be added to
-						the cluster
-					*/
-					signed long int dx,dy;
-					if(lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents+2] == 255) {
-						for(dx = -10; dx <= 10; dx=dx+1) {
-							for(dy = -10; dy <= 10; dy=dy+1) {
-								signed long int curX = (signed long int)x + dx;
-								signed long int curY = (signed long int)y + dy;
-
-								if((lpImage->lpData[(curX + curY * lpImage->width)*lpImage->numComponents] > 0.5*dMaxPixelValueInCluster) && (lpImage->lpData[(curX + curY * lpImage->width)*lpImage->numComponents+2] != 255)) {
-									lpImage->lpData[(curX + curY * lpImage->width)*lpImage->numComponents+2] = 255;
-									if(peakXMinReal > curX) { peakXMinReal = curX; }
-									if(peakXMaxReal < curX) { peakXMaxReal = curX; }
-
-									if(peakYMinReal > curY) { peakYMinReal = curY; }
-									if(peakYMaxReal < curY) { peakYMaxReal = curY; }
-
-									clusterPixelArea = clusterPixelArea + 1;
-									done = 0;
-								}
-							}
-						}
-					}
-				}
-			}
+		if(bBatchMode == true) {
+			if(optind >= argc) { printUsage(argv); return 1; }
+			return (batchProcess(&(argv[optind]), argc - optind, dwBatchThreads, &detectorParams) == 0) ? 0 : 2;
+		}
+		if(bMultiMode == true) {
+			if(optind >= argc) { printUsage(argv); return 1; }
+			return (multiCapture(&(argv[optind]), argc - optind, &formatRequest, dwMultiFrames, dwBatchThreads, &detectorParams) == 0) ? 0 : 2;
 		}
 
-		/* Calculate new boundaries ... */
-		peakXMin = peakXMinReal;
-		peakXMax = peakXMaxReal;
-		peakYMin = peakYMinReal;
-		peakYMax = peakYMaxReal;
+		if(lpDaemonSocket != NULL) {
+			struct blobEstimatorSettings daemonSettings;
+			char* lpSSGAddress = NULL;
 
-		for(x = peakXMin; x <= peakXMax; x=x+1) {
-			for(y = peakYMin; y <= peakYMax; y=y+1) {
-				if(lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents+2] == 255) {
-					dAreaSum = dAreaSum + ((double)(lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents]));
-/* Mark cluster fully blue */
-lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents+0] = 0;
-lpImage->lpData[(x + y * lpImage->width)*lpImage->numComponents+1] = 0;
+			if((optind >= argc) || (optind + 2 < argc)) { printUsage(argv); return 1; }
+			#ifdef SSG_ENABLE
+				if(optind + 1 < argc) { lpSSGAddress = argv[optind + 1]; }
+			#else
+				if(optind + 1 < argc) { printUsage(argv); return 1; }
+			#endif
 
-				}
+			blobEstimatorSettingsDefault(&daemonSettings);
+			memcpy(&(daemonSettings.detector), &detectorParams, sizeof(struct blobDetectorParams));
+			if(bExposureControl == true) {
+				daemonSettings.dExposureTarget = dExposureTarget;
 			}
+			realtimeEnterThread(realtimeRole_Capture, 0);
+			return (measurementDaemon(lpDaemonSocket, argv[optind], &formatRequest, &daemonSettings, lpSSGAddress) == 0) ? 0 : 2;
 		}
 
-		printf("# Estimated peak\n#\tx: %lu %lu\n#\ty : %lu %lu\n#\tWidths: %lu %lu\n#\tArea sum: %lf\n#\tCluster pixel area: %lu\n%lu %lu %lu %lu %lu %lu %lf %lu\n", peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea, peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea);
-		#ifdef SSG_ENABLE
-			FILE* fHandle = fopen("peaks.dat", "a");
-			fprintf(fHandle, "%lu %lu %lu %lu %lu %lu %lu %lf %lu\n", frq, peakXMin, peakXMax, peakYMin, peakYMax, peakXMax-peakXMin, peakYMax-peakYMin, dAreaSum, clusterPixelArea);
-			fclose(fHandle);
-		#endif
-
-		/*
-			Plot estimated peak location into image (2 pixel wide red if possible)...
-		*/
-		drawRect(lpImage, peakXMin, peakXMax, peakYMin, peakYMax, 2);
+		argv[optind - 1] = argv[0];
+		argc = argc - (optind - 1);
+		argv = &(argv[optind - 1]);
 	}
 
-	return 0;
-}
-
-/*
-  Write one image into a target file
-
-  See https://www.tspi.at/2020/03/20/libjpegexample.html
-*/
-static int storeJpegImageFile(struct imgRawImage* lpImage, char* lpFilename) {
-	struct jpeg_compress_struct info;
-	struct jpeg_error_mgr err;
-
-	unsigned char* lpRowBuffer[1];
-
-	FILE* fHandle;
-
-	fHandle = fopen(lpFilename, "wb");
-	if(fHandle == NULL) {
-		#ifdef DEBUG
-			fprintf(stderr, "%s:%u Failed to open output file %s\n", __FILE__, __LINE__, lpFilename);
-		#endif
+	if(argc < 3) { printUsage(argv); return 1; }
+	if(argc > 8) { printUsage(argv); return 1; }
+	if((argc > 3) && (argc < 8)) { printUsage(argv); return 1; }
+	if((lpRawRecordingFile != NULL) && (dwRoiMargin > 0)) {
+		/* The recording has a single frame size */
+		printf("Region of interest tracking (-R) cannot be combined with raw recording (-r)\n");
 		return 1;
 	}
-
-	info.err = jpeg_std_error(&err);
-	jpeg_create_compress(&info);
-
-	jpeg_stdio_dest(&info, fHandle);
-
-	info.image_width = lpImage->width;
-	info.image_height = lpImage->height;
-	info.input_components = 3;
-	info.in_color_space = JCS_RGB;
-
-	jpeg_set_defaults(&info);
-	jpeg_set_quality(&info, 100, TRUE);
-
-	jpeg_start_compress(&info, TRUE);
-
-	/* Write every scanline ... */
-	while(info.next_scanline < info.image_height) {
-		lpRowBuffer[0] = &(lpImage->lpData[info.next_scanline * (lpImage->width * 3)]);
-		jpeg_write_scanlines(&info, lpRowBuffer, 1);
-	}
-
-	jpeg_finish_compress(&info);
-	fclose(fHandle);
-
-	jpeg_destroy_compress(&info);
-	return 0;
-}
-
-/*
-  Wrapper around ioctl that repeats the calls in case
-  they are interrupted by a signal (i.e. restarts) until
-  they succeed or fail.
-*/
-static int xioctl(int fh, int request, void* arg) {
-	int r;
-	do {
-		r = ioctl(fh, request, arg);
-	} while((r == -1) && (errno == EINTR));
-	return r;
-}
-
-/*
-	Exposure control:
-		V4L2 knows 4 exposure modes:
-
-		| Mode							  | Exposure | Aperture |
-		| ------------------------------- | -------- | -------- |
-		| V4L2_EXPOSURE_AUTO			  | Auto     | Auto     |
-		| V4L2_EXPOSURE_MANUAL			  | Manual   | Manual   |
-		| V4L2_EXPOSURE_SHUTTER_PRIORITY  | Manual   | Auto     |
-		| V4L2_EXPOSURE_APERTURE_PRIORITY | Auto     | Manual   |
-*/
-
-static int getExposureMode(int fh) {
-	struct v4l2_control ctrl;
-
-	memset(&ctrl, 0, sizeof(struct v4l2_control));
-
-	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
-
-	if(xioctl(fh, VIDIOC_G_CTRL, &ctrl) == -1) {
-		perror("Failed getting current exposure mode");
-		return -1;
-	}
-
-	return ctrl.value;
-}
-static int setExposureMode(int fh, int mode) {
-	struct v4l2_control ctrl;
-
-	memset(&ctrl, 0, sizeof(struct v4l2_control));
-
-	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
-	ctrl.value = mode;
-
-	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
-		perror("Failed getting current exposure mode");
-		return -1;
-	}
-
-	return 0;
-}
-
-static int setExposureManual(int fh) {
-	struct v4l2_control ctrl;
-
-	memset(&ctrl, 0, sizeof(struct v4l2_control));
-
-	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
-	ctrl.value = V4L2_EXPOSURE_MANUAL;
-
-	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
-		perror("Setting V4L2_CID_EXPOSURE_AUTO to V4L2_EXPOSURE_MANUAL");
-		return -1;
-	}
-
-	return 0;
-}
-
-static int setExposureAuto(int fh) {
-	struct v4l2_control ctrl;
-
-	memset(&ctrl, 0, sizeof(struct v4l2_control));
-
-	ctrl.id = V4L2_CID_EXPOSURE_AUTO;
-	ctrl.value = V4L2_EXPOSURE_AUTO;
-
-	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
-		perror("Setting V4L2_CID_EXPOSURE_AUTO to V4L2_EXPOSURE_MANUAL");
-		return -1;
-	}
-
-	return 0;
-}
-
-static int getExposureAbsolute(int fh) {
-	struct v4l2_control ctrl;
-
-	memset(&ctrl, 0, sizeof(struct v4l2_control));
-
-	ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
-	ctrl.value = ~0;
-
-	if (xioctl(fh,VIDIOC_G_CTRL,&ctrl) == -1) {
-      perror("Getting V4L2_CID_EXPOSURE_ABSOLUTE");
-	  return -1;
-	}
-
-	return ctrl.value;
-}
-
-static int setExposureAbsolute(int fh, int exposureValue) {
-	struct v4l2_control ctrl;
-
-	memset(&ctrl, 0, sizeof(struct v4l2_control));
-
-	ctrl.id = V4L2_CID_EXPOSURE_ABSOLUTE;
-	ctrl.value = exposureValue;
-
-	if(xioctl(fh, VIDIOC_S_CTRL, &ctrl) == -1) {
-		perror("Setting V4L2_CID_EXPOSURE_ABSOLUTE");
-		return -1;
-	}
-	return 0;
-}
-
-/*
-  Open the device file (first check it exists, is
-  a device file, etc.)
-*/
-static char* deviceOpen_DefaultFilename = "/dev/video0";
-static enum cameraError deviceOpen(
-	int* lpDeviceOut,
-	char* deviceName
-) {
-	struct stat st;
-	int hHandle;
-
-	if(lpDeviceOut == NULL) {
-		return cameraE_InvalidParam;
-	}
-	(*lpDeviceOut) = -1;
-
-	if(deviceName == NULL) {
-		deviceName = deviceOpen_DefaultFilename;
-	}
-
-	/*
-		First check that the file exists and that we
-		are really seeing a device file
-	*/
-	if(stat(deviceName, &st) == -1) {
-		return cameraE_UnknownDevice;
-	}
-
-	if(!S_ISCHR(st.st_mode)) {
-		return cameraE_UnknownDevice;
+	if((lpVideoFile != NULL) && (dwRoiMargin > 0)) {
+		/* Every stream of the video has a single frame size */
+		printf("Region of interest tracking (-R) cannot be combined with the sweep video (-V)\n");
+		return 1;
 	}
-
-	hHandle = open(deviceName, O_RDWR|O_NONBLOCK, 0);
-	if(hHandle < 0) {
-		switch(errno) {
-			case EACCES:	return cameraE_PermissionDenied;
-			case EPERM:		return cameraE_PermissionDenied;
-			default:		return cameraE_Failed;
+	#ifdef SSG_ENABLE
+		if((bDifferential == true) && ((bExposureControl == true) || (dwRoiMargin > 0))) {
+			/* Reference and signal frame have to be exposed and cropped identically */
+			printf("Differential imaging (-I) cannot be combined with exposure control (-e) or region of interest tracking (-R)\n");
+			return 1;
 		}
-	}
-
-	(*lpDeviceOut) = hHandle;
-	return cameraE_Ok;
-}
-
-static enum cameraError deviceClose(
-	int hHandle
-) {
-	if(hHandle < 0) { return cameraE_InvalidParam; }
-	close(hHandle);
-	return cameraE_Ok;
-}
-
-
-
-
-int main(int argc, char* argv[]) {
-	enum cameraError e;
-	int hHandle;
-	int kq = -1;
-
-	struct imgRawImage* lpRawImg;
-
-	if(argc < 3) { printUsage(argv); return 1; }
-	if(argc > 8) { printUsage(argv); return 1; }
-	if((argc > 3) && (argc < 8)) { printUsage(argv); return 1; }
+	#endif
 
 	#ifdef SSG_ENABLE
 		unsigned long int frqStart;
@@ -628,6 +436,9 @@ int main(int argc, char* argv[]) {
 		unsigned long int frqStep;
 		float ssgPower;
 
+		frqStart = frqEnd = frqStep = 0;
+		ssgPower = 0;
+
 		enum labError le;
 		struct siglentSSG3021x* lpSSG3021X;
 
@@ -661,515 +472,455 @@ int main(int argc, char* argv[]) {
 			return 2;
 		}
 
-		usleep(250000); /* Wait for system to settle */
-		if(frqStart != 0) {
-			le = lpSSG3021X->vtbl->rfOutEnable(lpSSG3021X, true);
-			usleep(250000); /* Wait for system to settle */
+		if(sweepSchedulerInit(&sweep, frqStart, frqEnd, frqStep, dwSweepBudget, frqSweepMinStep, dSweepTolerance) != 0) {
+			printf("Invalid sweep range\n");
+			lpSSG3021X->vtbl->disconnect(lpSSG3021X);
+			return 1;
 		}
+
+		/* Tune to the first sweep point (differential sweeps start every point with the reference) */
+		bSweepDone = (sweepSchedulerNext(&sweep, &frq) != 0) ? true : false;
+		if((bSweepDone == false) && (bDifferential == false)) {
+			le = sweepRetune(lpSSG3021X, frq, &bRfEnabled);
+			if(le != labE_Ok) {
+				printf("Failed setting frequency\n");
+			}
+		}
+		usleep(250000); /* Wait for system to settle */
+		sweepSettleDeadline(&tsSettled, 0);
 	#endif
 
 	/*
-		Try to open the camera
+		Open the camera and set up the capture and detection context.
+		The main thread captures, analyzes and writes the images
 	*/
-	e = deviceOpen(&hHandle, argv[1]);
+	realtimeEnterThread(realtimeRole_Capture, 0);
+	e = blobEstimatorOpen(&lpEstimator, argv[1], &formatRequest);
 	if(e != cameraE_Ok) {
 		printf("Failed to open camera\n");
 		return 2;
 	}
+	lpCamDevice = blobEstimatorDevice(lpEstimator);
 
-	kq = kqueue();
-	if(kq == -1) {
-		printf("%s:%u Failed to create kqueue\n", __FILE__, __LINE__);
-		return 3;
+	blobEstimatorSettingsDefault(&estimatorSettings);
+	memcpy(&(estimatorSettings.detector), &detectorParams, sizeof(struct blobDetectorParams));
+	if(bExposureControl == true) {
+		estimatorSettings.dExposureTarget = dExposureTarget;
 	}
-
-	/*
-		Query capabilities
-	*/
-	bool bReadWriteSupported = false;
-	bool bStreamingSupported = false;
-	{
-		struct v4l2_capability cap;
-
-		memset(&cap, 0, sizeof(cap));
-
-		if(xioctl(hHandle, VIDIOC_QUERYCAP, &cap) == -1) {
-			printf("%s:%u Failed to query capabilities\n", __FILE__, __LINE__);
-			deviceClose(hHandle);
-			return 2;
-		}
-
-		if((cap.capabilities & V4L2_CAP_VIDEO_CAPTURE) == 0) {
-			printf("%s:%u Device does not support video capture\n", __FILE__, __LINE__);
-			deviceClose(hHandle);
-			return 2;
-		}
-
-		if((cap.capabilities & V4L2_CAP_READWRITE) != 0) {
-			bReadWriteSupported = true;
-		}
-		if((cap.capabilities & V4L2_CAP_STREAMING) != 0) {
-			bStreamingSupported = true;
+	estimatorSettings.dwRoiMargin = dwRoiMargin;
+	#ifdef SSG_ENABLE
+		if(bStabilize == true) {
+			estimatorSettings.dStabilityTolerance = dStabilityTolerance;
 		}
+	#endif
+	if(blobEstimatorConfigure(lpEstimator, &estimatorSettings) != cameraE_Ok) {
+		printf("%s:%u Failed to configure capture (exposure control)\n", __FILE__, __LINE__);
+		blobEstimatorClose(lpEstimator);
+		return 2;
 	}
 
-
-	#ifdef DEBUG
-		printf("%s:%u Read/Write interface supported: %s\n", __FILE__, __LINE__, (bReadWriteSupported == true) ? "yes" : "no");
-		printf("%s:%u Streaming interface supported: %s\n", __FILE__, __LINE__, (bStreamingSupported == true) ? "yes" : "no");
-	#endif
+	unsigned long int defaultWidth = lpCamDevice->width;
+	unsigned long int defaultHeight = lpCamDevice->height;
+	unsigned long int defaultBytesPerLine = lpCamDevice->bytesPerLine;
+	unsigned long int defaultSizeImage = lpCamDevice->sizeImage;
 
 	/*
-		Query cropping capabilities and set cropping rectangle
+		Optional raw recording of the unmodified stream
 	*/
-	/* int defaultWidth 	= 640;
-	int defaultHeight	= 480; */
-	int defaultWidth 	= 1920;
-	int defaultHeight	= 1080;
-	for(;;) {
-		struct v4l2_cropcap cropcap;
-
-		memset(&cropcap, 0, sizeof(cropcap));
-		cropcap.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-
-		if(xioctl(hHandle, VIDIOC_CROPCAP, &cropcap) == -1) {
-			printf("%s:%u Failed to query cropping capabilities, continuing anyways\n", __FILE__, __LINE__);
-			break;
-		}
-
-		#ifdef DEBUG
-			printf("Cropping capabilities:\n");
-			printf("\tDefault boundaries: %d, %d, %d, %d\n", cropcap.defrect.left, cropcap.defrect.top, cropcap.defrect.width, cropcap.defrect.height);
-			printf("\tBoundaries (left, top, width, height): %d, %d, %d, %d\n", cropcap.bounds.left, cropcap.bounds.top, cropcap.bounds.width, cropcap.bounds.height);
-			printf("\tAspect ratio: %u : %u\n", cropcap.pixelaspect.numerator, cropcap.pixelaspect.denominator);
-		#endif
-
-		#ifdef DEBUG
-			printf("Setting default cropping rectangle ... ");
-		#endif
-
-		struct v4l2_crop crop;
-
-		crop.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		crop.c = cropcap.defrect;
-
-		if(xioctl(hHandle, VIDIOC_S_CROP, &crop) == -1) {
-			#ifdef DEBUG
-				printf("failed\n");
-			#endif
-		} else {
-			#ifdef DEBUG
-				printf("ok\n");
+	if(lpRawRecordingFile != NULL) {
+		if(dwRawPreallocateMBytes == 0) {
+			unsigned long int dwFrames = 1;
+			#ifdef SSG_ENABLE
+				if((argc > 3) && (frqStep > 0) && (frqEnd >= frqStart)) {
+					dwFrames = (frqEnd - frqStart) / frqStep + 1;
+				}
+				if(dwSweepBudget > dwFrames) {
+					dwFrames = dwSweepBudget;
+				}
+				if(bDifferential == true) {
+					dwFrames = dwFrames * 2; /* Reference frames are recorded too */
+				}
 			#endif
+			dwRawPreallocateMBytes = (unsigned long int)(((unsigned long long int)dwFrames * (defaultSizeImage + 4096)) / (1024*1024) + 1);
 		}
 
-		break;
-	}
-
-	/*
-		Enumerate all supported formats (even though we'll request 640 x 480
-		YUYV later on anyways)
-	*/
-	{
-		#ifdef DEBUG
-			printf("Doing format negotiation\n");
-		#endif
-
-		int idx = 0;
-		for(idx = 0;; idx = idx + 1) {
-			struct v4l2_fmtdesc fmt;
-
-			fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			fmt.index = idx;
-
-			if(xioctl(hHandle, VIDIOC_ENUM_FMT, &fmt) == -1) {
-				#ifdef DEBUG
-					printf("Done enumeration after %u formats\n", idx);
-				#endif
-				break;
-			}
-
-			#ifdef DEBUG
-				printf("\tFormat %u with code %08x (compressed: %s): %s\n", idx, fmt.pixelformat, ((fmt.flags & V4L2_FMT_FLAG_COMPRESSED) != 0) ? "yes" : "no", fmt.description);
-			#endif
+		if(rawRecorderCreate(&lpRawRecorder, lpRawRecordingFile, lpCamDevice->pixelFormat, defaultWidth, defaultHeight, defaultBytesPerLine, defaultSizeImage, dwRawPreallocateMBytes, bRawDirectIO) != 0) {
+			printf("%s:%u Failed to create raw recording %s\n", __FILE__, __LINE__, lpRawRecordingFile);
+			blobEstimatorClose(lpEstimator);
+			return 2;
 		}
 	}
 
 	/*
-		v4l2_format negotiation, we just request the default ones or 640x480
+		The annotated cluster image is rendered into a separate RGB
+		buffer that is allocated once
 	*/
-	{
-		struct v4l2_format fmt;
-
-		memset(&fmt, 0, sizeof(fmt));
-
-		fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		fmt.fmt.pix.width = defaultWidth;
-		fmt.fmt.pix.height = defaultHeight;
-		fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUYV;
-		fmt.fmt.pix.field = V4L2_FIELD_INTERLACED;
-
-		if(xioctl(hHandle, VIDIOC_S_FMT, &fmt) == -1) {
-			#ifdef DEBUG
-				printf("%s:%u Format negotiation (S_FMT) failed!\n", __FILE__, __LINE__);
-			#endif
-		}
-
-		/* Now one should query the real size ... */
-		defaultWidth = fmt.fmt.pix.width;
-		defaultHeight = fmt.fmt.pix.height;
+	memset(&clusterImg, 0, sizeof(clusterImg));
+	clusterImg.width = defaultWidth;
+	clusterImg.height = defaultHeight;
+	clusterImg.numComponents = 3;
+	clusterImg.lpData = malloc(sizeof(unsigned char)*defaultWidth*defaultHeight*3);
+	if(clusterImg.lpData == NULL) {
+		printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+		iExitCode = 2;
+	} else {
+		realtimePrefault(clusterImg.lpData, defaultWidth*defaultHeight*3);
 	}
 
-	#ifdef DEBUG
-		printf("Negotiated width and height: %d x %d\n", defaultWidth, defaultHeight);
-	#endif
-
 	/*
-		Setup buffers
+		Optional sweep video: raw and cluster image of every point as
+		frames of two streams in one file
 	*/
-	int bufferCount = 1;
-	{
-		struct v4l2_requestbuffers rqBuffers;
+	if((iExitCode == 0) && (lpVideoFile != NULL)) {
+		struct mjpegAviStreamInfo streams[2];
 
-		/*
-			Request 1 buffer (simple but not seamless, usually use 3+) ...
-		*/
+		memset(streams, 0, sizeof(streams));
+		strcpy(streams[0].strName, "raw");
+		streams[0].width = defaultWidth;
+		streams[0].height = defaultHeight;
+		strcpy(streams[1].strName, "cluster");
+		streams[1].width = defaultWidth;
+		streams[1].height = defaultHeight;
 
-		memset(&rqBuffers, 0, sizeof(rqBuffers));
-		rqBuffers.count = bufferCount;
-		rqBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		rqBuffers.memory = V4L2_MEMORY_MMAP;
-
-		if(xioctl(hHandle, VIDIOC_REQBUFS, &rqBuffers) == -1) {
-			#ifdef DEBUG
-				printf("%s:%u Requesting buffers failed!\n", __FILE__, __LINE__);
-			#endif
-			deviceClose(hHandle);
-			return 2;
+		if(mjpegAviCreate(&lpVideo, lpVideoFile, MJPEGAVI_DEFAULT_FPS, streams, 2) != 0) {
+			printf("%s:%u Failed to create sweep video %s\n", __FILE__, __LINE__, lpVideoFile);
+			lpVideo = NULL;
+			iExitCode = 2;
 		}
-
-		bufferCount = rqBuffers.count;
 	}
-	#ifdef DEBUG
-		printf("Requested %d buffers\n", bufferCount);
-	#endif
 
 	/*
-		Map buffers
+		Optional live preview, served from it's own thread
 	*/
-	struct imageBuffer* lpBuffers;
-	{
-		lpBuffers = calloc(bufferCount, sizeof(struct imageBuffer));
-		if(lpBuffers == NULL) {
-			printf("%s:%u Out of memory\n", __FILE__, __LINE__);
-			deviceClose(hHandle);
-			return 2;
-		}
-
-		int iBuf;
-		for(iBuf = 0; iBuf < bufferCount; iBuf = iBuf + 1) {
-			struct v4l2_buffer vBuffer;
-
-			memset(&vBuffer, 0, sizeof(struct v4l2_buffer));
-
-			vBuffer.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			vBuffer.memory = V4L2_MEMORY_MMAP;
-			vBuffer.index = iBuf;
-
-			if(xioctl(hHandle, VIDIOC_QUERYBUF, &vBuffer) == -1) {
-				printf("%s:%u Failed to query buffer %d\n", __FILE__, __LINE__, iBuf);
-				deviceClose(hHandle);
-				return 2;
-			}
-
-			lpBuffers[iBuf].lpBase = mmap(NULL, vBuffer.length, PROT_READ|PROT_WRITE, MAP_SHARED, hHandle, vBuffer.m.offset);
-			lpBuffers[iBuf].sLen = vBuffer.length;
-
-			if(lpBuffers[iBuf].lpBase == MAP_FAILED) {
-				printf("%s:%u Failed to map buffer %d\n", __FILE__, __LINE__, iBuf);
-				deviceClose(hHandle);
-				return 2;
-			}
+	if((iExitCode == 0) && (bPreview == true)) {
+		if(previewServerStart(&lpPreview, &previewSettings) != 0) {
+			printf("%s:%u Failed to start preview server\n", __FILE__, __LINE__);
+			lpPreview = NULL;
+			iExitCode = 2;
 		}
 	}
 
 	/*
-		First we queue all buffers
+		Differential imaging: rolling reference, difference image and
+		a separate detector scratch for the difference image. The
+		difference sums are appended to diffstat.dat
 	*/
-	{
-		int iBuf;
-		for(iBuf = 0; iBuf < bufferCount; iBuf = iBuf + 1) {
-			struct v4l2_buffer buf;
-			memset(&buf, 0, sizeof(struct v4l2_buffer));
-
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			buf.memory = V4L2_MEMORY_MMAP;
-			buf.index = iBuf;
-
-			if(xioctl(hHandle, VIDIOC_QBUF, &buf) == -1) {
-				printf("%s:%u Queueing buffer %d failed ...\n", __FILE__, __LINE__, iBuf);
-				deviceClose(hHandle);
-				return 2;
+	#ifdef SSG_ENABLE
+		memset(&diffImg, 0, sizeof(diffImg));
+		differenceImageInit(&diffImage, dwReferenceFrames);
+		blobDetectorScratchInit(&diffScratch);
+		if((iExitCode == 0) && (bDifferential == true)) {
+			diffImg.width = defaultWidth;
+			diffImg.height = defaultHeight;
+			diffImg.numComponents = 1;
+			diffImg.lpLuma = malloc(sizeof(unsigned char)*defaultWidth*defaultHeight);
+			diffImg.lpData = diffImg.lpLuma;
+			if((diffImg.lpLuma == NULL) || (blobDetectorScratchPrepare(&diffScratch, &detectorParams, defaultWidth, defaultHeight) != 0)) {
+				printf("%s:%u Out of memory\n", __FILE__, __LINE__);
+				iExitCode = 2;
+			} else {
+				realtimePrefault(diffImg.lpLuma, defaultWidth*defaultHeight);
+				fDiffStat = fopen("diffstat.dat", "a");
+				if(fDiffStat == NULL) {
+					printf("%s:%u Failed to open diffstat.dat, the difference sums are not written\n", __FILE__, __LINE__);
+				}
 			}
 		}
-	}
-
-	/*
-		Add to kqueue ...
-	*/
-	{
-		struct kevent kev;
-
-		EV_SET(&kev, hHandle, EVFILT_READ, EV_ADD|EV_ENABLE|EV_CLEAR, 0, 0, NULL);
-		kevent(kq, &kev, 1, NULL, 0, NULL);
-	}
-
-	/*
-		Run streaming loop
-	*/
-	{
-		/* Enable streaming */
-		enum v4l2_buf_type type;
+	#endif
 
-		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	#ifndef SSG_ENABLE
+		if((iExitCode == 0) && (lpPreview != NULL)) {
+			struct sigaction sa;
 
-		if(xioctl(hHandle, VIDIOC_STREAMON, &type) == -1) {
-			printf("%s:%u Stream on failed\n", __FILE__, __LINE__);
-			deviceClose(hHandle);
-			return 2;
+			memset(&sa, 0, sizeof(sa));
+			sa.sa_handler = &captureSignalHandler;
+			sigemptyset(&(sa.sa_mask));
+			sigaction(SIGINT, &sa, NULL);
+			sigaction(SIGTERM, &sa, NULL);
+			printf("Serving the preview until SIGINT or SIGTERM\n");
 		}
-	}
+	#endif
 
 	/*
 		Capture specified number of frames ...
 	*/
-	unsigned long int frq;
 	#ifdef SSG_ENABLE
-		for(frq = frqStart; frq <= frqEnd; frq = frq + frqStep) {
+		while((iExitCode == 0) && (bSweepDone == false)) {
 	#else
-		for(;;) {
+		while(iExitCode == 0) {
 	#endif
-		struct kevent kev;
-		struct v4l2_buffer buf;
+		struct blobEstimatorResult res;
+		const struct imgRawImage* lpRawImg;
+		const struct imgRawImage* lpAnalyzedImg;
+		const struct blobDetectorScratch* lpAnalyzedScratch;
 
-		int r = kevent(kq, NULL, 0, &kev, 1, NULL);
-		if(r < 0) {
-			printf("%s:%u kevent failed\n", __FILE__, __LINE__);
-			deviceClose(hHandle);
-			return 2;
-		}
+		/*
+			Differential sweeps first capture the reference (RF off or at
+			the base frequency) into the rolling reference and then return
+			to the sweep point for the signal frame
+		*/
+		#ifdef SSG_ENABLE
+			if(bDifferential == true) {
+				le = sweepRetune(lpSSG3021X, frqReference, &bRfEnabled);
+				if(le != labE_Ok) {
+					printf("Failed setting reference frequency\n");
+				}
+				sweepSettleDeadline(&tsSettled, dwSettleMs);
 
-		if(r > 0) {
-			/* We got our frame or EOF ... try to dqueue */
-			memset(&buf, 0, sizeof(struct v4l2_buffer));
+				e = blobEstimatorGrab(lpEstimator, &tsSettled, &res);
+				if(e != cameraE_Ok) {
+					printf("%s:%u Failed to capture reference frame\n", __FILE__, __LINE__);
+					iExitCode = 2;
+					break;
+				}
+				dwGateDiscarded = dwGateDiscarded + res.dwDiscarded;
+				differenceImageReference(&diffImage, blobEstimatorImage(lpEstimator));
 
-			buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-			buf.memory = V4L2_MEMORY_MMAP;
+				if(lpRawRecorder != NULL) {
+					void* lpFrameData;
+					size_t sFrameLen;
+					struct timeval tvTimestamp = res.tvTimestamp;
 
-			if(xioctl(hHandle, VIDIOC_DQBUF, &buf) == -1) {
-				if(errno == EAGAIN) { continue; }
+					if(blobEstimatorRawFrame(lpEstimator, &lpFrameData, &sFrameLen) == 0) {
+						rawRecorderAppend(lpRawRecorder, lpFrameData, sFrameLen, res.dwSequence, &tvTimestamp, frqReference);
+					}
+				}
 
-				printf("%s:%u DQBUF failed\n", __FILE__, __LINE__);
-				deviceClose(hHandle);
-				return 2;
+				le = sweepRetune(lpSSG3021X, frq, &bRfEnabled);
+				if(le != labE_Ok) {
+					printf("Failed setting frequency\n");
+				}
+				sweepSettleDeadline(&tsSettled, dwSettleMs);
 			}
+		#endif
 
-			#ifdef DEBUG
-				printf("%s:%u Dequeued buffer %d\n", __FILE__, __LINE__, buf.index);
-			#endif
+		/*
+			Grab a usable frame: exposed after the generator settled,
+			acceptably exposed (exposure control) and stable (optional)
+		*/
+		#ifdef SSG_ENABLE
+			e = blobEstimatorGrab(lpEstimator, &tsSettled, &res);
+		#else
+			e = blobEstimatorGrab(lpEstimator, NULL, &res);
+		#endif
+		#ifndef SSG_ENABLE
+			if((e != cameraE_Ok) && (captureStop != 0)) {
+				break; /* Interrupted while waiting for the frame */
+			}
+		#endif
+		if(e != cameraE_Ok) {
+			printf("%s:%u Failed to capture frame\n", __FILE__, __LINE__);
+			iExitCode = 2;
+			break;
+		}
+		#ifdef SSG_ENABLE
+			dwGateDiscarded = dwGateDiscarded + res.dwDiscarded;
+		#endif
+		if(res.dwAttempts > 1) {
+			printf("Accepted frame after %lu attempts (exposure %d)\n", res.dwAttempts, res.dwExposure);
+		}
+		lpRawImg = blobEstimatorImage(lpEstimator);
+		lpAnalyzedImg = lpRawImg;
+		lpAnalyzedScratch = blobEstimatorScratch(lpEstimator);
 
-			/* Process image ... */
-			{
-				lpRawImg = malloc(sizeof(struct imgRawImage));
-				if(lpRawImg == NULL) {
-					printf("%s:%u Out of memory\n", __FILE__, __LINE__);
-					deviceClose(hHandle);
-					return 2;
-				}
-				lpRawImg->lpData = malloc(sizeof(unsigned char)*defaultWidth*defaultHeight*3);
-				if(lpRawImg->lpData == NULL) {
-					free(lpRawImg);
-					printf("%s:%u Out of memory\n", __FILE__, __LINE__);
-					deviceClose(hHandle);
-					return 2;
-				}
-				/*
-					Convert the previously requested YUYV (YUV422) image into RGB (RGB888)
-
-					YUV422:
-						4 Byte -> 2 Pixel
-
-					RGB888
-						3 Byte -> 1 Pixel
-				*/
-
-				lpRawImg->numComponents = 3;
-				lpRawImg->width = defaultWidth;
-				lpRawImg->height = defaultHeight;
-
-				unsigned long int row,col;
-				for(row = 0; row < defaultHeight; row=row+1) {
-					for(col = 0; col < defaultWidth; col=col+1) {
-						unsigned char y0, y1, y;
-						unsigned char u0, v0;
-
-						signed int c,d,e;
-						unsigned char r,g,b;
-						signed int rtmp,gtmp, btmp;
-
-						y0 = ((unsigned char*)(lpBuffers[buf.index].lpBase))[((col + row * defaultWidth) >> 1)*4 + 0];
-						u0 = ((unsigned char*)(lpBuffers[buf.index].lpBase))[((col + row * defaultWidth) >> 1)*4 + 1];
-						y1 = ((unsigned char*)(lpBuffers[buf.index].lpBase))[((col + row * defaultWidth) >> 1)*4 + 2];
-						v0 = ((unsigned char*)(lpBuffers[buf.index].lpBase))[((col + row * defaultWidth) >> 1)*4 + 3];
-
-						if((col + row * defaultWidth) % 2 == 0) {
-							y = y0;
-						} else {
-							y = y1;
-						}
+		if(lpRawRecorder != NULL) {
+			void* lpFrameData;
+			size_t sFrameLen;
+			struct timeval tvTimestamp = res.tvTimestamp;
 
-						c = ((signed int)y) - 16;
-						d = ((signed int)u0) - 128;
-						e = ((signed int)v0) - 128;
+			if(blobEstimatorRawFrame(lpEstimator, &lpFrameData, &sFrameLen) == 0) {
+				rawRecorderAppend(lpRawRecorder, lpFrameData, sFrameLen, res.dwSequence, &tvTimestamp, frq);
+			}
+		}
 
-						rtmp = ((298 * c + 409 * e + 128) >> 8);
-						gtmp = ((298 * c - 100 * d - 208 * e + 128) >> 8);
-						btmp = ((298 * c + 516 * d + 128) >> 8);
+		/* Detection and statistics run on the difference to the rolling reference */
+		#ifdef SSG_ENABLE
+			if(bDifferential == true) {
+				struct differenceImageStats diffStats;
+
+				res.bDetected = 0;
+				if(differenceImageApply(&diffImage, lpRawImg, &diffImg, &diffStats) == 0) {
+					lpAnalyzedImg = &diffImg;
+					lpAnalyzedScratch = &diffScratch;
+					if(blobDetect(&diffImg, &detectorParams, &diffScratch, &(res.blob)) == 0) {
+						res.bDetected = 1;
+						blobResultOffset(&(res.blob), (long int)res.roi.xMin, (long int)res.roi.yMin);
+					}
 
-						if(rtmp < 0) { r = 0; }
-						else if(rtmp > 255) { r = 255; }
-						else { r = (unsigned char)rtmp; }
+					if(fDiffStat != NULL) {
+						fprintf(fDiffStat, "%lu %llu %llu %lld\n", frq, (unsigned long long int)diffStats.qwPositiveSum, (unsigned long long int)diffStats.qwNegativeSum, (long long int)diffStats.qwPositiveSum - (long long int)diffStats.qwNegativeSum);
+					}
+				} else {
+					printf("%s:%u No reference frame of the same size, skipping detection\n", __FILE__, __LINE__);
+				}
+			}
+		#endif
 
-						if(gtmp < 0) { g = 0; }
-						else if(gtmp > 255) { g = 255; }
-						else { g = (unsigned char)gtmp; }
+		/* Process image ... */
+		{
+        	char* lpFilename = NULL;
+			char* lpFilename2 = NULL;
+
+			if(lpPreview != NULL) {
+				if(res.bDetected != 0) {
+					/* The preview is rendered from the analyzed frame */
+					struct blobResult blobFrame = res.blob;
+					blobResultOffset(&blobFrame, -(long int)res.roi.xMin, -(long int)res.roi.yMin);
+					previewServerSubmit(lpPreview, lpAnalyzedImg, lpAnalyzedScratch, &blobFrame);
+				} else {
+					previewServerSubmit(lpPreview, lpAnalyzedImg, NULL, NULL);
+				}
+			}
 
-						if(btmp < 0) { b = 0; }
-						else if(btmp > 255) { b = 255; }
-						else { b = (unsigned char)btmp; }
+			/*
+				Sweep video: every image is encoded once, the same data is
+				appended to the video and written to the current-*.jpg files
+			*/
+			if(lpVideo != NULL) {
+				size_t sEncoded;
 
-						lpRawImg->lpData[(col + row*defaultWidth)*3 + 0] = r;
-						lpRawImg->lpData[(col + row*defaultWidth)*3 + 1] = g;
-						lpRawImg->lpData[(col + row*defaultWidth)*3 + 2] = b;
+				if(encodeJpegImage(lpRawImg, iVideoQuality, &lpEncoded, &sEncodedCapacity, &sEncoded) == 0) {
+					mjpegAviAppend(lpVideo, 0, lpEncoded, sEncoded, frq);
+					if(lpPreview == NULL) { storeJpegBufferFile(lpEncoded, sEncoded, "current-raw.jpg"); }
+				}
+				if(res.bDetected != 0) {
+					#ifdef SSG_ENABLE
+						createHistograms(frq, (sweep.bAdaptive == 0) ? true : false, argv[2], lpAnalyzedScratch, &(res.roi), &(res.blob), res.dwExposure);
+					#else
+						createHistograms(argv[2], lpAnalyzedScratch, &(res.roi), &(res.blob), res.dwExposure);
+					#endif
+					{
+						struct blobResult blobFrame = res.blob;
+						blobResultOffset(&blobFrame, -(long int)res.roi.xMin, -(long int)res.roi.yMin);
+						blobRenderAnnotation(lpAnalyzedImg, lpAnalyzedScratch, &blobFrame, &clusterImg);
 					}
+					if(encodeJpegImage(&clusterImg, iVideoQuality, &lpEncoded, &sEncodedCapacity, &sEncoded) == 0) {
+						mjpegAviAppend(lpVideo, 1, lpEncoded, sEncoded, frq);
+						if(lpPreview == NULL) { storeJpegBufferFile(lpEncoded, sEncoded, "current-cluster.jpg"); }
+					}
+				} else {
+					/* Keeps both streams in step, players repeat the last cluster image */
+					mjpegAviAppend(lpVideo, 1, NULL, 0, frq);
 				}
-
-	        	char* lpFilename = NULL;
-				char* lpFilename2 = NULL;
+			#ifdef SSG_ENABLE
+        		} else if(asprintf(&lpFilename, "%s%lu-raw.jpg", argv[2], frq) < 0) {
+			#else
+				} else if(asprintf(&lpFilename, "%s-raw.jpg", argv[2]) < 0) {
+			#endif
+				printf("%s:%u Out of memory, skipping frame\n", __FILE__, __LINE__);
+        	} else {
 				#ifdef SSG_ENABLE
-	        		if(asprintf(&lpFilename, "%s%lu-raw.jpg", argv[2], frq) < 0) {
+					asprintf(&lpFilename2, "%s%lu-cluster.jpg", argv[2], frq);
 				#else
-					if(asprintf(&lpFilename, "%s-raw.jpg", argv[2]) < 0) {
+					asprintf(&lpFilename2, "%s-cluster.jpg", argv[2]);
 				#endif
-					printf("%s:%u Out of memory, skipping frame\n", __FILE__, __LINE__);
-	        	} else {
-					#ifdef SSG_ENABLE
-						asprintf(&lpFilename2, "%s%lu-cluster.jpg", argv[2], frq);
-					#else
-						asprintf(&lpFilename2, "%s-cluster.jpg", argv[2]);
-					#endif
-					#ifdef DEBUG
-	  					printf("%s:%u Writing %s\n", __FILE__, __LINE__, lpFilename);
-					#endif
-					greyscale(lpRawImg);
-					storeJpegImageFile(lpRawImg, lpFilename);
-					storeJpegImageFile(lpRawImg, "current-raw.jpg");
+				#ifdef DEBUG
+  					printf("%s:%u Writing %s\n", __FILE__, __LINE__, lpFilename);
+				#endif
+				storeJpegImageFile(lpRawImg, lpFilename);
+				if(lpPreview == NULL) { storeJpegImageFile(lpRawImg, "current-raw.jpg"); }
+				if(res.bDetected != 0) {
 					#ifdef SSG_ENABLE
-						createHistograms(frq, lpRawImg, argv[2], NULL, NULL, NULL);
+						createHistograms(frq, (sweep.bAdaptive == 0) ? true : false, argv[2], lpAnalyzedScratch, &(res.roi), &(res.blob), res.dwExposure);
 					#else
-						createHistograms(lpRawImg, argv[2], NULL, NULL, NULL);
+						createHistograms(argv[2], lpAnalyzedScratch, &(res.roi), &(res.blob), res.dwExposure);
 					#endif
-		  			storeJpegImageFile(lpRawImg, lpFilename2);
-					storeJpegImageFile(lpRawImg, "current-cluster.jpg");
-	          		free(lpFilename);
-					free(lpFilename2);
+					{
+						/* The annotation is drawn into the analyzed frame */
+						struct blobResult blobFrame = res.blob;
+						blobResultOffset(&blobFrame, -(long int)res.roi.xMin, -(long int)res.roi.yMin);
+						blobRenderAnnotation(lpAnalyzedImg, lpAnalyzedScratch, &blobFrame, &clusterImg);
+					}
+		  			storeJpegImageFile(&clusterImg, lpFilename2);
+					if(lpPreview == NULL) { storeJpegImageFile(&clusterImg, "current-cluster.jpg"); }
 				}
+          		free(lpFilename);
+				free(lpFilename2);
+			}
 
-				/*
-					Setting new frequency
-				*/
-				#ifdef SSG_ENABLE
-					if(frq == 0) {
-						le = lpSSG3021X->vtbl->rfOutEnable(lpSSG3021X, true);
-					}
-					le = lpSSG3021X->vtbl->rfSetFrequency(lpSSG3021X, frq + frqStep);
+			/*
+				Setting new frequency (the next grab discards frames
+				exposed before the generator settled)
+			*/
+			#ifdef SSG_ENABLE
+				sweepSchedulerRecord(&sweep, frq, (res.bDetected != 0) ? &(res.blob) : NULL, res.dwExposure);
+
+				if(sweepSchedulerNext(&sweep, &frq) != 0) {
+					bSweepDone = true;
+				} else if(bDifferential == false) {
+					le = sweepRetune(lpSSG3021X, frq, &bRfEnabled);
 					if(le != labE_Ok) {
 						printf("Failed setting frequency\n");
 					}
-					usleep(500*1000);
-				#endif
-
-				free(lpRawImg->lpData);
-				free(lpRawImg);
-				lpRawImg = NULL;
-			}
-
-			/* Re-enqueue */
-			if(xioctl(hHandle, VIDIOC_QBUF, &buf) == -1) {
-				printf("%s:%u Queueing buffer %d failed ...\n", __FILE__, __LINE__, buf.index);
-				deviceClose(hHandle);
-				return 2;
-			}
+					sweepSettleDeadline(&tsSettled, dwSettleMs);
+				}
+			#endif
 		}
+
 		#ifndef SSG_ENABLE
-			break;
+			if((lpPreview == NULL) || (captureStop != 0)) {
+				break;
+			}
 		#endif
 	}
 
-	#ifdef SSG_ENABLE
-		le = lpSSG3021X->vtbl->rfOutEnable(lpSSG3021X, false);
+	#ifndef SSG_ENABLE
+		if(lpPreview != NULL) {
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+		}
 	#endif
 
+	#ifdef SSG_ENABLE
+		le = lpSSG3021X->vtbl->rfOutEnable(lpSSG3021X, false);
 
+		if(sweep.bAdaptive != 0) {
+			/* Adaptive sweeps are not measured in order, write them sorted */
+			if(sweepSchedulerWrite(&sweep, "peaks.dat") != 0) {
+				printf("%s:%u Failed to write peaks.dat\n", __FILE__, __LINE__);
+			}
+			printf("Adaptive sweep measured %lu points\n", sweep.dwPointCount);
+		}
+		printf("Discarded %lu frames captured before the generator settled\n", dwGateDiscarded);
+		sweepSchedulerRelease(&sweep);
 
-	/*
-		Stop streaming
-	*/
-	{
-		/* Disable streaming */
-		enum v4l2_buf_type type;
+		differenceImageRelease(&diffImage);
+		blobDetectorScratchRelease(&diffScratch);
+		if(diffImg.lpLuma != NULL) { free(diffImg.lpLuma); }
+		if(fDiffStat != NULL) { fclose(fDiffStat); }
+	#endif
 
-		type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+	if(clusterImg.lpData != NULL) { free(clusterImg.lpData); }
 
-		if(xioctl(hHandle, VIDIOC_STREAMOFF, &type) == -1) {
-			printf("%s:%u Stream off failed\n", __FILE__, __LINE__);
-			deviceClose(hHandle);
-			return 2;
-		}
+	if(lpPreview != NULL) {
+		previewServerStop(lpPreview);
+		lpPreview = NULL;
 	}
 
-	/*
-		Release buffers ...
-	*/
-	{
-		int iBuf;
-		for(iBuf = 0; iBuf < bufferCount; iBuf = iBuf + 1) {
-			munmap(lpBuffers[iBuf].lpBase, lpBuffers[iBuf].sLen);
+	if(lpVideo != NULL) {
+		if(mjpegAviClose(lpVideo) != 0) {
+			printf("%s:%u Failed to finalize sweep video\n", __FILE__, __LINE__);
 		}
+		lpVideo = NULL;
 	}
+	if(lpEncoded != NULL) { free(lpEncoded); }
 
-	{
-		struct v4l2_requestbuffers rqBuffers;
-
-		/*
-			Request 1 buffer (simple but not seamless, usually use 3+) ...
-		*/
-
-		memset(&rqBuffers, 0, sizeof(rqBuffers));
-		rqBuffers.count = 0;
-		rqBuffers.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-		rqBuffers.memory = V4L2_MEMORY_MMAP;
-
-		if(xioctl(hHandle, VIDIOC_REQBUFS, &rqBuffers) == -1) {
-			printf("%s:%u Releasing buffers failed!\n", __FILE__, __LINE__);
-			deviceClose(hHandle);
-			return 2;
+	if(lpRawRecorder != NULL) {
+		if(rawRecorderClose(lpRawRecorder) != 0) {
+			printf("%s:%u Failed to finalize raw recording\n", __FILE__, __LINE__);
 		}
+		lpRawRecorder = NULL;
 	}
 
+	printf("Delivered frame rate: %lf fps (nominal %lf fps)\n", captureDeviceDeliveredFps(lpCamDevice), lpCamDevice->dNominalFps);
+	captureDeviceTimingPrint(stdout, lpCamDevice);
+
 	/*
-		Close camera at the end
+		Stop streaming, restore exposure mode, release buffers and
+		close camera at the end
 	*/
-	deviceClose(hHandle);
-	return 0;
+	if(blobEstimatorClose(lpEstimator) != cameraE_Ok) {
+		return 2;
+	}
+	return iExitCode;
 }
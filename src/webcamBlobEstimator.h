@@ -1,3 +1,8 @@
+#ifndef __WEBCAMBLOBESTIMATOR_H__
+#define __WEBCAMBLOBESTIMATOR_H__
+
+#include <stddef.h>
+
 #ifdef __cplusplus
     extern "C" {
 #endif
@@ -10,6 +15,7 @@ enum cameraError {
 	cameraE_InvalidParam,
 	cameraE_UnknownDevice,
 	cameraE_PermissionDenied,
+	cameraE_Timeout,
 };
 
 struct imageBuffer {
@@ -22,11 +28,17 @@ struct histogramBuffer {
     double          dValues[];
 };
 
+/*
+	lpData holds interleaved pixels (numComponents bytes per pixel),
+	lpLuma the planar 8 bit luma (width * height bytes) the detector
+	works on. Either may be NULL when not required.
+*/
 struct imgRawImage {
 	unsigned int numComponents;
 	unsigned long int width, height;
 
 	unsigned char* lpData;
+	unsigned char* lpLuma;
 };
 
 struct rectBound {
@@ -41,3 +53,5 @@ struct rectBound {
 #ifdef __cplusplus
     } /* extern "C" { */
 #endif
+
+#endif /* #ifndef __WEBCAMBLOBESTIMATOR_H__ */